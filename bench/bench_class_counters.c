@@ -0,0 +1,123 @@
+/* Cost of class_counters_add_frame() on the probe thread, per frame and per
+ * object, alone and while another thread scrapes the counters as fast as it
+ * can. The scraper takes no locks and writes nothing shared, so what it costs
+ * the probe is the counter lines it pulls into its own cache.
+ *
+ * Usage: bench_class_counters [objects] [sources] [frames] */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "core/class_counters.h"
+
+#define FRAME_NS (NSEC_PER_SEC / 30)
+#define NUM_CLASSES 4
+#define NUM_COLORS 12
+#define SGIE_COMPONENT_ID 2
+
+typedef struct {
+    ClassCounters *counters;
+    gint stop;
+    guint64 scrapes;
+    gsize bytes;
+} Scraper;
+
+static gpointer scrape(gpointer data) {
+    Scraper *scraper = (Scraper *)data;
+    GString *out = g_string_sized_new(256 * 1024);
+
+    while (!g_atomic_int_get(&scraper->stop)) {
+        g_string_truncate(out, 0);
+        class_counters_dump_prometheus(scraper->counters, out, g_get_real_time());
+        scraper->bytes = out->len;
+        scraper->scrapes++;
+    }
+    g_string_free(out, TRUE);
+    return NULL;
+}
+
+/* Frames in source order, objects keeping their ids and classes, one in ten
+ * replaced by a new track every second */
+static void fill_frame(FrameRecord *frame, guint source, guint f, guint objects) {
+    frame->source_id = source;
+    frame->frame_num = f;
+    frame->pts = (guint64)(f + 1) * FRAME_NS;
+    frame->num_objects = objects;
+    for (guint i = 0; i < objects; i++) {
+        ObjectRecord *obj = &frame->objects[i];
+        guint generation = i % 10 == 0 ? f / 30 : 0;
+
+        obj->object_id = (guint64)generation * objects + i;
+        obj->class_id = i % NUM_CLASSES;
+        obj->num_labels = obj->class_id == 0 ? 1 : 0;
+        obj->labels[0].component_id = SGIE_COMPONENT_ID;
+        obj->labels[0].class_id = i % NUM_COLORS;
+    }
+}
+
+static gdouble run(ClassCounters *counters, guint objects, guint sources,
+                   guint frames) {
+    FrameRecord frame = {0};
+    guint64 elapsed = 0;
+
+    frame.objects = g_new0(ObjectRecord, objects);
+    for (guint f = 0; f < frames; f++) {
+        for (guint s = 0; s < sources; s++) {
+            guint64 t0;
+
+            fill_frame(&frame, s, f, objects);
+            t0 = now_ns();
+            class_counters_add_frame(counters, &frame, g_get_real_time());
+            elapsed += now_ns() - t0;
+        }
+    }
+    g_free(frame.objects);
+    return (gdouble)elapsed / ((gdouble)frames * sources);
+}
+
+int main(int argc, char *argv[]) {
+    static const gchar *const classes[NUM_CLASSES] = {"Car", "Bicycle", "Person",
+                                                      "Roadsign"};
+    static const gchar *const colors[NUM_COLORS] = {
+        "black", "blue",  "brown", "gold",   "green", "grey",
+        "maroon", "orange", "red",  "silver", "white", "yellow"};
+    guint objects = argc > 1 ? (guint)atoi(argv[1]) : 50;
+    guint sources = argc > 2 ? (guint)atoi(argv[2]) : 16;
+    guint frames = argc > 3 ? (guint)atoi(argv[3]) : 3000;
+    CounterModel models[2] = {
+        {"pgie", TRUE, 1, classes, NUM_CLASSES},
+        {"sgie1", FALSE, SGIE_COMPONENT_ID, colors, NUM_COLORS},
+    };
+    Scraper scraper = {0};
+    GThread *thread;
+    gdouble alone, scraped;
+
+    if (objects == 0 || sources == 0 || frames == 0) {
+        fprintf(stderr, "usage: %s [objects] [sources] [frames]\n", argv[0]);
+        return 1;
+    }
+
+    scraper.counters = class_counters_new(models, G_N_ELEMENTS(models), sources,
+                                          CLASS_COUNTERS_DEFAULT_TRACK_TTL_NS);
+    alone = run(scraper.counters, objects, sources, frames);
+    class_counters_free(scraper.counters);
+
+    scraper.counters = class_counters_new(models, G_N_ELEMENTS(models), sources,
+                                          CLASS_COUNTERS_DEFAULT_TRACK_TTL_NS);
+    thread = g_thread_new("scraper", scrape, &scraper);
+    scraped = run(scraper.counters, objects, sources, frames);
+    g_atomic_int_set(&scraper.stop, 1);
+    g_thread_join(thread);
+
+    printf("%u objects x %u sources x %u frames, %u series\n", objects, sources,
+           frames, class_counters_num_series(scraper.counters));
+    printf("%-10s %12s %12s\n", "", "ns/frame", "ns/object");
+    printf("%-10s %12.0f %12.1f\n", "alone", alone, alone / objects);
+    printf("%-10s %12.0f %12.1f\n", "scraped", scraped, scraped / objects);
+    printf("%" G_GUINT64_FORMAT " scrapes of %" G_GSIZE_FORMAT " bytes\n",
+           scraper.scrapes, scraper.bytes);
+    class_counters_free(scraper.counters);
+    return 0;
+}
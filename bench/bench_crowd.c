@@ -0,0 +1,140 @@
+/* Crowd proximity and density for frames of 50 to 1000 people. Every pair is
+ * compared by the scalar kernel and by the vector one the CPU supports, and
+ * then again with the people bucketed into the grid. All four must count the
+ * same close and overlapping pairs. People stand in a few dense groups with
+ * boxes growing towards the bottom of the frame, as seen from a camera above.
+ *
+ * Usage: bench_crowd [frames] */
+
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "core/crowd.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define GROUPS 6
+
+static gfloat uniform(gfloat lo, gfloat hi) {
+    return lo + (hi - lo) * (gfloat)rand() / (gfloat)RAND_MAX;
+}
+
+static void make_frame(ObjectRecord *objects, guint n) {
+    gfloat gx[GROUPS], gy[GROUPS];
+
+    for (guint g = 0; g < GROUPS; g++) {
+        gx[g] = uniform(200, WIDTH - 200);
+        gy[g] = uniform(150, HEIGHT - 150);
+    }
+    for (guint i = 0; i < n; i++) {
+        ObjectRecord *obj = &objects[i];
+        guint g = i % GROUPS;
+        /* Half in the groups, the rest anywhere */
+        gfloat spread = i % 2 ? 400 : 120;
+        gfloat x = CLAMP(gx[g] + uniform(-spread, spread), 0, WIDTH - 1);
+        gfloat y = CLAMP(gy[g] + uniform(-spread, spread) / 2, 0, HEIGHT - 1);
+
+        obj->object_id = i;
+        obj->class_id = 0;
+        obj->height = 30 + 90 * y / HEIGHT;
+        obj->width = obj->height * 0.4f;
+        obj->left = x - obj->width / 2;
+        obj->top = y - obj->height / 2;
+    }
+}
+
+typedef struct {
+    CrowdStats total;
+    gdouble us_per_frame;
+} Result;
+
+static Result run(const FrameRecord *frames, guint num_frames, CrowdKernel kernel,
+                  guint grid_threshold, guint max_objects, const gchar **name) {
+    CrowdConfig config;
+    CrowdAnalyzer *analyzer;
+    Result result = {0};
+    guint64 t0;
+
+    crowd_config_init(&config, 0);
+    config.kernel = kernel;
+    config.grid_threshold = grid_threshold;
+    analyzer = crowd_analyzer_new(&config, max_objects);
+    *name = crowd_analyzer_kernel_name(analyzer);
+    t0 = now_ns();
+    for (guint f = 0; f < num_frames; f++) {
+        CrowdStats stats;
+
+        crowd_analyzer_process(analyzer, &frames[f], &stats, NULL);
+        result.total.close_pairs += stats.close_pairs;
+        result.total.crowded += stats.crowded;
+        result.total.overlapping_pairs += stats.overlapping_pairs;
+        result.total.peak_density += stats.peak_density;
+    }
+    result.us_per_frame = (now_ns() - t0) / 1e3 / num_frames;
+    crowd_analyzer_free(analyzer);
+    return result;
+}
+
+static gboolean same_counts(const CrowdStats *a, const CrowdStats *b) {
+    return a->close_pairs == b->close_pairs && a->crowded == b->crowded &&
+           a->overlapping_pairs == b->overlapping_pairs &&
+           a->peak_density == b->peak_density;
+}
+
+int main(int argc, char *argv[]) {
+    static const guint sizes[] = {50, 100, 200, 500, 1000};
+    guint num_frames = argc > 1 ? (guint)atoi(argv[1]) : 300;
+    gboolean mismatch = FALSE;
+
+    if (num_frames == 0) {
+        g_printerr("Usage: %s [frames]\n", argv[0]);
+        return 2;
+    }
+    srand(42);
+    printf("%u frames of %dx%d, us per frame\n", num_frames, WIDTH, HEIGHT);
+    printf("%-8s %10s %10s %10s %10s %12s %10s\n", "people", "scalar", "vector",
+           "grid", "grid+vec", "close/frame", "crowded");
+
+    for (guint s = 0; s < G_N_ELEMENTS(sizes); s++) {
+        guint n = sizes[s];
+        ObjectRecord *objects = g_new0(ObjectRecord, (gsize)n * num_frames);
+        FrameRecord *frames = g_new0(FrameRecord, num_frames);
+        Result scalar, vector, grid, grid_vector;
+        const gchar *vector_name;
+        const gchar *unused;
+
+        for (guint f = 0; f < num_frames; f++) {
+            frames[f].pts = f;
+            frames[f].num_objects = n;
+            frames[f].objects = &objects[(gsize)f * n];
+            make_frame(frames[f].objects, n);
+        }
+        scalar = run(frames, num_frames, CROWD_KERNEL_SCALAR, G_MAXUINT, n, &unused);
+        vector = run(frames, num_frames, CROWD_KERNEL_AUTO, G_MAXUINT, n, &vector_name);
+        grid = run(frames, num_frames, CROWD_KERNEL_SCALAR, 0, n, &unused);
+        grid_vector = run(frames, num_frames, CROWD_KERNEL_AUTO, 0, n, &unused);
+
+        if (s == 0) printf("(vector kernel: %s)\n", vector_name);
+        printf("%-8u %10.1f %10.1f %10.1f %10.1f %12.1f %10.1f\n", n,
+               scalar.us_per_frame, vector.us_per_frame, grid.us_per_frame,
+               grid_vector.us_per_frame,
+               (gdouble)scalar.total.close_pairs / num_frames,
+               (gdouble)scalar.total.crowded / num_frames);
+        if (!same_counts(&scalar.total, &vector.total) ||
+            !same_counts(&scalar.total, &grid.total) ||
+            !same_counts(&scalar.total, &grid_vector.total)) {
+            mismatch = TRUE;
+        }
+        g_free(frames);
+        g_free(objects);
+    }
+
+    if (mismatch) {
+        g_printerr("Kernels disagree\n");
+        return 1;
+    }
+    return 0;
+}
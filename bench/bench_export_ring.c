@@ -0,0 +1,123 @@
+/* Throughput of the memory-mapped export ring: one writer thread appends
+ * frames of detections as fast as it can while reader threads follow it
+ * through their own mappings of the file.
+ *
+ * Usage: bench_export_ring [records] [path] */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "core/export_reader.h"
+#include "core/export_ring.h"
+
+#define OBJECTS_PER_FRAME 32
+#define READ_BATCH 256
+#define RING_CAPACITY (1 << 20)
+
+typedef struct {
+    ExportWriter *writer;
+    guint64 records;
+    gint done;
+    guint64 elapsed_ns;
+} Writer;
+
+typedef struct {
+    Writer *writer;
+    ExportReader *reader;
+    guint64 read;
+    guint64 checksum;
+    guint64 elapsed_ns;
+} Reader;
+
+static gpointer writer_main(gpointer data) {
+    Writer *w = (Writer *)data;
+    ObjectRecord objects[OBJECTS_PER_FRAME] = {{0}};
+    FrameRecord frame = {.objects = objects, .num_objects = OBJECTS_PER_FRAME};
+    guint64 t0 = now_ns();
+
+    for (guint64 n = 0; n < w->records; n += OBJECTS_PER_FRAME) {
+        frame.frame_num++;
+        frame.pts += NSEC_PER_SEC / 30;
+        for (guint i = 0; i < OBJECTS_PER_FRAME; i++) objects[i].object_id = n + i;
+        export_writer_write(w->writer, &frame);
+    }
+    w->elapsed_ns = now_ns() - t0;
+    g_atomic_int_set(&w->done, TRUE);
+    return NULL;
+}
+
+static gpointer reader_main(gpointer data) {
+    Reader *r = (Reader *)data;
+    ExportRecord *batch = g_new(ExportRecord, READ_BATCH);
+    guint64 t0 = now_ns();
+
+    for (;;) {
+        guint n = export_reader_read(r->reader, batch, READ_BATCH);
+        for (guint i = 0; i < n; i++) r->checksum += batch[i].object.object_id;
+        r->read += n;
+        if (n == 0 && g_atomic_int_get(&r->writer->done)) {
+            /* Pick up whatever was published after the last empty read */
+            while ((n = export_reader_read(r->reader, batch, READ_BATCH)) > 0)
+                r->read += n;
+            break;
+        }
+    }
+    r->elapsed_ns = now_ns() - t0;
+    g_free(batch);
+    return NULL;
+}
+
+static void run(const gchar *path, guint64 records, guint num_readers) {
+    Writer writer = {.records = records};
+    Reader *readers = g_new0(Reader, num_readers);
+    GThread **threads = g_new(GThread *, num_readers);
+    GThread *writer_thread;
+
+    /* Create the ring first so readers can map it before the writer starts */
+    writer.writer = export_writer_open(path, RING_CAPACITY, NULL);
+    if (!writer.writer) {
+        fprintf(stderr, "Cannot create %s\n", path);
+        exit(1);
+    }
+    for (guint i = 0; i < num_readers; i++) {
+        readers[i].writer = &writer;
+        readers[i].reader = export_reader_open(path, FALSE, NULL);
+    }
+
+    for (guint i = 0; i < num_readers; i++) {
+        threads[i] = g_thread_new("reader", reader_main, &readers[i]);
+    }
+    writer_thread = g_thread_new("writer", writer_main, &writer);
+    g_thread_join(writer_thread);
+    export_writer_close(writer.writer);
+
+    printf("%8u  %12.1f", num_readers, records * 1e3 / writer.elapsed_ns);
+    for (guint i = 0; i < num_readers; i++) {
+        Reader *r = &readers[i];
+        g_thread_join(threads[i]);
+        printf("  %10.1f/%" G_GUINT64_FORMAT, r->read * 1e3 / r->elapsed_ns,
+               export_reader_lost(r->reader));
+        export_reader_close(r->reader);
+    }
+    printf("\n");
+    g_free(threads);
+    g_free(readers);
+}
+
+int main(int argc, char *argv[]) {
+    static const guint reader_counts[] = {0, 1, 2, 4};
+    guint64 records = argc > 1 ? g_ascii_strtoull(argv[1], NULL, 10) : 50000000ULL;
+    const gchar *path = argc > 2 ? argv[2] : "/dev/shm/bench_export_ring";
+
+    printf("%" G_GUINT64_FORMAT " records of %zu bytes, ring of %u\n", records,
+           sizeof(ExportRecord), RING_CAPACITY);
+    printf("%8s  %12s  %s\n", "readers", "write Mrec/s",
+           "read Mrec/s/lost per reader");
+    for (guint i = 0; i < G_N_ELEMENTS(reader_counts); i++) {
+        run(path, records, reader_counts[i]);
+    }
+    remove(path);
+    return 0;
+}
@@ -0,0 +1,177 @@
+/* What a LOG_* call costs the thread making it. Calls are timed in bursts of
+ * half a ring, and the writer thread empties the ring between bursts, so
+ * every timed record is accepted. The writer formats to /dev/null. For
+ * comparison, the last row formats the same line with fprintf to /dev/null
+ * on the calling thread, which is what g_print costs when nothing blocks.
+ *
+ * Usage: bench_logger [calls] [threads] */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench_util.h"
+#include "core/logger.h"
+
+#define RING_CAPACITY 1024
+#define BURST (RING_CAPACITY / 2)
+/* Limit of the category used for the suppressed row */
+#define RATE_LIMIT 10
+
+typedef enum {
+    CASE_DISABLED,
+    CASE_NUMBERS,
+    CASE_STRING,
+    CASE_LONG_STRINGS,
+    CASE_FORMAT_NOW,
+    CASE_SUPPRESSED,
+    CASE_FPRINTF,
+    NUM_CASES,
+} Case;
+
+static const gchar *const case_names[NUM_CASES] = {
+    "disabled level", "3 numbers",       "numbers + path", "2 long paths",
+    "formatted now",  "over rate limit", "fprintf (sync)"};
+
+static FILE *dev_null;
+
+/* Each longer than a record, so the second only gets what the first left */
+static gchar long_path[241];
+
+static void log_once(Case c, guint i) {
+    static const gchar *path = "/data/footage/cam-07/2024-05-01T09-00-00.mp4";
+
+    switch (c) {
+        case CASE_DISABLED:
+            LOG_DEBUG(LOG_CAT_SOURCES, "Source %u frame %u", i & 15, i);
+            break;
+        case CASE_NUMBERS:
+            LOG_INFO(LOG_CAT_APP, "Source %u: %u objects, %.2f ms", i & 15, i,
+                     i * 0.01);
+            break;
+        case CASE_STRING:
+            LOG_INFO(LOG_CAT_APP, "Source %u: %s at frame %u", i & 15, path, i);
+            break;
+        case CASE_LONG_STRINGS:
+            LOG_INFO(LOG_CAT_OFFLINE, "%s, then %s at frame %u", long_path, long_path,
+                     i);
+            break;
+        case CASE_FORMAT_NOW:
+            LOG_INFO(LOG_CAT_APP, "Source %*u: %u objects, %.2f ms", 2, i & 15, i,
+                     i * 0.01);
+            break;
+        case CASE_SUPPRESSED:
+            LOG_INFO(LOG_CAT_CLIPS, "Source %u: %u objects, %.2f ms", i & 15, i,
+                     i * 0.01);
+            break;
+        case CASE_FPRINTF:
+            fprintf(dev_null, "Source %u: %u objects, %.2f ms\n", i & 15, i, i * 0.01);
+            break;
+        default:
+            break;
+    }
+}
+
+static void wait_written(guint64 target) {
+    LogStats stats;
+
+    for (;;) {
+        logger_get_stats(&stats);
+        if (stats.written + stats.dropped + stats.suppressed >= target) return;
+        g_usleep(100);
+    }
+}
+
+typedef struct {
+    Case c;
+    guint calls;
+    guint64 elapsed;
+} Job;
+
+/* Threads log without waiting for each other, so rings may overflow here */
+static gpointer run_thread(gpointer data) {
+    Job *job = (Job *)data;
+    guint64 t0 = now_ns();
+
+    for (guint i = 0; i < job->calls; i++) log_once(job->c, i);
+    job->elapsed = now_ns() - t0;
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    guint calls = argc > 1 ? (guint)atoi(argv[1]) : 200000;
+    guint threads = argc > 2 ? (guint)atoi(argv[2]) : 4;
+    LogConfig config;
+    LogStats before, after;
+    GError *error = NULL;
+    guint64 expected = 0;
+
+    if (calls == 0 || threads == 0) {
+        fprintf(stderr, "usage: %s [calls] [threads]\n", argv[0]);
+        return 1;
+    }
+    memset(long_path, 'x', sizeof(long_path) - 1);
+    dev_null = fopen("/dev/null", "w");
+    logger_config_init(&config);
+    config.path = "/dev/null";
+    config.ring_capacity = RING_CAPACITY;
+    for (guint c = 0; c < LOG_NUM_CATEGORIES; c++) config.rate_limits[c] = 0;
+    config.rate_limits[LOG_CAT_CLIPS] = RATE_LIMIT;
+    if (!dev_null || !logger_start(&config, &error)) {
+        fprintf(stderr, "%s\n", error ? error->message : "Cannot open /dev/null");
+        return 1;
+    }
+
+    printf("%u calls per case, bursts of %u\n", calls, BURST);
+    printf("%-16s %10s\n", "", "ns/call");
+    for (Case c = 0; c < NUM_CASES; c++) {
+        guint64 elapsed = 0;
+
+        for (guint done = 0; done < calls; done += BURST) {
+            guint n = MIN(BURST, calls - done);
+            guint64 t0 = now_ns();
+
+            for (guint i = 0; i < n; i++) log_once(c, done + i);
+            elapsed += now_ns() - t0;
+            if (c != CASE_DISABLED && c != CASE_FPRINTF) expected += n;
+            wait_written(expected);
+        }
+        printf("%-16s %10.1f\n", case_names[c], (gdouble)elapsed / calls);
+    }
+
+    /* The writer falls behind here, drops are counted and reported */
+    logger_get_stats(&before);
+    {
+        Job *jobs = g_new0(Job, threads);
+        GThread **handles = g_new(GThread *, threads);
+        guint64 total = 0;
+
+        for (guint t = 0; t < threads; t++) {
+            jobs[t].c = CASE_NUMBERS;
+            jobs[t].calls = calls;
+            handles[t] = g_thread_new("bench", run_thread, &jobs[t]);
+        }
+        for (guint t = 0; t < threads; t++) {
+            g_thread_join(handles[t]);
+            total += jobs[t].elapsed;
+        }
+        wait_written(before.written + before.dropped + before.suppressed +
+                     (guint64)calls * threads);
+        logger_get_stats(&after);
+        printf("%u threads, no pauses: %.1f ns/call, %" G_GUINT64_FORMAT
+               " written, %" G_GUINT64_FORMAT " dropped\n",
+               threads, (gdouble)total / ((gdouble)calls * threads),
+               after.written - before.written, after.dropped - before.dropped);
+        g_free(handles);
+        g_free(jobs);
+    }
+
+    logger_stop();
+    logger_get_stats(&after);
+    printf("%" G_GUINT64_FORMAT " written, %" G_GUINT64_FORMAT
+           " dropped, %" G_GUINT64_FORMAT " suppressed in total\n",
+           after.written, after.dropped, after.suppressed);
+    fclose(dev_null);
+    return 0;
+}
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Serial against pipelined stage layouts, on the real pipeline. Runs the app
+# in --benchmark mode twice over the same files: with the stages and queue
+# settings of PIPELINE, first with threading=serial and then with
+# threading=pipelined, which queues every element. Prints both reports.
+# --cpu-only replaces the stages with a stub, so this needs the GPU build.
+#
+# Usage: bench_stage_threading.sh APP PIPELINE FILE... [-- APP_OPTION...]
+
+set -e
+
+if [ $# -lt 3 ]; then
+    echo "usage: $0 APP PIPELINE FILE... [-- APP_OPTION...]" >&2
+    exit 2
+fi
+app=$1
+pipeline=$2
+shift 2
+
+files=""
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+    files="$files $1"
+    shift
+done
+[ "$1" = "--" ] && shift
+
+# Next to PIPELINE, so the config-file paths in it still resolve
+dir=$(dirname "$pipeline")
+trap 'rm -f "$dir/.pipeline-serial.txt" "$dir/.pipeline-pipelined.txt"' EXIT
+
+for mode in serial pipelined; do
+    layout="$dir/.pipeline-$mode.txt"
+    awk -v mode="$mode" '
+        /^(threading|queues)[ \t]*=/ { next }
+        { print }
+        /^\[pipeline\]/ { print "threading=" mode }
+    ' "$pipeline" >"$layout"
+    echo "threading=$mode"
+    "$app" --benchmark --pipeline "$layout" "$@" $files 2>&1 |
+        sed -n '/^Benchmark:/,/cpu:/p'
+done
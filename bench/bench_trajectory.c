@@ -0,0 +1,239 @@
+/* Size and query speed of the trajectory archive. Objects wander like people:
+ * they keep a heading that drifts, stop now and then, and live for 5 to 60 s,
+ * with a pixel or so of detector jitter on every box. Every path is simplified
+ * and archived, then the archive is queried by time and by region.
+ *
+ * The size is compared with the 40 byte ObjectRecord per detection that
+ * --record writes, and with 16 bytes per point (pts and two floats) for the
+ * raw and the simplified paths.
+ *
+ * Usage: bench_trajectory [objects] [seconds] [sources] [tolerance] */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "core/trajectory_archive.h"
+
+#define FPS 30
+#define FRAME_NS (NSEC_PER_SEC / FPS)
+#define WIDTH 1920
+#define HEIGHT 1080
+#define TIME_BASE_MS 1600000000000LL
+#define SEGMENT_MS (60 * 1000)
+#define QUERY_RUNS 5
+
+typedef struct {
+    guint64 object_id;
+    guint frames_left;
+    guint pause_left;
+    gfloat x, y;
+    gfloat heading;
+    gfloat speed;
+} Walker;
+
+static gfloat uniform(gfloat lo, gfloat hi) {
+    return lo + (hi - lo) * (gfloat)rand() / (gfloat)RAND_MAX;
+}
+
+static void spawn(Walker *walker, guint64 object_id) {
+    walker->object_id = object_id;
+    walker->frames_left = (guint)uniform(5 * FPS, 60 * FPS);
+    walker->pause_left = 0;
+    walker->x = uniform(0, WIDTH);
+    walker->y = uniform(0, HEIGHT);
+    walker->heading = uniform(0, 2 * G_PI);
+    walker->speed = uniform(0.5f, 4);
+}
+
+static void step(Walker *walker, ObjectRecord *obj) {
+    if (walker->pause_left) {
+        walker->pause_left--;
+    } else if (rand() % (10 * FPS) == 0) {
+        walker->pause_left = (guint)uniform(FPS, 5 * FPS);
+    } else {
+        walker->heading += uniform(-0.08f, 0.08f);
+        walker->x += walker->speed * cosf(walker->heading);
+        walker->y += walker->speed * sinf(walker->heading);
+        if (walker->x < 0 || walker->x >= WIDTH || walker->y < 0 ||
+            walker->y >= HEIGHT) {
+            walker->heading += G_PI;
+            walker->x = CLAMP(walker->x, 0, WIDTH - 1);
+            walker->y = CLAMP(walker->y, 0, HEIGHT - 1);
+        }
+    }
+    walker->frames_left--;
+
+    obj->object_id = walker->object_id;
+    obj->class_id = 2;
+    obj->width = 40 + uniform(-1, 1);
+    obj->height = 80 + uniform(-1, 1);
+    obj->left = walker->x + uniform(-1, 1) - obj->width / 2;
+    obj->top = walker->y + uniform(-1, 1) - obj->height / 2;
+}
+
+static void count_match(const TrajectoryMatch *match, gpointer data) {
+    (*(guint64 *)data)++;
+}
+
+static guint64 run_query(const gchar *name, const gchar *dir,
+                         const TrajectoryQuery *query) {
+    TrajectoryQueryStats stats = {0};
+    guint64 best = G_MAXUINT64, matches = 0;
+    GError *error = NULL;
+
+    for (guint run = 0; run < QUERY_RUNS; run++) {
+        guint64 t0 = now_ns(), elapsed;
+
+        matches = 0;
+        if (!trajectory_archive_query(dir, query, count_match, &matches, &stats,
+                                      &error)) {
+            g_printerr("%s\n", error->message);
+            g_error_free(error);
+            exit(1);
+        }
+        elapsed = now_ns() - t0;
+        best = MIN(best, elapsed);
+    }
+    printf("%-16s %9.3f ms %8" G_GUINT64_FORMAT " matches %5u/%u segments %9"
+           G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT " tracks decoded\n",
+           name, best / 1e6, matches, stats.segments_read, stats.segments,
+           stats.tracks_decoded, stats.tracks_scanned);
+    return matches;
+}
+
+static void remove_dir(const gchar *path) {
+    GDir *dir = g_dir_open(path, 0, NULL);
+    const gchar *name;
+
+    if (!dir) return;
+    while ((name = g_dir_read_name(dir))) {
+        gchar *file = g_build_filename(path, name, NULL);
+        g_remove(file);
+        g_free(file);
+    }
+    g_dir_close(dir);
+    g_rmdir(path);
+}
+
+int main(int argc, char *argv[]) {
+    guint objects = argc > 1 ? (guint)atoi(argv[1]) : 200;
+    guint seconds = argc > 2 ? (guint)atoi(argv[2]) : 600;
+    guint sources = argc > 3 ? (guint)atoi(argv[3]) : 4;
+    gdouble tolerance = argc > 4 ? atof(argv[4]) : TRAJECTORY_DEFAULT_TOLERANCE;
+    guint frames = seconds * FPS, per_source;
+    TrajectoryArchiveConfig archive_config;
+    TrajectoryConfig config;
+    TrajectoryArchiveStats stats;
+    TrajectoryArchive *archive;
+    TrajectoryBuilder *builder;
+    TrajectoryQuery query;
+    Walker *walkers;
+    ObjectRecord *records;
+    GError *error = NULL;
+    guint64 next_id = 0, elapsed = 0, all;
+    gchar *dir;
+
+    if (objects < sources || sources == 0 || frames == 0) {
+        g_printerr("Need at least one object per source and one second\n");
+        return 2;
+    }
+    per_source = objects / sources;
+    dir = g_dir_make_tmp("bench_trajectory-XXXXXX", &error);
+    if (!dir) {
+        g_printerr("%s\n", error->message);
+        return 1;
+    }
+
+    trajectory_archive_config_init(&archive_config);
+    archive_config.time_base_ms = TIME_BASE_MS;
+    /* Short segments, so that time queries have some to skip */
+    archive_config.segment_ms = SEGMENT_MS;
+    archive = trajectory_archive_open(dir, &archive_config, &error);
+    if (!archive) {
+        g_printerr("%s\n", error->message);
+        return 1;
+    }
+    trajectory_config_init(&config);
+    config.tolerance = tolerance;
+    builder = trajectory_builder_new(&config, trajectory_archive_add, archive);
+
+    srand(42);
+    walkers = g_new(Walker, per_source * sources);
+    for (guint i = 0; i < per_source * sources; i++) spawn(&walkers[i], next_id++);
+    records = g_new0(ObjectRecord, per_source);
+    for (guint f = 0; f < frames; f++) {
+        for (guint s = 0; s < sources; s++) {
+            FrameRecord frame = {0};
+            guint64 t0;
+
+            for (guint i = 0; i < per_source; i++) {
+                Walker *walker = &walkers[s * per_source + i];
+                if (!walker->frames_left) spawn(walker, next_id++);
+                step(walker, &records[i]);
+            }
+            frame.source_id = s;
+            frame.frame_num = f;
+            frame.pts = (guint64)f * FRAME_NS;
+            frame.num_objects = per_source;
+            frame.objects = records;
+            t0 = now_ns();
+            trajectory_builder_process(builder, &frame);
+            elapsed += now_ns() - t0;
+        }
+    }
+    trajectory_builder_free(builder);
+    trajectory_archive_close(archive, &stats);
+
+    printf("%u objects on %u sources for %u s, tolerance %.1f px\n",
+           per_source * sources, sources, seconds, tolerance);
+    printf("%" G_GUINT64_FORMAT " tracks, %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT
+           " points kept (%.1f%%), %.1f ns per point to build and archive\n",
+           stats.tracks, stats.points, stats.raw_points,
+           100.0 * stats.points / stats.raw_points,
+           (gdouble)elapsed / stats.raw_points);
+    printf("%" G_GUINT64_FORMAT " bytes in %" G_GUINT64_FORMAT
+           " segments, %.2f bytes per detection\n",
+           stats.bytes, stats.segments, (gdouble)stats.bytes / stats.raw_points);
+    printf("%.0fx smaller than ObjectRecords, %.0fx than raw points, %.1fx than "
+           "simplified points\n",
+           (gdouble)stats.raw_points * sizeof(ObjectRecord) / stats.bytes,
+           (gdouble)stats.raw_points * 16 / stats.bytes,
+           (gdouble)stats.points * 16 / stats.bytes);
+
+    trajectory_query_init(&query);
+    all = run_query("all", dir, &query);
+
+    trajectory_query_init(&query);
+    query.start_ms = TIME_BASE_MS + seconds * 1000 / 2;
+    query.end_ms = query.start_ms + 60 * 1000;
+    run_query("one minute", dir, &query);
+
+    trajectory_query_init(&query);
+    query.has_region = TRUE;
+    query.min_x = WIDTH / 2 - 100;
+    query.min_y = HEIGHT / 2 - 100;
+    query.max_x = WIDTH / 2 + 100;
+    query.max_y = HEIGHT / 2 + 100;
+    run_query("200 px square", dir, &query);
+
+    query.source_id = 0;
+    query.start_ms = TIME_BASE_MS + seconds * 1000 / 2;
+    query.end_ms = query.start_ms + 60 * 1000;
+    run_query("all three", dir, &query);
+
+    remove_dir(dir);
+    g_free(dir);
+    g_free(walkers);
+    g_free(records);
+    if (all != stats.tracks) {
+        g_printerr("The archive returned %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT
+                   " tracks\n",
+                   all, stats.tracks);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef __BENCH_UTIL_H__
+#define __BENCH_UTIL_H__
+
+#include <glib.h>
+#include <time.h>
+
+/* Shared by the benchmarks in this directory and nvds_replay */
+
+#define NSEC_PER_SEC 1000000000ULL
+
+static inline guint64 now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (guint64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+#endif
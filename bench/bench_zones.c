@@ -0,0 +1,246 @@
+/* Zone membership and line crossings for many objects against many zones.
+ * Brute force tests every centroid against every polygon and every move
+ * against every line. The grid looks up each centroid's cell and only tests
+ * the zones and lines listed there, skipping cells a zone covers fully.
+ * Both must agree on every membership and crossing. The last column runs the
+ * whole ZoneAnalytics update, including the per-track state and events.
+ *
+ * Usage: bench_zones [objects] [zones] [lines] [frames] */
+
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "core/zone_analytics.h"
+#include "core/zones.h"
+
+#define FRAME_NS (NSEC_PER_SEC / 30)
+#define WIDTH 1920
+#define HEIGHT 1080
+#define VERTICES 10
+
+static gfloat uniform(gfloat lo, gfloat hi) {
+    return lo + (hi - lo) * (gfloat)rand() / (gfloat)RAND_MAX;
+}
+
+/* Star-shaped, so most are concave */
+static void make_zone(Zone *zone, ZonePoint *points) {
+    gfloat cx = uniform(0, WIDTH), cy = uniform(0, HEIGHT);
+    gfloat radius = uniform(60, 200);
+
+    for (guint v = 0; v < VERTICES; v++) {
+        gfloat angle = 2 * G_PI * v / VERTICES;
+        gfloat r = radius * uniform(0.5f, 1.0f);
+        points[v].x = cx + r * cosf(angle);
+        points[v].y = cy + r * sinf(angle);
+    }
+    zone->name = "zone";
+    zone->source_id = -1;
+    zone->class_mask = ZONE_ALL_CLASSES;
+    zone->points = points;
+    zone->num_points = VERTICES;
+}
+
+static void make_line(ZoneLine *line) {
+    gfloat angle = uniform(0, G_PI), length = uniform(200, 600);
+
+    line->name = "line";
+    line->source_id = -1;
+    line->class_mask = ZONE_ALL_CLASSES;
+    line->a.x = uniform(0, WIDTH);
+    line->a.y = uniform(0, HEIGHT);
+    line->b.x = line->a.x + length * cosf(angle);
+    line->b.y = line->a.y + length * sinf(angle);
+}
+
+/* Centroids for every frame, walking a few pixels per frame */
+static ObjectRecord *make_frames(guint objects, guint frames) {
+    ObjectRecord *records = g_new0(ObjectRecord, (gsize)objects * frames);
+
+    for (guint i = 0; i < objects; i++) {
+        gfloat x = uniform(0, WIDTH), y = uniform(0, HEIGHT);
+        gfloat vx = uniform(-4, 4), vy = uniform(-4, 4);
+
+        for (guint f = 0; f < frames; f++) {
+            ObjectRecord *obj = &records[(gsize)f * objects + i];
+            if (x < 0 || x >= WIDTH) vx = -vx;
+            if (y < 0 || y >= HEIGHT) vy = -vy;
+            x = CLAMP(x + vx, 0, WIDTH - 1);
+            y = CLAMP(y + vy, 0, HEIGHT - 1);
+            obj->object_id = i;
+            obj->width = 40;
+            obj->height = 80;
+            obj->left = x - obj->width / 2;
+            obj->top = y - obj->height / 2;
+        }
+    }
+    return records;
+}
+
+typedef struct {
+    guint64 memberships;
+    guint64 crossings;
+    gdouble ns_per_object;
+} Result;
+
+static void finish(Result *result, guint64 elapsed, guint objects, guint frames) {
+    result->ns_per_object = (gdouble)elapsed / ((gdouble)objects * frames);
+}
+
+static Result run_brute(const ZoneLayout *layout, const ObjectRecord *records,
+                        guint objects, guint frames) {
+    guint num_zones = zone_layout_num_zones(layout);
+    guint num_lines = zone_layout_num_lines(layout);
+    Result result = {0};
+    guint64 t0 = now_ns();
+
+    for (guint f = 0; f < frames; f++) {
+        for (guint i = 0; i < objects; i++) {
+            const ObjectRecord *obj = &records[(gsize)f * objects + i];
+            gfloat x = obj->left + obj->width / 2, y = obj->top + obj->height / 2;
+
+            for (guint z = 0; z < num_zones; z++) {
+                const Zone *zone = zone_layout_zone(layout, z);
+                if (zone_applies(zone->class_mask, zone->source_id, 0, obj->class_id) &&
+                    zone_contains(zone, x, y)) {
+                    result.memberships++;
+                }
+            }
+            if (f == 0) continue;
+            obj -= objects;
+            for (guint l = 0; l < num_lines; l++) {
+                const ZoneLine *line = zone_layout_line(layout, l);
+                if (zone_line_crossing(line, obj->left + obj->width / 2,
+                                       obj->top + obj->height / 2, x, y)) {
+                    result.crossings++;
+                }
+            }
+        }
+    }
+    finish(&result, now_ns() - t0, objects, frames);
+    return result;
+}
+
+static Result run_grid(const ZoneLayout *layout, const ObjectRecord *records,
+                       guint objects, guint frames) {
+    guint16 zones[ZONE_TRACK_MAX_ZONES * 4];
+    ZoneCrossing crossings[16];
+    Result result = {0};
+    guint64 t0 = now_ns();
+
+    for (guint f = 0; f < frames; f++) {
+        for (guint i = 0; i < objects; i++) {
+            const ObjectRecord *obj = &records[(gsize)f * objects + i];
+            gfloat x = obj->left + obj->width / 2, y = obj->top + obj->height / 2;
+
+            result.memberships += zone_layout_find(layout, 0, obj->class_id, x, y,
+                                                   zones, G_N_ELEMENTS(zones));
+            if (f == 0) continue;
+            obj -= objects;
+            result.crossings += zone_layout_crossings(
+                layout, 0, obj->class_id, obj->left + obj->width / 2,
+                obj->top + obj->height / 2, x, y, crossings, G_N_ELEMENTS(crossings));
+        }
+    }
+    finish(&result, now_ns() - t0, objects, frames);
+    return result;
+}
+
+static Result run_analytics(const ZoneLayout *layout, ObjectRecord *records,
+                            guint objects, guint frames) {
+    ZoneAnalyticsConfig config;
+    ZoneAnalytics *analytics;
+    ZoneEvent *events = g_new(ZoneEvent, objects * 4);
+    Result result = {0};
+    guint64 elapsed = 0;
+
+    zone_analytics_config_init(&config);
+    config.max_tracks = objects;
+    analytics = zone_analytics_new(layout, &config);
+    for (guint f = 0; f < frames; f++) {
+        FrameRecord frame = {0};
+        guint64 t0;
+
+        frame.pts = (guint64)(f + 1) * FRAME_NS;
+        frame.num_objects = objects;
+        frame.objects = &records[(gsize)f * objects];
+        t0 = now_ns();
+        zone_analytics_process(analytics, &frame, events, objects * 4);
+        elapsed += now_ns() - t0;
+    }
+    finish(&result, elapsed, objects, frames);
+    zone_analytics_free(analytics);
+    g_free(events);
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    static const guint cell_sizes[] = {32, 64, 128, 256};
+    guint objects = argc > 1 ? (guint)atoi(argv[1]) : 1000;
+    guint num_zones = argc > 2 ? (guint)atoi(argv[2]) : 100;
+    guint num_lines = argc > 3 ? (guint)atoi(argv[3]) : 20;
+    guint frames = argc > 4 ? (guint)atoi(argv[4]) : 300;
+    Zone *zones;
+    ZonePoint *points;
+    ZoneLine *lines;
+    ObjectRecord *records;
+    ZoneLayout *layout;
+    Result brute;
+    gboolean mismatch = FALSE;
+
+    if (objects == 0 || frames < 2) {
+        g_printerr("Usage: %s [objects] [zones] [lines] [frames]\n", argv[0]);
+        return 2;
+    }
+    srand(42);
+    zones = g_new0(Zone, MAX(num_zones, 1));
+    points = g_new0(ZonePoint, (gsize)MAX(num_zones, 1) * VERTICES);
+    lines = g_new0(ZoneLine, MAX(num_lines, 1));
+    for (guint z = 0; z < num_zones; z++) make_zone(&zones[z], &points[z * VERTICES]);
+    for (guint l = 0; l < num_lines; l++) make_line(&lines[l]);
+    records = make_frames(objects, frames);
+
+    printf("%u objects, %u zones of %u vertices, %u lines, %u frames of %dx%d\n",
+           objects, num_zones, VERTICES, num_lines, frames, WIDTH, HEIGHT);
+    layout = zone_layout_new(zones, num_zones, lines, num_lines, WIDTH, HEIGHT, 64);
+    brute = run_brute(layout, records, objects, frames);
+    zone_layout_free(layout);
+    printf("%-10s %10s %12s %12s %12s %14s\n", "cell", "ns/object", "us/frame",
+           "memberships", "crossings", "analytics us");
+    printf("%-10s %10.1f %12.1f %12" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT "\n",
+           "brute", brute.ns_per_object, brute.ns_per_object * objects / 1e3,
+           brute.memberships, brute.crossings);
+
+    for (guint i = 0; i < G_N_ELEMENTS(cell_sizes); i++) {
+        gchar label[16];
+        Result grid, full;
+
+        layout = zone_layout_new(zones, num_zones, lines, num_lines, WIDTH, HEIGHT,
+                                 cell_sizes[i]);
+        grid = run_grid(layout, records, objects, frames);
+        full = run_analytics(layout, records, objects, frames);
+        zone_layout_free(layout);
+
+        g_snprintf(label, sizeof(label), "grid %u", cell_sizes[i]);
+        printf("%-10s %10.1f %12.1f %12" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT
+               " %14.1f\n",
+               label, grid.ns_per_object, grid.ns_per_object * objects / 1e3,
+               grid.memberships, grid.crossings, full.ns_per_object * objects / 1e3);
+        if (grid.memberships != brute.memberships ||
+            grid.crossings != brute.crossings) {
+            mismatch = TRUE;
+        }
+    }
+
+    g_free(records);
+    g_free(lines);
+    g_free(points);
+    g_free(zones);
+    if (mismatch) {
+        g_printerr("Grid and brute force disagree\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include "benchmark.h"
+
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "gstnvdsmeta.h"
+
+/* Frames in flight per source between the two probes */
+#define INFLIGHT_LEN 256
+#define MAX_LATENCY_SAMPLES (1 << 20)
+
+/* Single producer (in_pad thread), single consumer (out_pad thread) */
+typedef struct {
+    gint64 enter_ns[INFLIGHT_LEN];
+    gint head;
+    gint tail;
+} Inflight;
+
+struct _Benchmark {
+    Inflight *inflight;
+    guint max_sources;
+    gint64 warmup_ns;
+    gint64 first_out_ns;
+    gint64 steady_start_ns;
+    gint64 last_out_ns;
+    guint64 frames;
+    guint64 *latency_ns;
+    guint num_latency;
+    struct rusage steady_usage;
+};
+
+static inline gint64 now_ns(void) { return g_get_monotonic_time() * 1000; }
+
+Benchmark *benchmark_new(guint max_sources, guint warmup_sec) {
+    Benchmark *bench = g_new0(Benchmark, 1);
+    bench->inflight = g_new0(Inflight, max_sources);
+    bench->max_sources = max_sources;
+    bench->warmup_ns = (gint64)warmup_sec * GST_SECOND;
+    bench->latency_ns = g_new(guint64, MAX_LATENCY_SAMPLES);
+    return bench;
+}
+
+void benchmark_free(Benchmark *bench) {
+    if (!bench) return;
+    g_free(bench->inflight);
+    g_free(bench->latency_ns);
+    g_free(bench);
+}
+
+static GstPadProbeReturn in_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
+                                             gpointer u_data) {
+    Benchmark *bench = (Benchmark *)u_data;
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta((GstBuffer *)info->data);
+    gint64 now = now_ns();
+
+    if (!batch_meta) return GST_PAD_PROBE_OK;
+    for (NvDsMetaList *l = batch_meta->frame_meta_list; l; l = l->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)l->data;
+        Inflight *q;
+        gint head;
+
+        if (frame_meta->source_id >= bench->max_sources) continue;
+        q = &bench->inflight[frame_meta->source_id];
+        head = g_atomic_int_get(&q->head);
+        /* The out probe fell behind, drop the sample rather than block */
+        if (head - g_atomic_int_get(&q->tail) >= INFLIGHT_LEN) continue;
+        q->enter_ns[head % INFLIGHT_LEN] = now;
+        g_atomic_int_set(&q->head, head + 1);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn out_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
+                                              gpointer u_data) {
+    Benchmark *bench = (Benchmark *)u_data;
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta((GstBuffer *)info->data);
+    gint64 now = now_ns();
+    gboolean steady;
+
+    if (!batch_meta) return GST_PAD_PROBE_OK;
+
+    if (!bench->first_out_ns) bench->first_out_ns = now;
+    if (!bench->steady_start_ns && now - bench->first_out_ns >= bench->warmup_ns) {
+        bench->steady_start_ns = now;
+        getrusage(RUSAGE_SELF, &bench->steady_usage);
+    }
+    steady = bench->steady_start_ns != 0;
+
+    for (NvDsMetaList *l = batch_meta->frame_meta_list; l; l = l->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)l->data;
+        Inflight *q;
+        gint tail;
+
+        if (frame_meta->source_id >= bench->max_sources) continue;
+        q = &bench->inflight[frame_meta->source_id];
+        tail = g_atomic_int_get(&q->tail);
+        if (tail == g_atomic_int_get(&q->head)) continue;
+
+        if (steady) {
+            bench->frames++;
+            if (bench->num_latency < MAX_LATENCY_SAMPLES) {
+                bench->latency_ns[bench->num_latency++] =
+                    now - q->enter_ns[tail % INFLIGHT_LEN];
+            }
+        }
+        g_atomic_int_set(&q->tail, tail + 1);
+    }
+    if (steady) bench->last_out_ns = now;
+    return GST_PAD_PROBE_OK;
+}
+
+void benchmark_attach(Benchmark *bench, GstPad *in_pad, GstPad *out_pad) {
+    gst_pad_add_probe(in_pad, GST_PAD_PROBE_TYPE_BUFFER, in_pad_buffer_probe, bench,
+                      NULL);
+    gst_pad_add_probe(out_pad, GST_PAD_PROBE_TYPE_BUFFER, out_pad_buffer_probe, bench,
+                      NULL);
+}
+
+static int compare_u64(const void *a, const void *b) {
+    guint64 x = *(const guint64 *)a, y = *(const guint64 *)b;
+    return x < y ? -1 : x > y;
+}
+
+static gdouble timeval_sec(const struct timeval *tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+void benchmark_report(Benchmark *bench) {
+    struct rusage usage;
+    gdouble elapsed, cpu_sec;
+    guint active_sources = 0;
+
+    if (!bench->steady_start_ns || bench->last_out_ns <= bench->steady_start_ns) {
+        g_print("Benchmark: stream ended before the %.0f s warmup finished\n",
+                bench->warmup_ns / 1e9);
+        return;
+    }
+
+    getrusage(RUSAGE_SELF, &usage);
+    elapsed = (bench->last_out_ns - bench->steady_start_ns) / 1e9;
+    cpu_sec = timeval_sec(&usage.ru_utime) + timeval_sec(&usage.ru_stime) -
+              timeval_sec(&bench->steady_usage.ru_utime) -
+              timeval_sec(&bench->steady_usage.ru_stime);
+    for (guint i = 0; i < bench->max_sources; i++) {
+        if (bench->inflight[i].head) active_sources++;
+    }
+
+    qsort(bench->latency_ns, bench->num_latency, sizeof(guint64), compare_u64);
+
+    g_print("Benchmark: %" G_GUINT64_FORMAT " frames from %u source(s) in %.2f s\n",
+            bench->frames, active_sources, elapsed);
+    g_print("  throughput: %.1f fps (%.1f fps per source)\n", bench->frames / elapsed,
+            bench->frames / elapsed / MAX(active_sources, 1));
+    if (bench->num_latency) {
+        g_print("  latency:    p50 %.3f ms, p99 %.3f ms\n",
+                bench->latency_ns[bench->num_latency / 2] / 1e6,
+                bench->latency_ns[(guint64)bench->num_latency * 99 / 100] / 1e6);
+    }
+    g_print("  cpu:        %.1f%% of one core (%u cores)\n", 100.0 * cpu_sec / elapsed,
+            g_get_num_processors());
+}
@@ -0,0 +1,24 @@
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+/* Steady-state throughput, per-frame latency and CPU usage for --benchmark.
+ *
+ * A probe on in_pad timestamps every frame of each batch as it enters the
+ * measured part of the pipeline, and a probe on out_pad matches it up again
+ * by source id, in order, when it leaves. Frames leaving during the first
+ * warmup_sec seconds are not counted. */
+
+typedef struct _Benchmark Benchmark;
+
+Benchmark *benchmark_new(guint max_sources, guint warmup_sec);
+void benchmark_free(Benchmark *bench);
+
+void benchmark_attach(Benchmark *bench, GstPad *in_pad, GstPad *out_pad);
+
+/* Prints FPS, p50/p99 latency and CPU usage measured since the warmup. */
+void benchmark_report(Benchmark *bench);
+
+#endif
@@ -0,0 +1,538 @@
+#include "clips.h"
+
+#include <string.h>
+
+#include "core/frame_record.h"
+#include "core/logger.h"
+
+/* How long the writer waits when no open clip has anything new */
+#define CLIP_POLL_MS 100
+/* A clip whose source stops short of its end is closed after this much quiet */
+#define CLIP_GRACE_MS 2000
+/* How long mp4mux gets to write its index once the clip has ended */
+#define CLIP_EOS_TIMEOUT_SEC 5
+/* Buffers taken from a ring for one clip at a time */
+#define CLIP_BATCH 64
+#define CLIP_RING_INITIAL_CAPACITY 256
+/* Tracks remembered for the retrigger check before old ones are pruned */
+#define CLIP_MAX_TRIGGERS 1024
+
+typedef struct {
+    GstBuffer *buffer;
+    /* DTS, or PTS, so that the ring and clip windows follow the stream however
+     * fast it is fed */
+    GstClockTime time;
+    gboolean keyframe;
+} RingEntry;
+
+/* Circular, starting on a keyframe whenever it is not empty */
+typedef struct {
+    RingEntry *entries;
+    /* Power of two */
+    guint capacity;
+    guint head;
+    guint count;
+    /* Counting every buffer pushed, the sequence number of the oldest one */
+    guint64 first_seq;
+    gsize bytes;
+    GstCaps *caps;
+    /* Time of the newest buffer */
+    GstClockTime latest;
+    /* Monotonic time the newest buffer came in */
+    gint64 arrival_us;
+    /* Bumped with every new branch, whose clips and probes then go stale */
+    guint generation;
+} ClipRing;
+
+typedef struct {
+    ClipRecorder *recorder;
+    guint source_id;
+    guint generation;
+} ClipTap;
+
+typedef struct {
+    guint source_id;
+    guint generation;
+    gchar *path;
+    guint64 next_seq;
+    /* Stream time of the last buffer wanted */
+    GstClockTime end;
+    /* Nothing is written before the first keyframe */
+    gboolean started;
+    GstCaps *caps;
+    /* The first buffer's DTS, or PTS, which becomes zero */
+    GstClockTime base;
+    GstElement *pipeline;
+    GstElement *appsrc;
+    guint buffers;
+} Clip;
+
+typedef struct {
+    guint64 key;
+    guint source_id;
+    /* The branch and stream time of the clip */
+    guint generation;
+    GstClockTime time;
+} ClipTrigger;
+
+struct _ClipRecorder {
+    gchar *dir;
+    GstClockTime preroll;
+    GstClockTime postroll;
+    gsize max_bytes;
+    guint max_sources;
+    ClipRing *rings;
+    GThread *writer;
+
+    /* Guards everything below and the rings */
+    GMutex lock;
+    GCond cond;
+    gboolean stopping;
+    /* Open clips, only ever removed by the writer */
+    GPtrArray *clips;
+    /* Track key -> ClipTrigger of its last clip */
+    GHashTable *triggers;
+    guint next_clip;
+    guint64 started;
+    guint64 written;
+    guint64 failed;
+    guint64 gaps;
+    guint64 suppressed;
+};
+
+void clip_config_init(ClipConfig *config, const gchar *dir) {
+    config->dir = dir;
+    config->preroll_ms = CLIP_DEFAULT_PREROLL_MS;
+    config->postroll_ms = CLIP_DEFAULT_POSTROLL_MS;
+    config->max_bytes = CLIP_DEFAULT_MAX_BYTES;
+}
+
+static inline RingEntry *ring_entry(ClipRing *ring, guint64 seq) {
+    guint offset = (guint)(seq - ring->first_seq);
+
+    return &ring->entries[(ring->head + offset) & (ring->capacity - 1)];
+}
+
+static void ring_pop(ClipRing *ring) {
+    RingEntry *entry = &ring->entries[ring->head];
+
+    ring->bytes -= gst_buffer_get_size(entry->buffer);
+    gst_buffer_unref(entry->buffer);
+    ring->head = (ring->head + 1) & (ring->capacity - 1);
+    ring->count--;
+    ring->first_seq++;
+}
+
+static void ring_clear(ClipRing *ring) {
+    while (ring->count) ring_pop(ring);
+    gst_caps_replace(&ring->caps, NULL);
+    ring->latest = 0;
+}
+
+static void ring_push(ClipRing *ring, GstBuffer *buffer, GstClockTime time,
+                      gboolean keyframe) {
+    RingEntry *entry;
+
+    if (ring->count == ring->capacity) {
+        RingEntry *entries = g_new(RingEntry, ring->capacity * 2);
+        guint first = ring->capacity - ring->head;
+
+        memcpy(entries, ring->entries + ring->head, first * sizeof(*entries));
+        memcpy(entries + first, ring->entries, ring->head * sizeof(*entries));
+        g_free(ring->entries);
+        ring->entries = entries;
+        ring->head = 0;
+        ring->capacity *= 2;
+    }
+    entry = &ring->entries[(ring->head + ring->count) & (ring->capacity - 1)];
+    entry->buffer = buffer;
+    entry->time = time;
+    entry->keyframe = keyframe;
+    ring->latest = time;
+    ring->count++;
+    ring->bytes += gst_buffer_get_size(buffer);
+}
+
+/* Drops whole GOPs from the front: over max_bytes regardless, and otherwise
+ * for as long as the next GOP alone still reaches back preroll from the newest
+ * buffer */
+static void ring_trim(ClipRing *ring, GstClockTime preroll, gsize max_bytes) {
+    while (ring->count) {
+        gboolean over = ring->bytes > max_bytes;
+        guint next = 1;
+
+        while (next < ring->count &&
+               !ring_entry(ring, ring->first_seq + next)->keyframe) {
+            next++;
+        }
+        if (!over && (next == ring->count ||
+                      ring_entry(ring, ring->first_seq + next)->time + preroll >
+                          ring->latest)) {
+            break;
+        }
+        while (next--) ring_pop(ring);
+    }
+}
+
+static GstPadProbeReturn tap_probe(GstPad *pad, GstPadProbeInfo *info,
+                                   gpointer u_data) {
+    ClipTap *tap = (ClipTap *)u_data;
+    ClipRecorder *recorder = tap->recorder;
+    ClipRing *ring = &recorder->rings[tap->source_id];
+    GstBuffer *buffer;
+    GstClockTime time;
+    gboolean keyframe;
+
+    if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        GstCaps *caps;
+
+        if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS) return GST_PAD_PROBE_OK;
+        gst_event_parse_caps(event, &caps);
+        g_mutex_lock(&recorder->lock);
+        if (tap->generation == ring->generation) gst_caps_replace(&ring->caps, caps);
+        g_mutex_unlock(&recorder->lock);
+        return GST_PAD_PROBE_OK;
+    }
+
+    buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    keyframe = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    time = GST_BUFFER_DTS_OR_PTS(buffer);
+    g_mutex_lock(&recorder->lock);
+    /* A reference, the payload is shared with the decoder */
+    if (tap->generation == ring->generation && (ring->count || keyframe)) {
+        /* Untimed buffers go with the one before */
+        if (!GST_CLOCK_TIME_IS_VALID(time)) time = ring->latest;
+        ring_push(ring, gst_buffer_ref(buffer), time, keyframe);
+        ring_trim(ring, recorder->preroll, recorder->max_bytes);
+        ring->arrival_us = g_get_monotonic_time();
+        if (recorder->clips->len) g_cond_signal(&recorder->cond);
+    }
+    g_mutex_unlock(&recorder->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+void clip_recorder_tap(guint source_id, GstElement *parser, gpointer data) {
+    ClipRecorder *recorder = (ClipRecorder *)data;
+    ClipRing *ring;
+    ClipTap *tap;
+    GstPad *pad;
+
+    if (source_id >= recorder->max_sources) return;
+    ring = &recorder->rings[source_id];
+    /* SPS and PPS ahead of every keyframe, so that any clip decodes alone */
+    g_object_set(G_OBJECT(parser), "config-interval", -1, NULL);
+
+    tap = g_new0(ClipTap, 1);
+    tap->recorder = recorder;
+    tap->source_id = source_id;
+    g_mutex_lock(&recorder->lock);
+    ring_clear(ring);
+    tap->generation = ++ring->generation;
+    g_mutex_unlock(&recorder->lock);
+
+    pad = gst_element_get_static_pad(parser, "src");
+    gst_pad_add_probe(pad,
+                      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                      tap_probe, tap, g_free);
+    gst_object_unref(pad);
+}
+
+/* Called with the lock held. Triggers only compare within a branch, since the
+ * stream time of the next starts over. */
+static gboolean trigger_expired(ClipRecorder *recorder, const ClipTrigger *trigger) {
+    ClipRing *ring = &recorder->rings[trigger->source_id];
+
+    return trigger->generation != ring->generation ||
+           trigger->time + recorder->preroll + recorder->postroll < ring->latest;
+}
+
+static gboolean trigger_remove(gpointer key, gpointer value, gpointer data) {
+    return trigger_expired((ClipRecorder *)data, (ClipTrigger *)value);
+}
+
+gboolean clip_recorder_trigger(ClipRecorder *recorder, guint source_id,
+                               guint64 object_id) {
+    guint64 key = record_track_key(source_id, object_id);
+    ClipTrigger *trigger;
+    gboolean recent;
+    ClipRing *ring;
+    GDateTime *time;
+    gchar *stamp, *name;
+    Clip *clip;
+
+    if (source_id >= recorder->max_sources) return FALSE;
+    ring = &recorder->rings[source_id];
+    g_mutex_lock(&recorder->lock);
+    trigger = g_hash_table_lookup(recorder->triggers, &key);
+    recent = trigger && !trigger_expired(recorder, trigger);
+    /* Nothing to cut from before the branch's first keyframe */
+    if (recorder->stopping || recent || !ring->count) {
+        if (recent) recorder->suppressed++;
+        g_mutex_unlock(&recorder->lock);
+        return FALSE;
+    }
+    if (!trigger) {
+        if (g_hash_table_size(recorder->triggers) >= CLIP_MAX_TRIGGERS) {
+            g_hash_table_foreach_remove(recorder->triggers, trigger_remove, recorder);
+        }
+        trigger = g_new(ClipTrigger, 1);
+        trigger->key = key;
+        trigger->source_id = source_id;
+        g_hash_table_insert(recorder->triggers, &trigger->key, trigger);
+    }
+    trigger->generation = ring->generation;
+    trigger->time = ring->latest;
+
+    /* From the last keyframe old enough, or else the oldest */
+    clip = g_new0(Clip, 1);
+    clip->source_id = source_id;
+    clip->generation = ring->generation;
+    clip->next_seq = ring->first_seq;
+    for (guint64 seq = ring->first_seq + ring->count; seq-- > ring->first_seq;) {
+        RingEntry *entry = ring_entry(ring, seq);
+        if (entry->keyframe && entry->time + recorder->preroll <= ring->latest) {
+            clip->next_seq = seq;
+            break;
+        }
+    }
+    clip->end = ring->latest + recorder->postroll;
+    clip->base = GST_CLOCK_TIME_NONE;
+
+    time = g_date_time_new_now_local();
+    stamp = g_date_time_format(time, "%Y%m%d-%H%M%S");
+    name = g_strdup_printf("source%02u-track%" G_GUINT64_FORMAT "-%s-%u.mp4", source_id,
+                           object_id, stamp, recorder->next_clip++);
+    clip->path = g_build_filename(recorder->dir, name, NULL);
+    g_free(name);
+    g_free(stamp);
+    g_date_time_unref(time);
+
+    g_ptr_array_add(recorder->clips, clip);
+    recorder->started++;
+    g_cond_signal(&recorder->cond);
+    g_mutex_unlock(&recorder->lock);
+    return TRUE;
+}
+
+/* Called with the lock held. Takes the clip's next buffers from its ring into
+ * batch, and returns TRUE once the clip is complete. */
+static gboolean clip_collect(ClipRecorder *recorder, Clip *clip, GstBuffer **batch,
+                             guint *count) {
+    ClipRing *ring = &recorder->rings[clip->source_id];
+
+    *count = 0;
+    /* The branch was rebuilt and timestamps started over */
+    if (clip->generation != ring->generation) return TRUE;
+    if (clip->next_seq < ring->first_seq) {
+        /* Evicted before the writer got to them, the ring resumes on a
+         * keyframe */
+        clip->next_seq = ring->first_seq;
+        recorder->gaps++;
+    }
+    if (!clip->caps && ring->caps) clip->caps = gst_caps_ref(ring->caps);
+
+    while (*count < CLIP_BATCH && clip->next_seq < ring->first_seq + ring->count) {
+        RingEntry *entry = ring_entry(ring, clip->next_seq);
+
+        if (entry->time > clip->end) return TRUE;
+        clip->next_seq++;
+        if (!clip->started && !entry->keyframe) continue;
+        clip->started = TRUE;
+        batch[(*count)++] = gst_buffer_ref(entry->buffer);
+    }
+    if (*count == CLIP_BATCH) return FALSE;
+    return recorder->stopping ||
+           g_get_monotonic_time() > ring->arrival_us + CLIP_GRACE_MS * 1000;
+}
+
+/* appsrc ! h264parse ! mp4mux ! filesink, h264parse turning the byte-stream
+ * the decoder takes into the avc that mp4mux wants */
+static gboolean clip_open(Clip *clip) {
+    GstElement *parser, *mux, *sink;
+
+    clip->pipeline = gst_pipeline_new("clip");
+    clip->appsrc = gst_element_factory_make("appsrc", "src");
+    parser = gst_element_factory_make("h264parse", "parser");
+    mux = gst_element_factory_make("mp4mux", "mux");
+    sink = gst_element_factory_make("filesink", "sink");
+    if (!clip->pipeline || !clip->appsrc || !parser || !mux || !sink) {
+        GstElement *elements[] = {clip->pipeline, clip->appsrc, parser, mux, sink};
+
+        LOG_ERROR(LOG_CAT_CLIPS, "Clip elements could not be created");
+        for (guint i = 0; i < G_N_ELEMENTS(elements); i++) {
+            if (elements[i]) gst_object_unref(elements[i]);
+        }
+        clip->pipeline = NULL;
+        return FALSE;
+    }
+    gst_bin_add_many(GST_BIN(clip->pipeline), clip->appsrc, parser, mux, sink, NULL);
+    if (!gst_element_link_many(clip->appsrc, parser, mux, sink, NULL)) {
+        LOG_ERROR(LOG_CAT_CLIPS, "Clip elements could not be linked");
+        return FALSE;
+    }
+    g_object_set(G_OBJECT(clip->appsrc), "format", GST_FORMAT_TIME, "caps", clip->caps,
+                 NULL);
+    g_object_set(G_OBJECT(sink), "location", clip->path, NULL);
+    return gst_element_set_state(clip->pipeline, GST_STATE_PLAYING) !=
+           GST_STATE_CHANGE_FAILURE;
+}
+
+static inline GstClockTime retime(GstClockTime t, GstClockTime base) {
+    if (!GST_CLOCK_TIME_IS_VALID(t)) return t;
+    return t > base ? t - base : 0;
+}
+
+/* Pushes and releases batch. Returns FALSE once the clip has failed. */
+static gboolean clip_push(Clip *clip, GstBuffer **batch, guint count) {
+    GstFlowReturn flow = GST_FLOW_OK;
+    guint i = 0;
+
+    if (count && !clip->pipeline && !clip_open(clip)) flow = GST_FLOW_ERROR;
+    for (; i < count && flow == GST_FLOW_OK; i++) {
+        /* New buffer metadata around the same memory */
+        GstBuffer *copy = gst_buffer_copy(batch[i]);
+
+        if (!GST_CLOCK_TIME_IS_VALID(clip->base)) {
+            clip->base = GST_CLOCK_TIME_IS_VALID(GST_BUFFER_DTS(copy))
+                             ? GST_BUFFER_DTS(copy)
+                             : GST_BUFFER_PTS(copy);
+        }
+        GST_BUFFER_PTS(copy) = retime(GST_BUFFER_PTS(copy), clip->base);
+        GST_BUFFER_DTS(copy) = retime(GST_BUFFER_DTS(copy), clip->base);
+        g_signal_emit_by_name(clip->appsrc, "push-buffer", copy, &flow);
+        gst_buffer_unref(copy);
+        gst_buffer_unref(batch[i]);
+        clip->buffers++;
+    }
+    for (; i < count; i++) gst_buffer_unref(batch[i]);
+    return flow == GST_FLOW_OK;
+}
+
+/* Ends the file and frees the clip. Returns TRUE when it was written. */
+static gboolean clip_close(Clip *clip, gboolean ok) {
+    if (!clip->pipeline) {
+        ok = FALSE;
+    } else {
+        if (ok) {
+            GstBus *bus = gst_element_get_bus(clip->pipeline);
+            GstFlowReturn flow;
+            GstMessage *msg;
+
+            g_signal_emit_by_name(clip->appsrc, "end-of-stream", &flow);
+            msg = gst_bus_timed_pop_filtered(bus, CLIP_EOS_TIMEOUT_SEC * GST_SECOND,
+                                             GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+            ok = msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+            if (msg) gst_message_unref(msg);
+            gst_object_unref(bus);
+        }
+        gst_element_set_state(clip->pipeline, GST_STATE_NULL);
+        gst_object_unref(clip->pipeline);
+    }
+    if (ok) {
+        LOG_INFO(LOG_CAT_CLIPS, "Clip %s written, %u buffers", clip->path,
+                 clip->buffers);
+    } else {
+        LOG_WARNING(LOG_CAT_CLIPS, "Clip %s failed", clip->path);
+    }
+    if (clip->caps) gst_caps_unref(clip->caps);
+    g_free(clip->path);
+    g_free(clip);
+    return ok;
+}
+
+/* Goes round the open clips, writing whatever each has new */
+static gpointer writer_main(gpointer data) {
+    ClipRecorder *recorder = (ClipRecorder *)data;
+    GstBuffer *batch[CLIP_BATCH];
+
+    g_mutex_lock(&recorder->lock);
+    while (!recorder->stopping || recorder->clips->len) {
+        gboolean progress = FALSE;
+
+        for (guint c = 0; c < recorder->clips->len;) {
+            Clip *clip = g_ptr_array_index(recorder->clips, c);
+            gboolean done, ok;
+            guint count;
+
+            done = clip_collect(recorder, clip, batch, &count);
+            g_mutex_unlock(&recorder->lock);
+            ok = clip_push(clip, batch, count);
+            if (done || !ok) ok = clip_close(clip, ok);
+            g_mutex_lock(&recorder->lock);
+
+            progress |= count > 0 || done || !ok;
+            if (!done && ok) {
+                c++;
+                continue;
+            }
+            g_ptr_array_remove_index(recorder->clips, c);
+            if (ok) {
+                recorder->written++;
+            } else {
+                recorder->failed++;
+            }
+        }
+        if (!progress && !recorder->stopping) {
+            g_cond_wait_until(&recorder->cond, &recorder->lock,
+                              g_get_monotonic_time() + CLIP_POLL_MS * 1000);
+        }
+    }
+    g_mutex_unlock(&recorder->lock);
+    return NULL;
+}
+
+ClipRecorder *clip_recorder_new(const ClipConfig *config, guint max_sources) {
+    ClipRecorder *recorder = g_new0(ClipRecorder, 1);
+
+    recorder->dir = g_strdup(config->dir);
+    recorder->preroll = (GstClockTime)config->preroll_ms * GST_MSECOND;
+    recorder->postroll = (GstClockTime)config->postroll_ms * GST_MSECOND;
+    recorder->max_bytes = config->max_bytes;
+    recorder->max_sources = max_sources;
+    recorder->rings = g_new0(ClipRing, max_sources);
+    for (guint i = 0; i < max_sources; i++) {
+        recorder->rings[i].capacity = CLIP_RING_INITIAL_CAPACITY;
+        recorder->rings[i].entries = g_new(RingEntry, CLIP_RING_INITIAL_CAPACITY);
+    }
+    g_mutex_init(&recorder->lock);
+    g_cond_init(&recorder->cond);
+    recorder->clips = g_ptr_array_new();
+    recorder->triggers =
+        g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, g_free);
+    recorder->writer = g_thread_new("clip-writer", writer_main, recorder);
+    return recorder;
+}
+
+void clip_recorder_free(ClipRecorder *recorder) {
+    if (!recorder) return;
+    g_mutex_lock(&recorder->lock);
+    recorder->stopping = TRUE;
+    g_cond_signal(&recorder->cond);
+    g_mutex_unlock(&recorder->lock);
+    g_thread_join(recorder->writer);
+
+    for (guint i = 0; i < recorder->max_sources; i++) {
+        ring_clear(&recorder->rings[i]);
+        g_free(recorder->rings[i].entries);
+    }
+    g_free(recorder->rings);
+    g_ptr_array_free(recorder->clips, TRUE);
+    g_hash_table_destroy(recorder->triggers);
+    g_cond_clear(&recorder->cond);
+    g_mutex_clear(&recorder->lock);
+    g_free(recorder->dir);
+    g_free(recorder);
+}
+
+void clip_recorder_print_stats(const ClipRecorder *recorder) {
+    ClipRecorder *r = (ClipRecorder *)recorder;
+
+    if (!recorder) return;
+    g_mutex_lock(&r->lock);
+    g_print("Clips: %" G_GUINT64_FORMAT " started, %" G_GUINT64_FORMAT
+            " written, %" G_GUINT64_FORMAT " failed, %" G_GUINT64_FORMAT
+            " gaps, %" G_GUINT64_FORMAT " retriggers ignored\n",
+            r->started, r->written, r->failed, r->gaps, r->suppressed);
+    g_mutex_unlock(&r->lock);
+}
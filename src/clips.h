@@ -0,0 +1,55 @@
+#ifndef __CLIPS_H__
+#define __CLIPS_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+/* Evidence clips around analytics events, written without re-encoding.
+ *
+ * Each source's h264parse output is tapped into a pre-roll ring holding
+ * references to the compressed buffers. All windows are in stream time, the
+ * buffers' DTS or PTS, so clips come out the same length when files are read
+ * faster than real time. The ring keeps the pre-roll plus the rest of the
+ * oldest GOP, so it always starts on a keyframe, and never more than
+ * max_bytes. An event starts a clip at the last keyframe at least preroll_ms
+ * before the newest buffer; one background thread then feeds the buffers
+ * into appsrc ! h264parse ! mp4mux ! filesink until postroll_ms after that,
+ * or until the source has been quiet for a while. Buffers are pushed as
+ * shallow copies sharing the ring's memory, retimed to start at zero. Any
+ * number of clips of a source can be open at once, all reading the same
+ * ring. */
+
+#define CLIP_DEFAULT_PREROLL_MS 5000
+#define CLIP_DEFAULT_POSTROLL_MS 5000
+#define CLIP_DEFAULT_MAX_BYTES (64 * 1024 * 1024)
+
+typedef struct {
+    /* Where the MP4 files go */
+    const gchar *dir;
+    guint preroll_ms;
+    guint postroll_ms;
+    /* Per source */
+    gsize max_bytes;
+} ClipConfig;
+
+typedef struct _ClipRecorder ClipRecorder;
+
+void clip_config_init(ClipConfig *config, const gchar *dir);
+
+ClipRecorder *clip_recorder_new(const ClipConfig *config, guint max_sources);
+/* Finishes the clips still open with what they have, then stops the writer. */
+void clip_recorder_free(ClipRecorder *recorder);
+
+/* A SourceTapFunc: taps source_id's new branch at parser, emptying its ring,
+ * since timestamps start over with a new branch. */
+void clip_recorder_tap(guint source_id, GstElement *parser, gpointer recorder);
+
+/* Starts a clip for an event on object_id, unless that object already had one
+ * in the last preroll + postroll of its stream. Returns TRUE when a clip was
+ * started. Can be called from any thread. */
+gboolean clip_recorder_trigger(ClipRecorder *recorder, guint source_id,
+                               guint64 object_id);
+
+void clip_recorder_print_stats(const ClipRecorder *recorder);
+
+#endif
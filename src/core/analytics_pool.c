@@ -0,0 +1,325 @@
+#include "analytics_pool.h"
+
+#include <string.h>
+
+#include "spsc_ring.h"
+
+/* Polls before an idle worker starts sleeping between checks */
+#define WORKER_SPIN 1024
+#define WORKER_IDLE_US 100
+
+typedef struct {
+    AnalyticsPool *pool;
+    GThread *thread;
+    SpscRing *ring;
+    LoiterAnalytics *loiter;
+    ZoneAnalytics *zones;
+    TrajectoryBuilder *trajectories;
+    TrackResults *results;
+    gboolean *loitering;
+
+    /* Producer side, the slot being filled by the current submit */
+    FrameRecord *pending;
+    guint64 frames;
+    guint64 dropped_frames;
+    guint64 dropped_objects;
+    guint max_depth;
+
+    /* Worker side */
+    guint64 processed_frames;
+} Worker;
+
+struct _AnalyticsPool {
+    AnalyticsConfig config;
+    Worker *workers;
+    gint running;
+};
+
+void analytics_config_init(AnalyticsConfig *config, guint max_objects,
+                           gint person_class_id) {
+    config->num_workers = ANALYTICS_DEFAULT_WORKERS;
+    config->queue_len = ANALYTICS_DEFAULT_QUEUE_LEN;
+    config->max_objects = max_objects;
+    loiter_config_init(&config->loiter, person_class_id);
+    config->zones = NULL;
+    zone_analytics_config_init(&config->zone);
+    config->trajectory_sink = NULL;
+    config->trajectory_data = NULL;
+    trajectory_config_init(&config->trajectory);
+    config->loiter_start = NULL;
+    config->loiter_start_data = NULL;
+}
+
+static inline guint shard_of(const AnalyticsPool *pool, guint64 key) {
+    if (pool->config.num_workers == 1) return 0;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (guint)(key % pool->config.num_workers);
+}
+
+static void process_frame(Worker *worker, const FrameRecord *frame) {
+    const AnalyticsConfig *config = &worker->pool->config;
+
+    loiter_analytics_process(worker->loiter, frame, worker->loitering);
+
+    /* Only loitering tracks are kept in the results, the rest read back 0 */
+    for (guint i = 0; i < frame->num_objects; i++) {
+        const ObjectRecord *obj = &frame->objects[i];
+        guint32 flags;
+        guint64 key;
+
+        if (obj->object_id == RECORD_UNTRACKED_ID) continue;
+        key = record_track_key(frame->source_id, obj->object_id);
+        flags = track_results_get(worker->results, key);
+        if (worker->loitering[i]) {
+            track_results_set(worker->results, key, TRACK_RESULT_LOITERING, frame->pts);
+            if (!(flags & TRACK_RESULT_LOITERING) && config->loiter_start) {
+                config->loiter_start(frame->source_id, obj->object_id,
+                                     config->loiter_start_data);
+            }
+        } else if (flags) {
+            track_results_set(worker->results, key, 0, frame->pts);
+        }
+    }
+    track_results_expire(worker->results, frame->pts);
+
+    if (worker->zones) zone_analytics_process(worker->zones, frame, NULL, 0);
+    if (worker->trajectories) trajectory_builder_process(worker->trajectories, frame);
+}
+
+static gpointer worker_main(gpointer data) {
+    Worker *worker = (Worker *)data;
+    guint idle = 0;
+
+    for (;;) {
+        FrameRecord *frame = spsc_ring_peek(worker->ring);
+        if (!frame) {
+            if (!g_atomic_int_get(&worker->pool->running)) break;
+            if (++idle > WORKER_SPIN) g_usleep(WORKER_IDLE_US);
+            continue;
+        }
+        idle = 0;
+        process_frame(worker, frame);
+        spsc_ring_release(worker->ring);
+        worker->processed_frames++;
+    }
+    return NULL;
+}
+
+AnalyticsPool *analytics_pool_new(const AnalyticsConfig *config) {
+    AnalyticsPool *pool = g_new0(AnalyticsPool, 1);
+    gsize slot_size =
+        sizeof(FrameRecord) + (gsize)config->max_objects * sizeof(ObjectRecord);
+
+    pool->config = *config;
+    pool->config.num_workers = MAX(config->num_workers, 1);
+    pool->config.queue_len = 1;
+    while (pool->config.queue_len < config->queue_len) pool->config.queue_len <<= 1;
+    pool->workers = g_new0(Worker, pool->config.num_workers);
+    pool->running = TRUE;
+
+    for (guint i = 0; i < pool->config.num_workers; i++) {
+        Worker *worker = &pool->workers[i];
+        gchar name[16];
+
+        worker->pool = pool;
+        worker->ring = spsc_ring_new(pool->config.queue_len, slot_size);
+        worker->loiter = loiter_analytics_new(&config->loiter);
+        if (config->zones) {
+            worker->zones = zone_analytics_new(config->zones, &config->zone);
+        }
+        if (config->trajectory_sink) {
+            worker->trajectories = trajectory_builder_new(
+                &config->trajectory, config->trajectory_sink, config->trajectory_data);
+        }
+        /* Loitering needs the full window, so at most max_tracks of them */
+        worker->results = track_results_new(config->loiter.max_tracks * 2,
+                                            config->loiter.ttl);
+        worker->loitering = g_new0(gboolean, MAX(config->max_objects, 1));
+
+        g_snprintf(name, sizeof(name), "analytics-%u", i);
+        worker->thread = g_thread_new(name, worker_main, worker);
+    }
+    return pool;
+}
+
+void analytics_pool_free(AnalyticsPool *pool) {
+    if (!pool) return;
+    g_atomic_int_set(&pool->running, FALSE);
+    for (guint i = 0; i < pool->config.num_workers; i++) {
+        Worker *worker = &pool->workers[i];
+        g_thread_join(worker->thread);
+        spsc_ring_free(worker->ring);
+        loiter_analytics_free(worker->loiter);
+        zone_analytics_free(worker->zones);
+        trajectory_builder_free(worker->trajectories);
+        track_results_free(worker->results);
+        g_free(worker->loitering);
+    }
+    g_free(pool->workers);
+    g_free(pool);
+}
+
+guint analytics_pool_submit(AnalyticsPool *pool, const FrameRecord *frame) {
+    guint num_workers = pool->config.num_workers;
+    guint num_objects = MIN(frame->num_objects, pool->config.max_objects);
+    guint dropped = frame->num_objects - num_objects;
+
+    for (guint w = 0; w < num_workers; w++) {
+        Worker *worker = &pool->workers[w];
+        guint depth = spsc_ring_depth(worker->ring);
+
+        worker->frames++;
+        if (depth > worker->max_depth) worker->max_depth = depth;
+        worker->pending = spsc_ring_reserve(worker->ring);
+        if (!worker->pending) {
+            worker->dropped_frames++;
+            continue;
+        }
+        worker->pending->source_id = frame->source_id;
+        worker->pending->frame_num = frame->frame_num;
+        worker->pending->pts = frame->pts;
+        worker->pending->num_objects = 0;
+        worker->pending->objects = (ObjectRecord *)(worker->pending + 1);
+    }
+
+    for (guint i = 0; i < num_objects; i++) {
+        const ObjectRecord *obj = &frame->objects[i];
+        Worker *worker = &pool->workers[0];
+        FrameRecord *slot;
+
+        if (obj->object_id != RECORD_UNTRACKED_ID) {
+            worker = &pool->workers[shard_of(
+                pool, record_track_key(frame->source_id, obj->object_id))];
+        }
+        slot = worker->pending;
+        if (!slot) {
+            worker->dropped_objects++;
+            dropped++;
+            continue;
+        }
+        slot->objects[slot->num_objects++] = *obj;
+    }
+
+    for (guint w = 0; w < num_workers; w++) {
+        if (pool->workers[w].pending) spsc_ring_commit(pool->workers[w].ring);
+        pool->workers[w].pending = NULL;
+    }
+    return dropped;
+}
+
+guint32 analytics_pool_lookup(AnalyticsPool *pool, guint source_id, guint64 object_id) {
+    guint64 key;
+
+    if (object_id == RECORD_UNTRACKED_ID) return 0;
+    key = record_track_key(source_id, object_id);
+    return track_results_get(pool->workers[shard_of(pool, key)].results, key);
+}
+
+guint analytics_pool_num_workers(const AnalyticsPool *pool) {
+    return pool->config.num_workers;
+}
+
+void analytics_pool_get_stats(AnalyticsPool *pool, guint worker,
+                              AnalyticsWorkerStats *stats) {
+    Worker *w = &pool->workers[worker];
+    stats->frames = w->frames;
+    stats->dropped_frames = w->dropped_frames;
+    stats->dropped_objects = w->dropped_objects;
+    stats->processed_frames = w->processed_frames;
+    stats->depth = spsc_ring_depth(w->ring);
+    stats->max_depth = w->max_depth;
+    stats->capacity = spsc_ring_capacity(w->ring);
+}
+
+static void print_zone_counters(AnalyticsPool *pool) {
+    const ZoneLayout *layout = pool->config.zones;
+    ZoneCounters *zones;
+    LineCounters *lines;
+
+    if (!layout) return;
+    zones = g_new(ZoneCounters, MAX(zone_layout_num_zones(layout), 1));
+    lines = g_new(LineCounters, MAX(zone_layout_num_lines(layout), 1));
+    analytics_pool_get_zone_counters(pool, zones, lines);
+    for (guint i = 0; i < zone_layout_num_zones(layout); i++) {
+        g_print("zone %s: %" G_GUINT64_FORMAT " entries, %" G_GINT64_FORMAT
+                " inside, mean dwell %.1f s, max %.1f s\n",
+                zone_layout_zone(layout, i)->name, zones[i].entries, zones[i].occupancy,
+                zones[i].exits ? zones[i].dwell_total / 1e9 / zones[i].exits : 0.0,
+                zones[i].dwell_max / 1e9);
+    }
+    for (guint i = 0; i < zone_layout_num_lines(layout); i++) {
+        g_print("line %s: %" G_GUINT64_FORMAT " forward, %" G_GUINT64_FORMAT
+                " backward\n",
+                zone_layout_line(layout, i)->name, lines[i].forward, lines[i].backward);
+    }
+    g_free(zones);
+    g_free(lines);
+}
+
+void analytics_pool_print_stats(AnalyticsPool *pool) {
+    for (guint i = 0; i < pool->config.num_workers; i++) {
+        AnalyticsWorkerStats stats;
+        analytics_pool_get_stats(pool, i, &stats);
+        g_print("analytics-%u: %" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT
+                " processed, %" G_GUINT64_FORMAT " dropped (%" G_GUINT64_FORMAT
+                " objects), queue %u/%u, max %u\n",
+                i, stats.frames, stats.processed_frames, stats.dropped_frames,
+                stats.dropped_objects, stats.depth, stats.capacity, stats.max_depth);
+    }
+    print_zone_counters(pool);
+}
+
+gboolean analytics_pool_get_zone_counters(AnalyticsPool *pool, ZoneCounters *zones,
+                                          LineCounters *lines) {
+    const ZoneLayout *layout = pool->config.zones;
+
+    if (!layout) return FALSE;
+    memset(zones, 0, zone_layout_num_zones(layout) * sizeof(ZoneCounters));
+    memset(lines, 0, zone_layout_num_lines(layout) * sizeof(LineCounters));
+    for (guint i = 0; i < pool->config.num_workers; i++) {
+        zone_analytics_add_counters(pool->workers[i].zones, zones, lines);
+    }
+    return TRUE;
+}
+
+void analytics_pool_dump_zones(AnalyticsPool *pool, GString *out) {
+    const ZoneLayout *layout = pool->config.zones;
+    ZoneCounters *zones;
+    LineCounters *lines;
+
+    if (!layout) {
+        g_string_append(out, "null");
+        return;
+    }
+    zones = g_new(ZoneCounters, MAX(zone_layout_num_zones(layout), 1));
+    lines = g_new(LineCounters, MAX(zone_layout_num_lines(layout), 1));
+    analytics_pool_get_zone_counters(pool, zones, lines);
+
+    g_string_append(out, "{\"zones\":[");
+    for (guint i = 0; i < zone_layout_num_zones(layout); i++) {
+        gchar *name = g_strescape(zone_layout_zone(layout, i)->name, NULL);
+        g_string_append_printf(
+            out,
+            "%s{\"zone\":\"%s\",\"occupancy\":%" G_GINT64_FORMAT
+            ",\"entries\":%" G_GUINT64_FORMAT ",\"exits\":%" G_GUINT64_FORMAT
+            ",\"mean_dwell_sec\":%.3f,\"max_dwell_sec\":%.3f}",
+            i ? "," : "", name, zones[i].occupancy, zones[i].entries, zones[i].exits,
+            zones[i].exits ? zones[i].dwell_total / 1e9 / zones[i].exits : 0.0,
+            zones[i].dwell_max / 1e9);
+        g_free(name);
+    }
+    g_string_append(out, "],\"lines\":[");
+    for (guint i = 0; i < zone_layout_num_lines(layout); i++) {
+        gchar *name = g_strescape(zone_layout_line(layout, i)->name, NULL);
+        g_string_append_printf(out,
+                               "%s{\"line\":\"%s\",\"forward\":%" G_GUINT64_FORMAT
+                               ",\"backward\":%" G_GUINT64_FORMAT "}",
+                               i ? "," : "", name, lines[i].forward, lines[i].backward);
+        g_free(name);
+    }
+    g_string_append(out, "]}");
+    g_free(zones);
+    g_free(lines);
+}
@@ -0,0 +1,90 @@
+#ifndef __ANALYTICS_POOL_H__
+#define __ANALYTICS_POOL_H__
+
+#include <glib.h>
+
+#include "frame_record.h"
+#include "loiter.h"
+#include "track_results.h"
+#include "trajectory.h"
+#include "zone_analytics.h"
+
+/* Runs the per-track analytics on worker threads, off the streaming thread.
+ *
+ * analytics_pool_submit() copies a frame's objects into one SPSC ring per
+ * worker, sharded by track so that every track always lands on the same
+ * worker and its LoiterAnalytics. Workers publish the outcome per track in
+ * their TrackResults, which analytics_pool_lookup() reads, so results show up
+ * on a later frame than the one that produced them. When a worker's ring is
+ * full its share of the frame is dropped instead of blocking the caller.
+ * With a ZoneLayout, each worker also runs ZoneAnalytics over its tracks,
+ * and the pool sums their counters. With a TrajectorySink, each worker builds
+ * the paths of its tracks and hands them to the sink from its own thread.
+ * A LoiterStartFunc is likewise called by the workers, once as each track
+ * starts loitering. */
+
+#define ANALYTICS_DEFAULT_WORKERS 1
+#define ANALYTICS_DEFAULT_QUEUE_LEN 64
+
+/* Called from a worker thread when a track becomes loitering */
+typedef void (*LoiterStartFunc)(guint source_id, guint64 object_id, gpointer data);
+
+typedef struct {
+    guint num_workers;
+    /* Frames each worker can have queued, rounded up to a power of two */
+    guint queue_len;
+    /* Largest num_objects that will be submitted */
+    guint max_objects;
+    LoiterConfig loiter;
+    /* NULL for no zones, must outlive the pool */
+    const ZoneLayout *zones;
+    ZoneAnalyticsConfig zone;
+    /* NULL for no trajectories, called from every worker */
+    TrajectorySink trajectory_sink;
+    gpointer trajectory_data;
+    TrajectoryConfig trajectory;
+    /* NULL for none, called from every worker */
+    LoiterStartFunc loiter_start;
+    gpointer loiter_start_data;
+} AnalyticsConfig;
+
+typedef struct {
+    guint64 frames;
+    guint64 dropped_frames;
+    guint64 dropped_objects;
+    guint64 processed_frames;
+    guint depth;
+    guint max_depth;
+    guint capacity;
+} AnalyticsWorkerStats;
+
+typedef struct _AnalyticsPool AnalyticsPool;
+
+void analytics_config_init(AnalyticsConfig *config, guint max_objects,
+                           gint person_class_id);
+
+/* Starts the worker threads. */
+AnalyticsPool *analytics_pool_new(const AnalyticsConfig *config);
+/* Lets the workers drain their queues, then joins them. The paths still open
+ * are handed to the trajectory sink. */
+void analytics_pool_free(AnalyticsPool *pool);
+
+/* Single producer. Returns the number of objects dropped. */
+guint analytics_pool_submit(AnalyticsPool *pool, const FrameRecord *frame);
+
+/* TRACK_RESULT_* flags last published for the track, 0 if none. */
+guint32 analytics_pool_lookup(AnalyticsPool *pool, guint source_id, guint64 object_id);
+
+guint analytics_pool_num_workers(const AnalyticsPool *pool);
+void analytics_pool_get_stats(AnalyticsPool *pool, guint worker,
+                              AnalyticsWorkerStats *stats);
+void analytics_pool_print_stats(AnalyticsPool *pool);
+
+/* Sums the workers' zone and line counters, FALSE without zones. zones and
+ * lines have one entry per zone and line of the layout. */
+gboolean analytics_pool_get_zone_counters(AnalyticsPool *pool, ZoneCounters *zones,
+                                          LineCounters *lines);
+/* Appends the zone and line counters as a JSON object, or null. */
+void analytics_pool_dump_zones(AnalyticsPool *pool, GString *out);
+
+#endif
@@ -0,0 +1,153 @@
+#include "attribute_cache.h"
+
+#include <string.h>
+
+#include "frame_record.h"
+#include "slab_table.h"
+
+typedef struct {
+    guint64 last_seen;
+    AttributeResult result;
+    /* Classifications in a row that agreed with result */
+    guint agreed;
+    guint hits_since_refresh;
+} CacheEntry;
+
+struct _AttributeCache {
+    GMutex lock;
+    SlabTable *table;
+    CacheEntry *slab;
+    AttributeCacheConfig config;
+    guint64 last_sweep;
+    guint64 hits;
+    guint64 misses;
+    guint64 rejected;
+};
+
+void attribute_cache_config_init(AttributeCacheConfig *config) {
+    config->stable_frames = ATTRIBUTE_CACHE_DEFAULT_STABLE_FRAMES;
+    config->refresh_frames = ATTRIBUTE_CACHE_DEFAULT_REFRESH_FRAMES;
+    config->max_tracks = ATTRIBUTE_CACHE_DEFAULT_MAX_TRACKS;
+    config->ttl = ATTRIBUTE_CACHE_DEFAULT_TTL;
+}
+
+AttributeCache *attribute_cache_new(const AttributeCacheConfig *config) {
+    AttributeCache *cache = g_new0(AttributeCache, 1);
+
+    g_mutex_init(&cache->lock);
+    cache->table = slab_table_new(config->max_tracks);
+    cache->slab = g_new0(CacheEntry, config->max_tracks);
+    cache->config = *config;
+    cache->config.stable_frames = MAX(config->stable_frames, 1);
+    return cache;
+}
+
+void attribute_cache_free(AttributeCache *cache) {
+    if (!cache) return;
+    g_mutex_clear(&cache->lock);
+    slab_table_free(cache->table);
+    g_free(cache->slab);
+    g_free(cache);
+}
+
+static CacheEntry *find(AttributeCache *cache, guint64 key) {
+    guint32 idx = slab_table_find(cache->table, key);
+    return idx != SLAB_TABLE_NONE ? &cache->slab[idx] : NULL;
+}
+
+static CacheEntry *insert(AttributeCache *cache, guint64 key) {
+    guint32 idx = slab_table_insert(cache->table, key);
+
+    if (idx == SLAB_TABLE_NONE) return NULL;
+    memset(&cache->slab[idx], 0, sizeof(CacheEntry));
+    return &cache->slab[idx];
+}
+
+static guint sweep(AttributeCache *cache, guint64 now) {
+    guint removed = 0;
+
+    for (guint i = 0; i < cache->config.max_tracks; i++) {
+        if (!slab_table_in_use(cache->table, i) ||
+            !record_is_stale(cache->slab[i].last_seen, now, cache->config.ttl))
+            continue;
+        slab_table_remove(cache->table, i);
+        removed++;
+    }
+    cache->last_sweep = now;
+    return removed;
+}
+
+gboolean attribute_cache_lookup(AttributeCache *cache, guint64 key, guint64 now,
+                                AttributeResult *result) {
+    gboolean hit = FALSE;
+    CacheEntry *entry;
+
+    g_mutex_lock(&cache->lock);
+    entry = find(cache, key);
+    if (entry) {
+        entry->last_seen = now;
+        if (entry->agreed >= cache->config.stable_frames) {
+            hit = !cache->config.refresh_frames ||
+                  ++entry->hits_since_refresh < cache->config.refresh_frames;
+            if (hit) {
+                *result = entry->result;
+            } else {
+                entry->hits_since_refresh = 0;
+            }
+        }
+    }
+    if (hit) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+    g_mutex_unlock(&cache->lock);
+    return hit;
+}
+
+void attribute_cache_update(AttributeCache *cache, guint64 key, guint64 now,
+                            const AttributeResult *result) {
+    CacheEntry *entry;
+
+    g_mutex_lock(&cache->lock);
+    entry = find(cache, key);
+    if (!entry) {
+        entry = insert(cache, key);
+        if (!entry && sweep(cache, now) > 0) entry = insert(cache, key);
+    }
+    if (!entry) {
+        cache->rejected++;
+        g_mutex_unlock(&cache->lock);
+        return;
+    }
+
+    if (entry->agreed && entry->result.class_id == result->class_id) {
+        /* Saturate so a long-lived track does not wrap back to unstable */
+        if (entry->agreed < G_MAXUINT) entry->agreed++;
+    } else {
+        entry->agreed = 1;
+        entry->hits_since_refresh = 0;
+    }
+    entry->result = *result;
+    entry->last_seen = now;
+    g_mutex_unlock(&cache->lock);
+}
+
+guint attribute_cache_expire(AttributeCache *cache, guint64 now) {
+    guint removed = 0;
+
+    g_mutex_lock(&cache->lock);
+    if (record_is_stale(cache->last_sweep, now, cache->config.ttl / 4))
+        removed = sweep(cache, now);
+    g_mutex_unlock(&cache->lock);
+    return removed;
+}
+
+void attribute_cache_get_stats(AttributeCache *cache, AttributeCacheStats *stats) {
+    g_mutex_lock(&cache->lock);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->rejected = cache->rejected;
+    stats->tracks = slab_table_size(cache->table);
+    g_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,73 @@
+#ifndef __ATTRIBUTE_CACHE_H__
+#define __ATTRIBUTE_CACHE_H__
+
+#include <glib.h>
+
+/* Per-track results of one secondary classifier.
+ *
+ * A fixed-capacity slab_table.h index from track key to the last label the
+ * classifier gave that track. Once the same label has come back stable_frames
+ * times in a row the result is considered stable and lookups hit, which is the
+ * caller's cue to skip classifying the object and reuse the cached label. A
+ * stable track is classified again every refresh_frames hits so a wrong label
+ * does not stick forever. Entries not looked up for longer than the ttl are
+ * removed by attribute_cache_expire().
+ *
+ * The lookup and update sides run on the sink and src pad threads of the
+ * classifier, so every call takes the cache's lock. */
+
+#define ATTRIBUTE_LABEL_LEN 32
+
+#define ATTRIBUTE_CACHE_DEFAULT_STABLE_FRAMES 3
+#define ATTRIBUTE_CACHE_DEFAULT_REFRESH_FRAMES 300
+#define ATTRIBUTE_CACHE_DEFAULT_MAX_TRACKS 4096
+#define ATTRIBUTE_CACHE_DEFAULT_TTL (2 * G_GUINT64_CONSTANT(1000000000))
+
+typedef struct {
+    gint class_id;
+    guint label_id;
+    guint num_classes;
+    gfloat prob;
+    gchar label[ATTRIBUTE_LABEL_LEN];
+} AttributeResult;
+
+typedef struct {
+    guint stable_frames;
+    /* 0 never classifies a stable track again */
+    guint refresh_frames;
+    guint max_tracks;
+    /* ns */
+    guint64 ttl;
+} AttributeCacheConfig;
+
+typedef struct {
+    /* Lookups that returned a stable result, i.e. classifications saved */
+    guint64 hits;
+    guint64 misses;
+    /* New tracks turned away because the table was full */
+    guint64 rejected;
+    guint tracks;
+} AttributeCacheStats;
+
+typedef struct _AttributeCache AttributeCache;
+
+void attribute_cache_config_init(AttributeCacheConfig *config);
+
+AttributeCache *attribute_cache_new(const AttributeCacheConfig *config);
+void attribute_cache_free(AttributeCache *cache);
+
+/* Copies the stable result for key into result and returns TRUE, or returns
+ * FALSE when the object has to be classified. Keeps the track alive. */
+gboolean attribute_cache_lookup(AttributeCache *cache, guint64 key, guint64 now,
+                                AttributeResult *result);
+
+/* Records a classification of key. */
+void attribute_cache_update(AttributeCache *cache, guint64 key, guint64 now,
+                            const AttributeResult *result);
+
+/* Removes tracks not looked up for longer than the ttl. */
+guint attribute_cache_expire(AttributeCache *cache, guint64 now);
+
+void attribute_cache_get_stats(AttributeCache *cache, AttributeCacheStats *stats);
+
+#endif
@@ -0,0 +1,409 @@
+#include "class_counters.h"
+
+#include <string.h>
+
+#define CACHE_LINE 64
+#define NUM_BUCKETS (60 + 60 + 24)
+#define NUM_COMPONENTS 256
+
+static const guint window_len[COUNTER_NUM_WINDOWS] = {60, 60, 24};
+static const guint window_offset[COUNTER_NUM_WINDOWS] = {0, 60, 120};
+static const gint64 bucket_us[COUNTER_NUM_WINDOWS] = {
+    G_USEC_PER_SEC, 60 * G_USEC_PER_SEC, 3600 * (gint64)G_USEC_PER_SEC};
+static const gchar *const window_names[COUNTER_NUM_WINDOWS] = {"1m", "1h", "1d"};
+
+/* One source and series, alone on its cache line */
+typedef struct {
+    guint64 objects;
+    guint64 tracks;
+    guint current;
+    gchar pad[CACHE_LINE - 2 * sizeof(guint64) - sizeof(guint)];
+} Cell;
+
+G_STATIC_ASSERT(sizeof(Cell) == CACHE_LINE);
+
+typedef struct {
+    guint64 frames;
+    /* Which second, minute or hour since the epoch each bucket holds, -1
+     * while the writer clears it */
+    gint64 tags[NUM_BUCKETS];
+    /* Per bucket, frames and then objects and tracks per series */
+    guint32 *buckets;
+    gchar pad[CACHE_LINE];
+} SourceCounters;
+
+typedef struct {
+    guint64 key;
+    guint64 last_seen;
+    /* Series this track has been counted in */
+    guint64 counted;
+} SeenTrack;
+
+struct _ClassCounters {
+    guint max_sources;
+    guint num_series;
+    guint64 track_ttl;
+    gchar **model_names;
+    /* Per series, the model's name and the label */
+    const gchar **series_model;
+    gchar **series_label;
+    /* First series and number of labels of the primary detector, and of the
+     * classifier with each unique_component_id */
+    guint primary_series;
+    guint primary_labels;
+    guint component_series[NUM_COMPONENTS];
+    guint component_labels[NUM_COMPONENTS];
+
+    /* max_sources * num_series, cache-line aligned within cells_mem */
+    Cell *cells;
+    gpointer cells_mem;
+    SourceCounters *sources;
+    guint bucket_stride;
+
+    /* Writer side */
+    GHashTable *tracks;
+    guint64 last_sweep;
+    guint32 *frame_objects;
+    guint32 *frame_tracks;
+};
+
+ClassCounters *class_counters_new(const CounterModel *models, guint num_models,
+                                  guint max_sources, guint64 track_ttl) {
+    ClassCounters *counters = g_new0(ClassCounters, 1);
+    guint series = 0;
+    gsize cells_size;
+
+    num_models = MIN(num_models, CLASS_COUNTERS_MAX_MODELS);
+    for (guint m = 0; m < num_models; m++) counters->num_series += models[m].num_labels;
+    counters->max_sources = max_sources;
+    counters->track_ttl = track_ttl;
+    counters->model_names = g_new0(gchar *, num_models + 1);
+    counters->series_model = g_new0(const gchar *, MAX(counters->num_series, 1));
+    counters->series_label = g_new0(gchar *, counters->num_series + 1);
+    for (guint m = 0; m < num_models; m++) {
+        const CounterModel *model = &models[m];
+
+        counters->model_names[m] = g_strdup(model->name);
+        if (model->primary) {
+            counters->primary_series = series;
+            counters->primary_labels = model->num_labels;
+        } else if (model->component_id < NUM_COMPONENTS) {
+            counters->component_series[model->component_id] = series;
+            counters->component_labels[model->component_id] = model->num_labels;
+        }
+        for (guint l = 0; l < model->num_labels; l++, series++) {
+            counters->series_model[series] = counters->model_names[m];
+            counters->series_label[series] = g_strdup(model->labels[l]);
+        }
+    }
+
+    cells_size = (gsize)max_sources * counters->num_series * sizeof(Cell);
+    counters->cells_mem = g_malloc0(cells_size + CACHE_LINE);
+    counters->cells = (Cell *)(((guintptr)counters->cells_mem + CACHE_LINE - 1) &
+                               ~(guintptr)(CACHE_LINE - 1));
+    counters->bucket_stride = 1 + 2 * counters->num_series;
+    counters->sources = g_new0(SourceCounters, MAX(max_sources, 1));
+    for (guint s = 0; s < max_sources; s++) {
+        SourceCounters *source = &counters->sources[s];
+        for (guint b = 0; b < NUM_BUCKETS; b++) source->tags[b] = -1;
+        source->buckets = g_new0(guint32, NUM_BUCKETS * counters->bucket_stride);
+    }
+
+    counters->tracks = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, g_free);
+    counters->frame_objects = g_new0(guint32, MAX(counters->num_series, 1));
+    counters->frame_tracks = g_new0(guint32, MAX(counters->num_series, 1));
+    return counters;
+}
+
+void class_counters_free(ClassCounters *counters) {
+    if (!counters) return;
+    for (guint s = 0; s < counters->max_sources; s++) {
+        g_free(counters->sources[s].buckets);
+    }
+    g_free(counters->sources);
+    g_free(counters->cells_mem);
+    g_hash_table_destroy(counters->tracks);
+    g_free(counters->frame_objects);
+    g_free(counters->frame_tracks);
+    g_strfreev(counters->model_names);
+    g_strfreev(counters->series_label);
+    g_free(counters->series_model);
+    g_free(counters);
+}
+
+static inline Cell *cell_of(ClassCounters *counters, guint source_id, guint series) {
+    return &counters->cells[(gsize)source_id * counters->num_series + series];
+}
+
+static inline void count(ClassCounters *counters, SeenTrack *track, guint series) {
+    counters->frame_objects[series]++;
+    if (!track || series >= CLASS_COUNTERS_MAX_TRACK_SERIES) return;
+    if (track->counted & (1ULL << series)) return;
+    track->counted |= 1ULL << series;
+    counters->frame_tracks[series]++;
+}
+
+/* The bucket of each ring for now_us, cleared first if it held an older
+ * second, minute or hour */
+static void current_buckets(ClassCounters *counters, SourceCounters *source,
+                            gint64 now_us, guint32 **buckets) {
+    for (guint w = 0; w < COUNTER_NUM_WINDOWS; w++) {
+        gint64 tag = now_us / bucket_us[w];
+        guint b = window_offset[w] + (guint)(tag % window_len[w]);
+        guint32 *bucket = source->buckets + (gsize)b * counters->bucket_stride;
+
+        if (source->tags[b] != tag) {
+            __atomic_store_n(&source->tags[b], -1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            for (guint i = 0; i < counters->bucket_stride; i++) {
+                __atomic_store_n(&bucket[i], 0, __ATOMIC_RELAXED);
+            }
+            __atomic_store_n(&source->tags[b], tag, __ATOMIC_RELEASE);
+        }
+        buckets[w] = bucket;
+    }
+}
+
+void class_counters_add_frame(ClassCounters *counters, const FrameRecord *frame,
+                              gint64 now_us) {
+    guint32 *objects = counters->frame_objects, *tracks = counters->frame_tracks;
+    guint32 *buckets[COUNTER_NUM_WINDOWS];
+    SourceCounters *source;
+
+    if (frame->source_id >= counters->max_sources) return;
+    source = &counters->sources[frame->source_id];
+    memset(objects, 0, counters->num_series * sizeof(*objects));
+    memset(tracks, 0, counters->num_series * sizeof(*tracks));
+
+    /* Count the frame on its own first, then publish once per series */
+    for (guint i = 0; i < frame->num_objects; i++) {
+        const ObjectRecord *obj = &frame->objects[i];
+        SeenTrack *track = NULL;
+
+        if (obj->object_id != RECORD_UNTRACKED_ID) {
+            guint64 key = record_track_key(frame->source_id, obj->object_id);
+            track = g_hash_table_lookup(counters->tracks, &key);
+            if (!track) {
+                track = g_new0(SeenTrack, 1);
+                track->key = key;
+                g_hash_table_insert(counters->tracks, &track->key, track);
+            }
+            track->last_seen = frame->pts;
+        }
+        if (obj->class_id >= 0 && (guint)obj->class_id < counters->primary_labels) {
+            count(counters, track, counters->primary_series + obj->class_id);
+        }
+        for (guint l = 0; l < MIN(obj->num_labels, RECORD_MAX_LABELS); l++) {
+            const RecordLabel *label = &obj->labels[l];
+            if (label->class_id >= counters->component_labels[label->component_id]) {
+                continue;
+            }
+            count(counters, track,
+                  counters->component_series[label->component_id] + label->class_id);
+        }
+    }
+
+    current_buckets(counters, source, now_us, buckets);
+    __atomic_fetch_add(&source->frames, 1, __ATOMIC_RELAXED);
+    for (guint w = 0; w < COUNTER_NUM_WINDOWS; w++) {
+        __atomic_fetch_add(&buckets[w][0], 1, __ATOMIC_RELAXED);
+    }
+    for (guint s = 0; s < counters->num_series; s++) {
+        Cell *cell = cell_of(counters, frame->source_id, s);
+
+        /* Only dirty the lines of series that changed */
+        if (cell->current != objects[s]) {
+            __atomic_store_n(&cell->current, objects[s], __ATOMIC_RELAXED);
+        }
+        if (!objects[s]) continue;
+        __atomic_fetch_add(&cell->objects, objects[s], __ATOMIC_RELAXED);
+        if (tracks[s]) __atomic_fetch_add(&cell->tracks, tracks[s], __ATOMIC_RELAXED);
+        for (guint w = 0; w < COUNTER_NUM_WINDOWS; w++) {
+            __atomic_fetch_add(&buckets[w][1 + 2 * s], objects[s], __ATOMIC_RELAXED);
+            if (tracks[s]) {
+                __atomic_fetch_add(&buckets[w][2 + 2 * s], tracks[s], __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    if (record_is_stale(counters->last_sweep, frame->pts, counters->track_ttl / 4)) {
+        GHashTableIter iter;
+        gpointer value;
+
+        g_hash_table_iter_init(&iter, counters->tracks);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            SeenTrack *track = (SeenTrack *)value;
+            if (record_is_stale(track->last_seen, frame->pts, counters->track_ttl)) {
+                g_hash_table_iter_remove(&iter);
+            }
+        }
+        counters->last_sweep = frame->pts;
+    }
+}
+
+guint class_counters_num_series(const ClassCounters *counters) {
+    return counters->num_series;
+}
+
+void class_counters_get_series(const ClassCounters *counters, guint series,
+                               const gchar **model, const gchar **label) {
+    *model = counters->series_model[series];
+    *label = counters->series_label[series];
+}
+
+guint64 class_counters_get_frames(ClassCounters *counters, guint source_id) {
+    if (source_id >= counters->max_sources) return 0;
+    return __atomic_load_n(&counters->sources[source_id].frames, __ATOMIC_RELAXED);
+}
+
+guint class_counters_get(ClassCounters *counters, guint source_id, guint series,
+                         CounterValues *total) {
+    Cell *cell = cell_of(counters, source_id, series);
+
+    total->objects = __atomic_load_n(&cell->objects, __ATOMIC_RELAXED);
+    total->tracks = __atomic_load_n(&cell->tracks, __ATOMIC_RELAXED);
+    return __atomic_load_n(&cell->current, __ATOMIC_RELAXED);
+}
+
+guint64 class_counters_get_window(ClassCounters *counters, guint source_id,
+                                  guint series, CounterWindow window, gint64 now_us,
+                                  CounterValues *sum) {
+    SourceCounters *source = &counters->sources[source_id];
+    gint64 now_tag = now_us / bucket_us[window];
+    guint64 frames = 0;
+
+    sum->objects = sum->tracks = 0;
+    for (guint i = 0; i < window_len[window]; i++) {
+        guint b = window_offset[window] + i;
+        const guint32 *bucket = source->buckets + (gsize)b * counters->bucket_stride;
+        gint64 tag = __atomic_load_n(&source->tags[b], __ATOMIC_ACQUIRE);
+        guint32 bucket_frames, objects = 0, tracks = 0;
+
+        if (tag < 0 || tag > now_tag || now_tag - tag >= window_len[window]) continue;
+        bucket_frames = __atomic_load_n(&bucket[0], __ATOMIC_RELAXED);
+        if (series < counters->num_series) {
+            objects = __atomic_load_n(&bucket[1 + 2 * series], __ATOMIC_RELAXED);
+            tracks = __atomic_load_n(&bucket[2 + 2 * series], __ATOMIC_RELAXED);
+        }
+        /* Skip a bucket the writer started clearing meanwhile */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&source->tags[b], __ATOMIC_RELAXED) != tag) continue;
+        frames += bucket_frames;
+        sum->objects += objects;
+        sum->tracks += tracks;
+    }
+    return frames;
+}
+
+static void append_label_value(GString *out, const gchar *value) {
+    for (const gchar *p = value; *p; p++) {
+        if (*p == '\\' || *p == '"') {
+            g_string_append_c(out, '\\');
+            g_string_append_c(out, *p);
+        } else if (*p == '\n') {
+            g_string_append(out, "\\n");
+        } else {
+            g_string_append_c(out, *p);
+        }
+    }
+}
+
+static void append_series_labels(ClassCounters *counters, GString *out,
+                                 guint source_id, guint series) {
+    g_string_append_printf(out, "{source=\"%u\",model=\"", source_id);
+    append_label_value(out, counters->series_model[series]);
+    g_string_append(out, "\",label=\"");
+    append_label_value(out, counters->series_label[series]);
+    g_string_append_c(out, '"');
+}
+
+static void append_header(GString *out, const gchar *name, const gchar *type,
+                          const gchar *help) {
+    g_string_append_printf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+typedef enum {
+    METRIC_CURRENT,
+    METRIC_DETECTIONS,
+    METRIC_TRACKS,
+} SeriesMetric;
+
+static void dump_series(ClassCounters *counters, GString *out, SeriesMetric metric,
+                        const gchar *name) {
+    for (guint s = 0; s < counters->max_sources; s++) {
+        if (!class_counters_get_frames(counters, s)) continue;
+        for (guint i = 0; i < counters->num_series; i++) {
+            CounterValues total;
+            guint current = class_counters_get(counters, s, i, &total);
+
+            g_string_append(out, name);
+            append_series_labels(counters, out, s, i);
+            g_string_append_printf(out, "} %" G_GUINT64_FORMAT "\n",
+                                   metric == METRIC_CURRENT      ? (guint64)current
+                                   : metric == METRIC_DETECTIONS ? total.objects
+                                                                 : total.tracks);
+        }
+    }
+}
+
+static void dump_windows(ClassCounters *counters, GString *out, gint64 now_us) {
+    append_header(out, "nvds_frames_window", "gauge",
+                  "Frames in the trailing window.");
+    for (guint s = 0; s < counters->max_sources; s++) {
+        if (!class_counters_get_frames(counters, s)) continue;
+        for (guint w = 0; w < COUNTER_NUM_WINDOWS; w++) {
+            CounterValues sum;
+            guint64 frames = class_counters_get_window(counters, s, 0, w, now_us, &sum);
+            g_string_append_printf(out,
+                                   "nvds_frames_window{source=\"%u\",window=\"%s\"} "
+                                   "%" G_GUINT64_FORMAT "\n",
+                                   s, window_names[w], frames);
+        }
+    }
+    if (!counters->num_series) return;
+
+    for (guint metric = METRIC_DETECTIONS; metric <= METRIC_TRACKS; metric++) {
+        const gchar *name = metric == METRIC_DETECTIONS ? "nvds_detections_window"
+                                                        : "nvds_tracks_window";
+        append_header(out, name, "gauge",
+                      metric == METRIC_DETECTIONS
+                          ? "Objects summed over the frames of the trailing window."
+                          : "Tracks first seen in the trailing window.");
+        for (guint s = 0; s < counters->max_sources; s++) {
+            if (!class_counters_get_frames(counters, s)) continue;
+            for (guint i = 0; i < counters->num_series; i++) {
+                for (guint w = 0; w < COUNTER_NUM_WINDOWS; w++) {
+                    CounterValues sum;
+
+                    class_counters_get_window(counters, s, i, w, now_us, &sum);
+                    g_string_append(out, name);
+                    append_series_labels(counters, out, s, i);
+                    g_string_append_printf(
+                        out, ",window=\"%s\"} %" G_GUINT64_FORMAT "\n", window_names[w],
+                        metric == METRIC_DETECTIONS ? sum.objects : sum.tracks);
+                }
+            }
+        }
+    }
+}
+
+void class_counters_dump_prometheus(ClassCounters *counters, GString *out,
+                                    gint64 now_us) {
+    append_header(out, "nvds_frames_total", "counter", "Frames counted per source.");
+    for (guint s = 0; s < counters->max_sources; s++) {
+        guint64 frames = class_counters_get_frames(counters, s);
+        if (!frames) continue;
+        g_string_append_printf(
+            out, "nvds_frames_total{source=\"%u\"} %" G_GUINT64_FORMAT "\n", s, frames);
+    }
+    if (counters->num_series) {
+        append_header(out, "nvds_objects", "gauge", "Objects in the latest frame.");
+        dump_series(counters, out, METRIC_CURRENT, "nvds_objects");
+        append_header(out, "nvds_detections_total", "counter",
+                      "Objects summed over frames.");
+        dump_series(counters, out, METRIC_DETECTIONS, "nvds_detections_total");
+        append_header(out, "nvds_tracks_total", "counter", "Distinct tracks.");
+        dump_series(counters, out, METRIC_TRACKS, "nvds_tracks_total");
+    }
+    dump_windows(counters, out, now_us);
+}
@@ -0,0 +1,83 @@
+#ifndef __CLASS_COUNTERS_H__
+#define __CLASS_COUNTERS_H__
+
+#include <glib.h>
+
+#include "frame_record.h"
+
+/* Object counts per source and class, for scraping while the pipeline runs.
+ *
+ * A series is one label of one model: a class of the primary detector, read
+ * from the objects' class_id, or a label of a secondary classifier, read
+ * from the objects' labels. For every source and series there are running
+ * totals of detections (objects summed over frames) and of distinct tracks,
+ * and the number in the source's latest frame, each on its own cache line.
+ * The same counts also go into three rings of buckets per source: the last
+ * 60 seconds, 60 minutes and 24 hours of wall-clock time. The writer adds a
+ * frame to the current bucket of each ring directly, so there is no rollup
+ * step, and a bucket is cleared when it is reused. Everything is counted per
+ * frame first and then published with relaxed atomic adds, without locks.
+ * There is a single writer, the thread calling class_counters_add_frame(),
+ * and any number of readers. */
+
+#define CLASS_COUNTERS_MAX_MODELS 8
+/* Series whose distinct tracks are counted, the rest only count detections */
+#define CLASS_COUNTERS_MAX_TRACK_SERIES 64
+#define CLASS_COUNTERS_DEFAULT_TRACK_TTL_NS (60 * 1000000000ULL)
+
+typedef struct {
+    /* Model name in the metrics, e.g. the pipeline.txt stage name */
+    const gchar *name;
+    /* Labels of the objects' class_id for the primary detector, otherwise of
+     * the labels with this unique_component_id */
+    gboolean primary;
+    guint component_id;
+    const gchar *const *labels;
+    guint num_labels;
+} CounterModel;
+
+typedef enum {
+    /* The last 60 one-second buckets, then minutes, then hours */
+    COUNTER_WINDOW_MINUTE,
+    COUNTER_WINDOW_HOUR,
+    COUNTER_WINDOW_DAY,
+    COUNTER_NUM_WINDOWS,
+} CounterWindow;
+
+typedef struct {
+    guint64 objects;
+    guint64 tracks;
+} CounterValues;
+
+typedef struct _ClassCounters ClassCounters;
+
+/* Copies the models and their labels. track_ttl is in ns of pts: a track
+ * seen again after that long counts again. */
+ClassCounters *class_counters_new(const CounterModel *models, guint num_models,
+                                  guint max_sources, guint64 track_ttl);
+void class_counters_free(ClassCounters *counters);
+
+/* Writer side. now_us is wall-clock time, g_get_real_time(). Frames of
+ * sources from max_sources on are ignored. */
+void class_counters_add_frame(ClassCounters *counters, const FrameRecord *frame,
+                              gint64 now_us);
+
+/* Reader side, from any thread. */
+guint class_counters_num_series(const ClassCounters *counters);
+void class_counters_get_series(const ClassCounters *counters, guint series,
+                               const gchar **model, const gchar **label);
+guint64 class_counters_get_frames(ClassCounters *counters, guint source_id);
+/* Totals since the start, and the number in the latest frame. */
+guint class_counters_get(ClassCounters *counters, guint source_id, guint series,
+                         CounterValues *total);
+/* Sums over the window ending at now_us. Returns the frames counted, which
+ * is all a series past the last gives. */
+guint64 class_counters_get_window(ClassCounters *counters, guint source_id,
+                                  guint series, CounterWindow window, gint64 now_us,
+                                  CounterValues *sum);
+
+/* Appends every source that has had frames in the Prometheus text format. */
+void class_counters_dump_prometheus(ClassCounters *counters, GString *out,
+                                    gint64 now_us);
+
+#endif
@@ -0,0 +1,386 @@
+#include "crowd.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/* Built for any x86, the AVX2 kernel is only picked when the CPU has it */
+#define CROWD_HAVE_AVX2 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+/* NEON is always there on AArch64 */
+#define CROWD_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Cells per axis of the proximity and density grids, a wider spread of
+ * objects gets bigger cells */
+#define CROWD_GRID_MAX_DIM 64
+
+/* One frame's objects as structure of arrays, so that a kernel loads eight
+ * (AVX2) or four (NEON) of each field at once */
+typedef struct {
+    gfloat *cx;
+    gfloat *cy;
+    gfloat *w;
+    gfloat *h;
+    gint32 *cls;
+    /* Index in the frame */
+    guint32 *index;
+    /* Non-zero once the object is too close to another */
+    guint32 *near;
+} CrowdArrays;
+
+typedef struct {
+    /* Too close when dx^2 + dy^2 < k * (h_i + h_j)^2 */
+    gfloat k;
+    guint close_pairs;
+    guint overlapping_pairs;
+} PairState;
+
+/* Compares object i with objects [j0, j1) */
+typedef void (*PairFunc)(const CrowdArrays *arrays, guint i, guint j0, guint j1,
+                         PairState *state);
+
+struct _CrowdAnalyzer {
+    CrowdConfig config;
+    guint capacity;
+    CrowdArrays gathered;
+    /* gathered, reordered by grid cell */
+    CrowdArrays sorted;
+    guint32 *cell_of;
+    guint32 cell_start[CROWD_GRID_MAX_DIM * CROWD_GRID_MAX_DIM + 1];
+    guint32 density[CROWD_GRID_MAX_DIM * CROWD_GRID_MAX_DIM];
+    PairFunc pairs;
+    const gchar *kernel_name;
+};
+
+void crowd_config_init(CrowdConfig *config, gint class_id) {
+    config->class_id = class_id;
+    config->distance_ratio = CROWD_DEFAULT_DISTANCE_RATIO;
+    config->grid_threshold = CROWD_DEFAULT_GRID_THRESHOLD;
+    config->density_cell = CROWD_DEFAULT_DENSITY_CELL;
+    config->kernel = CROWD_KERNEL_AUTO;
+}
+
+/* Also finishes the vector kernels' last few objects, so it must compute
+ * exactly what they do, in the same order */
+static void pairs_scalar(const CrowdArrays *a, guint i, guint j0, guint j1,
+                         PairState *state) {
+    gfloat xi = a->cx[i], yi = a->cy[i], wi = a->w[i], hi = a->h[i];
+    gint32 ci = a->cls[i];
+    guint32 any = 0;
+
+    for (guint j = j0; j < j1; j++) {
+        gfloat dx = a->cx[j] - xi, dy = a->cy[j] - yi;
+        gfloat d2 = dx * dx + dy * dy;
+        gfloat hs = hi + a->h[j];
+        gboolean same = a->cls[j] == ci;
+        gboolean close = same && d2 < state->k * (hs * hs);
+
+        if (same && fabsf(dx + dx) < wi + a->w[j] && fabsf(dy + dy) < hs) {
+            state->overlapping_pairs++;
+        }
+        if (close) {
+            state->close_pairs++;
+            a->near[j] = 1;
+            any = 1;
+        }
+    }
+    if (any) a->near[i] = 1;
+}
+
+#ifdef CROWD_HAVE_AVX2
+__attribute__((target("avx2,popcnt"))) static void pairs_avx2(const CrowdArrays *a,
+                                                       guint i, guint j0, guint j1,
+                                                       PairState *state) {
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 xi = _mm256_set1_ps(a->cx[i]), yi = _mm256_set1_ps(a->cy[i]);
+    __m256 wi = _mm256_set1_ps(a->w[i]), hi = _mm256_set1_ps(a->h[i]);
+    __m256 k = _mm256_set1_ps(state->k);
+    __m256i ci = _mm256_set1_epi32(a->cls[i]);
+    __m256 any = _mm256_setzero_ps();
+    guint j = j0;
+
+    for (; j + 8 <= j1; j += 8) {
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(a->cx + j), xi);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(a->cy + j), yi);
+        __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        __m256 hs = _mm256_add_ps(hi, _mm256_loadu_ps(a->h + j));
+        __m256 ws = _mm256_add_ps(wi, _mm256_loadu_ps(a->w + j));
+        __m256 same = _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+            _mm256_loadu_si256((const __m256i *)(a->cls + j)), ci));
+        __m256 close = _mm256_and_ps(
+            same, _mm256_cmp_ps(d2, _mm256_mul_ps(k, _mm256_mul_ps(hs, hs)),
+                                _CMP_LT_OQ));
+        __m256 ox = _mm256_cmp_ps(_mm256_andnot_ps(sign, _mm256_add_ps(dx, dx)), ws,
+                                  _CMP_LT_OQ);
+        __m256 oy = _mm256_cmp_ps(_mm256_andnot_ps(sign, _mm256_add_ps(dy, dy)), hs,
+                                  _CMP_LT_OQ);
+        gint close_bits = _mm256_movemask_ps(close);
+
+        state->overlapping_pairs += _mm_popcnt_u32(
+            _mm256_movemask_ps(_mm256_and_ps(same, _mm256_and_ps(ox, oy))));
+        if (close_bits) {
+            __m256i *near = (__m256i *)(a->near + j);
+            state->close_pairs += _mm_popcnt_u32(close_bits);
+            _mm256_storeu_si256(near, _mm256_or_si256(_mm256_loadu_si256(near),
+                                                      _mm256_castps_si256(close)));
+            any = _mm256_or_ps(any, close);
+        }
+    }
+    if (_mm256_movemask_ps(any)) a->near[i] = 1;
+    /* GCC leaves the upper halves dirty on the tail call, which stalls every
+     * SSE instruction in the scalar loop */
+    _mm256_zeroupper();
+    pairs_scalar(a, i, j, j1, state);
+}
+#endif
+
+#ifdef CROWD_HAVE_NEON
+static void pairs_neon(const CrowdArrays *a, guint i, guint j0, guint j1,
+                       PairState *state) {
+    float32x4_t xi = vdupq_n_f32(a->cx[i]), yi = vdupq_n_f32(a->cy[i]);
+    float32x4_t wi = vdupq_n_f32(a->w[i]), hi = vdupq_n_f32(a->h[i]);
+    float32x4_t k = vdupq_n_f32(state->k);
+    int32x4_t ci = vdupq_n_s32(a->cls[i]);
+    uint32x4_t any = vdupq_n_u32(0);
+    guint j = j0;
+
+    for (; j + 4 <= j1; j += 4) {
+        float32x4_t dx = vsubq_f32(vld1q_f32(a->cx + j), xi);
+        float32x4_t dy = vsubq_f32(vld1q_f32(a->cy + j), yi);
+        float32x4_t d2 = vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy));
+        float32x4_t hs = vaddq_f32(hi, vld1q_f32(a->h + j));
+        float32x4_t ws = vaddq_f32(wi, vld1q_f32(a->w + j));
+        uint32x4_t same = vceqq_s32(vld1q_s32(a->cls + j), ci);
+        uint32x4_t close =
+            vandq_u32(same, vcltq_f32(d2, vmulq_f32(k, vmulq_f32(hs, hs))));
+        uint32x4_t overlap =
+            vandq_u32(same, vandq_u32(vcltq_f32(vabsq_f32(vaddq_f32(dx, dx)), ws),
+                                      vcltq_f32(vabsq_f32(vaddq_f32(dy, dy)), hs)));
+
+        state->overlapping_pairs += vaddvq_u32(vshrq_n_u32(overlap, 31));
+        if (vmaxvq_u32(close)) {
+            state->close_pairs += vaddvq_u32(vshrq_n_u32(close, 31));
+            vst1q_u32(a->near + j, vorrq_u32(vld1q_u32(a->near + j), close));
+            any = vorrq_u32(any, close);
+        }
+    }
+    if (vmaxvq_u32(any)) a->near[i] = 1;
+    pairs_scalar(a, i, j, j1, state);
+}
+#endif
+
+static void arrays_init(CrowdArrays *arrays, guint capacity) {
+    arrays->cx = g_new(gfloat, capacity);
+    arrays->cy = g_new(gfloat, capacity);
+    arrays->w = g_new(gfloat, capacity);
+    arrays->h = g_new(gfloat, capacity);
+    arrays->cls = g_new(gint32, capacity);
+    arrays->index = g_new(guint32, capacity);
+    arrays->near = g_new(guint32, capacity);
+}
+
+static void arrays_clear(CrowdArrays *arrays) {
+    g_free(arrays->cx);
+    g_free(arrays->cy);
+    g_free(arrays->w);
+    g_free(arrays->h);
+    g_free(arrays->cls);
+    g_free(arrays->index);
+    g_free(arrays->near);
+}
+
+CrowdAnalyzer *crowd_analyzer_new(const CrowdConfig *config, guint max_objects) {
+    CrowdAnalyzer *analyzer = g_new0(CrowdAnalyzer, 1);
+
+    analyzer->config = *config;
+    analyzer->config.density_cell = MAX(config->density_cell, 1);
+    analyzer->capacity = MAX(max_objects, 1);
+    arrays_init(&analyzer->gathered, analyzer->capacity);
+    arrays_init(&analyzer->sorted, analyzer->capacity);
+    analyzer->cell_of = g_new(guint32, analyzer->capacity);
+
+    analyzer->pairs = pairs_scalar;
+    analyzer->kernel_name = "scalar";
+    if (config->kernel == CROWD_KERNEL_AUTO) {
+#if defined(CROWD_HAVE_AVX2)
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+            analyzer->pairs = pairs_avx2;
+            analyzer->kernel_name = "avx2";
+        }
+#elif defined(CROWD_HAVE_NEON)
+        analyzer->pairs = pairs_neon;
+        analyzer->kernel_name = "neon";
+#endif
+    }
+    return analyzer;
+}
+
+void crowd_analyzer_free(CrowdAnalyzer *analyzer) {
+    if (!analyzer) return;
+    arrays_clear(&analyzer->gathered);
+    arrays_clear(&analyzer->sorted);
+    g_free(analyzer->cell_of);
+    g_free(analyzer);
+}
+
+const gchar *crowd_analyzer_kernel_name(const CrowdAnalyzer *analyzer) {
+    return analyzer->kernel_name;
+}
+
+static guint gather(CrowdAnalyzer *analyzer, const FrameRecord *frame) {
+    CrowdArrays *a = &analyzer->gathered;
+    gint class_id = analyzer->config.class_id;
+    guint n = 0;
+
+    for (guint i = 0; i < frame->num_objects && n < analyzer->capacity; i++) {
+        const ObjectRecord *obj = &frame->objects[i];
+
+        if (class_id >= 0 && obj->class_id != class_id) continue;
+        a->cx[n] = obj->left + obj->width / 2;
+        a->cy[n] = obj->top + obj->height / 2;
+        a->w[n] = obj->width;
+        a->h[n] = obj->height;
+        a->cls[n] = obj->class_id;
+        a->index[n] = i;
+        a->near[n] = 0;
+        n++;
+    }
+    return n;
+}
+
+static void compare_all(CrowdAnalyzer *analyzer, guint n, PairState *state) {
+    for (guint i = 0; i + 1 < n; i++) {
+        analyzer->pairs(&analyzer->gathered, i, i + 1, n, state);
+    }
+}
+
+/* Buckets the objects into cells at least as wide as the furthest apart two of
+ * them can still be close or overlap, sorted cell by cell. Each cell is then
+ * compared with itself and its east, south-west, south and south-east
+ * neighbours; the other four neighbours compare with it in turn. In row-major
+ * order, the cell and its east neighbour, and the three cells below, are each
+ * one contiguous run of objects. Returns the arrays the results are in. */
+static CrowdArrays *compare_grid(CrowdAnalyzer *analyzer, guint n, PairState *state) {
+    const CrowdArrays *a = &analyzer->gathered;
+    CrowdArrays *s = &analyzer->sorted;
+    guint32 *start = analyzer->cell_start;
+    gfloat min_x = a->cx[0], max_x = min_x, min_y = a->cy[0], max_y = min_y;
+    gfloat max_w = 0, max_h = 0, cell;
+    guint cols, rows, num_cells;
+
+    for (guint i = 0; i < n; i++) {
+        min_x = MIN(min_x, a->cx[i]);
+        max_x = MAX(max_x, a->cx[i]);
+        min_y = MIN(min_y, a->cy[i]);
+        max_y = MAX(max_y, a->cy[i]);
+        max_w = MAX(max_w, a->w[i]);
+        max_h = MAX(max_h, a->h[i]);
+    }
+    cell = MAX(max_w, max_h);
+    cell = MAX(cell, (gfloat)analyzer->config.distance_ratio * max_h);
+    cell = MAX(cell, (max_x - min_x) / (CROWD_GRID_MAX_DIM - 1));
+    cell = MAX(cell, (max_y - min_y) / (CROWD_GRID_MAX_DIM - 1));
+    cell = MAX(cell, 1.0f);
+    cols = MIN((guint)((max_x - min_x) / cell) + 1, CROWD_GRID_MAX_DIM);
+    rows = MIN((guint)((max_y - min_y) / cell) + 1, CROWD_GRID_MAX_DIM);
+    num_cells = cols * rows;
+
+    /* Counting sort by cell */
+    memset(start, 0, (num_cells + 1) * sizeof(*start));
+    for (guint i = 0; i < n; i++) {
+        guint col = MIN((guint)((a->cx[i] - min_x) / cell), cols - 1);
+        guint row = MIN((guint)((a->cy[i] - min_y) / cell), rows - 1);
+        analyzer->cell_of[i] = row * cols + col;
+        start[analyzer->cell_of[i] + 1]++;
+    }
+    for (guint c = 0; c < num_cells; c++) start[c + 1] += start[c];
+    for (guint i = 0; i < n; i++) {
+        guint to = start[analyzer->cell_of[i]]++;
+        s->cx[to] = a->cx[i];
+        s->cy[to] = a->cy[i];
+        s->w[to] = a->w[i];
+        s->h[to] = a->h[i];
+        s->cls[to] = a->cls[i];
+        s->index[to] = a->index[i];
+        s->near[to] = 0;
+    }
+    /* Each start was advanced to the next cell's */
+    memmove(start + 1, start, num_cells * sizeof(*start));
+    start[0] = 0;
+
+    for (guint row = 0; row < rows; row++) {
+        for (guint col = 0; col < cols; col++) {
+            guint c = row * cols + col;
+            guint east_end = start[c + (col + 1 < cols ? 2 : 1)];
+            guint below_begin = 0, below_end = 0;
+
+            if (start[c] == start[c + 1]) continue;
+            if (row + 1 < rows) {
+                below_begin = start[c + cols - (col > 0 ? 1 : 0)];
+                below_end = start[c + cols + (col + 1 < cols ? 2 : 1)];
+            }
+            for (guint i = start[c]; i < start[c + 1]; i++) {
+                analyzer->pairs(s, i, i + 1, east_end, state);
+                if (below_begin < below_end) {
+                    analyzer->pairs(s, i, below_begin, below_end, state);
+                }
+            }
+        }
+    }
+    return s;
+}
+
+/* Most centres in one density_cell square, counted in a grid that is cleared
+ * again cell by cell rather than all at once */
+static guint peak_density(CrowdAnalyzer *analyzer, const CrowdArrays *a, guint n) {
+    gfloat cell = analyzer->config.density_cell;
+    guint peak = 0;
+
+    for (guint pass = 0; pass < 2; pass++) {
+        for (guint i = 0; i < n; i++) {
+            guint col = MIN((guint)(MAX(a->cx[i], 0) / cell), CROWD_GRID_MAX_DIM - 1);
+            guint row = MIN((guint)(MAX(a->cy[i], 0) / cell), CROWD_GRID_MAX_DIM - 1);
+            guint32 *count = &analyzer->density[row * CROWD_GRID_MAX_DIM + col];
+
+            if (pass == 0) {
+                ++*count;
+                peak = MAX(peak, *count);
+            } else {
+                *count = 0;
+            }
+        }
+    }
+    return peak;
+}
+
+void crowd_analyzer_process(CrowdAnalyzer *analyzer, const FrameRecord *frame,
+                            CrowdStats *stats, gboolean *crowded) {
+    gdouble ratio = analyzer->config.distance_ratio;
+    guint n = gather(analyzer, frame);
+    CrowdArrays *result = &analyzer->gathered;
+    PairState state = {0};
+
+    memset(stats, 0, sizeof(*stats));
+    if (crowded) memset(crowded, 0, frame->num_objects * sizeof(*crowded));
+    stats->objects = n;
+    if (n == 0) return;
+
+    /* (ratio * (h_i + h_j) / 2)^2 */
+    state.k = (gfloat)(ratio * ratio / 4);
+    if (n >= analyzer->config.grid_threshold) {
+        result = compare_grid(analyzer, n, &state);
+    } else {
+        compare_all(analyzer, n, &state);
+    }
+    stats->close_pairs = state.close_pairs;
+    stats->overlapping_pairs = state.overlapping_pairs;
+    for (guint i = 0; i < n; i++) {
+        if (!result->near[i]) continue;
+        stats->crowded++;
+        if (crowded) crowded[result->index[i]] = TRUE;
+    }
+    stats->peak_density = peak_density(analyzer, result, n);
+}
@@ -0,0 +1,67 @@
+#ifndef __CROWD_H__
+#define __CROWD_H__
+
+#include <glib.h>
+
+#include "frame_record.h"
+
+/* Crowd density and proximity of the objects in one frame.
+ *
+ * The objects of the configured class are gathered into structure-of-arrays
+ * buffers of box centres, sizes and classes, and every pair is compared with
+ * a vectorised kernel: AVX2 on x86 when the CPU has it, NEON on AArch64, and
+ * plain C otherwise. Two people are too close when their centres are nearer
+ * than distance_ratio times their mean box height, which follows the
+ * perspective of the scene without calibration, and overlap when their boxes
+ * intersect. Above grid_threshold objects, they are bucketed into a grid of
+ * cells as wide as the furthest two objects can interact, and only
+ * neighbouring cells are compared. Density is the most objects whose centre
+ * falls in any density_cell square of the frame. */
+
+#define CROWD_DEFAULT_DISTANCE_RATIO 1.0
+#define CROWD_DEFAULT_GRID_THRESHOLD 128
+#define CROWD_DEFAULT_DENSITY_CELL 256
+
+typedef enum {
+    /* The fastest kernel the CPU supports */
+    CROWD_KERNEL_AUTO,
+    CROWD_KERNEL_SCALAR,
+} CrowdKernel;
+
+typedef struct {
+    /* -1 compares objects of every class, pairs only count within a class */
+    gint class_id;
+    gdouble distance_ratio;
+    /* Objects from which the grid is used, 0 always, G_MAXUINT never */
+    guint grid_threshold;
+    guint density_cell;
+    CrowdKernel kernel;
+} CrowdConfig;
+
+typedef struct {
+    guint objects;
+    /* Pairs closer than the distance, and objects in at least one */
+    guint close_pairs;
+    guint crowded;
+    /* Pairs whose boxes intersect */
+    guint overlapping_pairs;
+    guint peak_density;
+} CrowdStats;
+
+typedef struct _CrowdAnalyzer CrowdAnalyzer;
+
+void crowd_config_init(CrowdConfig *config, gint class_id);
+
+/* Frames with more than max_objects objects of the class are cut short. */
+CrowdAnalyzer *crowd_analyzer_new(const CrowdConfig *config, guint max_objects);
+void crowd_analyzer_free(CrowdAnalyzer *analyzer);
+
+/* Analyses frame. When crowded is not NULL, crowded[i] is set for each of the
+ * frame's objects that is too close to another. */
+void crowd_analyzer_process(CrowdAnalyzer *analyzer, const FrameRecord *frame,
+                            CrowdStats *stats, gboolean *crowded);
+
+/* "avx2", "neon" or "scalar" */
+const gchar *crowd_analyzer_kernel_name(const CrowdAnalyzer *analyzer);
+
+#endif
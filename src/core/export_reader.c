@@ -0,0 +1,162 @@
+#include "export_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct _ExportReader {
+    gchar *path;
+    const ExportRingHeader *header;
+    const ExportRecord *records;
+    gsize map_size;
+    /* The file mapped, to notice a new writer's ring replacing it */
+    dev_t dev;
+    ino_t ino;
+    guint capacity;
+    guint mask;
+    guint64 next;
+    guint64 lost;
+};
+
+/* Maps the ring at path and checks its header */
+static gboolean map_ring(ExportReader *reader, const gchar *path, GError **error) {
+    const ExportRingHeader *header;
+    struct stat st;
+    gpointer map;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        g_set_error(error, EXPORT_RING_ERROR, 0, "Cannot open %s: %s", path,
+                    g_strerror(errno));
+        if (fd >= 0) close(fd);
+        return FALSE;
+    }
+    if ((gsize)st.st_size < EXPORT_RING_HEADER_SIZE) {
+        g_set_error(error, EXPORT_RING_ERROR, 0, "%s is not an export ring", path);
+        close(fd);
+        return FALSE;
+    }
+    map = mmap(NULL, (gsize)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        g_set_error(error, EXPORT_RING_ERROR, 0, "Cannot map %s: %s", path,
+                    g_strerror(errno));
+        return FALSE;
+    }
+
+    header = (const ExportRingHeader *)map;
+    if (memcmp(header->magic, EXPORT_RING_MAGIC, sizeof(header->magic)) ||
+        header->version != EXPORT_RING_VERSION ||
+        header->record_size != sizeof(ExportRecord) || header->capacity == 0 ||
+        (header->capacity & (header->capacity - 1)) ||
+        EXPORT_RING_HEADER_SIZE + (gsize)header->capacity * sizeof(ExportRecord) >
+            (gsize)st.st_size) {
+        g_set_error(error, EXPORT_RING_ERROR, 0,
+                    "%s is not a version %d export ring", path, EXPORT_RING_VERSION);
+        munmap(map, (gsize)st.st_size);
+        return FALSE;
+    }
+
+    if (reader->header) munmap((gpointer)reader->header, reader->map_size);
+    reader->header = header;
+    reader->records =
+        (const ExportRecord *)((const gchar *)map + EXPORT_RING_HEADER_SIZE);
+    reader->map_size = (gsize)st.st_size;
+    reader->dev = st.st_dev;
+    reader->ino = st.st_ino;
+    reader->capacity = header->capacity;
+    reader->mask = header->capacity - 1;
+    return TRUE;
+}
+
+ExportReader *export_reader_open(const gchar *path, gboolean from_oldest,
+                                 GError **error) {
+    ExportReader *reader = g_new0(ExportReader, 1);
+    guint64 write_seq;
+
+    if (!map_ring(reader, path, error)) {
+        g_free(reader);
+        return NULL;
+    }
+    reader->path = g_strdup(path);
+    write_seq = __atomic_load_n(&reader->header->write_seq, __ATOMIC_ACQUIRE);
+    reader->next = write_seq + 1;
+    if (from_oldest) {
+        reader->next =
+            write_seq < reader->capacity ? 1 : write_seq - reader->capacity + 1;
+    }
+    return reader;
+}
+
+void export_reader_close(ExportReader *reader) {
+    if (!reader) return;
+    munmap((gpointer)reader->header, reader->map_size);
+    g_free(reader->path);
+    g_free(reader);
+}
+
+/* Moves a reader that fell behind to the oldest record the writer may not be
+ * overwriting yet */
+static inline void skip_overwritten(ExportReader *reader, guint64 write_seq) {
+    guint64 oldest = write_seq - reader->capacity + 1;
+    if (write_seq >= reader->capacity && reader->next < oldest) {
+        reader->lost += oldest - reader->next;
+        reader->next = oldest;
+    }
+}
+
+/* Once the mapped ring is read out, moves to the file now at the path if a
+ * new writer has put one there, to follow it from its start */
+static gboolean follow_new_ring(ExportReader *reader) {
+    struct stat st;
+
+    if (stat(reader->path, &st) < 0 ||
+        (st.st_dev == reader->dev && st.st_ino == reader->ino)) {
+        return FALSE;
+    }
+    /* Gone again, or not a ring, the next call retries */
+    if (!map_ring(reader, reader->path, NULL)) return FALSE;
+    reader->next = 1;
+    return TRUE;
+}
+
+guint export_reader_read(ExportReader *reader, ExportRecord *records,
+                         guint max_records) {
+    guint64 write_seq = __atomic_load_n(&reader->header->write_seq, __ATOMIC_ACQUIRE);
+    guint n = 0;
+
+    if (reader->next > write_seq && follow_new_ring(reader)) {
+        write_seq = __atomic_load_n(&reader->header->write_seq, __ATOMIC_ACQUIRE);
+    }
+    skip_overwritten(reader, write_seq);
+
+    while (n < max_records && reader->next <= write_seq) {
+        const ExportRecord *record = &reader->records[reader->next & reader->mask];
+        guint64 seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+
+        memcpy(&records[n], record, sizeof(ExportRecord));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (seq == reader->next &&
+            __atomic_load_n(&record->seq, __ATOMIC_RELAXED) == seq) {
+            records[n].seq = seq;
+            reader->next++;
+            n++;
+            continue;
+        }
+        /* The writer has lapped us and is at seq, or is rewriting this very
+         * record when seq is 0 */
+        skip_overwritten(reader, MAX(seq, reader->next + reader->capacity));
+    }
+    return n;
+}
+
+guint64 export_reader_lost(const ExportReader *reader) { return reader->lost; }
+
+guint64 export_reader_position(const ExportReader *reader) { return reader->next; }
+
+guint64 export_reader_write_seq(const ExportReader *reader) {
+    return __atomic_load_n(&reader->header->write_seq, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,37 @@
+#ifndef __EXPORT_READER_H__
+#define __EXPORT_READER_H__
+
+#include <glib.h>
+
+#include "export_ring.h"
+
+/* Follows an export ring file written by ExportWriter.
+ *
+ * Each reader keeps its own position and never writes to the file, so any
+ * number of them can run next to the writer. A reader that falls more than
+ * the ring capacity behind skips ahead to the oldest record still in the ring
+ * and counts the records it missed as lost. When a new writer replaces the
+ * file, the reader finishes the old ring, then follows the new one from its
+ * first record. */
+
+typedef struct _ExportReader ExportReader;
+
+/* The reader starts after the latest record, or at the oldest one still in
+ * the ring when from_oldest is set. */
+ExportReader *export_reader_open(const gchar *path, gboolean from_oldest,
+                                 GError **error);
+void export_reader_close(ExportReader *reader);
+
+/* Copies up to max_records of the records published since the last call.
+ * Returns the number copied, 0 when the reader has caught up. */
+guint export_reader_read(ExportReader *reader, ExportRecord *records,
+                         guint max_records);
+
+/* Records overwritten before this reader got to them. */
+guint64 export_reader_lost(const ExportReader *reader);
+/* seq of the next record this reader will return. */
+guint64 export_reader_position(const ExportReader *reader);
+/* seq of the writer's latest record. */
+guint64 export_reader_write_seq(const ExportReader *reader);
+
+#endif
@@ -0,0 +1,106 @@
+#include "export_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+struct _ExportWriter {
+    ExportRingHeader *header;
+    ExportRecord *records;
+    gsize map_size;
+    guint mask;
+    guint64 seq;
+};
+
+ExportWriter *export_writer_open(const gchar *path, guint capacity, GError **error) {
+    ExportWriter *writer;
+    ExportRingHeader *header;
+    gsize map_size;
+    guint size = 1;
+    gpointer map;
+    gchar *tmp_path;
+    int fd;
+
+    while (size < capacity) size <<= 1;
+    map_size = EXPORT_RING_HEADER_SIZE + (gsize)size * sizeof(ExportRecord);
+
+    /* Built aside and renamed over path, so readers of a previous ring keep a
+     * valid mapping of the old file until they move to the new one */
+    tmp_path = g_strconcat(path, ".XXXXXX", NULL);
+    fd = g_mkstemp_full(tmp_path, O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)map_size) < 0) {
+        g_set_error(error, EXPORT_RING_ERROR, 0, "Cannot create %s: %s", tmp_path,
+                    g_strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+            g_unlink(tmp_path);
+        }
+        g_free(tmp_path);
+        return NULL;
+    }
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        g_set_error(error, EXPORT_RING_ERROR, 0, "Cannot map %s: %s", tmp_path,
+                    g_strerror(errno));
+        g_unlink(tmp_path);
+        g_free(tmp_path);
+        return NULL;
+    }
+
+    /* The file is fresh and zero-filled, so every record reads as unwritten
+     * until the header below makes it valid */
+    header = (ExportRingHeader *)map;
+    header->version = EXPORT_RING_VERSION;
+    header->record_size = sizeof(ExportRecord);
+    header->capacity = size;
+    header->writer_pid = (guint64)getpid();
+    __atomic_store_n(&header->write_seq, 0, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, EXPORT_RING_MAGIC, sizeof(header->magic));
+    if (g_rename(tmp_path, path) < 0) {
+        g_set_error(error, EXPORT_RING_ERROR, 0, "Cannot create %s: %s", path,
+                    g_strerror(errno));
+        munmap(map, map_size);
+        g_unlink(tmp_path);
+        g_free(tmp_path);
+        return NULL;
+    }
+    g_free(tmp_path);
+
+    writer = g_new0(ExportWriter, 1);
+    writer->header = header;
+    writer->records = (ExportRecord *)((gchar *)map + EXPORT_RING_HEADER_SIZE);
+    writer->map_size = map_size;
+    writer->mask = size - 1;
+    return writer;
+}
+
+void export_writer_close(ExportWriter *writer) {
+    if (!writer) return;
+    munmap(writer->header, writer->map_size);
+    g_free(writer);
+}
+
+void export_writer_write(ExportWriter *writer, const FrameRecord *frame) {
+    for (guint i = 0; i < frame->num_objects; i++) {
+        guint64 seq = ++writer->seq;
+        ExportRecord *record = &writer->records[seq & writer->mask];
+
+        /* Readers that copy the record while it changes see seq move */
+        __atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        record->source_id = frame->source_id;
+        record->frame_num = frame->frame_num;
+        record->pts = frame->pts;
+        record->object = frame->objects[i];
+        __atomic_store_n(&record->seq, seq, __ATOMIC_RELEASE);
+    }
+    /* One header update per frame keeps the shared cache line quiet */
+    __atomic_store_n(&writer->header->write_seq, writer->seq, __ATOMIC_RELEASE);
+}
+
+guint64 export_writer_seq(const ExportWriter *writer) { return writer->seq; }
@@ -0,0 +1,66 @@
+#ifndef __EXPORT_RING_H__
+#define __EXPORT_RING_H__
+
+#include <glib.h>
+
+#include "frame_record.h"
+
+/* Detection export through a memory-mapped ring file.
+ *
+ * The file is a 4 KiB header followed by a power-of-two number of 64 byte
+ * ExportRecords, one per detected object. A single writer fills the ring in
+ * order, overwriting the oldest records, and stamps each one with a sequence
+ * number starting at 1. Any number of readers map the same file (see
+ * export_reader.h) and follow the writer without syscalls or locks; a
+ * record's seq is cleared while it is rewritten, so readers detect both torn
+ * and overwritten records. A new writer never reuses the file: it builds its
+ * ring under a temporary name and renames it over the old one, and readers
+ * move to the new file once they have read what the old one holds.
+ * Everything is host-endian, readers must run on the same machine. */
+
+#define EXPORT_RING_MAGIC "NVDSRING"
+#define EXPORT_RING_VERSION 1
+#define EXPORT_RING_HEADER_SIZE 4096
+#define EXPORT_RING_DEFAULT_CAPACITY (1 << 20)
+
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 record_size;
+    guint32 capacity;
+    guint32 reserved;
+    /* Writer process id, changes when the writer restarts the ring */
+    guint64 writer_pid;
+    gchar pad0[64 - 32];
+    /* seq of the last complete record, 0 while the ring is empty */
+    guint64 write_seq;
+} ExportRingHeader;
+
+typedef struct {
+    /* 0 while the record is being written */
+    guint64 seq;
+    guint32 source_id;
+    gint32 frame_num;
+    guint64 pts;
+    ObjectRecord object;
+} ExportRecord;
+
+G_STATIC_ASSERT(sizeof(ExportRecord) == 64);
+G_STATIC_ASSERT(sizeof(ExportRingHeader) <= EXPORT_RING_HEADER_SIZE);
+
+#define EXPORT_RING_ERROR g_quark_from_static_string("export-ring-error")
+
+typedef struct _ExportWriter ExportWriter;
+
+/* Creates path, replacing any previous ring, and sizes it for capacity
+ * records, rounded up to a power of two. A tmpfs path such as /dev/shm keeps
+ * it off the disk. */
+ExportWriter *export_writer_open(const gchar *path, guint capacity, GError **error);
+void export_writer_close(ExportWriter *writer);
+
+/* Appends one record per object in frame. */
+void export_writer_write(ExportWriter *writer, const FrameRecord *frame);
+
+guint64 export_writer_seq(const ExportWriter *writer);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __FRAME_RECORD_H__
+#define __FRAME_RECORD_H__
+
+#include <glib.h>
+
+/* Compact, DeepStream-independent copy of the per-frame object metadata the
+ * analytics consume. The layout is also the on-disk record format used by
+ * meta_record.h, so fields are fixed-width and the struct has no padding. */
+
+#define RECORD_MAX_LABELS 4
+/* Tracker objects without an id, NvDsObjectMeta's UNTRACKED_OBJECT_ID */
+#define RECORD_UNTRACKED_ID G_MAXUINT64
+
+typedef struct {
+    /* unique_component_id of the classifier and its result_class_id */
+    guint8 component_id;
+    guint8 class_id;
+} RecordLabel;
+
+typedef struct {
+    guint64 object_id;
+    gint16 class_id;
+    guint8 num_labels;
+    guint8 reserved;
+    gfloat confidence;
+    gfloat left;
+    gfloat top;
+    gfloat width;
+    gfloat height;
+    RecordLabel labels[RECORD_MAX_LABELS];
+} ObjectRecord;
+
+G_STATIC_ASSERT(sizeof(ObjectRecord) == 40);
+
+typedef struct {
+    guint32 source_id;
+    gint32 frame_num;
+    guint64 pts;
+    guint32 num_objects;
+    /* Caller-owned array of at least num_objects entries */
+    ObjectRecord *objects;
+} FrameRecord;
+
+/* Tracker ids are only guaranteed unique within a stream, so fold the source
+ * id into the top bits of the key */
+static inline guint64 record_track_key(guint source_id, guint64 object_id) {
+    return object_id ^ ((guint64)source_id << 56);
+}
+
+/* Whether a track last seen at last has outlived ttl by now. Timestamps come
+ * from per-source PTS, so they are not globally monotonic and a now behind
+ * last never counts as stale */
+static inline gboolean record_is_stale(guint64 last, guint64 now, guint64 ttl) {
+    return now > last && now - last > ttl;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include "interval_control.h"
+
+/* Longest wait before retrying a step down, in hold periods */
+#define INTERVAL_MAX_BACKOFF 16
+
+struct _IntervalController {
+    IntervalControlConfig config;
+    guint interval;
+    /* Lowest interval the load currently allows */
+    guint load_floor;
+    guint calm_periods;
+    /* Calm periods wanted before the next step down. Doubles each time a
+     * step down brings the overload back, so a box that cannot sustain an
+     * interval does not keep retrying it every few seconds. */
+    guint down_hold;
+    gboolean stepped_down;
+    guint quiet_periods;
+    gboolean overloaded;
+};
+
+void interval_control_config_init(IntervalControlConfig *config, guint min_interval,
+                                  guint max_interval) {
+    config->min_interval = min_interval;
+    config->max_interval = MAX(min_interval, max_interval);
+    config->min_throughput = INTERVAL_CONTROL_DEFAULT_MIN_THROUGHPUT;
+    config->max_backlog = INTERVAL_CONTROL_DEFAULT_MAX_BACKLOG;
+    config->quiet_objects = INTERVAL_CONTROL_DEFAULT_QUIET_OBJECTS;
+    config->hold_periods = INTERVAL_CONTROL_DEFAULT_HOLD_PERIODS;
+}
+
+IntervalController *interval_controller_new(const IntervalControlConfig *config) {
+    IntervalController *controller = g_new0(IntervalController, 1);
+
+    controller->config = *config;
+    controller->config.max_interval = MAX(config->min_interval, config->max_interval);
+    controller->config.hold_periods = MAX(config->hold_periods, 1);
+    controller->interval = config->min_interval;
+    controller->load_floor = config->min_interval;
+    controller->down_hold = controller->config.hold_periods;
+    return controller;
+}
+
+void interval_controller_free(IntervalController *controller) { g_free(controller); }
+
+static gboolean is_overloaded(const IntervalControlConfig *config,
+                              const LoadSample *sample) {
+    if (sample->backlog > config->max_backlog) return TRUE;
+    return sample->input_fps > 0 &&
+           sample->output_fps < sample->input_fps * config->min_throughput;
+}
+
+guint interval_controller_update(IntervalController *controller,
+                                 const LoadSample *sample) {
+    const IntervalControlConfig *config = &controller->config;
+    guint target;
+
+    controller->overloaded = is_overloaded(config, sample);
+    if (controller->overloaded) {
+        /* Back off from what was running when the load got too high */
+        controller->load_floor =
+            MIN(MAX(controller->load_floor, controller->interval + 1),
+                config->max_interval);
+        controller->calm_periods = 0;
+        if (controller->stepped_down) {
+            controller->down_hold = MIN(controller->down_hold * 2,
+                                        config->hold_periods * INTERVAL_MAX_BACKOFF);
+            controller->stepped_down = FALSE;
+        }
+    } else if (++controller->calm_periods >= controller->down_hold) {
+        /* The last step down held */
+        if (controller->stepped_down) controller->down_hold = config->hold_periods;
+        controller->stepped_down = controller->load_floor > config->min_interval;
+        if (controller->stepped_down) controller->load_floor--;
+        controller->calm_periods = 0;
+    }
+
+    if (sample->objects_per_frame <= config->quiet_objects) {
+        controller->quiet_periods++;
+    } else {
+        controller->quiet_periods = 0;
+    }
+
+    target = controller->load_floor;
+    if (controller->quiet_periods >= config->hold_periods) {
+        target = config->max_interval;
+    }
+    controller->interval = target;
+    return target;
+}
+
+guint interval_controller_interval(const IntervalController *controller) {
+    return controller->interval;
+}
+
+gboolean interval_controller_overloaded(const IntervalController *controller) {
+    return controller->overloaded;
+}
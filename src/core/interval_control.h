@@ -0,0 +1,71 @@
+#ifndef __INTERVAL_CONTROL_H__
+#define __INTERVAL_CONTROL_H__
+
+#include <glib.h>
+
+/* Picks the primary detector's inference interval from measured load.
+ *
+ * Fed one LoadSample per control period. When the pipeline falls behind its
+ * input, or too many frames are in flight, the interval is raised by one at
+ * once and kept at least that high until the load has been calm for
+ * hold_periods periods in a row; the floor then comes down one step at a
+ * time, waiting twice as long after each step down that brought the overload
+ * back. Independently, a scene that has stayed at or under quiet_objects per
+ * frame for hold_periods periods runs at max_interval, and drops straight
+ * back to the floor as soon as it gets busier. Skipped frames rely on the
+ * tracker to carry the boxes.
+ *
+ * The controller is pure: the same samples always give the same intervals,
+ * so recorded traces can be replayed against it (see tools/). */
+
+#define INTERVAL_CONTROL_DEFAULT_MIN_THROUGHPUT 0.95
+#define INTERVAL_CONTROL_DEFAULT_MAX_BACKLOG 16
+#define INTERVAL_CONTROL_DEFAULT_QUIET_OBJECTS 0.5
+#define INTERVAL_CONTROL_DEFAULT_HOLD_PERIODS 5
+
+typedef struct {
+    guint min_interval;
+    guint max_interval;
+    /* Overloaded when output_fps drops below this share of input_fps */
+    gdouble min_throughput;
+    /* or when more frames than this are in flight */
+    guint max_backlog;
+    gdouble quiet_objects;
+    guint hold_periods;
+} IntervalControlConfig;
+
+typedef struct {
+    /* Frames per second entering and leaving the measured pipeline */
+    gdouble input_fps;
+    gdouble output_fps;
+    /* Frames waiting at the end of the period; the app counts those in its
+     * fullest queue */
+    guint backlog;
+    /* Mean objects per frame leaving the pipeline */
+    gdouble objects_per_frame;
+} LoadSample;
+
+/* Load traces are CSV with this header and one line per period: seconds
+ * since the start, the LoadSample fields, and the interval chosen for the
+ * next period. */
+#define INTERVAL_TRACE_HEADER \
+    "seconds,input_fps,output_fps,backlog,objects_per_frame,interval"
+
+typedef struct _IntervalController IntervalController;
+
+void interval_control_config_init(IntervalControlConfig *config, guint min_interval,
+                                  guint max_interval);
+
+IntervalController *interval_controller_new(const IntervalControlConfig *config);
+void interval_controller_free(IntervalController *controller);
+
+/* Returns the interval to use for the next period. */
+guint interval_controller_update(IntervalController *controller,
+                                 const LoadSample *sample);
+
+guint interval_controller_interval(const IntervalController *controller);
+
+/* Whether the last sample counted as overloaded. */
+gboolean interval_controller_overloaded(const IntervalController *controller);
+
+#endif
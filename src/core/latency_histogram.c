@@ -0,0 +1,70 @@
+#include "latency_histogram.h"
+
+#include <math.h>
+#include <string.h>
+
+#define SUB_COUNT (1u << LATENCY_HISTOGRAM_SUB_BITS)
+#define LINEAR_LIMIT (2u * SUB_COUNT)
+#define MAX_VALUE ((G_GUINT64_CONSTANT(1) << LATENCY_HISTOGRAM_MAX_BITS) - 1)
+
+static inline guint bucket_index(guint64 value) {
+    guint msb, shift;
+
+    if (value < LINEAR_LIMIT) return (guint)value;
+    if (value > MAX_VALUE) value = MAX_VALUE;
+    msb = 63 - __builtin_clzll(value);
+    shift = msb - LATENCY_HISTOGRAM_SUB_BITS;
+    return (shift + 1) * SUB_COUNT + (guint)((value >> shift) & (SUB_COUNT - 1));
+}
+
+/* Midpoint of the values that map to bucket i */
+static inline guint64 bucket_value(guint i) {
+    guint shift;
+
+    if (i < LINEAR_LIMIT) return i;
+    shift = i / SUB_COUNT - 1;
+    return ((guint64)(SUB_COUNT + i % SUB_COUNT) << shift) +
+           ((G_GUINT64_CONSTANT(1) << shift) >> 1);
+}
+
+void latency_histogram_reset(LatencyHistogram *hist) {
+    memset(hist->counts, 0, sizeof(hist->counts));
+}
+
+void latency_histogram_record(LatencyHistogram *hist, guint64 value_ns) {
+    __atomic_fetch_add(&hist->counts[bucket_index(value_ns)], 1, __ATOMIC_RELAXED);
+}
+
+void latency_histogram_drain(LatencyHistogram *src, LatencyHistogram *dst) {
+    for (guint i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        if (__atomic_load_n(&src->counts[i], __ATOMIC_RELAXED) == 0) continue;
+        dst->counts[i] += __atomic_exchange_n(&src->counts[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+guint64 latency_histogram_count(const LatencyHistogram *hist) {
+    guint64 total = 0;
+    for (guint i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) total += hist->counts[i];
+    return total;
+}
+
+guint64 latency_histogram_percentile(const LatencyHistogram *hist, gdouble q) {
+    guint64 total = latency_histogram_count(hist);
+    guint64 rank, seen = 0;
+
+    if (total == 0) return 0;
+    rank = (guint64)ceil(CLAMP(q, 0.0, 1.0) * total);
+    if (rank == 0) rank = 1;
+    for (guint i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) return bucket_value(i);
+    }
+    return bucket_value(LATENCY_HISTOGRAM_BUCKETS - 1);
+}
+
+guint64 latency_histogram_max(const LatencyHistogram *hist) {
+    for (guint i = LATENCY_HISTOGRAM_BUCKETS; i > 0; i--) {
+        if (hist->counts[i - 1]) return bucket_value(i - 1);
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef __LATENCY_HISTOGRAM_H__
+#define __LATENCY_HISTOGRAM_H__
+
+#include <glib.h>
+
+/* Log-linear histogram of durations in ns, in the style of HdrHistogram.
+ *
+ * Values below 64 ns are counted exactly; above that every power of two is
+ * split into 32 buckets, so a percentile is within about 3% of the true
+ * value. Values of 2^41 ns (about 36 minutes) and more land in the last
+ * bucket. Recording is a single relaxed atomic add and may run on any number
+ * of threads, while another thread drains the counts into a snapshot. */
+
+#define LATENCY_HISTOGRAM_SUB_BITS 5
+#define LATENCY_HISTOGRAM_MAX_BITS 41
+#define LATENCY_HISTOGRAM_BUCKETS                                        \
+    ((LATENCY_HISTOGRAM_MAX_BITS - LATENCY_HISTOGRAM_SUB_BITS + 1) <<   \
+     LATENCY_HISTOGRAM_SUB_BITS)
+
+typedef struct {
+    guint64 counts[LATENCY_HISTOGRAM_BUCKETS];
+} LatencyHistogram;
+
+void latency_histogram_reset(LatencyHistogram *hist);
+void latency_histogram_record(LatencyHistogram *hist, guint64 value_ns);
+
+/* Moves all counts from src into dst, leaving src empty. Counts recorded
+ * concurrently end up in exactly one of the two. */
+void latency_histogram_drain(LatencyHistogram *src, LatencyHistogram *dst);
+
+guint64 latency_histogram_count(const LatencyHistogram *hist);
+/* Value at quantile q (0 to 1), 0 for an empty histogram. */
+guint64 latency_histogram_percentile(const LatencyHistogram *hist, gdouble q);
+guint64 latency_histogram_max(const LatencyHistogram *hist);
+
+#endif
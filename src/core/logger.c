@@ -0,0 +1,708 @@
+#include "logger.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "spsc_ring.h"
+
+#define CACHE_LINE 64
+#define LOG_RECORD_SIZE 256
+/* How long the writer sleeps when every ring is empty */
+#define LOG_IDLE_US 2000
+/* Drops and suppressions are reported at most this often */
+#define LOG_LOSS_REPORT_US G_USEC_PER_SEC
+
+typedef enum {
+    SITE_UNPARSED,
+    /* Arguments are copied into the record, formatted by the writer */
+    SITE_DEFERRED,
+    /* The message is formatted into the record by the caller */
+    SITE_FORMAT_NOW,
+} SiteMode;
+
+typedef enum {
+    ARG_INT,
+    ARG_LONG,
+    ARG_LONG_LONG,
+    ARG_SIZE,
+    ARG_PTRDIFF,
+    ARG_INTMAX,
+    ARG_DOUBLE,
+    ARG_POINTER,
+    ARG_STRING,
+} ArgType;
+
+/* Numbers take 8 bytes each, strings a 2-byte length and their bytes */
+typedef struct {
+    const LogSite *site;
+    gint64 time_us;
+    guint32 thread;
+    guint16 len;
+    guint8 formatted;
+    guint8 reserved;
+    guint8 data[LOG_RECORD_SIZE - 24];
+} LogRecord;
+
+G_STATIC_ASSERT(sizeof(LogRecord) == LOG_RECORD_SIZE);
+
+typedef struct {
+    guint end;
+    ArgType type;
+} Conversion;
+
+typedef struct _LogThread {
+    SpscRing *ring;
+    guint id;
+    /* Written by the owning thread */
+    guint64 dropped;
+    /* Set while it fills a record, from before it checks that the writer runs */
+    gint writing;
+    /* Writer only */
+    guint64 dropped_reported;
+    struct _LogThread *next;
+} LogThread;
+
+/* Each on its own cache line, as every thread logging to it writes there */
+typedef struct {
+    /* Current second and the records counted in it */
+    gint64 window;
+    guint count;
+    guint rate_limit;
+    guint64 suppressed;
+    /* Writer only */
+    guint64 suppressed_reported;
+    gchar pad[CACHE_LINE - 32];
+} CategoryState;
+
+G_STATIC_ASSERT(sizeof(CategoryState) == CACHE_LINE);
+
+static const gchar *const category_names[LOG_NUM_CATEGORIES] = {
+    "app", "sources", "clips", "interval", "offline", "trajectories"};
+static const gchar *const level_names[LOG_NUM_LEVELS] = {"error", "warning", "info",
+                                                         "debug"};
+static const gchar *const level_tags[LOG_NUM_LEVELS] = {"ERROR", "WARN ", "INFO ",
+                                                        "DEBUG"};
+
+LogLevel logger_levels[LOG_NUM_CATEGORIES] = {[0 ... LOG_NUM_CATEGORIES - 1] =
+                                                  LOG_LEVEL_INFO};
+
+static struct {
+    gint running;
+    gboolean started;
+    LogFormat format;
+    guint ring_capacity;
+    FILE *file;
+    GThread *writer;
+    /* Registered rings, pushed at the front and never removed */
+    LogThread *threads;
+    guint num_threads;
+    guint64 written;
+    gint64 last_loss_report;
+    /* Serialises the records written at once */
+    GMutex lock;
+    CategoryState categories[LOG_NUM_CATEGORIES];
+} logger;
+
+static __thread LogThread *current_thread;
+
+/* Conversions of a printf format and the type each one takes. Returns -1 for
+ * formats whose arguments cannot be copied and formatted later. */
+static gint parse_format(const gchar *format, Conversion *conversions, guint max) {
+    guint n = 0;
+
+    for (const gchar *c = format; *c; c++) {
+        ArgType type = ARG_INT;
+
+        if (*c != '%') continue;
+        if (*++c == '%') continue;
+        while (*c && strchr("-+ #0'", *c)) c++;
+        while (g_ascii_isdigit(*c)) c++;
+        if (*c == '.') {
+            c++;
+            while (g_ascii_isdigit(*c)) c++;
+        }
+        if (*c == 'h') {
+            if (*++c == 'h') c++;
+        } else if (*c == 'l') {
+            type = ARG_LONG;
+            if (*++c == 'l') {
+                type = ARG_LONG_LONG;
+                c++;
+            }
+        } else if (*c == 'q' || *c == 'j' || *c == 'z' || *c == 't') {
+            type = *c == 'q'   ? ARG_LONG_LONG
+                   : *c == 'j' ? ARG_INTMAX
+                   : *c == 'z' ? ARG_SIZE
+                               : ARG_PTRDIFF;
+            c++;
+        }
+        switch (*c) {
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                break;
+            case 'c':
+                if (type != ARG_INT) return -1;
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                if (type != ARG_INT && type != ARG_LONG) return -1;
+                type = ARG_DOUBLE;
+                break;
+            case 's':
+                if (type != ARG_INT) return -1;
+                type = ARG_STRING;
+                break;
+            case 'p':
+                type = ARG_POINTER;
+                break;
+            default:
+                /* '*', %n, %m, long double, or the end of the string */
+                return -1;
+        }
+        if (n == max) return -1;
+        conversions[n].end = (guint)(c - format) + 1;
+        conversions[n].type = type;
+        n++;
+    }
+    return (gint)n;
+}
+
+static gint parse_site(LogSite *site) {
+    Conversion conversions[LOG_MAX_ARGS];
+    gint n = parse_format(site->format, conversions, LOG_MAX_ARGS);
+
+    if (n >= 0) {
+        for (gint i = 0; i < n; i++) site->arg_types[i] = conversions[i].type;
+        site->num_args = n;
+    }
+    /* Racing first calls store the same values */
+    __atomic_store_n(&site->mode, n >= 0 ? SITE_DEFERRED : SITE_FORMAT_NOW,
+                     __ATOMIC_RELEASE);
+    return n >= 0 ? SITE_DEFERRED : SITE_FORMAT_NOW;
+}
+
+static gboolean rate_allows(CategoryState *state, gint64 now_us) {
+    gint64 window = now_us / G_USEC_PER_SEC;
+    gint64 seen;
+
+    if (!state->rate_limit) return TRUE;
+    seen = __atomic_load_n(&state->window, __ATOMIC_RELAXED);
+    if (seen != window && __atomic_compare_exchange_n(&state->window, &seen, window,
+                                                      FALSE, __ATOMIC_RELAXED,
+                                                      __ATOMIC_RELAXED)) {
+        __atomic_store_n(&state->count, 0, __ATOMIC_RELAXED);
+    }
+    if (__atomic_fetch_add(&state->count, 1, __ATOMIC_RELAXED) < state->rate_limit) {
+        return TRUE;
+    }
+    __atomic_fetch_add(&state->suppressed, 1, __ATOMIC_RELAXED);
+    return FALSE;
+}
+
+/* Strings share what the arguments after them leave of the record: the
+ * numbers, and the length of every later string */
+static guint16 copy_args(LogRecord *record, const LogSite *site, va_list args) {
+    guint8 *p = record->data, *end = record->data + sizeof(record->data);
+    gssize fixed = 0;
+
+    for (guint i = 0; i < site->num_args; i++) {
+        fixed += site->arg_types[i] == ARG_STRING ? sizeof(guint16) : sizeof(gint64);
+    }
+    for (guint i = 0; i < site->num_args; i++) {
+        gint64 value = 0;
+        gdouble real;
+        gpointer pointer;
+        const gchar *string;
+        gssize avail;
+        guint16 len;
+
+        switch ((ArgType)site->arg_types[i]) {
+            case ARG_INT:
+                value = va_arg(args, int);
+                break;
+            case ARG_LONG:
+                value = va_arg(args, long);
+                break;
+            case ARG_LONG_LONG:
+                value = va_arg(args, long long);
+                break;
+            case ARG_SIZE:
+                value = (gint64)va_arg(args, size_t);
+                break;
+            case ARG_PTRDIFF:
+                value = va_arg(args, ptrdiff_t);
+                break;
+            case ARG_INTMAX:
+                value = va_arg(args, intmax_t);
+                break;
+            case ARG_DOUBLE:
+                real = va_arg(args, double);
+                memcpy(&value, &real, sizeof(value));
+                break;
+            case ARG_POINTER:
+                pointer = va_arg(args, gpointer);
+                value = (gint64)(guintptr)pointer;
+                break;
+            case ARG_STRING:
+                string = va_arg(args, const gchar *);
+                if (!string) string = "(null)";
+                fixed -= sizeof(len);
+                avail = (end - p) - (gssize)sizeof(len) - fixed;
+                len = avail > 0 ? (guint16)MIN(strlen(string), (gsize)avail) : 0;
+                memcpy(p, &len, sizeof(len));
+                memcpy(p + sizeof(len), string, len);
+                p += sizeof(len) + len;
+                continue;
+        }
+        memcpy(p, &value, sizeof(value));
+        p += sizeof(value);
+        fixed -= sizeof(value);
+    }
+    return (guint16)(p - record->data);
+}
+
+/* The message of a record, with each argument put back through its own piece
+ * of the format */
+static void format_message(const LogRecord *record, GString *out) {
+    const gchar *format = record->site->format;
+    Conversion conversions[LOG_MAX_ARGS];
+    const guint8 *p = record->data;
+    gchar piece[256], string[sizeof(record->data) + 1];
+    guint start = 0;
+    gint n;
+
+    if (record->formatted) {
+        g_string_append_len(out, (const gchar *)record->data, record->len);
+        return;
+    }
+    n = parse_format(format, conversions, LOG_MAX_ARGS);
+    for (gint i = 0; i < n; i++) {
+        guint len = conversions[i].end - start;
+        gint64 value;
+        gdouble real;
+        guint16 string_len;
+
+        if (conversions[i].type == ARG_STRING) {
+            memcpy(&string_len, p, sizeof(string_len));
+            memcpy(string, p + sizeof(string_len), string_len);
+            string[string_len] = '\0';
+            p += sizeof(string_len) + string_len;
+        } else {
+            memcpy(&value, p, sizeof(value));
+            p += sizeof(value);
+        }
+        /* Left as it is, the argument is still stepped over */
+        if (len >= sizeof(piece)) {
+            g_string_append_len(out, format + start, len);
+            start = conversions[i].end;
+            continue;
+        }
+        memcpy(piece, format + start, len);
+        piece[len] = '\0';
+        start = conversions[i].end;
+        switch (conversions[i].type) {
+            case ARG_INT:
+                g_string_append_printf(out, piece, (int)value);
+                break;
+            case ARG_LONG:
+                g_string_append_printf(out, piece, (long)value);
+                break;
+            case ARG_LONG_LONG:
+                g_string_append_printf(out, piece, (long long)value);
+                break;
+            case ARG_SIZE:
+                g_string_append_printf(out, piece, (size_t)value);
+                break;
+            case ARG_PTRDIFF:
+                g_string_append_printf(out, piece, (ptrdiff_t)value);
+                break;
+            case ARG_INTMAX:
+                g_string_append_printf(out, piece, (intmax_t)value);
+                break;
+            case ARG_DOUBLE:
+                memcpy(&real, &value, sizeof(real));
+                g_string_append_printf(out, piece, real);
+                break;
+            case ARG_POINTER:
+                g_string_append_printf(out, piece, (gpointer)(guintptr)value);
+                break;
+            case ARG_STRING:
+                g_string_append_printf(out, piece, string);
+                break;
+        }
+    }
+    /* The rest has no conversions left, only %% */
+    for (const gchar *c = format + start; *c; c++) {
+        g_string_append_c(out, *c);
+        if (c[0] == '%' && c[1] == '%') c++;
+    }
+}
+
+static void append_json_string(GString *out, const gchar *value, gsize len) {
+    g_string_append_c(out, '"');
+    for (gsize i = 0; i < len; i++) {
+        guchar c = (guchar)value[i];
+
+        if (c == '"' || c == '\\') {
+            g_string_append_c(out, '\\');
+            g_string_append_c(out, c);
+        } else if (c < 0x20) {
+            g_string_append_printf(out, "\\u%04x", c);
+        } else {
+            g_string_append_c(out, c);
+        }
+    }
+    g_string_append_c(out, '"');
+}
+
+/* Formats the whole line into line, which holds the message on entry */
+static void finish_line(GString *line, LogLevel level, LogCategory category,
+                        guint thread, gint64 time_us) {
+    if (logger.format == LOG_FORMAT_JSON) {
+        gchar *message = g_strndup(line->str, line->len);
+
+        g_string_printf(line,
+                        "{\"ts\":%" G_GINT64_FORMAT ".%06d,\"level\":\"%s\","
+                        "\"category\":\"%s\",\"thread\":%u,\"message\":",
+                        time_us / G_USEC_PER_SEC, (gint)(time_us % G_USEC_PER_SEC),
+                        level_names[level], category_names[category], thread);
+        append_json_string(line, message, strlen(message));
+        g_string_append(line, "}\n");
+        g_free(message);
+    } else {
+        time_t seconds = (time_t)(time_us / G_USEC_PER_SEC);
+        struct tm local;
+        gchar prefix[64];
+
+        localtime_r(&seconds, &local);
+        g_snprintf(prefix, sizeof(prefix), "%02d:%02d:%02d.%03d %s %s: ",
+                   local.tm_hour, local.tm_min, local.tm_sec,
+                   (gint)(time_us % G_USEC_PER_SEC / 1000), level_tags[level],
+                   category_names[category]);
+        g_string_prepend(line, prefix);
+        g_string_append_c(line, '\n');
+    }
+}
+
+static FILE *stream_for(LogLevel level) {
+    if (logger.file) return logger.file;
+    return level <= LOG_LEVEL_WARNING ? stderr : stdout;
+}
+
+static void write_line(const GString *line, LogLevel level) {
+    fwrite(line->str, 1, line->len, stream_for(level));
+}
+
+/* Before the writer runs, or after it stopped */
+static void write_now(const LogSite *site, va_list args) {
+    GString *line = g_string_sized_new(256);
+
+    g_string_vprintf(line, site->format, args);
+    finish_line(line, site->level, site->category, 0, g_get_real_time());
+    g_mutex_lock(&logger.lock);
+    write_line(line, site->level);
+    fflush(stream_for(site->level));
+    g_mutex_unlock(&logger.lock);
+    __atomic_fetch_add(&logger.written, 1, __ATOMIC_RELAXED);
+    g_string_free(line, TRUE);
+}
+
+static LogThread *register_thread(void) {
+    LogThread *thread = g_new0(LogThread, 1);
+
+    thread->ring = spsc_ring_new(logger.ring_capacity, sizeof(LogRecord));
+    thread->id = __atomic_add_fetch(&logger.num_threads, 1, __ATOMIC_RELAXED);
+    thread->next = __atomic_load_n(&logger.threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&logger.threads, &thread->next, thread, TRUE,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    current_thread = thread;
+    return thread;
+}
+
+void logger_write(LogSite *site, ...) {
+    gint mode = __atomic_load_n(&site->mode, __ATOMIC_ACQUIRE);
+    gint64 now_us = g_get_real_time();
+    LogThread *thread;
+    LogRecord *record;
+    va_list args;
+
+    if (!rate_allows(&logger.categories[site->category], now_us)) return;
+    va_start(args, site);
+    if (!g_atomic_int_get(&logger.running)) {
+        write_now(site, args);
+        va_end(args);
+        return;
+    }
+    if (mode == SITE_UNPARSED) mode = parse_site(site);
+    thread = current_thread ? current_thread : register_thread();
+    /* Pairs with logger_stop(): either it waits for this record, or this
+     * call sees the writer stopped */
+    __atomic_store_n(&thread->writing, TRUE, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&logger.running, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&thread->writing, FALSE, __ATOMIC_RELEASE);
+        write_now(site, args);
+        va_end(args);
+        return;
+    }
+    record = spsc_ring_reserve(thread->ring);
+    if (!record) {
+        __atomic_store_n(&thread->dropped, thread->dropped + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&thread->writing, FALSE, __ATOMIC_RELEASE);
+        va_end(args);
+        return;
+    }
+    record->site = site;
+    record->time_us = now_us;
+    record->thread = thread->id;
+    if (mode == SITE_DEFERRED) {
+        record->formatted = FALSE;
+        record->len = copy_args(record, site, args);
+    } else {
+        gint len = g_vsnprintf((gchar *)record->data, sizeof(record->data),
+                               site->format, args);
+        record->formatted = TRUE;
+        record->len = (guint16)CLAMP(len, 0, (gint)sizeof(record->data) - 1);
+    }
+    va_end(args);
+    spsc_ring_commit(thread->ring);
+    __atomic_store_n(&thread->writing, FALSE, __ATOMIC_RELEASE);
+}
+
+static void report_losses(GString *line, gboolean force) {
+    gint64 now_us = g_get_real_time();
+    guint64 dropped = 0;
+
+    if (!force && now_us - logger.last_loss_report < LOG_LOSS_REPORT_US) return;
+    logger.last_loss_report = now_us;
+    for (LogThread *t = __atomic_load_n(&logger.threads, __ATOMIC_ACQUIRE); t;
+         t = t->next) {
+        guint64 total = __atomic_load_n(&t->dropped, __ATOMIC_RELAXED);
+        dropped += total - t->dropped_reported;
+        t->dropped_reported = total;
+    }
+    if (dropped) {
+        g_string_printf(line, "%" G_GUINT64_FORMAT " records dropped, a ring was full",
+                        dropped);
+        finish_line(line, LOG_LEVEL_WARNING, LOG_CAT_APP, 0, now_us);
+        write_line(line, LOG_LEVEL_WARNING);
+    }
+    for (guint c = 0; c < LOG_NUM_CATEGORIES; c++) {
+        CategoryState *state = &logger.categories[c];
+        guint64 total = __atomic_load_n(&state->suppressed, __ATOMIC_RELAXED);
+
+        if (total == state->suppressed_reported) continue;
+        g_string_printf(line,
+                        "%" G_GUINT64_FORMAT " records over the limit of %u/s "
+                        "suppressed",
+                        total - state->suppressed_reported, state->rate_limit);
+        finish_line(line, LOG_LEVEL_WARNING, (LogCategory)c, 0, now_us);
+        write_line(line, LOG_LEVEL_WARNING);
+        state->suppressed_reported = total;
+    }
+}
+
+/* Writes the oldest record at the head of any ring until all are empty */
+static guint drain(GString *line) {
+    guint written = 0;
+
+    for (;;) {
+        LogThread *oldest = NULL;
+        LogRecord *record = NULL;
+
+        for (LogThread *t = __atomic_load_n(&logger.threads, __ATOMIC_ACQUIRE); t;
+             t = t->next) {
+            LogRecord *head = spsc_ring_peek(t->ring);
+            if (head && (!record || head->time_us < record->time_us)) {
+                record = head;
+                oldest = t;
+            }
+        }
+        if (!record) return written;
+        g_string_truncate(line, 0);
+        format_message(record, line);
+        finish_line(line, record->site->level, record->site->category,
+                    record->thread, record->time_us);
+        write_line(line, record->site->level);
+        spsc_ring_release(oldest->ring);
+        written++;
+    }
+}
+
+/* Writes out what the rings hold, and the losses when due or when final */
+static guint write_pending(GString *line, gboolean final) {
+    guint written = drain(line);
+
+    report_losses(line, final);
+    __atomic_fetch_add(&logger.written, written, __ATOMIC_RELAXED);
+    if (written) {
+        fflush(stream_for(LOG_LEVEL_ERROR));
+        fflush(stream_for(LOG_LEVEL_DEBUG));
+    }
+    return written;
+}
+
+static gpointer writer_main(gpointer data) {
+    GString *line = g_string_sized_new(512);
+
+    while (g_atomic_int_get(&logger.running)) {
+        if (!write_pending(line, FALSE)) g_usleep(LOG_IDLE_US);
+    }
+    g_string_free(line, TRUE);
+    return NULL;
+}
+
+void logger_config_init(LogConfig *config) {
+    memset(config, 0, sizeof(*config));
+    for (guint c = 0; c < LOG_NUM_CATEGORIES; c++) {
+        config->levels[c] = LOG_LEVEL_INFO;
+        config->rate_limits[c] = LOG_DEFAULT_RATE_LIMIT;
+    }
+    config->ring_capacity = LOG_DEFAULT_RING_CAPACITY;
+    config->format = LOG_FORMAT_TEXT;
+}
+
+static gint find_name(const gchar *const *names, guint count, const gchar *name) {
+    for (guint i = 0; i < count; i++) {
+        if (!g_ascii_strcasecmp(names[i], name)) return (gint)i;
+    }
+    return -1;
+}
+
+/* Calls set for each category an item names, with the value's text */
+static gboolean parse_spec(LogConfig *config, const gchar *spec, const gchar *what,
+                           gboolean (*set)(LogConfig *, guint, const gchar *),
+                           GError **error) {
+    gchar **items = g_strsplit(spec, ",", -1);
+    gboolean ok = TRUE;
+
+    for (gchar **item = items; ok && *item; item++) {
+        gchar *value = strchr(*item, '=');
+        gint category = -1;
+
+        if (value) {
+            *value++ = '\0';
+            category = find_name(category_names, LOG_NUM_CATEGORIES, g_strstrip(*item));
+            if (category < 0) {
+                g_set_error(error, LOGGER_ERROR, 0, "Unknown log category '%s'", *item);
+                ok = FALSE;
+                break;
+            }
+        }
+        value = g_strstrip(value ? value : *item);
+        for (guint c = 0; ok && c < LOG_NUM_CATEGORIES; c++) {
+            if (category >= 0 && c != (guint)category) continue;
+            ok = set(config, c, value);
+        }
+        if (!ok) g_set_error(error, LOGGER_ERROR, 0, "Bad log %s '%s'", what, value);
+    }
+    g_strfreev(items);
+    return ok;
+}
+
+static gboolean set_level(LogConfig *config, guint category, const gchar *value) {
+    gint level = find_name(level_names, LOG_NUM_LEVELS, value);
+
+    if (level < 0) return FALSE;
+    config->levels[category] = (LogLevel)level;
+    return TRUE;
+}
+
+static gboolean set_rate(LogConfig *config, guint category, const gchar *value) {
+    gchar *end;
+    guint64 rate = g_ascii_strtoull(value, &end, 10);
+
+    if (!*value || *end || rate > G_MAXUINT) return FALSE;
+    config->rate_limits[category] = (guint)rate;
+    return TRUE;
+}
+
+gboolean logger_config_parse_levels(LogConfig *config, const gchar *spec,
+                                    GError **error) {
+    return parse_spec(config, spec, "level", set_level, error);
+}
+
+gboolean logger_config_parse_rates(LogConfig *config, const gchar *spec,
+                                   GError **error) {
+    return parse_spec(config, spec, "rate", set_rate, error);
+}
+
+gboolean logger_start(const LogConfig *config, GError **error) {
+    g_return_val_if_fail(!logger.started, FALSE);
+    g_return_val_if_fail(
+        config->ring_capacity && !(config->ring_capacity & (config->ring_capacity - 1)),
+        FALSE);
+
+    if (config->path) {
+        logger.file = g_fopen(config->path, "a");
+        if (!logger.file) {
+            g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                        "Cannot open %s: %s", config->path, g_strerror(errno));
+            return FALSE;
+        }
+    }
+    for (guint c = 0; c < LOG_NUM_CATEGORIES; c++) {
+        logger_levels[c] = config->levels[c];
+        logger.categories[c].rate_limit = config->rate_limits[c];
+    }
+    logger.format = config->format;
+    logger.ring_capacity = config->ring_capacity;
+    logger.started = TRUE;
+    g_atomic_int_set(&logger.running, TRUE);
+    logger.writer = g_thread_new("logger", writer_main, NULL);
+    /* Early exits still write out what was queued */
+    atexit(logger_stop);
+    return TRUE;
+}
+
+void logger_stop(void) {
+    GString *line;
+
+    if (!g_atomic_int_get(&logger.running)) return;
+    __atomic_store_n(&logger.running, FALSE, __ATOMIC_SEQ_CST);
+    g_thread_join(logger.writer);
+    logger.writer = NULL;
+
+    /* Records started while the writer ran are committed within a few
+     * hundred ns, wait for them and write them out here. Calls from now on
+     * format on their own thread. Rings stay allocated, a thread may still be
+     * holding one. */
+    for (LogThread *t = __atomic_load_n(&logger.threads, __ATOMIC_SEQ_CST); t;
+         t = t->next) {
+        while (__atomic_load_n(&t->writing, __ATOMIC_ACQUIRE)) g_thread_yield();
+    }
+    line = g_string_sized_new(512);
+    write_pending(line, TRUE);
+    g_string_free(line, TRUE);
+    fflush(stream_for(LOG_LEVEL_ERROR));
+}
+
+void logger_get_stats(LogStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->written = __atomic_load_n(&logger.written, __ATOMIC_RELAXED);
+    for (LogThread *t = __atomic_load_n(&logger.threads, __ATOMIC_ACQUIRE); t;
+         t = t->next) {
+        stats->dropped += __atomic_load_n(&t->dropped, __ATOMIC_RELAXED);
+    }
+    for (guint c = 0; c < LOG_NUM_CATEGORIES; c++) {
+        stats->suppressed +=
+            __atomic_load_n(&logger.categories[c].suppressed, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef __LOGGER_H__
+#define __LOGGER_H__
+
+#include <glib.h>
+
+/* Logging that streaming threads can afford.
+ *
+ * LOG_INFO(LOG_CAT_SOURCES, "Source %u is down", id) and friends first
+ * compare the level with the category's, so a disabled call costs a load and
+ * a branch. An enabled one copies the format's arguments, strings included,
+ * into a fixed-size binary record in a ring owned by the calling thread, and
+ * returns. Nothing is formatted, locked or written on that thread: a
+ * background thread merges the rings in time order, formats the records as
+ * text or JSON lines and writes them out. A full ring drops the record, and
+ * each category has a limit of records per second over which they are
+ * suppressed. Both are counted and reported in the log itself.
+ *
+ * Formats with '*' widths, %n or long doubles, or with more than
+ * LOG_MAX_ARGS arguments, are formatted on the calling thread instead. Until
+ * logger_start(), and after logger_stop(), records are formatted and written
+ * at once. */
+
+/* Records per thread ring, a power of two */
+#define LOG_DEFAULT_RING_CAPACITY 1024
+#define LOG_DEFAULT_RATE_LIMIT 100
+#define LOG_MAX_ARGS 8
+
+#define LOGGER_ERROR g_quark_from_static_string("logger-error")
+
+typedef enum {
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG,
+    LOG_NUM_LEVELS,
+} LogLevel;
+
+typedef enum {
+    /* Bus messages and the application itself */
+    LOG_CAT_APP,
+    /* Source branches, their pads, outages and recoveries */
+    LOG_CAT_SOURCES,
+    LOG_CAT_CLIPS,
+    /* Adaptive pgie interval decisions */
+    LOG_CAT_INTERVAL,
+    LOG_CAT_OFFLINE,
+    /* Trajectory segments written by the analytics workers */
+    LOG_CAT_TRAJECTORIES,
+    LOG_NUM_CATEGORIES,
+} LogCategory;
+
+typedef enum {
+    /* 12:00:01.250 WARN  sources: message */
+    LOG_FORMAT_TEXT,
+    /* {"ts":...,"level":"warning","category":"sources","thread":2,"message":...} */
+    LOG_FORMAT_JSON,
+} LogFormat;
+
+typedef struct {
+    LogLevel levels[LOG_NUM_CATEGORIES];
+    /* Records per second, 0 for no limit */
+    guint rate_limits[LOG_NUM_CATEGORIES];
+    guint ring_capacity;
+    LogFormat format;
+    /* File to append to, NULL for stderr for errors and warnings and stdout
+     * for the rest */
+    const gchar *path;
+} LogConfig;
+
+typedef struct {
+    guint64 written;
+    /* Rings were full */
+    guint64 dropped;
+    /* Over a category's rate limit */
+    guint64 suppressed;
+} LogStats;
+
+/* One per LOG_* call, made by the macros. */
+typedef struct {
+    LogCategory category;
+    LogLevel level;
+    const gchar *format;
+    /* Parsed on first use */
+    gint mode;
+    guint num_args;
+    guint8 arg_types[LOG_MAX_ARGS];
+} LogSite;
+
+/* Maximum level enabled per category, read on every call */
+extern LogLevel logger_levels[LOG_NUM_CATEGORIES];
+
+/* Everything at info, LOG_DEFAULT_RATE_LIMIT records per second, text. */
+void logger_config_init(LogConfig *config);
+/* LEVEL for every category, CATEGORY=LEVEL, or a comma-separated list of
+ * both, e.g. "warning,sources=debug". */
+gboolean logger_config_parse_levels(LogConfig *config, const gchar *spec,
+                                    GError **error);
+/* N records per second for every category, CATEGORY=N, or a list as above. */
+gboolean logger_config_parse_rates(LogConfig *config, const gchar *spec,
+                                   GError **error);
+
+/* Starts the writer thread. Only called once, logger_stop() runs at exit if
+ * it was not called before. */
+gboolean logger_start(const LogConfig *config, GError **error);
+/* Writes out every record logged so far and stops the writer thread. */
+void logger_stop(void);
+void logger_get_stats(LogStats *stats);
+
+void logger_write(LogSite *site, ...);
+
+/* Lets the compiler check the arguments against the format */
+static inline void G_GNUC_PRINTF(1, 2) logger_check_format(const gchar *format, ...) {}
+
+#define LOG_AT(category, level, format, ...)                                    \
+    do {                                                                        \
+        static LogSite log_site_ = {(category), (level), (format), 0, 0, {0}};  \
+        if (0) logger_check_format(format, ##__VA_ARGS__);                      \
+        if ((level) <= logger_levels[(category)]) {                             \
+            logger_write(&log_site_, ##__VA_ARGS__);                            \
+        }                                                                       \
+    } while (0)
+
+#define LOG_ERROR(category, ...) LOG_AT(category, LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARNING(category, ...) LOG_AT(category, LOG_LEVEL_WARNING, __VA_ARGS__)
+#define LOG_INFO(category, ...) LOG_AT(category, LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(category, ...) LOG_AT(category, LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#endif
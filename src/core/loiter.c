@@ -0,0 +1,70 @@
+#include "loiter.h"
+
+#include "track_store.h"
+
+struct _LoiterAnalytics {
+    LoiterConfig config;
+    TrackStore *tracks;
+};
+
+void loiter_config_init(LoiterConfig *config, gint person_class_id) {
+    config->person_class_id = person_class_id;
+    config->speed_threshold = LOITER_DEFAULT_SPEED_THRESHOLD;
+    config->window = LOITER_DEFAULT_WINDOW_NS;
+    config->ttl = LOITER_DEFAULT_TTL_NS;
+    config->max_tracks = LOITER_DEFAULT_MAX_TRACKS;
+    config->history_len = LOITER_DEFAULT_HISTORY_LEN;
+}
+
+LoiterAnalytics *loiter_analytics_new(const LoiterConfig *config) {
+    LoiterAnalytics *loiter = g_new0(LoiterAnalytics, 1);
+    loiter->config = *config;
+    loiter->tracks = track_store_new(config->max_tracks, config->history_len,
+                                     config->window, config->ttl);
+    return loiter;
+}
+
+void loiter_analytics_free(LoiterAnalytics *loiter) {
+    if (!loiter) return;
+    track_store_free(loiter->tracks);
+    g_free(loiter);
+}
+
+guint loiter_analytics_process(LoiterAnalytics *loiter, const FrameRecord *frame,
+                               gboolean *loitering) {
+    const LoiterConfig *config = &loiter->config;
+    guint num_loitering = 0;
+
+    for (guint i = 0; i < frame->num_objects; i++) {
+        const ObjectRecord *obj = &frame->objects[i];
+        TrackState *track;
+
+        loitering[i] = FALSE;
+        if (obj->class_id != config->person_class_id ||
+            obj->object_id == RECORD_UNTRACKED_ID)
+            continue;
+
+        track = track_store_lookup(loiter->tracks,
+                                   record_track_key(frame->source_id, obj->object_id),
+                                   frame->pts);
+        /* Store is full, this person is not analysed until a slot frees */
+        if (!track) continue;
+
+        motion_stats_update(&track->motion, frame->pts, obj->left + obj->width / 2,
+                            obj->top + obj->height / 2);
+
+        /* Only judge tracks once they cover most of the window */
+        track->is_loitering =
+            motion_stats_span(&track->motion) >= config->window * 9 / 10 &&
+            motion_stats_mean_speed(&track->motion) < config->speed_threshold;
+        loitering[i] = track->is_loitering;
+        if (loitering[i]) num_loitering++;
+    }
+
+    track_store_expire(loiter->tracks, frame->pts);
+    return num_loitering;
+}
+
+guint loiter_analytics_num_tracks(const LoiterAnalytics *loiter) {
+    return track_store_size(loiter->tracks);
+}
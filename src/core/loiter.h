@@ -0,0 +1,45 @@
+#ifndef __LOITER_H__
+#define __LOITER_H__
+
+#include <glib.h>
+
+#include "frame_record.h"
+
+/* Loitering detection over tracked objects of one class.
+ *
+ * Every object of person_class_id feeds its centroid into the MotionStats of
+ * its track. A track is loitering once its samples cover most of the window
+ * and its mean speed stays under speed_threshold. */
+
+/* Mean centroid speed in px/s, roughly 5 px per frame at 30 fps */
+#define LOITER_DEFAULT_SPEED_THRESHOLD 150.0
+#define LOITER_DEFAULT_WINDOW_NS (2 * 1000000000ULL)
+#define LOITER_DEFAULT_TTL_NS (2 * 1000000000ULL)
+#define LOITER_DEFAULT_MAX_TRACKS 1024
+/* Samples kept per track, enough for the window at up to 64 fps */
+#define LOITER_DEFAULT_HISTORY_LEN 128
+
+typedef struct {
+    gint person_class_id;
+    gdouble speed_threshold;
+    guint64 window;
+    guint64 ttl;
+    guint max_tracks;
+    guint history_len;
+} LoiterConfig;
+
+typedef struct _LoiterAnalytics LoiterAnalytics;
+
+void loiter_config_init(LoiterConfig *config, gint person_class_id);
+
+LoiterAnalytics *loiter_analytics_new(const LoiterConfig *config);
+void loiter_analytics_free(LoiterAnalytics *loiter);
+
+/* Updates the tracks seen in frame and sets loitering[i] for each of its
+ * objects. Returns the number of loitering objects in the frame. */
+guint loiter_analytics_process(LoiterAnalytics *loiter, const FrameRecord *frame,
+                               gboolean *loitering);
+
+guint loiter_analytics_num_tracks(const LoiterAnalytics *loiter);
+
+#endif
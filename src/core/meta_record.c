@@ -0,0 +1,133 @@
+#include "meta_record.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#define META_RECORD_ERROR g_quark_from_static_string("meta-record-error")
+
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 object_size;
+} FileHeader;
+
+typedef struct {
+    guint32 source_id;
+    gint32 frame_num;
+    guint64 pts;
+    guint32 num_objects;
+    guint32 reserved;
+} FrameHeader;
+
+G_STATIC_ASSERT(sizeof(FileHeader) == 16);
+G_STATIC_ASSERT(sizeof(FrameHeader) == 24);
+
+struct _MetaRecorder {
+    FILE *file;
+    gboolean failed;
+};
+
+MetaRecorder *meta_recorder_open(const gchar *path, GError **error) {
+    FileHeader header;
+    MetaRecorder *recorder;
+    FILE *file = fopen(path, "wb");
+
+    if (!file) {
+        g_set_error(error, META_RECORD_ERROR, 0, "Cannot open %s: %s", path,
+                    g_strerror(errno));
+        return NULL;
+    }
+    /* Large buffer so the probe rarely waits on the disk */
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, META_RECORD_MAGIC, sizeof(header.magic));
+    header.version = META_RECORD_VERSION;
+    header.object_size = sizeof(ObjectRecord);
+
+    recorder = g_new0(MetaRecorder, 1);
+    recorder->file = file;
+    recorder->failed = fwrite(&header, sizeof(header), 1, file) != 1;
+    return recorder;
+}
+
+gboolean meta_recorder_write(MetaRecorder *recorder, const FrameRecord *frame) {
+    FrameHeader header = {0};
+
+    header.source_id = frame->source_id;
+    header.frame_num = frame->frame_num;
+    header.pts = frame->pts;
+    header.num_objects = frame->num_objects;
+
+    if (fwrite(&header, sizeof(header), 1, recorder->file) != 1 ||
+        fwrite(frame->objects, sizeof(ObjectRecord), frame->num_objects,
+               recorder->file) != frame->num_objects) {
+        recorder->failed = TRUE;
+    }
+    return !recorder->failed;
+}
+
+gboolean meta_recorder_close(MetaRecorder *recorder) {
+    gboolean ok;
+    if (!recorder) return TRUE;
+    ok = fclose(recorder->file) == 0 && !recorder->failed;
+    g_free(recorder);
+    return ok;
+}
+
+MetaRecording *meta_recording_load(const gchar *path, GError **error) {
+    MetaRecording *recording;
+    GArray *frames;
+    gchar *data = NULL;
+    gsize length = 0, offset;
+    FileHeader *file_header;
+
+    if (!g_file_get_contents(path, &data, &length, error)) return NULL;
+
+    file_header = (FileHeader *)data;
+    if (length < sizeof(FileHeader) ||
+        memcmp(file_header->magic, META_RECORD_MAGIC, sizeof(file_header->magic)) ||
+        file_header->version != META_RECORD_VERSION ||
+        file_header->object_size != sizeof(ObjectRecord)) {
+        g_set_error(error, META_RECORD_ERROR, 0, "%s is not a version %d recording",
+                    path, META_RECORD_VERSION);
+        g_free(data);
+        return NULL;
+    }
+
+    recording = g_new0(MetaRecording, 1);
+    frames = g_array_new(FALSE, FALSE, sizeof(FrameRecord));
+    offset = sizeof(FileHeader);
+    while (offset + sizeof(FrameHeader) <= length) {
+        FrameHeader *header = (FrameHeader *)(data + offset);
+        FrameRecord frame;
+        gsize objects_size = (gsize)header->num_objects * sizeof(ObjectRecord);
+
+        offset += sizeof(FrameHeader);
+        /* A recording cut short by a crash ends with a partial frame */
+        if (offset + objects_size > length) break;
+
+        frame.source_id = header->source_id;
+        frame.frame_num = header->frame_num;
+        frame.pts = header->pts;
+        frame.num_objects = header->num_objects;
+        frame.objects = (ObjectRecord *)(data + offset);
+        g_array_append_val(frames, frame);
+
+        recording->num_objects += header->num_objects;
+        offset += objects_size;
+    }
+
+    recording->num_frames = frames->len;
+    recording->frames = (FrameRecord *)g_array_free(frames, FALSE);
+    recording->data = data;
+    return recording;
+}
+
+void meta_recording_free(MetaRecording *recording) {
+    if (!recording) return;
+    g_free(recording->frames);
+    g_free(recording->data);
+    g_free(recording);
+}
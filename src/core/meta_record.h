@@ -0,0 +1,37 @@
+#ifndef __META_RECORD_H__
+#define __META_RECORD_H__
+
+#include <glib.h>
+
+#include "frame_record.h"
+
+/* Binary recording of per-frame object metadata.
+ *
+ * A file is a 16 byte header (magic "NVDSMETA", version, object record size)
+ * followed by one 24 byte frame header (source_id, frame_num, pts,
+ * num_objects, reserved) per frame, each followed by num_objects
+ * ObjectRecords. Everything is host-endian and 8 byte aligned, so a loaded
+ * recording is replayed straight from the file buffer. */
+
+#define META_RECORD_MAGIC "NVDSMETA"
+#define META_RECORD_VERSION 1
+
+typedef struct _MetaRecorder MetaRecorder;
+
+MetaRecorder *meta_recorder_open(const gchar *path, GError **error);
+gboolean meta_recorder_write(MetaRecorder *recorder, const FrameRecord *frame);
+/* Flushes and closes the file. Returns FALSE if any write failed. */
+gboolean meta_recorder_close(MetaRecorder *recorder);
+
+typedef struct {
+    /* Frames pointing into the file buffer */
+    FrameRecord *frames;
+    guint num_frames;
+    guint64 num_objects;
+    gchar *data;
+} MetaRecording;
+
+MetaRecording *meta_recording_load(const gchar *path, GError **error);
+void meta_recording_free(MetaRecording *recording);
+
+#endif
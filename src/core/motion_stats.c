@@ -0,0 +1,120 @@
+#include "motion_stats.h"
+
+#include <math.h>
+
+void motion_stats_init(MotionStats *stats, MotionSample *ring, guint capacity,
+                       guint64 window) {
+    g_return_if_fail((capacity & (capacity - 1)) == 0);
+    stats->ring = ring;
+    stats->capacity = capacity;
+    stats->mask = capacity - 1;
+    stats->window = window;
+    motion_stats_reset(stats);
+}
+
+void motion_stats_reset(MotionStats *stats) {
+    stats->head = 0;
+    stats->tail = 0;
+    stats->count = 0;
+    stats->sum_step = 0.0;
+    stats->sum_speed = 0.0;
+    stats->sum_speed_sq = 0.0;
+    stats->num_steps = 0;
+}
+
+static inline MotionSample *oldest(const MotionStats *stats) {
+    return &stats->ring[stats->tail];
+}
+
+static inline MotionSample *newest(const MotionStats *stats) {
+    return &stats->ring[(stats->head - 1) & stats->mask];
+}
+
+static inline void pop_oldest(MotionStats *stats) {
+    MotionSample *s = oldest(stats);
+    if (s->has_step) {
+        stats->sum_step -= s->step;
+        stats->sum_speed -= s->speed;
+        stats->sum_speed_sq -= (gdouble)s->speed * s->speed;
+        stats->num_steps--;
+    }
+    stats->tail = (stats->tail + 1) & stats->mask;
+    stats->count--;
+}
+
+void motion_stats_update(MotionStats *stats, guint64 pts, gfloat cx, gfloat cy) {
+    MotionSample *s;
+
+    if (stats->count > 0) {
+        MotionSample *last = newest(stats);
+        if (pts <= last->pts) return;
+    }
+
+    /* Drop everything that falls out of the window, or the oldest sample if
+     * the ring is full because the source runs faster than expected */
+    while (stats->count > 0 && pts - oldest(stats)->pts > stats->window) {
+        pop_oldest(stats);
+    }
+    if (stats->count == stats->capacity) pop_oldest(stats);
+
+    s = &stats->ring[stats->head];
+    s->pts = pts;
+    s->cx = cx;
+    s->cy = cy;
+    s->has_step = FALSE;
+    s->step = 0.0f;
+    s->speed = 0.0f;
+
+    if (stats->count > 0) {
+        MotionSample *last = newest(stats);
+        gdouble dt = (gdouble)(pts - last->pts) / 1e9;
+        gfloat dx = cx - last->cx;
+        gfloat dy = cy - last->cy;
+
+        s->has_step = TRUE;
+        s->step = sqrtf(dx * dx + dy * dy);
+        s->speed = (gfloat)(s->step / dt);
+        stats->sum_step += s->step;
+        stats->sum_speed += s->speed;
+        stats->sum_speed_sq += (gdouble)s->speed * s->speed;
+        stats->num_steps++;
+    }
+
+    stats->head = (stats->head + 1) & stats->mask;
+    stats->count++;
+
+    /* Clear the accumulated rounding error whenever the sums restart */
+    if (stats->num_steps == 0) {
+        stats->sum_step = 0.0;
+        stats->sum_speed = 0.0;
+        stats->sum_speed_sq = 0.0;
+    }
+}
+
+guint64 motion_stats_span(const MotionStats *stats) {
+    if (stats->count < 2) return 0;
+    return newest(stats)->pts - oldest(stats)->pts;
+}
+
+gdouble motion_stats_path_length(const MotionStats *stats) { return stats->sum_step; }
+
+gdouble motion_stats_displacement(const MotionStats *stats) {
+    const MotionSample *a, *b;
+    if (stats->count < 2) return 0.0;
+    a = oldest(stats);
+    b = newest(stats);
+    return hypot(b->cx - a->cx, b->cy - a->cy);
+}
+
+gdouble motion_stats_mean_speed(const MotionStats *stats) {
+    if (stats->num_steps == 0) return 0.0;
+    return stats->sum_speed / stats->num_steps;
+}
+
+gdouble motion_stats_speed_variance(const MotionStats *stats) {
+    gdouble mean, var;
+    if (stats->num_steps < 2) return 0.0;
+    mean = stats->sum_speed / stats->num_steps;
+    var = stats->sum_speed_sq / stats->num_steps - mean * mean;
+    return var > 0.0 ? var : 0.0;
+}
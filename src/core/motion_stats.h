@@ -0,0 +1,61 @@
+#ifndef __MOTION_STATS_H__
+#define __MOTION_STATS_H__
+
+#include <glib.h>
+
+/* Streaming movement statistics over a sliding time window.
+ *
+ * Each update appends one centroid sample and adds its step length and speed
+ * to running sums; samples older than the window (by PTS) are popped off the
+ * ring and subtracted again. Every update is O(1) amortised and the results do
+ * not depend on the frame rate of the source. */
+
+typedef struct {
+    guint64 pts;
+    gfloat cx;
+    gfloat cy;
+    /* Distance (px) and speed (px/s) from the previous sample. Both are zero
+     * and has_step is FALSE for the first sample of a track. */
+    gfloat step;
+    gfloat speed;
+    gboolean has_step;
+} MotionSample;
+
+typedef struct {
+    /* Ring storage is owned by the caller, typically a TrackStore slab. */
+    MotionSample *ring;
+    guint capacity;
+    guint mask;
+    guint head;
+    guint tail;
+    guint count;
+    guint64 window;
+    gdouble sum_step;
+    gdouble sum_speed;
+    gdouble sum_speed_sq;
+    guint num_steps;
+} MotionStats;
+
+/* capacity must be a power of two. */
+void motion_stats_init(MotionStats *stats, MotionSample *ring, guint capacity,
+                       guint64 window);
+void motion_stats_reset(MotionStats *stats);
+
+/* Adds a centroid observed at pts (ns). Samples with a pts that is not newer
+ * than the last one are ignored. */
+void motion_stats_update(MotionStats *stats, guint64 pts, gfloat cx, gfloat cy);
+
+/* Time covered by the samples currently in the window, in ns. */
+guint64 motion_stats_span(const MotionStats *stats);
+
+/* Sum of the steps ending inside the window, px. */
+gdouble motion_stats_path_length(const MotionStats *stats);
+
+/* Straight-line distance between the oldest and newest sample, px. */
+gdouble motion_stats_displacement(const MotionStats *stats);
+
+/* Mean and variance of the speed of the steps ending inside the window, px/s. */
+gdouble motion_stats_mean_speed(const MotionStats *stats);
+gdouble motion_stats_speed_variance(const MotionStats *stats);
+
+#endif
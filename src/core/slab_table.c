@@ -0,0 +1,134 @@
+#include "slab_table.h"
+
+#include <string.h>
+
+#define EMPTY_SLOT SLAB_TABLE_NONE
+
+struct _SlabTable {
+    /* Hash slots hold an index into the slab, or EMPTY_SLOT. */
+    guint32 *slots;
+    guint32 slot_mask;
+    /* Per slab index */
+    guint64 *keys;
+    gboolean *in_use;
+    guint32 *free_list;
+    guint free_count;
+    guint capacity;
+    guint size;
+};
+
+/* splitmix64 finalizer, tracker ids are sequential so they need mixing */
+static inline guint32 hash_key(guint64 key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return (guint32)key;
+}
+
+/* Slots and keys are read and written atomically only for the sake of a
+ * concurrent reader, on x86 and ARM64 these are plain loads and stores. */
+static inline guint32 get_slot(const SlabTable *table, guint32 pos) {
+    return __atomic_load_n(&table->slots[pos], __ATOMIC_ACQUIRE);
+}
+
+static inline void set_slot(SlabTable *table, guint32 pos, guint32 index) {
+    __atomic_store_n(&table->slots[pos], index, __ATOMIC_RELEASE);
+}
+
+static inline guint64 get_key(const SlabTable *table, guint32 index) {
+    return __atomic_load_n(&table->keys[index], __ATOMIC_RELAXED);
+}
+
+SlabTable *slab_table_new(guint capacity) {
+    SlabTable *table = g_new0(SlabTable, 1);
+    guint num_slots = 1;
+
+    /* Keep the load factor at or below 0.5 so probe chains stay short */
+    while (num_slots < capacity * 2) num_slots <<= 1;
+
+    table->slots = g_new(guint32, num_slots);
+    memset(table->slots, 0xff, num_slots * sizeof(guint32));
+    table->slot_mask = num_slots - 1;
+    table->keys = g_new0(guint64, capacity);
+    table->in_use = g_new0(gboolean, capacity);
+    table->free_list = g_new(guint32, capacity);
+    /* Pop from the end so the slab is handed out from index 0 upward */
+    for (guint i = 0; i < capacity; i++) table->free_list[i] = capacity - 1 - i;
+    table->free_count = capacity;
+    table->capacity = capacity;
+    return table;
+}
+
+void slab_table_free(SlabTable *table) {
+    if (!table) return;
+    g_free(table->slots);
+    g_free(table->keys);
+    g_free(table->in_use);
+    g_free(table->free_list);
+    g_free(table);
+}
+
+/* Position of key, or of the empty slot ending its probe chain. A concurrent
+ * reader can see a chain without an end while entries move, so it gives up
+ * after visiting every slot. */
+static guint32 find_slot(const SlabTable *table, guint64 key) {
+    guint32 pos = hash_key(key) & table->slot_mask;
+
+    for (guint32 probes = 0; probes <= table->slot_mask; probes++) {
+        guint32 index = get_slot(table, pos);
+        if (index == EMPTY_SLOT || get_key(table, index) == key) return pos;
+        pos = (pos + 1) & table->slot_mask;
+    }
+    return pos;
+}
+
+guint32 slab_table_find(const SlabTable *table, guint64 key) {
+    guint32 index = get_slot(table, find_slot(table, key));
+
+    if (index == EMPTY_SLOT || get_key(table, index) != key) return SLAB_TABLE_NONE;
+    return index;
+}
+
+guint32 slab_table_insert(SlabTable *table, guint64 key) {
+    guint32 pos, index;
+
+    if (table->free_count == 0) return SLAB_TABLE_NONE;
+    pos = find_slot(table, key);
+    index = table->free_list[--table->free_count];
+    __atomic_store_n(&table->keys[index], key, __ATOMIC_RELAXED);
+    table->in_use[index] = TRUE;
+    table->size++;
+    set_slot(table, pos, index);
+    return index;
+}
+
+/* Backward-shift deletion, so no tombstones build up under churn */
+void slab_table_remove(SlabTable *table, guint32 index) {
+    guint32 pos = find_slot(table, table->keys[index]);
+    guint32 next = (pos + 1) & table->slot_mask;
+
+    while (table->slots[next] != EMPTY_SLOT) {
+        guint32 home = hash_key(table->keys[table->slots[next]]) & table->slot_mask;
+        /* Move the entry back if its home is not within (pos, next] */
+        if (((next - home) & table->slot_mask) >= ((next - pos) & table->slot_mask)) {
+            set_slot(table, pos, table->slots[next]);
+            pos = next;
+        }
+        next = (next + 1) & table->slot_mask;
+    }
+    set_slot(table, pos, EMPTY_SLOT);
+
+    table->in_use[index] = FALSE;
+    table->free_list[table->free_count++] = index;
+    table->size--;
+}
+
+gboolean slab_table_in_use(const SlabTable *table, guint32 index) {
+    return table->in_use[index];
+}
+
+guint slab_table_capacity(const SlabTable *table) { return table->capacity; }
+
+guint slab_table_size(const SlabTable *table) { return table->size; }
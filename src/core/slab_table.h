@@ -0,0 +1,45 @@
+#ifndef __SLAB_TABLE_H__
+#define __SLAB_TABLE_H__
+
+#include <glib.h>
+
+/* Fixed-capacity index from a guint64 key to an entry of a caller-owned slab.
+ *
+ * The caller keeps its entries in an array of capacity elements and the table
+ * hands out indices into it, so entries never move while their key is in the
+ * table. The hash slots hold slab indices and are probed linearly at a load
+ * factor of at most 0.5. Removal shifts the entries behind a slot back instead
+ * of leaving a tombstone, so probe chains do not grow under churn. Nothing is
+ * allocated after slab_table_new().
+ *
+ * There is one writer. A reader on another thread may call slab_table_find()
+ * while the writer changes the table, but can then miss a key or get an index
+ * that is being reused, so it has to check with the writer that nothing was
+ * inserted or removed meanwhile, as track_results.c does. */
+
+#define SLAB_TABLE_NONE G_MAXUINT32
+
+typedef struct _SlabTable SlabTable;
+
+SlabTable *slab_table_new(guint capacity);
+void slab_table_free(SlabTable *table);
+
+/* Returns the slab index of key, or SLAB_TABLE_NONE. */
+guint32 slab_table_find(const SlabTable *table, guint64 key);
+
+/* Takes a free slab index for key, which must not be in the table yet.
+ * Indices are handed out from 0 upward. Returns SLAB_TABLE_NONE when every
+ * index is taken. */
+guint32 slab_table_insert(SlabTable *table, guint64 key);
+
+/* Removes the key at index and frees the index. */
+void slab_table_remove(SlabTable *table, guint32 index);
+
+/* For sweeps over the slab, removing the current index while iterating is
+ * fine. */
+gboolean slab_table_in_use(const SlabTable *table, guint32 index);
+
+guint slab_table_capacity(const SlabTable *table);
+guint slab_table_size(const SlabTable *table);
+
+#endif
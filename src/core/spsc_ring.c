@@ -0,0 +1,78 @@
+#include "spsc_ring.h"
+
+#define CACHE_LINE 64
+
+/* head and tail count slots since creation and wrap as unsigned ints, each
+ * side keeps its own index on a separate cache line from the other's */
+struct _SpscRing {
+    gchar *slots;
+    gsize slot_size;
+    guint capacity;
+    guint mask;
+
+    gchar pad0[CACHE_LINE];
+    gint head;
+    /* Producer's last view of tail, refreshed only when the ring looks full */
+    guint cached_tail;
+
+    gchar pad1[CACHE_LINE];
+    gint tail;
+    /* Consumer's last view of head, refreshed only when the ring looks empty */
+    guint cached_head;
+
+    gchar pad2[CACHE_LINE];
+};
+
+SpscRing *spsc_ring_new(guint capacity, gsize slot_size) {
+    SpscRing *ring;
+
+    g_return_val_if_fail(capacity > 0 && (capacity & (capacity - 1)) == 0, NULL);
+    ring = g_new0(SpscRing, 1);
+    /* Round slots up to whole cache lines so neighbours never share one */
+    ring->slot_size = (slot_size + CACHE_LINE - 1) & ~(gsize)(CACHE_LINE - 1);
+    ring->slots = g_malloc0(ring->slot_size * capacity);
+    ring->capacity = capacity;
+    ring->mask = capacity - 1;
+    return ring;
+}
+
+void spsc_ring_free(SpscRing *ring) {
+    if (!ring) return;
+    g_free(ring->slots);
+    g_free(ring);
+}
+
+gpointer spsc_ring_reserve(SpscRing *ring) {
+    guint head = (guint)ring->head;
+
+    if (head - ring->cached_tail == ring->capacity) {
+        ring->cached_tail = (guint)g_atomic_int_get(&ring->tail);
+        if (head - ring->cached_tail == ring->capacity) return NULL;
+    }
+    return ring->slots + (gsize)(head & ring->mask) * ring->slot_size;
+}
+
+void spsc_ring_commit(SpscRing *ring) {
+    g_atomic_int_set(&ring->head, (gint)((guint)ring->head + 1));
+}
+
+gpointer spsc_ring_peek(SpscRing *ring) {
+    guint tail = (guint)ring->tail;
+
+    if (tail == ring->cached_head) {
+        ring->cached_head = (guint)g_atomic_int_get(&ring->head);
+        if (tail == ring->cached_head) return NULL;
+    }
+    return ring->slots + (gsize)(tail & ring->mask) * ring->slot_size;
+}
+
+void spsc_ring_release(SpscRing *ring) {
+    g_atomic_int_set(&ring->tail, (gint)((guint)ring->tail + 1));
+}
+
+guint spsc_ring_depth(SpscRing *ring) {
+    guint tail = (guint)g_atomic_int_get(&ring->tail);
+    return (guint)g_atomic_int_get(&ring->head) - tail;
+}
+
+guint spsc_ring_capacity(const SpscRing *ring) { return ring->capacity; }
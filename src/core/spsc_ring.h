@@ -0,0 +1,29 @@
+#ifndef __SPSC_RING_H__
+#define __SPSC_RING_H__
+
+#include <glib.h>
+
+/* Bounded single-producer/single-consumer queue of fixed-size slots.
+ *
+ * The producer writes into the slot returned by spsc_ring_reserve() and
+ * publishes it with spsc_ring_commit(); the consumer reads the slot returned
+ * by spsc_ring_peek() and hands it back with spsc_ring_release(). Neither
+ * side blocks or allocates, a full ring makes reserve return NULL. */
+
+typedef struct _SpscRing SpscRing;
+
+/* capacity must be a power of two. */
+SpscRing *spsc_ring_new(guint capacity, gsize slot_size);
+void spsc_ring_free(SpscRing *ring);
+
+gpointer spsc_ring_reserve(SpscRing *ring);
+void spsc_ring_commit(SpscRing *ring);
+
+gpointer spsc_ring_peek(SpscRing *ring);
+void spsc_ring_release(SpscRing *ring);
+
+/* Committed slots not yet released, as seen from the calling thread. */
+guint spsc_ring_depth(SpscRing *ring);
+guint spsc_ring_capacity(const SpscRing *ring);
+
+#endif
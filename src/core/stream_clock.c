@@ -0,0 +1,52 @@
+#include "stream_clock.h"
+
+typedef struct {
+    gboolean started;
+    /* Added to the source's pts */
+    guint64 offset;
+    /* Before the offset */
+    guint64 last_pts;
+} SourceClock;
+
+struct _StreamClock {
+    GMutex lock;
+    /* SourceClock by source_id, grown as sources show up */
+    GArray *sources;
+    /* Latest mapped pts of any source */
+    guint64 latest;
+};
+
+StreamClock *stream_clock_new(void) {
+    StreamClock *clock = g_new0(StreamClock, 1);
+
+    g_mutex_init(&clock->lock);
+    clock->sources = g_array_new(FALSE, TRUE, sizeof(SourceClock));
+    return clock;
+}
+
+void stream_clock_free(StreamClock *clock) {
+    if (!clock) return;
+    g_array_free(clock->sources, TRUE);
+    g_mutex_clear(&clock->lock);
+    g_free(clock);
+}
+
+guint64 stream_clock_map(StreamClock *clock, guint source_id, guint64 pts) {
+    SourceClock *source;
+
+    g_mutex_lock(&clock->lock);
+    if (source_id >= clock->sources->len) {
+        g_array_set_size(clock->sources, source_id + 1);
+    }
+    source = &g_array_index(clock->sources, SourceClock, source_id);
+    if (!source->started || pts < source->last_pts) {
+        /* A new stream, carried on from where the others are */
+        source->offset = clock->latest > pts ? clock->latest - pts : 0;
+        source->started = TRUE;
+    }
+    source->last_pts = pts;
+    pts += source->offset;
+    clock->latest = MAX(clock->latest, pts);
+    g_mutex_unlock(&clock->lock);
+    return pts;
+}
@@ -0,0 +1,28 @@
+#ifndef __STREAM_CLOCK_H__
+#define __STREAM_CLOCK_H__
+
+#include <glib.h>
+
+/* Puts the frame timestamps of every source on one timeline.
+ *
+ * The analytics stores are shared by all sources and expire their tracks
+ * against the pts of whichever frame came last, which only works while every
+ * source's pts advance together. They stop doing so when one source's stream
+ * starts over: the next queued file, or a rebuilt branch, begins again near 0
+ * while the other sources are far ahead. Its frames would then be evicted by
+ * every sweep, and the tracks left behind by the old stream would never be.
+ * StreamClock offsets each source so that its first frame, and the first one
+ * whose pts goes backwards, lands on the latest time seen from any source.
+ * In the application this happens as frames leave the muxer, before any stage
+ * reads their pts. */
+
+typedef struct _StreamClock StreamClock;
+
+StreamClock *stream_clock_new(void);
+void stream_clock_free(StreamClock *clock);
+
+/* Returns pts of source_id on the shared timeline. Can be called from any
+ * thread. */
+guint64 stream_clock_map(StreamClock *clock, guint source_id, guint64 pts);
+
+#endif
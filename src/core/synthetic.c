@@ -0,0 +1,44 @@
+#include "synthetic.h"
+
+#include <math.h>
+
+static void fill_object(const SyntheticScene *scene, gint frame_num, guint i,
+                        ObjectRecord *obj) {
+    gfloat phase = (gfloat)i * 0.61803f;
+    gfloat t = (gfloat)frame_num;
+    gboolean person = i % 2 == 0;
+
+    obj->object_id = i + 1;
+    obj->class_id = person ? scene->person_class_id : scene->vehicle_class_id;
+    obj->num_labels = 0;
+    obj->reserved = 0;
+    obj->confidence = 0.9f;
+    obj->width = person ? 60.0f : 200.0f;
+    obj->height = person ? 160.0f : 120.0f;
+
+    if (i % 4 == 0) {
+        obj->left = fmodf(phase * 997.0f, scene->width - obj->width);
+        obj->top = fmodf(phase * 571.0f, scene->height - obj->height);
+        obj->left += sinf(t * 0.7f + phase) * 1.5f;
+    } else {
+        gfloat speed = person ? 8.0f : 12.0f;
+        obj->left = fmodf(phase * 997.0f + t * speed, scene->width - obj->width);
+        obj->top =
+            fmodf(phase * 571.0f + t * speed * 0.25f, scene->height - obj->height);
+    }
+}
+
+void synthetic_scene_frame(const SyntheticScene *scene, guint source_id,
+                           gint frame_num, FrameRecord *frame) {
+    frame->source_id = source_id;
+    frame->frame_num = frame_num;
+    frame->pts = (guint64)frame_num * scene->frame_duration;
+    frame->num_objects = scene->num_objects;
+    for (guint i = 0; i < scene->num_objects; i++) {
+        fill_object(scene, frame_num, i, &frame->objects[i]);
+    }
+}
+
+guint synthetic_scene_num_stationary_persons(const SyntheticScene *scene) {
+    return (scene->num_objects + 3) / 4;
+}
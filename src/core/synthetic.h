@@ -0,0 +1,32 @@
+#ifndef __SYNTHETIC_H__
+#define __SYNTHETIC_H__
+
+#include <glib.h>
+
+#include "frame_record.h"
+
+/* Deterministic synthetic scene for exercising the analytics without a
+ * camera or a GPU. Even objects are persons and odd ones vehicles; every
+ * fourth object stands still apart from a little detector jitter and the
+ * rest move across a width x height frame. Object ids are stable across
+ * frames, as if assigned by nvtracker. */
+
+typedef struct {
+    guint num_objects;
+    guint width;
+    guint height;
+    gint person_class_id;
+    gint vehicle_class_id;
+    /* Frame interval in ns, used for the pts of generated frames */
+    guint64 frame_duration;
+} SyntheticScene;
+
+/* Fills frame->objects (num_objects entries) for frame_num of source_id.
+ * pts is frame_num * frame_duration. */
+void synthetic_scene_frame(const SyntheticScene *scene, guint source_id,
+                           gint frame_num, FrameRecord *frame);
+
+/* Number of objects standing still, i.e. expected to be loitering persons. */
+guint synthetic_scene_num_stationary_persons(const SyntheticScene *scene);
+
+#endif
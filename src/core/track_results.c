@@ -0,0 +1,90 @@
+#include "track_results.h"
+
+#include "frame_record.h"
+#include "slab_table.h"
+
+struct _TrackResults {
+    SlabTable *table;
+    /* Per slab index */
+    guint32 *flags;
+    /* Only touched by the writer */
+    guint64 *last_set;
+    /* Odd while the writer inserts or removes a key */
+    gint table_seq;
+    guint64 ttl;
+    guint64 last_sweep;
+};
+
+TrackResults *track_results_new(guint capacity, guint64 ttl) {
+    TrackResults *results = g_new0(TrackResults, 1);
+
+    results->table = slab_table_new(capacity);
+    results->flags = g_new0(guint32, capacity);
+    results->last_set = g_new0(guint64, capacity);
+    results->ttl = ttl;
+    return results;
+}
+
+void track_results_free(TrackResults *results) {
+    if (!results) return;
+    slab_table_free(results->table);
+    g_free(results->flags);
+    g_free(results->last_set);
+    g_free(results);
+}
+
+gboolean track_results_set(TrackResults *results, guint64 key, guint32 flags,
+                           guint64 now) {
+    guint32 idx = slab_table_find(results->table, key);
+
+    if (idx == SLAB_TABLE_NONE) {
+        g_atomic_int_inc(&results->table_seq);
+        idx = slab_table_insert(results->table, key);
+        if (idx != SLAB_TABLE_NONE) {
+            __atomic_store_n(&results->flags[idx], flags, __ATOMIC_RELAXED);
+        }
+        g_atomic_int_inc(&results->table_seq);
+        if (idx == SLAB_TABLE_NONE) return FALSE;
+    } else if (results->flags[idx] != flags) {
+        /* A reader sees either set of flags, both were right at some point */
+        __atomic_store_n(&results->flags[idx], flags, __ATOMIC_RELAXED);
+    }
+    results->last_set[idx] = now;
+    return TRUE;
+}
+
+guint track_results_expire(TrackResults *results, guint64 now) {
+    guint removed = 0;
+
+    if (!record_is_stale(results->last_sweep, now, results->ttl / 4)) return 0;
+    results->last_sweep = now;
+
+    for (guint i = 0; i < slab_table_capacity(results->table); i++) {
+        if (!slab_table_in_use(results->table, i) ||
+            !record_is_stale(results->last_set[i], now, results->ttl))
+            continue;
+        g_atomic_int_inc(&results->table_seq);
+        slab_table_remove(results->table, i);
+        g_atomic_int_inc(&results->table_seq);
+        removed++;
+    }
+    return removed;
+}
+
+guint32 track_results_get(const TrackResults *results, guint64 key) {
+    guint32 flags;
+    gint seq;
+
+    /* The index found may be stale or a key missed while the writer changes
+     * the table, so only trust a result that no insert or removal overlapped */
+    do {
+        guint32 idx;
+
+        seq = g_atomic_int_get(&results->table_seq);
+        idx = slab_table_find(results->table, key);
+        flags = idx != SLAB_TABLE_NONE
+                    ? __atomic_load_n(&results->flags[idx], __ATOMIC_RELAXED)
+                    : 0;
+    } while ((seq & 1) || seq != g_atomic_int_get(&results->table_seq));
+    return flags;
+}
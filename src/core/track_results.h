@@ -0,0 +1,30 @@
+#ifndef __TRACK_RESULTS_H__
+#define __TRACK_RESULTS_H__
+
+#include <glib.h>
+
+/* Per-track analytics results, written by one thread and read by any.
+ *
+ * A fixed-capacity slab_table.h index from track key to a set of flags.
+ * Readers never block: the writer makes a table-wide sequence number odd
+ * while it inserts or removes a key, and a reader that overlapped such a
+ * change looks the key up again. Entries not set for longer than the ttl are
+ * removed by track_results_expire(). */
+
+#define TRACK_RESULT_LOITERING (1u << 0)
+
+typedef struct _TrackResults TrackResults;
+
+/* capacity is the most keys held at once, ttl is in ns. */
+TrackResults *track_results_new(guint capacity, guint64 ttl);
+void track_results_free(TrackResults *results);
+
+/* Writer side. Returns FALSE if the table is full. */
+gboolean track_results_set(TrackResults *results, guint64 key, guint32 flags,
+                           guint64 now);
+guint track_results_expire(TrackResults *results, guint64 now);
+
+/* Reader side. Returns 0 for unknown keys. */
+guint32 track_results_get(const TrackResults *results, guint64 key);
+
+#endif
@@ -0,0 +1,91 @@
+#include "track_store.h"
+
+#include "frame_record.h"
+#include "slab_table.h"
+
+struct _TrackStore {
+    SlabTable *table;
+    /* Preallocated track states and the history block they point into. */
+    TrackState *slab;
+    MotionSample *history_block;
+    guint64 ttl;
+    guint64 last_sweep;
+    guint64 rejected;
+};
+
+TrackStore *track_store_new(guint capacity, guint history_len, guint64 window,
+                            guint64 ttl) {
+    TrackStore *store = g_new0(TrackStore, 1);
+
+    store->table = slab_table_new(capacity);
+    store->slab = g_new0(TrackState, capacity);
+    store->history_block = g_new0(MotionSample, (gsize)capacity * history_len);
+    store->ttl = ttl;
+
+    for (guint i = 0; i < capacity; i++) {
+        motion_stats_init(&store->slab[i].motion,
+                          store->history_block + (gsize)i * history_len, history_len,
+                          window);
+    }
+    return store;
+}
+
+void track_store_free(TrackStore *store) {
+    if (!store) return;
+    slab_table_free(store->table);
+    g_free(store->slab);
+    g_free(store->history_block);
+    g_free(store);
+}
+
+static guint sweep(TrackStore *store, guint64 now) {
+    guint evicted = 0;
+    for (guint i = 0; i < slab_table_capacity(store->table); i++) {
+        if (!slab_table_in_use(store->table, i) ||
+            !record_is_stale(store->slab[i].last_seen, now, store->ttl))
+            continue;
+        slab_table_remove(store->table, i);
+        evicted++;
+    }
+    store->last_sweep = now;
+    return evicted;
+}
+
+guint track_store_expire(TrackStore *store, guint64 now) {
+    /* A full sweep is O(capacity), only do it a few times per TTL */
+    if (!record_is_stale(store->last_sweep, now, store->ttl / 4)) return 0;
+    return sweep(store, now);
+}
+
+TrackState *track_store_lookup(TrackStore *store, guint64 object_id, guint64 now) {
+    guint32 idx = slab_table_find(store->table, object_id);
+    TrackState *state;
+
+    if (idx != SLAB_TABLE_NONE) {
+        state = &store->slab[idx];
+        state->last_seen = now;
+        return state;
+    }
+
+    idx = slab_table_insert(store->table, object_id);
+    if (idx == SLAB_TABLE_NONE && sweep(store, now) > 0) {
+        idx = slab_table_insert(store->table, object_id);
+    }
+    if (idx == SLAB_TABLE_NONE) {
+        store->rejected++;
+        return NULL;
+    }
+
+    state = &store->slab[idx];
+    state->object_id = object_id;
+    state->last_seen = now;
+    motion_stats_reset(&state->motion);
+    state->is_loitering = FALSE;
+    return state;
+}
+
+guint track_store_size(const TrackStore *store) {
+    return slab_table_size(store->table);
+}
+
+guint64 track_store_rejected(const TrackStore *store) { return store->rejected; }
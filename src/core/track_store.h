@@ -0,0 +1,43 @@
+#ifndef __TRACK_STORE_H__
+#define __TRACK_STORE_H__
+
+#include <glib.h>
+
+#include "motion_stats.h"
+
+/* Per-track state table keyed by the object_id that nvtracker assigns.
+ *
+ * The table is an open-addressing (linear probing) hash over a fixed slab of
+ * TrackState entries, each of which owns a ring of motion samples carved out
+ * of one preallocated block. Nothing is allocated after track_store_new(), so
+ * lookups are safe to run from a pad probe. Tracks that have not been seen for
+ * longer than the TTL are evicted, and once the slab is full new tracks are
+ * refused rather than growing the table. */
+
+typedef struct {
+    guint64 object_id;
+    /* Timestamp (ns) of the last update, compared against the TTL. */
+    guint64 last_seen;
+    MotionStats motion;
+    gboolean is_loitering;
+} TrackState;
+
+typedef struct _TrackStore TrackStore;
+
+/* history_len bounds the number of samples a track keeps inside its motion
+ * window, window and ttl are in ns. */
+TrackStore *track_store_new(guint capacity, guint history_len, guint64 window,
+                            guint64 ttl);
+void track_store_free(TrackStore *store);
+
+/* Returns the state for object_id, creating it when it is not tracked yet.
+ * Returns NULL if the store is full and nothing could be evicted. */
+TrackState *track_store_lookup(TrackStore *store, guint64 object_id, guint64 now);
+
+/* Evicts tracks whose last update is older than now - ttl. */
+guint track_store_expire(TrackStore *store, guint64 now);
+
+guint track_store_size(const TrackStore *store);
+guint64 track_store_rejected(const TrackStore *store);
+
+#endif
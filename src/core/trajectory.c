@@ -0,0 +1,198 @@
+#include "trajectory.h"
+
+#include <string.h>
+
+typedef struct {
+    guint64 key;
+    guint source_id;
+    guint64 object_id;
+    gint class_id;
+    guint64 last_seen;
+    /* The first point is the last one of the previous piece */
+    gboolean continued;
+    GArray *points;
+} OpenTrack;
+
+struct _TrajectoryBuilder {
+    TrajectoryConfig config;
+    TrajectorySink sink;
+    gpointer data;
+    /* OpenTrack by its key */
+    GHashTable *tracks;
+    guint64 last_sweep;
+    /* Scratch for simplification */
+    GArray *keep;
+    GArray *kept;
+};
+
+void trajectory_config_init(TrajectoryConfig *config) {
+    config->tolerance = TRAJECTORY_DEFAULT_TOLERANCE;
+    config->max_points = TRAJECTORY_DEFAULT_MAX_POINTS;
+    config->ttl = TRAJECTORY_DEFAULT_TTL_NS;
+}
+
+/* Squared distance from p to where the object would be at p's time, moving
+ * in a straight line from a to b */
+static inline gdouble sed2(const TrajectoryPoint *a, const TrajectoryPoint *b,
+                           const TrajectoryPoint *p) {
+    gdouble r = 0, x, y;
+
+    if (b->time > a->time) r = (gdouble)(p->time - a->time) / (b->time - a->time);
+    x = a->x + r * (b->x - a->x) - p->x;
+    y = a->y + r * (b->y - a->y) - p->y;
+    return x * x + y * y;
+}
+
+guint trajectory_simplify(const TrajectoryPoint *points, guint num_points,
+                          gdouble tolerance, gboolean *keep) {
+    gdouble tolerance2 = tolerance * tolerance;
+    /* Ranges still to split, at most one per point */
+    guint *stack;
+    guint depth = 0, kept;
+
+    if (num_points <= 2) {
+        for (guint i = 0; i < num_points; i++) keep[i] = TRUE;
+        return num_points;
+    }
+    memset(keep, 0, num_points * sizeof(*keep));
+    keep[0] = keep[num_points - 1] = TRUE;
+    kept = 2;
+    stack = g_new(guint, num_points * 2);
+    stack[depth++] = 0;
+    stack[depth++] = num_points - 1;
+    while (depth) {
+        guint last = stack[--depth], first = stack[--depth];
+        guint worst = 0;
+        gdouble worst_d2 = tolerance2;
+
+        for (guint i = first + 1; i < last; i++) {
+            gdouble d2 = sed2(&points[first], &points[last], &points[i]);
+            if (d2 > worst_d2) {
+                worst_d2 = d2;
+                worst = i;
+            }
+        }
+        if (!worst) continue;
+        keep[worst] = TRUE;
+        kept++;
+        stack[depth++] = first;
+        stack[depth++] = worst;
+        stack[depth++] = worst;
+        stack[depth++] = last;
+    }
+    g_free(stack);
+    return kept;
+}
+
+static void emit(TrajectoryBuilder *builder, OpenTrack *track) {
+    const TrajectoryPoint *points = (const TrajectoryPoint *)track->points->data;
+    guint num_points = track->points->len;
+    gboolean *keep;
+    Trajectory trajectory;
+
+    /* Nothing new since the previous piece */
+    if (!num_points || (track->continued && num_points == 1)) return;
+    g_array_set_size(builder->keep, num_points);
+    keep = (gboolean *)builder->keep->data;
+    trajectory_simplify(points, num_points, builder->config.tolerance, keep);
+    g_array_set_size(builder->kept, 0);
+    for (guint i = 0; i < num_points; i++) {
+        if (keep[i]) g_array_append_val(builder->kept, points[i]);
+    }
+
+    trajectory.source_id = track->source_id;
+    trajectory.object_id = track->object_id;
+    trajectory.class_id = track->class_id;
+    trajectory.points = (const TrajectoryPoint *)builder->kept->data;
+    trajectory.num_points = builder->kept->len;
+    trajectory.num_raw_points = track->continued ? num_points - 1 : num_points;
+    builder->sink(&trajectory, builder->data);
+}
+
+static void open_track_free(gpointer data) {
+    OpenTrack *track = (OpenTrack *)data;
+    g_array_free(track->points, TRUE);
+    g_free(track);
+}
+
+TrajectoryBuilder *trajectory_builder_new(const TrajectoryConfig *config,
+                                          TrajectorySink sink, gpointer data) {
+    TrajectoryBuilder *builder = g_new0(TrajectoryBuilder, 1);
+
+    builder->config = *config;
+    builder->config.max_points = MAX(config->max_points, 2);
+    builder->sink = sink;
+    builder->data = data;
+    builder->tracks =
+        g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, open_track_free);
+    builder->keep = g_array_new(FALSE, FALSE, sizeof(gboolean));
+    builder->kept = g_array_new(FALSE, FALSE, sizeof(TrajectoryPoint));
+    return builder;
+}
+
+void trajectory_builder_free(TrajectoryBuilder *builder) {
+    GHashTableIter iter;
+    gpointer value;
+
+    if (!builder) return;
+    g_hash_table_iter_init(&iter, builder->tracks);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) emit(builder, value);
+    g_hash_table_destroy(builder->tracks);
+    g_array_free(builder->keep, TRUE);
+    g_array_free(builder->kept, TRUE);
+    g_free(builder);
+}
+
+void trajectory_builder_process(TrajectoryBuilder *builder, const FrameRecord *frame) {
+    for (guint i = 0; i < frame->num_objects; i++) {
+        const ObjectRecord *obj = &frame->objects[i];
+        guint64 key;
+        OpenTrack *track;
+        TrajectoryPoint point;
+
+        if (obj->object_id == RECORD_UNTRACKED_ID) continue;
+        key = record_track_key(frame->source_id, obj->object_id);
+        track = g_hash_table_lookup(builder->tracks, &key);
+        if (!track) {
+            track = g_new0(OpenTrack, 1);
+            track->key = key;
+            track->source_id = frame->source_id;
+            track->object_id = obj->object_id;
+            track->points =
+                g_array_sized_new(FALSE, FALSE, sizeof(TrajectoryPoint), 64);
+            g_hash_table_insert(builder->tracks, &track->key, track);
+        }
+        track->class_id = obj->class_id;
+        track->last_seen = frame->pts;
+        point.time = frame->pts;
+        point.x = obj->left + obj->width / 2;
+        point.y = obj->top + obj->height / 2;
+        g_array_append_val(track->points, point);
+
+        if (track->points->len >= builder->config.max_points) {
+            emit(builder, track);
+            g_array_set_size(track->points, 0);
+            g_array_append_val(track->points, point);
+            track->continued = TRUE;
+        }
+    }
+
+    if (record_is_stale(builder->last_sweep, frame->pts, builder->config.ttl / 4)) {
+        GHashTableIter iter;
+        gpointer value;
+
+        g_hash_table_iter_init(&iter, builder->tracks);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            OpenTrack *track = (OpenTrack *)value;
+            if (!record_is_stale(track->last_seen, frame->pts, builder->config.ttl))
+                continue;
+            emit(builder, track);
+            g_hash_table_iter_remove(&iter);
+        }
+        builder->last_sweep = frame->pts;
+    }
+}
+
+guint trajectory_builder_num_tracks(const TrajectoryBuilder *builder) {
+    return g_hash_table_size(builder->tracks);
+}
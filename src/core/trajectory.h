@@ -0,0 +1,70 @@
+#ifndef __TRAJECTORY_H__
+#define __TRAJECTORY_H__
+
+#include <glib.h>
+
+#include "frame_record.h"
+
+/* Paths of tracked objects, simplified as they are built.
+ *
+ * A TrajectoryBuilder follows the box centre of every track it is fed. Once a
+ * track has not been seen for ttl, or holds max_points points, its path is
+ * simplified and handed to the sink; a track still going on continues in a
+ * new piece from its last point. Simplification is Douglas-Peucker over the
+ * synchronized Euclidean distance: a point is only dropped when the position
+ * interpolated in time between the points kept around it is within tolerance
+ * of it, so the path stays accurate at every instant, not just in shape.
+ * Untracked objects are ignored. */
+
+#define TRAJECTORY_DEFAULT_TOLERANCE 2.0
+#define TRAJECTORY_DEFAULT_MAX_POINTS 1024
+#define TRAJECTORY_DEFAULT_TTL_NS (2 * 1000000000ULL)
+
+typedef struct {
+    /* pts in ns */
+    guint64 time;
+    gfloat x;
+    gfloat y;
+} TrajectoryPoint;
+
+typedef struct {
+    guint source_id;
+    guint64 object_id;
+    gint class_id;
+    const TrajectoryPoint *points;
+    guint num_points;
+    /* Points seen before simplification */
+    guint num_raw_points;
+} Trajectory;
+
+/* Called from the thread feeding the builder, the points are only valid
+ * during the call. */
+typedef void (*TrajectorySink)(const Trajectory *trajectory, gpointer data);
+
+typedef struct {
+    /* In px */
+    gdouble tolerance;
+    guint max_points;
+    guint64 ttl;
+} TrajectoryConfig;
+
+typedef struct _TrajectoryBuilder TrajectoryBuilder;
+
+void trajectory_config_init(TrajectoryConfig *config);
+
+TrajectoryBuilder *trajectory_builder_new(const TrajectoryConfig *config,
+                                          TrajectorySink sink, gpointer data);
+/* Hands the paths still open to the sink first. */
+void trajectory_builder_free(TrajectoryBuilder *builder);
+
+/* Extends the paths of the tracks in frame and ends the ones gone. */
+void trajectory_builder_process(TrajectoryBuilder *builder, const FrameRecord *frame);
+
+guint trajectory_builder_num_tracks(const TrajectoryBuilder *builder);
+
+/* Sets keep[i] for the points simplification keeps, always the first and the
+ * last, and returns how many. */
+guint trajectory_simplify(const TrajectoryPoint *points, guint num_points,
+                          gdouble tolerance, gboolean *keep);
+
+#endif
@@ -0,0 +1,576 @@
+#include "trajectory_archive.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "logger.h"
+
+/* Coordinates are stored in 1/8 px */
+#define TRAJECTORY_SCALE 8.0f
+#define NUM_COLUMNS 3
+
+enum { COLUMN_TIME, COLUMN_X, COLUMN_Y };
+
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 source_id;
+    guint32 num_tracks;
+    guint32 num_points;
+    gint64 start_ms;
+    gint64 end_ms;
+    gfloat min_x;
+    gfloat min_y;
+    gfloat max_x;
+    gfloat max_y;
+    /* Bytes in each column */
+    guint32 column_size[NUM_COLUMNS];
+    guint32 reserved;
+} SegmentHeader;
+
+typedef struct {
+    guint64 object_id;
+    gint64 start_ms;
+    gint64 end_ms;
+    guint32 num_points;
+    gint16 class_id;
+    guint16 reserved;
+    gfloat min_x;
+    gfloat min_y;
+    gfloat max_x;
+    gfloat max_y;
+    /* Where the track's values start in each column */
+    guint32 column_offset[NUM_COLUMNS];
+    guint32 reserved2;
+} TrackEntry;
+
+G_STATIC_ASSERT(sizeof(SegmentHeader) == 72);
+G_STATIC_ASSERT(sizeof(TrackEntry) == 64);
+
+/* A source's tracks waiting to be written */
+typedef struct {
+    GArray *tracks;
+    GByteArray *columns[NUM_COLUMNS];
+    guint32 num_points;
+    gint64 start_ms;
+    gint64 end_ms;
+    gfloat min_x;
+    gfloat min_y;
+    gfloat max_x;
+    gfloat max_y;
+} OpenSegment;
+
+struct _TrajectoryArchive {
+    gchar *dir;
+    TrajectoryArchiveConfig config;
+    GMutex lock;
+    /* By source id, NULL until the source has had a track */
+    GPtrArray *segments;
+    FILE *index;
+    guint next_segment;
+    gboolean failed;
+    TrajectoryArchiveStats stats;
+};
+
+void trajectory_archive_config_init(TrajectoryArchiveConfig *config) {
+    config->time_base_ms = 0;
+    config->segment_tracks = TRAJECTORY_DEFAULT_SEGMENT_TRACKS;
+    config->segment_ms = TRAJECTORY_DEFAULT_SEGMENT_MS;
+}
+
+static void put_varint(GByteArray *out, guint64 value) {
+    guint8 bytes[10];
+    guint n = 0;
+
+    do {
+        bytes[n] = value & 0x7f;
+        value >>= 7;
+        if (value) bytes[n] |= 0x80;
+        n++;
+    } while (value);
+    g_byte_array_append(out, bytes, n);
+}
+
+static inline gboolean get_varint(const guint8 **p, const guint8 *end, guint64 *value) {
+    *value = 0;
+    for (guint shift = 0; *p < end && shift < 64; shift += 7) {
+        guint8 byte = *(*p)++;
+        *value |= (guint64)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return TRUE;
+    }
+    return FALSE;
+}
+
+static inline guint64 zigzag(gint64 value) {
+    return ((guint64)value << 1) ^ (guint64)(value >> 63);
+}
+
+static inline gint64 unzigzag(guint64 value) {
+    return (gint64)(value >> 1) ^ -(gint64)(value & 1);
+}
+
+static inline gint32 quantize(gfloat value) {
+    return (gint32)lrintf(value * TRAJECTORY_SCALE);
+}
+
+static void segment_reset(OpenSegment *segment) {
+    g_array_set_size(segment->tracks, 0);
+    for (guint c = 0; c < NUM_COLUMNS; c++) {
+        g_byte_array_set_size(segment->columns[c], 0);
+    }
+    segment->num_points = 0;
+    segment->start_ms = G_MAXINT64;
+    segment->end_ms = G_MININT64;
+    segment->min_x = segment->min_y = G_MAXFLOAT;
+    segment->max_x = segment->max_y = -G_MAXFLOAT;
+}
+
+static OpenSegment *segment_new(void) {
+    OpenSegment *segment = g_new0(OpenSegment, 1);
+
+    segment->tracks = g_array_new(FALSE, FALSE, sizeof(TrackEntry));
+    for (guint c = 0; c < NUM_COLUMNS; c++) segment->columns[c] = g_byte_array_new();
+    segment_reset(segment);
+    return segment;
+}
+
+static void segment_free(gpointer data) {
+    OpenSegment *segment = (OpenSegment *)data;
+
+    if (!segment) return;
+    g_array_free(segment->tracks, TRUE);
+    for (guint c = 0; c < NUM_COLUMNS; c++) {
+        g_byte_array_free(segment->columns[c], TRUE);
+    }
+    g_free(segment);
+}
+
+/* Writes the segment to a temporary file renamed into place, then lists it in
+ * the index, so readers never see a partial segment */
+static gboolean segment_write(TrajectoryArchive *archive, guint source_id,
+                              OpenSegment *segment) {
+    SegmentHeader header;
+    gchar *name, *path, *tmp_path;
+    gsize size = sizeof(header) + segment->tracks->len * sizeof(TrackEntry);
+    gboolean ok;
+    FILE *file;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRAJECTORY_ARCHIVE_MAGIC, sizeof(header.magic));
+    header.version = TRAJECTORY_ARCHIVE_VERSION;
+    header.source_id = source_id;
+    header.num_tracks = segment->tracks->len;
+    header.num_points = segment->num_points;
+    header.start_ms = segment->start_ms;
+    header.end_ms = segment->end_ms;
+    header.min_x = segment->min_x;
+    header.min_y = segment->min_y;
+    header.max_x = segment->max_x;
+    header.max_y = segment->max_y;
+    for (guint c = 0; c < NUM_COLUMNS; c++) {
+        header.column_size[c] = segment->columns[c]->len;
+        size += segment->columns[c]->len;
+    }
+
+    name = g_strdup_printf("source%02u-%" G_GINT64_FORMAT "-%u.traj", source_id,
+                           segment->start_ms, archive->next_segment++);
+    path = g_build_filename(archive->dir, name, NULL);
+    tmp_path = g_strconcat(path, ".tmp", NULL);
+    file = fopen(tmp_path, "wb");
+    ok = file && fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(segment->tracks->data, sizeof(TrackEntry), segment->tracks->len,
+                file) == segment->tracks->len;
+    for (guint c = 0; c < NUM_COLUMNS && ok; c++) {
+        ok = fwrite(segment->columns[c]->data, 1, segment->columns[c]->len, file) ==
+             segment->columns[c]->len;
+    }
+    if (file && fclose(file) != 0) ok = FALSE;
+    ok = ok && rename(tmp_path, path) == 0;
+    if (ok) {
+        fprintf(archive->index,
+                "%u %" G_GINT64_FORMAT " %" G_GINT64_FORMAT
+                " %.3f %.3f %.3f %.3f %u %s\n",
+                source_id, segment->start_ms, segment->end_ms, segment->min_x,
+                segment->min_y, segment->max_x, segment->max_y, segment->tracks->len,
+                name);
+        ok = fflush(archive->index) == 0;
+        archive->stats.segments++;
+        archive->stats.bytes += size;
+    } else {
+        LOG_WARNING(LOG_CAT_TRAJECTORIES, "Cannot write trajectory segment %s: %s",
+                    path, g_strerror(errno));
+        remove(tmp_path);
+    }
+    g_free(tmp_path);
+    g_free(path);
+    g_free(name);
+    segment_reset(segment);
+    if (!ok) archive->failed = TRUE;
+    return ok;
+}
+
+TrajectoryArchive *trajectory_archive_open(const gchar *dir,
+                                           const TrajectoryArchiveConfig *config,
+                                           GError **error) {
+    TrajectoryArchive *archive;
+    gchar *index_path;
+    FILE *index;
+
+    if (g_mkdir_with_parents(dir, 0755) < 0) {
+        g_set_error(error, TRAJECTORY_ARCHIVE_ERROR, 0, "Cannot create %s: %s", dir,
+                    g_strerror(errno));
+        return NULL;
+    }
+    index_path = g_build_filename(dir, TRAJECTORY_ARCHIVE_INDEX, NULL);
+    index = fopen(index_path, "a");
+    if (!index) {
+        g_set_error(error, TRAJECTORY_ARCHIVE_ERROR, 0, "Cannot open %s: %s",
+                    index_path, g_strerror(errno));
+        g_free(index_path);
+        return NULL;
+    }
+    g_free(index_path);
+
+    archive = g_new0(TrajectoryArchive, 1);
+    archive->dir = g_strdup(dir);
+    archive->config = *config;
+    archive->config.segment_tracks = MAX(config->segment_tracks, 1);
+    g_mutex_init(&archive->lock);
+    archive->segments = g_ptr_array_new_with_free_func(segment_free);
+    archive->index = index;
+    return archive;
+}
+
+gboolean trajectory_archive_close(TrajectoryArchive *archive,
+                                  TrajectoryArchiveStats *stats) {
+    gboolean ok;
+
+    if (!archive) return TRUE;
+    for (guint s = 0; s < archive->segments->len; s++) {
+        OpenSegment *segment = g_ptr_array_index(archive->segments, s);
+        if (segment && segment->tracks->len) segment_write(archive, s, segment);
+    }
+    if (stats) *stats = archive->stats;
+    ok = fclose(archive->index) == 0 && !archive->failed;
+    g_ptr_array_free(archive->segments, TRUE);
+    g_mutex_clear(&archive->lock);
+    g_free(archive->dir);
+    g_free(archive);
+    return ok;
+}
+
+static inline gint64 to_ms(const TrajectoryArchive *archive, guint64 pts) {
+    return archive->config.time_base_ms + (gint64)(pts / 1000000);
+}
+
+void trajectory_archive_add(const Trajectory *trajectory, gpointer data) {
+    TrajectoryArchive *archive = (TrajectoryArchive *)data;
+    const TrajectoryPoint *points = trajectory->points;
+    guint source_id = trajectory->source_id;
+    TrackEntry entry = {0};
+    OpenSegment *segment;
+    gint64 time = 0;
+    gint32 x = 0, y = 0;
+
+    if (!trajectory->num_points) return;
+    entry.object_id = trajectory->object_id;
+    entry.start_ms = to_ms(archive, points[0].time);
+    entry.end_ms = to_ms(archive, points[trajectory->num_points - 1].time);
+    entry.num_points = trajectory->num_points;
+    entry.class_id = trajectory->class_id;
+    entry.min_x = entry.min_y = G_MAXFLOAT;
+    entry.max_x = entry.max_y = -G_MAXFLOAT;
+    for (guint i = 0; i < trajectory->num_points; i++) {
+        entry.min_x = MIN(entry.min_x, points[i].x);
+        entry.min_y = MIN(entry.min_y, points[i].y);
+        entry.max_x = MAX(entry.max_x, points[i].x);
+        entry.max_y = MAX(entry.max_y, points[i].y);
+    }
+
+    g_mutex_lock(&archive->lock);
+    if (source_id >= archive->segments->len) {
+        g_ptr_array_set_size(archive->segments, source_id + 1);
+    }
+    segment = g_ptr_array_index(archive->segments, source_id);
+    if (!segment) {
+        segment = segment_new();
+        g_ptr_array_index(archive->segments, source_id) = segment;
+    }
+    if (segment->tracks->len &&
+        (segment->tracks->len >= archive->config.segment_tracks ||
+         MAX(entry.end_ms, segment->end_ms) - MIN(entry.start_ms, segment->start_ms) >
+             archive->config.segment_ms)) {
+        segment_write(archive, source_id, segment);
+    }
+
+    for (guint c = 0; c < NUM_COLUMNS; c++) {
+        entry.column_offset[c] = segment->columns[c]->len;
+    }
+    for (guint i = 0; i < trajectory->num_points; i++) {
+        gint64 t = MAX(to_ms(archive, points[i].time), time);
+        gint32 qx = quantize(points[i].x), qy = quantize(points[i].y);
+
+        /* The first time is the track's start_ms */
+        if (i) put_varint(segment->columns[COLUMN_TIME], t - time);
+        put_varint(segment->columns[COLUMN_X], zigzag((gint64)qx - x));
+        put_varint(segment->columns[COLUMN_Y], zigzag((gint64)qy - y));
+        time = t;
+        x = qx;
+        y = qy;
+    }
+    g_array_append_val(segment->tracks, entry);
+    segment->num_points += entry.num_points;
+    segment->start_ms = MIN(segment->start_ms, entry.start_ms);
+    segment->end_ms = MAX(segment->end_ms, entry.end_ms);
+    segment->min_x = MIN(segment->min_x, entry.min_x);
+    segment->min_y = MIN(segment->min_y, entry.min_y);
+    segment->max_x = MAX(segment->max_x, entry.max_x);
+    segment->max_y = MAX(segment->max_y, entry.max_y);
+
+    archive->stats.tracks++;
+    archive->stats.raw_points += trajectory->num_raw_points;
+    archive->stats.points += trajectory->num_points;
+    g_mutex_unlock(&archive->lock);
+}
+
+void trajectory_archive_get_stats(TrajectoryArchive *archive,
+                                  TrajectoryArchiveStats *stats) {
+    g_mutex_lock(&archive->lock);
+    *stats = archive->stats;
+    g_mutex_unlock(&archive->lock);
+}
+
+/* Querying */
+
+void trajectory_query_init(TrajectoryQuery *query) {
+    memset(query, 0, sizeof(*query));
+    query->source_id = -1;
+    query->start_ms = G_MININT64;
+    query->end_ms = G_MAXINT64;
+}
+
+static inline gboolean box_overlaps(const TrajectoryQuery *query, gfloat min_x,
+                                    gfloat min_y, gfloat max_x, gfloat max_y) {
+    return !query->has_region ||
+           (min_x <= query->max_x && max_x >= query->min_x && min_y <= query->max_y &&
+            max_y >= query->min_y);
+}
+
+static inline gboolean time_overlaps(const TrajectoryQuery *query, gint64 start_ms,
+                                     gint64 end_ms) {
+    return start_ms <= query->end_ms && end_ms >= query->start_ms;
+}
+
+/* Liang-Barsky: whether the segment from (x0, y0) to (x1, y1) meets the box */
+static gboolean segment_in_box(const TrajectoryQuery *query, gfloat x0, gfloat y0,
+                               gfloat x1, gfloat y1) {
+    gfloat p[4] = {x0 - x1, x1 - x0, y0 - y1, y1 - y0};
+    gfloat q[4] = {x0 - query->min_x, query->max_x - x0, y0 - query->min_y,
+                   query->max_y - y0};
+    gfloat t0 = 0, t1 = 1;
+
+    for (guint k = 0; k < 4; k++) {
+        gfloat t;
+
+        if (p[k] == 0) {
+            if (q[k] < 0) return FALSE;
+            continue;
+        }
+        t = q[k] / p[k];
+        if (p[k] < 0) {
+            if (t > t1) return FALSE;
+            t0 = MAX(t0, t);
+        } else {
+            if (t < t0) return FALSE;
+            t1 = MIN(t1, t);
+        }
+    }
+    return TRUE;
+}
+
+static inline void sample_at(const TrajectorySample *a, const TrajectorySample *b,
+                             gint64 time_ms, gfloat *x, gfloat *y) {
+    gfloat r = 0;
+
+    if (b->time_ms > a->time_ms) {
+        r = (gfloat)(time_ms - a->time_ms) / (gfloat)(b->time_ms - a->time_ms);
+    }
+    *x = a->x + r * (b->x - a->x);
+    *y = a->y + r * (b->y - a->y);
+}
+
+/* Whether the path, moving in straight lines between samples, is inside the
+ * region at some time in the range */
+static gboolean path_matches(const TrajectoryQuery *query,
+                             const TrajectorySample *samples, guint num_samples) {
+    if (num_samples == 1) {
+        return time_overlaps(query, samples[0].time_ms, samples[0].time_ms) &&
+               segment_in_box(query, samples[0].x, samples[0].y, samples[0].x,
+                              samples[0].y);
+    }
+    for (guint i = 0; i + 1 < num_samples; i++) {
+        const TrajectorySample *a = &samples[i], *b = &samples[i + 1];
+        gint64 from = MAX(a->time_ms, query->start_ms);
+        gint64 to = MIN(b->time_ms, query->end_ms);
+        gfloat x0, y0, x1, y1;
+
+        if (from > to) continue;
+        if (!query->has_region) return TRUE;
+        sample_at(a, b, from, &x0, &y0);
+        sample_at(a, b, to, &x1, &y1);
+        if (segment_in_box(query, x0, y0, x1, y1)) return TRUE;
+    }
+    return FALSE;
+}
+
+static gboolean decode_track(const TrackEntry *entry, const guint8 **columns,
+                             const guint32 *column_size, GArray *samples) {
+    const guint8 *p[NUM_COLUMNS], *end[NUM_COLUMNS];
+    gint64 time = entry->start_ms, x = 0, y = 0;
+
+    for (guint c = 0; c < NUM_COLUMNS; c++) {
+        if (entry->column_offset[c] > column_size[c]) return FALSE;
+        p[c] = columns[c] + entry->column_offset[c];
+        end[c] = columns[c] + column_size[c];
+    }
+    g_array_set_size(samples, entry->num_points);
+    for (guint i = 0; i < entry->num_points; i++) {
+        TrajectorySample *sample = &g_array_index(samples, TrajectorySample, i);
+        guint64 dt = 0, dx, dy;
+
+        if ((i && !get_varint(&p[COLUMN_TIME], end[COLUMN_TIME], &dt)) ||
+            !get_varint(&p[COLUMN_X], end[COLUMN_X], &dx) ||
+            !get_varint(&p[COLUMN_Y], end[COLUMN_Y], &dy)) {
+            return FALSE;
+        }
+        time += dt;
+        x += unzigzag(dx);
+        y += unzigzag(dy);
+        sample->time_ms = time;
+        sample->x = x / TRAJECTORY_SCALE;
+        sample->y = y / TRAJECTORY_SCALE;
+    }
+    return TRUE;
+}
+
+static gboolean query_segment(const gchar *path, const TrajectoryQuery *query,
+                              TrajectoryMatchFunc func, gpointer data,
+                              TrajectoryQueryStats *stats, GArray *samples,
+                              GError **error) {
+    GMappedFile *file = g_mapped_file_new(path, FALSE, error);
+    const SegmentHeader *header;
+    const TrackEntry *tracks;
+    const guint8 *columns[NUM_COLUMNS];
+    const gchar *contents;
+    gsize length, size;
+    gboolean ok = TRUE;
+
+    if (!file) return FALSE;
+    contents = g_mapped_file_get_contents(file);
+    length = g_mapped_file_get_length(file);
+    header = (const SegmentHeader *)contents;
+    if (length < sizeof(*header) ||
+        memcmp(header->magic, TRAJECTORY_ARCHIVE_MAGIC, sizeof(header->magic)) ||
+        header->version != TRAJECTORY_ARCHIVE_VERSION) {
+        g_set_error(error, TRAJECTORY_ARCHIVE_ERROR, 0,
+                    "%s is not a version %d segment", path, TRAJECTORY_ARCHIVE_VERSION);
+        g_mapped_file_unref(file);
+        return FALSE;
+    }
+    size = sizeof(*header) + (gsize)header->num_tracks * sizeof(TrackEntry);
+    for (guint c = 0; c < NUM_COLUMNS; c++) size += header->column_size[c];
+    if (size != length) {
+        g_set_error(error, TRAJECTORY_ARCHIVE_ERROR, 0, "%s is truncated", path);
+        g_mapped_file_unref(file);
+        return FALSE;
+    }
+    tracks = (const TrackEntry *)(header + 1);
+    columns[0] = (const guint8 *)(tracks + header->num_tracks);
+    for (guint c = 1; c < NUM_COLUMNS; c++) {
+        columns[c] = columns[c - 1] + header->column_size[c - 1];
+    }
+
+    stats->segments_read++;
+    for (guint i = 0; i < header->num_tracks && ok; i++) {
+        const TrackEntry *entry = &tracks[i];
+        const TrajectorySample *decoded;
+        TrajectoryMatch match;
+
+        stats->tracks_scanned++;
+        if (!time_overlaps(query, entry->start_ms, entry->end_ms) ||
+            !box_overlaps(query, entry->min_x, entry->min_y, entry->max_x,
+                          entry->max_y)) {
+            continue;
+        }
+        stats->tracks_decoded++;
+        if (!decode_track(entry, columns, header->column_size, samples)) {
+            g_set_error(error, TRAJECTORY_ARCHIVE_ERROR, 0, "%s is corrupt", path);
+            ok = FALSE;
+            break;
+        }
+        decoded = (const TrajectorySample *)samples->data;
+        if (!path_matches(query, decoded, samples->len)) continue;
+
+        stats->matches++;
+        match.source_id = header->source_id;
+        match.object_id = entry->object_id;
+        match.class_id = entry->class_id;
+        match.start_ms = entry->start_ms;
+        match.end_ms = entry->end_ms;
+        match.samples = decoded;
+        match.num_samples = samples->len;
+        func(&match, data);
+    }
+    g_mapped_file_unref(file);
+    return ok;
+}
+
+gboolean trajectory_archive_query(const gchar *dir, const TrajectoryQuery *query,
+                                  TrajectoryMatchFunc func, gpointer data,
+                                  TrajectoryQueryStats *stats, GError **error) {
+    TrajectoryQueryStats local;
+    gchar *index_path = g_build_filename(dir, TRAJECTORY_ARCHIVE_INDEX, NULL);
+    FILE *index = fopen(index_path, "r");
+    GArray *samples;
+    gchar line[512];
+    gboolean ok = TRUE;
+
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    if (!index) {
+        g_set_error(error, TRAJECTORY_ARCHIVE_ERROR, 0, "Cannot open %s: %s",
+                    index_path, g_strerror(errno));
+        g_free(index_path);
+        return FALSE;
+    }
+    g_free(index_path);
+
+    samples = g_array_new(FALSE, FALSE, sizeof(TrajectorySample));
+    while (ok && fgets(line, sizeof(line), index)) {
+        guint source_id, num_tracks;
+        gint64 start_ms, end_ms;
+        gfloat min_x, min_y, max_x, max_y;
+        gchar name[256], *path;
+
+        if (sscanf(line,
+                   "%u %" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %f %f %f %f %u %255s",
+                   &source_id, &start_ms, &end_ms, &min_x, &min_y, &max_x, &max_y,
+                   &num_tracks, name) != 9) {
+            continue;
+        }
+        stats->segments++;
+        if ((query->source_id >= 0 && (guint)query->source_id != source_id) ||
+            !time_overlaps(query, start_ms, end_ms) ||
+            !box_overlaps(query, min_x, min_y, max_x, max_y)) {
+            continue;
+        }
+        path = g_build_filename(dir, name, NULL);
+        ok = query_segment(path, query, func, data, stats, samples, error);
+        g_free(path);
+    }
+    g_array_free(samples, TRUE);
+    fclose(index);
+    return ok;
+}
@@ -0,0 +1,118 @@
+#ifndef __TRAJECTORY_ARCHIVE_H__
+#define __TRAJECTORY_ARCHIVE_H__
+
+#include <glib.h>
+
+#include "trajectory.h"
+
+/* Columnar on-disk archive of simplified trajectories.
+ *
+ * An archive is a directory of segment files, each holding the tracks of one
+ * source that ended within a span of time, plus an index file with a line per
+ * segment: its source, time span, bounding box and file name. A segment
+ * starts with a table of its tracks, giving each one's time span, bounding
+ * box and where its points start in each of three columns: times, x and y.
+ * Per track, a column holds the first value and then the differences between
+ * consecutive ones as LEB128 varints, zigzag-coded for coordinates, which are
+ * stored in 1/8 px. A query reads the index, maps only the segments whose
+ * source, time and box match, and decodes only the tracks whose own time and
+ * box match. Segments are host-endian, like the other formats here. */
+
+#define TRAJECTORY_ARCHIVE_MAGIC "NVDSTRAJ"
+#define TRAJECTORY_ARCHIVE_VERSION 1
+#define TRAJECTORY_ARCHIVE_INDEX "index"
+#define TRAJECTORY_DEFAULT_SEGMENT_TRACKS 4096
+#define TRAJECTORY_DEFAULT_SEGMENT_MS (10 * 60 * 1000)
+
+#define TRAJECTORY_ARCHIVE_ERROR g_quark_from_static_string("trajectory-archive-error")
+
+typedef struct {
+    /* Wall-clock ms since the epoch at pts 0 */
+    gint64 time_base_ms;
+    /* A source's segment is written once it holds this many tracks, or its
+     * tracks span this long */
+    guint segment_tracks;
+    guint segment_ms;
+} TrajectoryArchiveConfig;
+
+typedef struct {
+    guint64 tracks;
+    guint64 raw_points;
+    guint64 points;
+    guint64 segments;
+    /* Segment files, the index excluded */
+    guint64 bytes;
+} TrajectoryArchiveStats;
+
+typedef struct _TrajectoryArchive TrajectoryArchive;
+
+void trajectory_archive_config_init(TrajectoryArchiveConfig *config);
+
+/* Creates dir if needed. Segments are added to an existing archive. */
+TrajectoryArchive *trajectory_archive_open(const gchar *dir,
+                                           const TrajectoryArchiveConfig *config,
+                                           GError **error);
+/* Writes the segments still open, then fills stats if not NULL. Returns FALSE
+ * if any write failed. */
+gboolean trajectory_archive_close(TrajectoryArchive *archive,
+                                  TrajectoryArchiveStats *stats);
+
+/* A TrajectorySink, data being the archive. Can be called from any number of
+ * threads. */
+void trajectory_archive_add(const Trajectory *trajectory, gpointer archive);
+
+void trajectory_archive_get_stats(TrajectoryArchive *archive,
+                                  TrajectoryArchiveStats *stats);
+
+/* Querying */
+
+typedef struct {
+    gint64 time_ms;
+    gfloat x;
+    gfloat y;
+} TrajectorySample;
+
+typedef struct {
+    /* -1 for every source */
+    gint source_id;
+    /* Inclusive, in ms since the epoch */
+    gint64 start_ms;
+    gint64 end_ms;
+    /* Tracks must pass through this box within the time range */
+    gboolean has_region;
+    gfloat min_x;
+    gfloat min_y;
+    gfloat max_x;
+    gfloat max_y;
+} TrajectoryQuery;
+
+typedef struct {
+    guint source_id;
+    guint64 object_id;
+    gint class_id;
+    gint64 start_ms;
+    gint64 end_ms;
+    /* The whole piece, valid during the callback */
+    const TrajectorySample *samples;
+    guint num_samples;
+} TrajectoryMatch;
+
+typedef void (*TrajectoryMatchFunc)(const TrajectoryMatch *match, gpointer data);
+
+typedef struct {
+    guint segments;
+    guint segments_read;
+    guint64 tracks_scanned;
+    guint64 tracks_decoded;
+    guint64 matches;
+} TrajectoryQueryStats;
+
+/* Every source and all of time. */
+void trajectory_query_init(TrajectoryQuery *query);
+
+/* Calls func for every track piece matching query. stats may be NULL. */
+gboolean trajectory_archive_query(const gchar *dir, const TrajectoryQuery *query,
+                                  TrajectoryMatchFunc func, gpointer data,
+                                  TrajectoryQueryStats *stats, GError **error);
+
+#endif
@@ -0,0 +1,257 @@
+#include "zone_analytics.h"
+
+#include <string.h>
+
+#include "slab_table.h"
+
+typedef struct {
+    guint64 object_id;
+    guint64 last_seen;
+    guint source_id;
+    gfloat x;
+    gfloat y;
+    guint num_zones;
+    /* Ascending, as zone_layout_find() returns them */
+    guint16 zones[ZONE_TRACK_MAX_ZONES];
+    guint64 entered[ZONE_TRACK_MAX_ZONES];
+} ZoneTrack;
+
+struct _ZoneAnalytics {
+    const ZoneLayout *layout;
+    ZoneAnalyticsConfig config;
+
+    SlabTable *table;
+    ZoneTrack *slab;
+    guint64 last_sweep;
+    guint64 rejected;
+
+    ZoneCounters *zone_counters;
+    LineCounters *line_counters;
+
+    /* Events of the current call */
+    ZoneEvent *events;
+    guint max_events;
+    guint num_events;
+};
+
+void zone_analytics_config_init(ZoneAnalyticsConfig *config) {
+    config->max_tracks = ZONE_ANALYTICS_DEFAULT_MAX_TRACKS;
+    config->ttl = ZONE_ANALYTICS_DEFAULT_TTL_NS;
+}
+
+ZoneAnalytics *zone_analytics_new(const ZoneLayout *layout,
+                                  const ZoneAnalyticsConfig *config) {
+    ZoneAnalytics *analytics = g_new0(ZoneAnalytics, 1);
+    guint capacity = MAX(config->max_tracks, 1);
+
+    analytics->layout = layout;
+    analytics->config = *config;
+    analytics->config.max_tracks = capacity;
+    analytics->table = slab_table_new(capacity);
+    analytics->slab = g_new0(ZoneTrack, capacity);
+    analytics->zone_counters =
+        g_new0(ZoneCounters, MAX(zone_layout_num_zones(layout), 1));
+    analytics->line_counters =
+        g_new0(LineCounters, MAX(zone_layout_num_lines(layout), 1));
+    return analytics;
+}
+
+void zone_analytics_free(ZoneAnalytics *analytics) {
+    if (!analytics) return;
+    slab_table_free(analytics->table);
+    g_free(analytics->slab);
+    g_free(analytics->zone_counters);
+    g_free(analytics->line_counters);
+    g_free(analytics);
+}
+
+/* Single writer, so a relaxed load and store is enough for other readers */
+static inline void bump(guint64 *counter, guint64 delta) {
+    __atomic_store_n(counter, *counter + delta, __ATOMIC_RELAXED);
+}
+
+static void emit(ZoneAnalytics *analytics, ZoneEventType type, const ZoneTrack *track,
+                 guint64 pts, guint index, guint64 dwell, gint direction) {
+    if (analytics->num_events < analytics->max_events) {
+        ZoneEvent *event = &analytics->events[analytics->num_events];
+        event->type = type;
+        event->source_id = track->source_id;
+        event->object_id = track->object_id;
+        event->pts = pts;
+        event->index = index;
+        event->dwell = dwell;
+        event->direction = direction;
+    }
+    analytics->num_events++;
+}
+
+static void enter_zone(ZoneAnalytics *analytics, const ZoneTrack *track, guint zone,
+                       guint64 pts) {
+    ZoneCounters *counters = &analytics->zone_counters[zone];
+
+    bump(&counters->entries, 1);
+    __atomic_store_n(&counters->occupancy, counters->occupancy + 1, __ATOMIC_RELAXED);
+    emit(analytics, ZONE_EVENT_ENTER, track, pts, zone, 0, 0);
+}
+
+static void exit_zone(ZoneAnalytics *analytics, const ZoneTrack *track, guint slot,
+                      guint64 pts) {
+    guint zone = track->zones[slot];
+    ZoneCounters *counters = &analytics->zone_counters[zone];
+    guint64 dwell = pts > track->entered[slot] ? pts - track->entered[slot] : 0;
+
+    bump(&counters->exits, 1);
+    bump(&counters->dwell_total, dwell);
+    if (dwell > counters->dwell_max) {
+        __atomic_store_n(&counters->dwell_max, dwell, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&counters->occupancy, counters->occupancy - 1, __ATOMIC_RELAXED);
+    emit(analytics, ZONE_EVENT_EXIT, track, pts, zone, dwell, 0);
+}
+
+/* Tracks gone for longer than the ttl leave their zones at their last
+ * sighting */
+static guint sweep(ZoneAnalytics *analytics, guint64 now) {
+    guint evicted = 0;
+
+    for (guint i = 0; i < analytics->config.max_tracks; i++) {
+        ZoneTrack *track = &analytics->slab[i];
+
+        if (!slab_table_in_use(analytics->table, i) ||
+            !record_is_stale(track->last_seen, now, analytics->config.ttl)) {
+            continue;
+        }
+        for (guint z = 0; z < track->num_zones; z++) {
+            exit_zone(analytics, track, z, track->last_seen);
+        }
+        slab_table_remove(analytics->table, i);
+        evicted++;
+    }
+    analytics->last_sweep = now;
+    return evicted;
+}
+
+static ZoneTrack *lookup(ZoneAnalytics *analytics, guint64 key, guint64 now,
+                         gboolean *created) {
+    guint32 idx = slab_table_find(analytics->table, key);
+    ZoneTrack *track;
+
+    *created = FALSE;
+    if (idx != SLAB_TABLE_NONE) return &analytics->slab[idx];
+
+    idx = slab_table_insert(analytics->table, key);
+    if (idx == SLAB_TABLE_NONE && sweep(analytics, now) > 0) {
+        idx = slab_table_insert(analytics->table, key);
+    }
+    if (idx == SLAB_TABLE_NONE) {
+        analytics->rejected++;
+        return NULL;
+    }
+
+    track = &analytics->slab[idx];
+    track->num_zones = 0;
+    *created = TRUE;
+    return track;
+}
+
+/* Both lists are ascending, so one merge finds the zones left and entered */
+static void update_zones(ZoneAnalytics *analytics, ZoneTrack *track,
+                         const guint16 *zones, guint num_zones, guint64 pts) {
+    guint16 kept[ZONE_TRACK_MAX_ZONES];
+    guint64 entered[ZONE_TRACK_MAX_ZONES];
+    guint i = 0, j = 0, n = 0;
+
+    while (i < track->num_zones || j < num_zones) {
+        if (j == num_zones || (i < track->num_zones && track->zones[i] < zones[j])) {
+            exit_zone(analytics, track, i++, pts);
+        } else if (i == track->num_zones || zones[j] < track->zones[i]) {
+            enter_zone(analytics, track, zones[j], pts);
+            kept[n] = zones[j++];
+            entered[n++] = pts;
+        } else {
+            kept[n] = zones[j++];
+            entered[n++] = track->entered[i++];
+        }
+    }
+    memcpy(track->zones, kept, n * sizeof(guint16));
+    memcpy(track->entered, entered, n * sizeof(guint64));
+    track->num_zones = n;
+}
+
+guint zone_analytics_process(ZoneAnalytics *analytics, const FrameRecord *frame,
+                             ZoneEvent *events, guint max_events) {
+    guint16 zones[ZONE_TRACK_MAX_ZONES];
+    ZoneCrossing crossings[ZONE_TRACK_MAX_ZONES];
+
+    analytics->events = events;
+    analytics->max_events = events ? max_events : 0;
+    analytics->num_events = 0;
+
+    for (guint i = 0; i < frame->num_objects; i++) {
+        const ObjectRecord *obj = &frame->objects[i];
+        gfloat x = obj->left + obj->width / 2, y = obj->top + obj->height / 2;
+        ZoneTrack *track;
+        gboolean created;
+        guint num_zones;
+
+        if (obj->object_id == RECORD_UNTRACKED_ID) continue;
+        track = lookup(analytics, record_track_key(frame->source_id, obj->object_id),
+                       frame->pts, &created);
+        if (!track) continue;
+        track->object_id = obj->object_id;
+        track->source_id = frame->source_id;
+        track->last_seen = frame->pts;
+
+        num_zones = zone_layout_find(analytics->layout, frame->source_id,
+                                     obj->class_id, x, y, zones, ZONE_TRACK_MAX_ZONES);
+        update_zones(analytics, track, zones, num_zones, frame->pts);
+
+        if (!created) {
+            guint num_crossings = zone_layout_crossings(
+                analytics->layout, frame->source_id, obj->class_id, track->x, track->y,
+                x, y, crossings, G_N_ELEMENTS(crossings));
+            for (guint c = 0; c < num_crossings; c++) {
+                LineCounters *counters = &analytics->line_counters[crossings[c].line];
+                bump(crossings[c].direction > 0 ? &counters->forward
+                                                : &counters->backward,
+                     1);
+                emit(analytics, ZONE_EVENT_CROSS, track, frame->pts, crossings[c].line,
+                     0, crossings[c].direction);
+            }
+        }
+        track->x = x;
+        track->y = y;
+    }
+
+    if (record_is_stale(analytics->last_sweep, frame->pts, analytics->config.ttl / 4)) {
+        sweep(analytics, frame->pts);
+    }
+    return analytics->num_events;
+}
+
+void zone_analytics_add_counters(const ZoneAnalytics *analytics, ZoneCounters *zones,
+                                 LineCounters *lines) {
+    for (guint i = 0; i < zone_layout_num_zones(analytics->layout); i++) {
+        const ZoneCounters *c = &analytics->zone_counters[i];
+        guint64 dwell_max = __atomic_load_n(&c->dwell_max, __ATOMIC_RELAXED);
+
+        zones[i].entries += __atomic_load_n(&c->entries, __ATOMIC_RELAXED);
+        zones[i].exits += __atomic_load_n(&c->exits, __ATOMIC_RELAXED);
+        zones[i].occupancy += __atomic_load_n(&c->occupancy, __ATOMIC_RELAXED);
+        zones[i].dwell_total += __atomic_load_n(&c->dwell_total, __ATOMIC_RELAXED);
+        zones[i].dwell_max = MAX(zones[i].dwell_max, dwell_max);
+    }
+    for (guint i = 0; i < zone_layout_num_lines(analytics->layout); i++) {
+        const LineCounters *c = &analytics->line_counters[i];
+        lines[i].forward += __atomic_load_n(&c->forward, __ATOMIC_RELAXED);
+        lines[i].backward += __atomic_load_n(&c->backward, __ATOMIC_RELAXED);
+    }
+}
+
+guint zone_analytics_num_tracks(const ZoneAnalytics *analytics) {
+    return slab_table_size(analytics->table);
+}
+
+guint64 zone_analytics_rejected(const ZoneAnalytics *analytics) {
+    return analytics->rejected;
+}
@@ -0,0 +1,89 @@
+#ifndef __ZONE_ANALYTICS_H__
+#define __ZONE_ANALYTICS_H__
+
+#include <glib.h>
+
+#include "frame_record.h"
+#include "zones.h"
+
+/* Zone dwell time and line crossings of tracked objects.
+ *
+ * For every track the zones its centroid is in, with when it entered them,
+ * and its centroid on the previous frame are kept. Each frame the centroid
+ * is looked up in the ZoneLayout grid and compared with the zones held, and
+ * the move since the previous frame is tested against the lines near it, so
+ * entries, exits and crossings come out incrementally. Dwell runs from entry
+ * to exit, or to the last sighting for tracks that expire inside a zone.
+ * Untracked objects are ignored. The counters have a single writer, the
+ * thread calling zone_analytics_process(), and can be read from any thread.
+ * Like TrackStore, nothing is allocated after zone_analytics_new(). */
+
+#define ZONE_ANALYTICS_DEFAULT_MAX_TRACKS 4096
+#define ZONE_ANALYTICS_DEFAULT_TTL_NS (2 * 1000000000ULL)
+/* Overlapping zones held per track, further ones are not counted */
+#define ZONE_TRACK_MAX_ZONES 8
+
+typedef enum {
+    ZONE_EVENT_ENTER,
+    ZONE_EVENT_EXIT,
+    ZONE_EVENT_CROSS,
+} ZoneEventType;
+
+typedef struct {
+    ZoneEventType type;
+    guint source_id;
+    guint64 object_id;
+    guint64 pts;
+    /* The zone, or the line for ZONE_EVENT_CROSS */
+    guint index;
+    /* ZONE_EVENT_EXIT: ns spent in the zone */
+    guint64 dwell;
+    /* ZONE_EVENT_CROSS: +1 forward, -1 backward */
+    gint direction;
+} ZoneEvent;
+
+typedef struct {
+    guint64 entries;
+    guint64 exits;
+    /* Tracks inside now */
+    gint64 occupancy;
+    /* Over completed visits, in ns */
+    guint64 dwell_total;
+    guint64 dwell_max;
+} ZoneCounters;
+
+typedef struct {
+    guint64 forward;
+    guint64 backward;
+} LineCounters;
+
+typedef struct {
+    guint max_tracks;
+    /* ns without a sighting before a track counts as gone */
+    guint64 ttl;
+} ZoneAnalyticsConfig;
+
+typedef struct _ZoneAnalytics ZoneAnalytics;
+
+void zone_analytics_config_init(ZoneAnalyticsConfig *config);
+
+/* layout must outlive the analytics. */
+ZoneAnalytics *zone_analytics_new(const ZoneLayout *layout,
+                                  const ZoneAnalyticsConfig *config);
+void zone_analytics_free(ZoneAnalytics *analytics);
+
+/* Updates the tracks seen in frame and expires the ones gone. Writes up to
+ * max_events events, events may be NULL, and returns how many happened. */
+guint zone_analytics_process(ZoneAnalytics *analytics, const FrameRecord *frame,
+                             ZoneEvent *events, guint max_events);
+
+/* Adds the counters so far to zones and lines, which have one entry per zone
+ * and line of the layout. */
+void zone_analytics_add_counters(const ZoneAnalytics *analytics, ZoneCounters *zones,
+                                 LineCounters *lines);
+
+guint zone_analytics_num_tracks(const ZoneAnalytics *analytics);
+/* New tracks turned away because the table was full */
+guint64 zone_analytics_rejected(const ZoneAnalytics *analytics);
+
+#endif
@@ -0,0 +1,565 @@
+#include "zones.h"
+
+#include <string.h>
+
+#define ZONES_ERROR g_quark_from_static_string("zones-error")
+#define GROUP_ZONES "zones"
+#define ZONE_GROUP_PREFIX "zone "
+#define LINE_GROUP_PREFIX "line "
+
+/* Candidates of each cell, cols * rows + 1 offsets into the entry arrays */
+typedef struct {
+    guint32 *zone_start;
+    /* Zone index << 1, | 1 when the cell lies wholly inside the zone */
+    guint16 *zone_entries;
+    guint32 *line_start;
+    guint16 *line_entries;
+} ZoneGrid;
+
+struct _ZoneLayout {
+    Zone *zones;
+    guint num_zones;
+    ZoneLine *lines;
+    guint num_lines;
+    guint width;
+    guint height;
+    gfloat cell_size;
+    guint cols;
+    guint rows;
+    /* grids[0] holds what applies to every source, grids[s + 1] that plus
+     * source s's own, or NULL when source s has nothing of its own */
+    ZoneGrid **grids;
+    guint num_grids;
+};
+
+typedef struct {
+    guint32 cell;
+    guint16 entry;
+} CellEntry;
+
+static inline gboolean class_counts(guint64 class_mask, gint class_id) {
+    if (class_mask == ZONE_ALL_CLASSES) return TRUE;
+    return class_id >= 0 && class_id < 64 && (class_mask >> class_id) & 1;
+}
+
+gboolean zone_applies(guint64 class_mask, gint zone_source_id, guint source_id,
+                      gint class_id) {
+    if (zone_source_id >= 0 && (guint)zone_source_id != source_id) return FALSE;
+    return class_counts(class_mask, class_id);
+}
+
+/* Even-odd rule */
+gboolean zone_contains(const Zone *zone, gfloat x, gfloat y) {
+    const ZonePoint *p = zone->points;
+    gboolean inside = FALSE;
+
+    for (guint i = 0, j = zone->num_points - 1; i < zone->num_points; j = i++) {
+        if ((p[i].y > y) != (p[j].y > y) &&
+            x < (p[j].x - p[i].x) * (y - p[i].y) / (p[j].y - p[i].y) + p[i].x) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+gint zone_line_crossing(const ZoneLine *line, gfloat x0, gfloat y0, gfloat x1,
+                        gfloat y1) {
+    gfloat dx = line->b.x - line->a.x, dy = line->b.y - line->a.y;
+    gfloat mx = x1 - x0, my = y1 - y0;
+    /* Which side of the line each end is on, the right being positive */
+    gfloat s0 = dx * (y0 - line->a.y) - dy * (x0 - line->a.x);
+    gfloat s1 = dx * (y1 - line->a.y) - dy * (x1 - line->a.x);
+    gfloat u;
+
+    if ((s0 > 0) == (s1 > 0)) return 0;
+    /* Where the move meets the line, as a fraction of a to b */
+    u = ((x0 - line->a.x) * my - (y0 - line->a.y) * mx) / (s1 - s0);
+    if (u < 0 || u > 1) return 0;
+    return s1 > 0 ? 1 : -1;
+}
+
+/* Liang-Barsky clip of p-q against a closed rectangle */
+static gboolean segment_hits_rect(ZonePoint p, ZonePoint q, gfloat x0, gfloat y0,
+                                  gfloat x1, gfloat y1) {
+    gfloat dx = q.x - p.x, dy = q.y - p.y;
+    gfloat edge[4] = {-dx, dx, -dy, dy};
+    gfloat dist[4] = {p.x - x0, x1 - p.x, p.y - y0, y1 - p.y};
+    gfloat t0 = 0, t1 = 1;
+
+    for (guint k = 0; k < 4; k++) {
+        gfloat r;
+
+        if (edge[k] == 0) {
+            if (dist[k] < 0) return FALSE;
+            continue;
+        }
+        r = dist[k] / edge[k];
+        if (edge[k] < 0) {
+            t0 = MAX(t0, r);
+        } else {
+            t1 = MIN(t1, r);
+        }
+        if (t0 > t1) return FALSE;
+    }
+    return TRUE;
+}
+
+/* Cell range covered by [lo, hi] on one axis, FALSE if it misses the grid */
+static gboolean cell_range(const ZoneLayout *layout, gfloat lo, gfloat hi, guint cells,
+                           guint *first, guint *last) {
+    if (hi < 0 || lo >= cells * layout->cell_size) return FALSE;
+    *first = lo <= 0 ? 0 : (guint)(lo / layout->cell_size);
+    *last = MIN((guint)(MAX(hi, 0) / layout->cell_size), cells - 1);
+    return TRUE;
+}
+
+static void index_zone(const ZoneLayout *layout, guint index, GArray *entries) {
+    const Zone *zone = &layout->zones[index];
+    gfloat min_x = G_MAXFLOAT, min_y = G_MAXFLOAT, max_x = -G_MAXFLOAT,
+           max_y = -G_MAXFLOAT;
+    guint c0, c1, r0, r1;
+
+    for (guint i = 0; i < zone->num_points; i++) {
+        min_x = MIN(min_x, zone->points[i].x);
+        max_x = MAX(max_x, zone->points[i].x);
+        min_y = MIN(min_y, zone->points[i].y);
+        max_y = MAX(max_y, zone->points[i].y);
+    }
+    if (!cell_range(layout, min_x, max_x, layout->cols, &c0, &c1) ||
+        !cell_range(layout, min_y, max_y, layout->rows, &r0, &r1)) {
+        return;
+    }
+
+    for (guint r = r0; r <= r1; r++) {
+        for (guint c = c0; c <= c1; c++) {
+            gfloat x0 = c * layout->cell_size, y0 = r * layout->cell_size;
+            gfloat x1 = x0 + layout->cell_size, y1 = y0 + layout->cell_size;
+            gboolean edge_inside = FALSE;
+            CellEntry entry = {r * layout->cols + c, (guint16)(index << 1)};
+
+            for (guint i = 0, j = zone->num_points - 1; i < zone->num_points; j = i++) {
+                if (segment_hits_rect(zone->points[j], zone->points[i], x0, y0, x1,
+                                      y1)) {
+                    edge_inside = TRUE;
+                    break;
+                }
+            }
+            /* Without an edge in the cell, all of it is on one side */
+            if (!edge_inside) {
+                if (!zone_contains(zone, x0 + layout->cell_size / 2,
+                                   y0 + layout->cell_size / 2)) {
+                    continue;
+                }
+                entry.entry |= 1;
+            }
+            g_array_append_val(entries, entry);
+        }
+    }
+}
+
+static void index_line(const ZoneLayout *layout, guint index, GArray *entries) {
+    const ZoneLine *line = &layout->lines[index];
+    guint c0, c1, r0, r1;
+
+    if (!cell_range(layout, MIN(line->a.x, line->b.x), MAX(line->a.x, line->b.x),
+                    layout->cols, &c0, &c1) ||
+        !cell_range(layout, MIN(line->a.y, line->b.y), MAX(line->a.y, line->b.y),
+                    layout->rows, &r0, &r1)) {
+        return;
+    }
+    for (guint r = r0; r <= r1; r++) {
+        for (guint c = c0; c <= c1; c++) {
+            gfloat x0 = c * layout->cell_size, y0 = r * layout->cell_size;
+            CellEntry entry = {r * layout->cols + c, (guint16)index};
+
+            if (segment_hits_rect(line->a, line->b, x0, y0, x0 + layout->cell_size,
+                                  y0 + layout->cell_size)) {
+                g_array_append_val(entries, entry);
+            }
+        }
+    }
+}
+
+/* Counting sort by cell. Entries were added in index order, which each cell
+ * keeps. */
+static void pack_cells(const ZoneLayout *layout, GArray *entries, guint32 **start,
+                       guint16 **packed) {
+    guint num_cells = layout->cols * layout->rows;
+    guint32 *cursor = g_new(guint32, num_cells);
+
+    *start = g_new0(guint32, num_cells + 1);
+    *packed = g_new(guint16, MAX(entries->len, 1));
+    for (guint i = 0; i < entries->len; i++) {
+        (*start)[g_array_index(entries, CellEntry, i).cell + 1]++;
+    }
+    for (guint c = 0; c < num_cells; c++) (*start)[c + 1] += (*start)[c];
+    memcpy(cursor, *start, num_cells * sizeof(guint32));
+    for (guint i = 0; i < entries->len; i++) {
+        CellEntry *entry = &g_array_index(entries, CellEntry, i);
+        (*packed)[cursor[entry->cell]++] = entry->entry;
+    }
+    g_free(cursor);
+}
+
+/* Grid of what applies to source, or to every source for -1 */
+static ZoneGrid *build_grid(const ZoneLayout *layout, gint source) {
+    ZoneGrid *grid = g_new0(ZoneGrid, 1);
+    GArray *entries = g_array_new(FALSE, FALSE, sizeof(CellEntry));
+
+    for (guint i = 0; i < layout->num_zones; i++) {
+        gint zone_source = layout->zones[i].source_id;
+        if (zone_source < 0 || zone_source == source) index_zone(layout, i, entries);
+    }
+    pack_cells(layout, entries, &grid->zone_start, &grid->zone_entries);
+
+    g_array_set_size(entries, 0);
+    for (guint i = 0; i < layout->num_lines; i++) {
+        gint line_source = layout->lines[i].source_id;
+        if (line_source < 0 || line_source == source) index_line(layout, i, entries);
+    }
+    pack_cells(layout, entries, &grid->line_start, &grid->line_entries);
+
+    g_array_free(entries, TRUE);
+    return grid;
+}
+
+static void free_grid(ZoneGrid *grid) {
+    if (!grid) return;
+    g_free(grid->zone_start);
+    g_free(grid->zone_entries);
+    g_free(grid->line_start);
+    g_free(grid->line_entries);
+    g_free(grid);
+}
+
+ZoneLayout *zone_layout_new(const Zone *zones, guint num_zones, const ZoneLine *lines,
+                            guint num_lines, guint width, guint height,
+                            guint cell_size) {
+    ZoneLayout *layout = g_new0(ZoneLayout, 1);
+    gint max_source = -1;
+
+    layout->num_zones = MIN(num_zones, ZONE_MAX_ZONES);
+    layout->num_lines = MIN(num_lines, ZONE_MAX_LINES);
+    layout->zones = g_new0(Zone, MAX(layout->num_zones, 1));
+    layout->lines = g_new0(ZoneLine, MAX(layout->num_lines, 1));
+    for (guint i = 0; i < layout->num_zones; i++) {
+        layout->zones[i] = zones[i];
+        layout->zones[i].name = g_strdup(zones[i].name);
+        layout->zones[i].points = g_new(ZonePoint, zones[i].num_points);
+        memcpy(layout->zones[i].points, zones[i].points,
+               zones[i].num_points * sizeof(ZonePoint));
+        max_source = MAX(max_source, zones[i].source_id);
+    }
+    for (guint i = 0; i < layout->num_lines; i++) {
+        layout->lines[i] = lines[i];
+        layout->lines[i].name = g_strdup(lines[i].name);
+        max_source = MAX(max_source, lines[i].source_id);
+    }
+
+    layout->width = MAX(width, 1);
+    layout->height = MAX(height, 1);
+    layout->cell_size = MAX(cell_size, 1);
+    layout->cols = (layout->width + layout->cell_size - 1) / layout->cell_size;
+    layout->rows = (layout->height + layout->cell_size - 1) / layout->cell_size;
+
+    layout->num_grids = max_source + 2;
+    layout->grids = g_new0(ZoneGrid *, layout->num_grids);
+    layout->grids[0] = build_grid(layout, -1);
+    for (guint i = 0; i < layout->num_zones; i++) {
+        gint source = layout->zones[i].source_id;
+        if (source >= 0 && !layout->grids[source + 1]) {
+            layout->grids[source + 1] = build_grid(layout, source);
+        }
+    }
+    for (guint i = 0; i < layout->num_lines; i++) {
+        gint source = layout->lines[i].source_id;
+        if (source >= 0 && !layout->grids[source + 1]) {
+            layout->grids[source + 1] = build_grid(layout, source);
+        }
+    }
+    return layout;
+}
+
+void zone_layout_free(ZoneLayout *layout) {
+    if (!layout) return;
+    for (guint i = 0; i < layout->num_zones; i++) {
+        g_free(layout->zones[i].name);
+        g_free(layout->zones[i].points);
+    }
+    for (guint i = 0; i < layout->num_lines; i++) g_free(layout->lines[i].name);
+    for (guint i = 0; i < layout->num_grids; i++) free_grid(layout->grids[i]);
+    g_free(layout->grids);
+    g_free(layout->zones);
+    g_free(layout->lines);
+    g_free(layout);
+}
+
+guint zone_layout_num_zones(const ZoneLayout *layout) { return layout->num_zones; }
+
+guint zone_layout_num_lines(const ZoneLayout *layout) { return layout->num_lines; }
+
+const Zone *zone_layout_zone(const ZoneLayout *layout, guint index) {
+    return &layout->zones[index];
+}
+
+const ZoneLine *zone_layout_line(const ZoneLayout *layout, guint index) {
+    return &layout->lines[index];
+}
+
+static inline const ZoneGrid *grid_for(const ZoneLayout *layout, guint source_id) {
+    if (source_id + 1 < layout->num_grids && layout->grids[source_id + 1]) {
+        return layout->grids[source_id + 1];
+    }
+    return layout->grids[0];
+}
+
+guint zone_layout_find(const ZoneLayout *layout, guint source_id, gint class_id,
+                       gfloat x, gfloat y, guint16 *zones, guint max_zones) {
+    const ZoneGrid *grid = grid_for(layout, source_id);
+    guint cell, found = 0;
+
+    /* Also rejects NaN */
+    if (!(x >= 0 && y >= 0 && x < layout->width && y < layout->height)) return 0;
+    cell = (guint)(y / layout->cell_size) * layout->cols +
+           (guint)(x / layout->cell_size);
+
+    for (guint32 e = grid->zone_start[cell]; e < grid->zone_start[cell + 1]; e++) {
+        guint16 entry = grid->zone_entries[e];
+        const Zone *zone = &layout->zones[entry >> 1];
+
+        if (!class_counts(zone->class_mask, class_id)) continue;
+        if (!(entry & 1) && !zone_contains(zone, x, y)) continue;
+        zones[found++] = entry >> 1;
+        if (found == max_zones) break;
+    }
+    return found;
+}
+
+static inline guint clamp_cell(gfloat v, gfloat cell_size, guint cells) {
+    if (!(v > 0)) return 0;
+    return MIN((guint)(v / cell_size), cells - 1);
+}
+
+static guint add_crossing(const ZoneLayout *layout, guint index, guint source_id,
+                          gint class_id, const gfloat *move, ZoneCrossing *crossings,
+                          guint found) {
+    const ZoneLine *line = &layout->lines[index];
+    gint direction;
+
+    if (!zone_applies(line->class_mask, line->source_id, source_id, class_id)) {
+        return found;
+    }
+    /* Lines through several of the cells looked at come up more than once */
+    for (guint i = 0; i < found; i++) {
+        if (crossings[i].line == index) return found;
+    }
+    direction = zone_line_crossing(line, move[0], move[1], move[2], move[3]);
+    if (!direction) return found;
+    crossings[found].line = (guint16)index;
+    crossings[found].direction = (gint8)direction;
+    return found + 1;
+}
+
+guint zone_layout_crossings(const ZoneLayout *layout, guint source_id, gint class_id,
+                            gfloat x0, gfloat y0, gfloat x1, gfloat y1,
+                            ZoneCrossing *crossings, guint max_crossings) {
+    const ZoneGrid *grid = grid_for(layout, source_id);
+    const gfloat move[4] = {x0, y0, x1, y1};
+    guint c0 = clamp_cell(x0, layout->cell_size, layout->cols);
+    guint c1 = clamp_cell(x1, layout->cell_size, layout->cols);
+    guint r0 = clamp_cell(y0, layout->cell_size, layout->rows);
+    guint r1 = clamp_cell(y1, layout->cell_size, layout->rows);
+    guint found = 0;
+
+    if (max_crossings == 0) return 0;
+    if (c0 > c1) {
+        guint t = c0;
+        c0 = c1;
+        c1 = t;
+    }
+    if (r0 > r1) {
+        guint t = r0;
+        r0 = r1;
+        r1 = t;
+    }
+
+    /* A move across more than two cells is rare enough to test every line */
+    if (c1 - c0 > 1 || r1 - r0 > 1) {
+        for (guint i = 0; i < layout->num_lines && found < max_crossings; i++) {
+            found =
+                add_crossing(layout, i, source_id, class_id, move, crossings, found);
+        }
+        return found;
+    }
+
+    for (guint r = r0; r <= r1; r++) {
+        for (guint c = c0; c <= c1; c++) {
+            guint cell = r * layout->cols + c;
+            for (guint32 e = grid->line_start[cell];
+                 e < grid->line_start[cell + 1] && found < max_crossings; e++) {
+                found = add_crossing(layout, grid->line_entries[e], source_id,
+                                     class_id, move, crossings, found);
+            }
+        }
+    }
+    return found;
+}
+
+/* "x,y;x,y;..." into points */
+static gboolean load_points(GKeyFile *key_file, const gchar *group, const gchar *key,
+                            GArray *points, GError **error) {
+    gchar **items = g_key_file_get_string_list(key_file, group, key, NULL, error);
+
+    if (!items) return FALSE;
+    for (gchar **item = items; *item; item++) {
+        gchar *end;
+        ZonePoint point;
+
+        point.x = (gfloat)g_ascii_strtod(*item, &end);
+        if (end == *item || *end != ',') goto invalid;
+        point.y = (gfloat)g_ascii_strtod(end + 1, &end);
+        while (g_ascii_isspace(*end)) end++;
+        if (*end != '\0') goto invalid;
+        g_array_append_val(points, point);
+        continue;
+
+    invalid:
+        g_set_error(error, ZONES_ERROR, 0, "[%s] %s: expected x,y but got '%s'", group,
+                    key, *item);
+        g_strfreev(items);
+        return FALSE;
+    }
+    g_strfreev(items);
+    return TRUE;
+}
+
+static gboolean load_filters(GKeyFile *key_file, const gchar *group,
+                             guint max_sources, gint *source_id, guint64 *class_mask,
+                             GError **error) {
+    gint *classes;
+    gsize num_classes;
+
+    *source_id = -1;
+    *class_mask = ZONE_ALL_CLASSES;
+    if (g_key_file_has_key(key_file, group, "source", NULL)) {
+        *source_id = g_key_file_get_integer(key_file, group, "source", error);
+        if (error && *error) return FALSE;
+        /* The layout keeps a grid per source id up to the highest one */
+        if (*source_id < 0 || (guint)*source_id >= max_sources) {
+            g_set_error(error, ZONES_ERROR, 0,
+                        "[%s] source: source ids go from 0 to %u, not %d", group,
+                        max_sources - 1, *source_id);
+            return FALSE;
+        }
+    }
+    if (!g_key_file_has_key(key_file, group, "classes", NULL)) return TRUE;
+
+    classes = g_key_file_get_integer_list(key_file, group, "classes", &num_classes,
+                                          error);
+    if (!classes) return FALSE;
+    *class_mask = 0;
+    for (gsize i = 0; i < num_classes; i++) {
+        if (classes[i] < 0 || classes[i] > 63) {
+            g_set_error(error, ZONES_ERROR, 0,
+                        "[%s] classes: class ids go from 0 to 63, not %d", group,
+                        classes[i]);
+            g_free(classes);
+            return FALSE;
+        }
+        *class_mask |= G_GUINT64_CONSTANT(1) << classes[i];
+    }
+    g_free(classes);
+    return TRUE;
+}
+
+ZoneLayout *zone_layout_load(const gchar *path, guint width, guint height,
+                             guint max_sources, GError **error) {
+    GKeyFile *key_file = g_key_file_new();
+    GArray *zones = g_array_new(FALSE, TRUE, sizeof(Zone));
+    GArray *lines = g_array_new(FALSE, TRUE, sizeof(ZoneLine));
+    GArray *points = g_array_new(FALSE, FALSE, sizeof(ZonePoint));
+    ZoneLayout *layout = NULL;
+    gint cell_size = ZONE_DEFAULT_CELL_SIZE;
+    gchar **groups = NULL;
+
+    if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, error)) goto done;
+    if (g_key_file_has_key(key_file, GROUP_ZONES, "cell-size", NULL)) {
+        cell_size = g_key_file_get_integer(key_file, GROUP_ZONES, "cell-size", error);
+        if (error && *error) goto done;
+        if (cell_size < 8) {
+            g_set_error(error, ZONES_ERROR, 0, "cell-size must be at least 8 pixels");
+            goto done;
+        }
+    }
+
+    groups = g_key_file_get_groups(key_file, NULL);
+    for (gchar **group = groups; *group; group++) {
+        if (g_str_has_prefix(*group, ZONE_GROUP_PREFIX)) {
+            Zone zone = {0};
+
+            g_array_set_size(points, 0);
+            if (!load_points(key_file, *group, "polygon", points, error) ||
+                !load_filters(key_file, *group, max_sources, &zone.source_id,
+                              &zone.class_mask, error)) {
+                goto done;
+            }
+            if (points->len < 3 || points->len > ZONE_MAX_VERTICES) {
+                g_set_error(error, ZONES_ERROR, 0,
+                            "[%s] polygon needs 3 to %d points, not %u", *group,
+                            ZONE_MAX_VERTICES, points->len);
+                goto done;
+            }
+            zone.name = g_strstrip(g_strdup(*group + strlen(ZONE_GROUP_PREFIX)));
+            zone.num_points = points->len;
+            zone.points = (ZonePoint *)g_array_free(points, FALSE);
+            points = g_array_new(FALSE, FALSE, sizeof(ZonePoint));
+            g_array_append_val(zones, zone);
+        } else if (g_str_has_prefix(*group, LINE_GROUP_PREFIX)) {
+            ZoneLine line = {0};
+
+            g_array_set_size(points, 0);
+            if (!load_points(key_file, *group, "points", points, error) ||
+                !load_filters(key_file, *group, max_sources, &line.source_id,
+                              &line.class_mask, error)) {
+                goto done;
+            }
+            if (points->len != 2) {
+                g_set_error(error, ZONES_ERROR, 0, "[%s] points needs 2 points, not %u",
+                            *group, points->len);
+                goto done;
+            }
+            line.name = g_strstrip(g_strdup(*group + strlen(LINE_GROUP_PREFIX)));
+            line.a = g_array_index(points, ZonePoint, 0);
+            line.b = g_array_index(points, ZonePoint, 1);
+            g_array_append_val(lines, line);
+        } else if (g_strcmp0(*group, GROUP_ZONES)) {
+            g_set_error(error, ZONES_ERROR, 0,
+                        "Unknown group [%s], expected [zone NAME] or [line NAME]",
+                        *group);
+            goto done;
+        }
+    }
+    if (zones->len > ZONE_MAX_ZONES || lines->len > ZONE_MAX_LINES) {
+        g_set_error(error, ZONES_ERROR, 0, "At most %d zones and %d lines",
+                    ZONE_MAX_ZONES, ZONE_MAX_LINES);
+        goto done;
+    }
+
+    layout = zone_layout_new((Zone *)zones->data, zones->len, (ZoneLine *)lines->data,
+                             lines->len, width, height, (guint)cell_size);
+
+done:
+    for (guint i = 0; i < zones->len; i++) {
+        g_free(g_array_index(zones, Zone, i).name);
+        g_free(g_array_index(zones, Zone, i).points);
+    }
+    for (guint i = 0; i < lines->len; i++) {
+        g_free(g_array_index(lines, ZoneLine, i).name);
+    }
+    g_array_free(zones, TRUE);
+    g_array_free(lines, TRUE);
+    g_array_free(points, TRUE);
+    g_strfreev(groups);
+    g_key_file_free(key_file);
+    return layout;
+}
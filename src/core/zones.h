@@ -0,0 +1,95 @@
+#ifndef __ZONES_H__
+#define __ZONES_H__
+
+#include <glib.h>
+
+/* Polygon zones and counting lines over the muxer output frame.
+ *
+ * A ZoneLayout is loaded once and never changes, so any number of threads
+ * can query it. Each zone and line applies to one source or to all of them,
+ * and optionally to a set of classes. For every source with zones of its
+ * own, and once for the zones shared by all sources, a uniform grid over the
+ * frame lists the zones overlapping each cell, flagging cells that lie wholly
+ * inside a zone, and the lines passing through it. A point is then only
+ * tested against the polygons of its cell, and not at all for cells a zone
+ * covers completely. */
+
+#define ZONE_DEFAULT_CELL_SIZE 32
+#define ZONE_MAX_VERTICES 64
+/* Zone and line indices are stored in 16 bits */
+#define ZONE_MAX_ZONES 4096
+#define ZONE_MAX_LINES 4096
+/* Every class, for class_mask */
+#define ZONE_ALL_CLASSES G_MAXUINT64
+
+typedef struct {
+    gfloat x;
+    gfloat y;
+} ZonePoint;
+
+typedef struct {
+    gchar *name;
+    /* -1 for every source */
+    gint source_id;
+    /* Bit n set when class n counts, class ids above 63 only count with
+     * ZONE_ALL_CLASSES */
+    guint64 class_mask;
+    ZonePoint *points;
+    guint num_points;
+} Zone;
+
+typedef struct {
+    gchar *name;
+    gint source_id;
+    guint64 class_mask;
+    /* Crossing from the left of a to b, as seen on screen, to its right is
+     * forward */
+    ZonePoint a;
+    ZonePoint b;
+} ZoneLine;
+
+typedef struct {
+    guint16 line;
+    /* +1 forward, -1 backward */
+    gint8 direction;
+} ZoneCrossing;
+
+typedef struct _ZoneLayout ZoneLayout;
+
+/* Reads [zone NAME] and [line NAME] groups from a key file, see zones.txt.
+ * width and height are the frame size the coordinates refer to, and source
+ * ids must be below max_sources. */
+ZoneLayout *zone_layout_load(const gchar *path, guint width, guint height,
+                             guint max_sources, GError **error);
+/* Takes a copy of the zones and lines, and builds the grids, one per source id
+ * up to the highest one used. */
+ZoneLayout *zone_layout_new(const Zone *zones, guint num_zones, const ZoneLine *lines,
+                            guint num_lines, guint width, guint height,
+                            guint cell_size);
+void zone_layout_free(ZoneLayout *layout);
+
+guint zone_layout_num_zones(const ZoneLayout *layout);
+guint zone_layout_num_lines(const ZoneLayout *layout);
+const Zone *zone_layout_zone(const ZoneLayout *layout, guint index);
+const ZoneLine *zone_layout_line(const ZoneLayout *layout, guint index);
+
+/* Writes the indices of up to max_zones zones containing (x, y) for an
+ * object of class_id on source_id, in ascending order. Returns how many. */
+guint zone_layout_find(const ZoneLayout *layout, guint source_id, gint class_id,
+                       gfloat x, gfloat y, guint16 *zones, guint max_zones);
+
+/* Writes up to max_crossings lines crossed by an object of class_id moving
+ * from (x0, y0) to (x1, y1). Returns how many. */
+guint zone_layout_crossings(const ZoneLayout *layout, guint source_id, gint class_id,
+                            gfloat x0, gfloat y0, gfloat x1, gfloat y1,
+                            ZoneCrossing *crossings, guint max_crossings);
+
+/* The exact tests behind the grid, exposed for comparison. */
+gboolean zone_applies(guint64 class_mask, gint zone_source_id, guint source_id,
+                      gint class_id);
+gboolean zone_contains(const Zone *zone, gfloat x, gfloat y);
+/* +1 or -1 when the move crosses line, 0 otherwise. */
+gint zone_line_crossing(const ZoneLine *line, gfloat x0, gfloat y0, gfloat x1,
+                        gfloat y1);
+
+#endif
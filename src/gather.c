@@ -0,0 +1,46 @@
+#include "gather.h"
+
+static void gather_labels(NvDsObjectMeta *obj_meta, ObjectRecord *obj) {
+    obj->num_labels = 0;
+    for (NvDsMetaList *l = obj_meta->classifier_meta_list;
+         l && obj->num_labels < RECORD_MAX_LABELS; l = l->next) {
+        NvDsClassifierMeta *classifier_meta = (NvDsClassifierMeta *)l->data;
+        NvDsLabelInfo *label_info;
+
+        if (!classifier_meta->label_info_list) continue;
+        label_info = (NvDsLabelInfo *)classifier_meta->label_info_list->data;
+        obj->labels[obj->num_labels].component_id =
+            (guint8)classifier_meta->unique_component_id;
+        obj->labels[obj->num_labels].class_id = (guint8)label_info->result_class_id;
+        obj->num_labels++;
+    }
+}
+
+void gather_frame(NvDsFrameMeta *frame_meta, FrameRecord *frame,
+                  NvDsObjectMeta **obj_metas) {
+    guint n = 0;
+
+    frame->source_id = frame_meta->source_id;
+    frame->frame_num = frame_meta->frame_num;
+    frame->pts = frame_meta->buf_pts;
+
+    for (NvDsMetaList *l_obj = frame_meta->obj_meta_list;
+         l_obj && n < MAX_FRAME_OBJECTS; l_obj = l_obj->next) {
+        NvDsObjectMeta *obj_meta = (NvDsObjectMeta *)l_obj->data;
+        ObjectRecord *obj = &frame->objects[n];
+
+        obj->object_id = obj_meta->object_id;
+        obj->class_id = (gint16)obj_meta->class_id;
+        obj->reserved = 0;
+        obj->confidence = obj_meta->confidence;
+        obj->left = obj_meta->rect_params.left;
+        obj->top = obj_meta->rect_params.top;
+        obj->width = obj_meta->rect_params.width;
+        obj->height = obj_meta->rect_params.height;
+        gather_labels(obj_meta, obj);
+
+        if (obj_metas) obj_metas[n] = obj_meta;
+        n++;
+    }
+    frame->num_objects = n;
+}
@@ -0,0 +1,16 @@
+#ifndef __GATHER_H__
+#define __GATHER_H__
+
+#include "core/frame_record.h"
+#include "gstnvdsmeta.h"
+
+/* Objects beyond this many per frame are left out of the analytics */
+#define MAX_FRAME_OBJECTS 512
+
+/* Copies the objects of frame_meta into frame->objects, which must hold
+ * MAX_FRAME_OBJECTS records. When obj_metas is not NULL, obj_metas[i] is set
+ * to the NvDsObjectMeta that frame->objects[i] was copied from. */
+void gather_frame(NvDsFrameMeta *frame_meta, FrameRecord *frame,
+                  NvDsObjectMeta **obj_metas);
+
+#endif
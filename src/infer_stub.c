@@ -0,0 +1,100 @@
+#include "infer_stub.h"
+
+#include "core/synthetic.h"
+#include "gstnvdsmeta.h"
+#include "labels.h"
+
+typedef struct {
+    guint source_id;
+    gint frame_num;
+    SyntheticScene scene;
+    ObjectRecord *objects;
+} InferStub;
+
+static void infer_stub_free(gpointer data) {
+    InferStub *stub = (InferStub *)data;
+    g_free(stub->objects);
+    g_free(stub);
+}
+
+static void fill_object_meta(const ObjectRecord *obj, NvDsObjectMeta *obj_meta) {
+    NvOSD_RectParams *rect = &obj_meta->rect_params;
+
+    obj_meta->unique_component_id = 1;
+    obj_meta->class_id = obj->class_id;
+    obj_meta->object_id = obj->object_id;
+    obj_meta->confidence = obj->confidence;
+    g_strlcpy(obj_meta->obj_label, pgie_classes_str[obj->class_id], MAX_LABEL_SIZE);
+
+    rect->left = obj->left;
+    rect->top = obj->top;
+    rect->width = obj->width;
+    rect->height = obj->height;
+    rect->border_width = 3;
+    rect->border_color.red = 1.0;
+    rect->border_color.green = 0.0;
+    rect->border_color.blue = 0.0;
+    rect->border_color.alpha = 1.0;
+}
+
+static GstPadProbeReturn stub_src_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
+                                                   gpointer u_data) {
+    InferStub *stub = (InferStub *)u_data;
+    GstBuffer *buf = gst_buffer_make_writable((GstBuffer *)info->data);
+    NvDsBatchMeta *batch_meta = nvds_create_batch_meta(1);
+    NvDsFrameMeta *frame_meta = nvds_acquire_frame_meta_from_pool(batch_meta);
+    FrameRecord frame = {0};
+    NvDsMeta *meta;
+
+    info->data = buf;
+
+    frame.objects = stub->objects;
+    synthetic_scene_frame(&stub->scene, stub->source_id, stub->frame_num, &frame);
+
+    frame_meta->pad_index = stub->source_id;
+    frame_meta->source_id = stub->source_id;
+    frame_meta->batch_id = 0;
+    frame_meta->frame_num = stub->frame_num;
+    frame_meta->buf_pts = GST_BUFFER_PTS(buf);
+    frame_meta->source_frame_width = stub->scene.width;
+    frame_meta->source_frame_height = stub->scene.height;
+    frame_meta->bInferDone = TRUE;
+    nvds_add_frame_meta_to_batch(batch_meta, frame_meta);
+
+    for (guint i = 0; i < frame.num_objects; i++) {
+        NvDsObjectMeta *obj_meta = nvds_acquire_obj_meta_from_pool(batch_meta);
+        fill_object_meta(&frame.objects[i], obj_meta);
+        nvds_add_obj_meta_to_frame(frame_meta, obj_meta, NULL);
+    }
+
+    meta = gst_buffer_add_nvds_meta(buf, batch_meta, NULL, nvds_batch_meta_copy_func,
+                                    nvds_batch_meta_release_func);
+    meta->meta_type = NVDS_BATCH_GST_META;
+
+    stub->frame_num++;
+    return GST_PAD_PROBE_OK;
+}
+
+GstElement *infer_stub_new(guint source_id, guint num_objects, guint width,
+                           guint height) {
+    GstElement *identity = gst_element_factory_make("identity", "infer-stub");
+    InferStub *stub;
+    GstPad *src_pad;
+
+    if (!identity) return NULL;
+
+    stub = g_new0(InferStub, 1);
+    stub->source_id = source_id;
+    stub->scene.num_objects = num_objects;
+    stub->scene.width = width;
+    stub->scene.height = height;
+    stub->scene.person_class_id = PGIE_CLASS_ID_PERSON;
+    stub->scene.vehicle_class_id = PGIE_CLASS_ID_VEHICLE;
+    stub->objects = g_new0(ObjectRecord, MAX(num_objects, 1));
+
+    src_pad = gst_element_get_static_pad(identity, "src");
+    gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, stub_src_pad_buffer_probe,
+                      stub, infer_stub_free);
+    gst_object_unref(src_pad);
+    return identity;
+}
@@ -0,0 +1,15 @@
+#ifndef __INFER_STUB_H__
+#define __INFER_STUB_H__
+
+#include <gst/gst.h>
+
+/* Stand-in for the nvstreammux/nvinfer/nvtracker chain on machines without a
+ * GPU. The returned identity element attaches an NvDsBatchMeta holding one
+ * frame of num_objects synthetic, already tracked persons and vehicles to
+ * every buffer, so the downstream probes run exactly as they would behind the
+ * real inference stages. The objects come from the SyntheticScene in
+ * core/synthetic.h, with the buffer PTS in place of the scene's own. */
+GstElement *infer_stub_new(guint source_id, guint num_objects, guint width,
+                           guint height);
+
+#endif
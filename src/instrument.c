@@ -0,0 +1,447 @@
+#include "instrument.h"
+
+#include <errno.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+
+#include "core/latency_histogram.h"
+#include "gstnvdsmeta.h"
+#include "unix_socket.h"
+
+/* Batches in flight between an element's sink and src pads */
+#define INFLIGHT_LEN 64
+
+typedef struct {
+    /* Only compared, never dereferenced */
+    gconstpointer buffer;
+    gint64 enter_ns;
+} Entry;
+
+/* The sink pad probe produces, the src pad probe consumes, which may be on
+ * different streaming threads */
+typedef struct {
+    gchar *name;
+    guint max_sources;
+    Entry inflight[INFLIGHT_LEN];
+    gint head;
+    gint tail;
+    /* max_sources histograms, recorded by the src pad thread */
+    LatencyHistogram *latency;
+    /* Queues only: the element, owned by the pipeline, its max-size-buffers,
+     * the highest fill since the last dump and how many batches filled the
+     * queue up, written by the sink pad thread. Levels are read from the
+     * queue, which may hold more batches than inflight has room for. */
+    GstElement *queue;
+    guint capacity;
+    gint max_level;
+    gint full;
+} ElementTimer;
+
+typedef struct {
+    gchar *key;
+    InstrumentSectionFunc func;
+    gpointer data;
+} Section;
+
+struct _Instrument {
+    GPtrArray *timers;
+    GArray *sections;
+    guint max_sources;
+    /* Frames seen at the sink per source */
+    guint64 *frames;
+    guint64 batches;
+    guint64 batch_frames;
+    guint64 batch_slots;
+
+    gint64 last_dump_ns;
+    guint64 *last_frames;
+    guint64 last_batches;
+    guint64 last_batch_frames;
+    guint64 last_batch_slots;
+    LatencyHistogram snapshot;
+
+    guint timeout_id;
+    FILE *file;
+    GSocketService *service;
+    gchar *socket_path;
+    GPtrArray *clients;
+    GString *line;
+};
+
+static inline gint64 now_ns(void) { return g_get_monotonic_time() * 1000; }
+
+static gint queue_level(ElementTimer *timer) {
+    guint level = 0;
+    g_object_get(G_OBJECT(timer->queue), "current-level-buffers", &level, NULL);
+    return (gint)level;
+}
+
+static GstPadProbeReturn timer_enter_probe(GstPad *pad, GstPadProbeInfo *info,
+                                           gpointer u_data) {
+    ElementTimer *timer = (ElementTimer *)u_data;
+    gint head = g_atomic_int_get(&timer->head);
+
+    /* Nothing came out for a while, e.g. a full queue, skip timing this one */
+    if (head - g_atomic_int_get(&timer->tail) < INFLIGHT_LEN) {
+        timer->inflight[head % INFLIGHT_LEN].buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        timer->inflight[head % INFLIGHT_LEN].enter_ns = now_ns();
+        g_atomic_int_set(&timer->head, head + 1);
+    }
+
+    if (timer->queue) {
+        gint level = queue_level(timer) + 1;
+        /* The dump only ever lowers it to 0, a lost race costs one sample */
+        if (level > g_atomic_int_get(&timer->max_level))
+            g_atomic_int_set(&timer->max_level, level);
+        if ((guint)level >= timer->capacity) g_atomic_int_inc(&timer->full);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn timer_exit_probe(GstPad *pad, GstPadProbeInfo *info,
+                                          gpointer u_data) {
+    ElementTimer *timer = (ElementTimer *)u_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    NvDsBatchMeta *batch_meta;
+    gint tail = g_atomic_int_get(&timer->tail);
+    gint head = g_atomic_int_get(&timer->head);
+    gint match = -1;
+    gint64 latency;
+
+    /* PTS are no help here, they start over with every file and reconnect.
+     * Elements working in place push the buffer they were given. A pooled
+     * buffer is only in flight once, so the newest entry holding it is this
+     * batch, and older ones belong to batches the element dropped. Elements
+     * making new buffers keep the order, so they get the oldest entry. */
+    for (gint i = head; i != tail; i--) {
+        if (timer->inflight[(i - 1) % INFLIGHT_LEN].buffer == buf) {
+            match = i - 1;
+            break;
+        }
+    }
+    if (match < 0 && tail != head) match = tail;
+    if (match < 0) return GST_PAD_PROBE_OK;
+    latency = now_ns() - timer->inflight[match % INFLIGHT_LEN].enter_ns;
+    g_atomic_int_set(&timer->tail, match + 1);
+
+    batch_meta = gst_buffer_get_nvds_batch_meta(buf);
+    if (!batch_meta) return GST_PAD_PROBE_OK;
+    for (NvDsMetaList *l = batch_meta->frame_meta_list; l; l = l->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)l->data;
+        if (frame_meta->source_id >= timer->max_sources) continue;
+        latency_histogram_record(&timer->latency[frame_meta->source_id],
+                                 (guint64)latency);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn sink_probe(GstPad *pad, GstPadProbeInfo *info,
+                                    gpointer u_data) {
+    Instrument *instrument = (Instrument *)u_data;
+    NvDsBatchMeta *batch_meta =
+        gst_buffer_get_nvds_batch_meta(GST_PAD_PROBE_INFO_BUFFER(info));
+
+    if (!batch_meta) return GST_PAD_PROBE_OK;
+    for (NvDsMetaList *l = batch_meta->frame_meta_list; l; l = l->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)l->data;
+        if (frame_meta->source_id >= instrument->max_sources) continue;
+        __atomic_fetch_add(&instrument->frames[frame_meta->source_id], 1,
+                           __ATOMIC_RELAXED);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn mux_probe(GstPad *pad, GstPadProbeInfo *info,
+                                   gpointer u_data) {
+    Instrument *instrument = (Instrument *)u_data;
+    NvDsBatchMeta *batch_meta =
+        gst_buffer_get_nvds_batch_meta(GST_PAD_PROBE_INFO_BUFFER(info));
+
+    if (!batch_meta) return GST_PAD_PROBE_OK;
+    __atomic_fetch_add(&instrument->batches, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&instrument->batch_frames, batch_meta->num_frames_in_batch,
+                       __ATOMIC_RELAXED);
+    __atomic_fetch_add(&instrument->batch_slots, batch_meta->max_frames_in_batch,
+                       __ATOMIC_RELAXED);
+    return GST_PAD_PROBE_OK;
+}
+
+static void add_probe(GstElement *element, const gchar *pad_name,
+                      GstPadProbeCallback callback, gpointer data) {
+    GstPad *pad = gst_element_get_static_pad(element, pad_name);
+    if (!pad) return;
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, callback, data, NULL);
+    gst_object_unref(pad);
+}
+
+static gboolean is_queue(GstElement *element) {
+    GstElementFactory *factory = gst_element_get_factory(element);
+    return factory && !g_strcmp0(gst_plugin_feature_get_name(factory), "queue");
+}
+
+static void instrument_element(Instrument *instrument, GstElement *element) {
+    GstPad *sink_pad, *src_pad;
+    ElementTimer *timer;
+
+    /* Source bins run before the muxer, with no batch meta to attribute */
+    if (GST_IS_BIN(element)) return;
+    sink_pad = gst_element_get_static_pad(element, "sink");
+    src_pad = gst_element_get_static_pad(element, "src");
+    if (sink_pad && src_pad) {
+        timer = g_new0(ElementTimer, 1);
+        timer->name = gst_element_get_name(element);
+        timer->max_sources = instrument->max_sources;
+        timer->latency = g_new0(LatencyHistogram, instrument->max_sources);
+        if (is_queue(element)) {
+            timer->queue = element;
+            g_object_get(G_OBJECT(element), "max-size-buffers", &timer->capacity, NULL);
+        }
+        gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, timer_enter_probe,
+                          timer, NULL);
+        gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, timer_exit_probe, timer,
+                          NULL);
+        g_ptr_array_add(instrument->timers, timer);
+    }
+    if (sink_pad) gst_object_unref(sink_pad);
+    if (src_pad) gst_object_unref(src_pad);
+}
+
+static void free_timer(gpointer data) {
+    ElementTimer *timer = (ElementTimer *)data;
+    g_free(timer->name);
+    g_free(timer->latency);
+    g_free(timer);
+}
+
+Instrument *instrument_new(GstElement *pipeline, GstElement *streammux,
+                           GstElement *sink, guint max_sources) {
+    Instrument *instrument = g_new0(Instrument, 1);
+    GPtrArray *elements = g_ptr_array_new_with_free_func(gst_object_unref);
+    GstIterator *it;
+    GValue item = G_VALUE_INIT;
+    gboolean done = FALSE;
+
+    instrument->max_sources = max_sources;
+    instrument->timers = g_ptr_array_new_with_free_func(free_timer);
+    instrument->sections = g_array_new(FALSE, FALSE, sizeof(Section));
+    instrument->frames = g_new0(guint64, max_sources);
+    instrument->last_frames = g_new0(guint64, max_sources);
+    instrument->clients = g_ptr_array_new_with_free_func(g_object_unref);
+    instrument->line = g_string_sized_new(4096);
+    instrument->last_dump_ns = now_ns();
+
+    it = gst_bin_iterate_elements(GST_BIN(pipeline));
+    while (!done) {
+        switch (gst_iterator_next(it, &item)) {
+            case GST_ITERATOR_OK:
+                g_ptr_array_add(elements, gst_object_ref(g_value_get_object(&item)));
+                g_value_reset(&item);
+                break;
+            case GST_ITERATOR_RESYNC:
+                g_ptr_array_set_size(elements, 0);
+                gst_iterator_resync(it);
+                break;
+            default:
+                done = TRUE;
+                break;
+        }
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+    /* Probes go on once the list is settled, a resync cannot take them back */
+    for (guint i = 0; i < elements->len; i++) {
+        instrument_element(instrument, GST_ELEMENT(g_ptr_array_index(elements, i)));
+    }
+    g_ptr_array_free(elements, TRUE);
+
+    if (streammux) add_probe(streammux, "src", mux_probe, instrument);
+    if (sink) add_probe(sink, "sink", sink_probe, instrument);
+    return instrument;
+}
+
+void instrument_free(Instrument *instrument) {
+    if (!instrument) return;
+    if (instrument->timeout_id) g_source_remove(instrument->timeout_id);
+    if (instrument->service) {
+        g_socket_service_stop(instrument->service);
+        g_socket_listener_close(G_SOCKET_LISTENER(instrument->service));
+        g_object_unref(instrument->service);
+        g_unlink(instrument->socket_path);
+    }
+    if (instrument->file) fclose(instrument->file);
+    g_free(instrument->socket_path);
+    g_ptr_array_free(instrument->clients, TRUE);
+    g_string_free(instrument->line, TRUE);
+    /* The probes still point at the timers, the pipeline must be gone */
+    g_ptr_array_free(instrument->timers, TRUE);
+    for (guint i = 0; i < instrument->sections->len; i++) {
+        g_free(g_array_index(instrument->sections, Section, i).key);
+    }
+    g_array_free(instrument->sections, TRUE);
+    g_free(instrument->frames);
+    g_free(instrument->last_frames);
+    g_free(instrument);
+}
+
+void instrument_add_section(Instrument *instrument, const gchar *key,
+                            InstrumentSectionFunc func, gpointer data) {
+    Section section = {g_strdup(key), func, data};
+    g_array_append_val(instrument->sections, section);
+}
+
+static void append_latency(Instrument *instrument, GString *out, const gchar *name,
+                           guint source_id, gboolean *first) {
+    LatencyHistogram *hist = &instrument->snapshot;
+    guint64 count = latency_histogram_count(hist);
+
+    if (count == 0) return;
+    g_string_append_printf(
+        out,
+        "%s{\"element\":\"%s\",\"source\":%u,\"count\":%" G_GUINT64_FORMAT
+        ",\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f}",
+        *first ? "" : ",", name, source_id, count,
+        latency_histogram_percentile(hist, 0.5) / 1e3,
+        latency_histogram_percentile(hist, 0.99) / 1e3,
+        latency_histogram_percentile(hist, 0.999) / 1e3,
+        latency_histogram_max(hist) / 1e3);
+    *first = FALSE;
+}
+
+void instrument_dump(Instrument *instrument, GString *out) {
+    gint64 now = now_ns();
+    gdouble interval = (now - instrument->last_dump_ns) / 1e9;
+    guint64 batches = __atomic_load_n(&instrument->batches, __ATOMIC_RELAXED);
+    guint64 batch_frames = __atomic_load_n(&instrument->batch_frames, __ATOMIC_RELAXED);
+    guint64 batch_slots = __atomic_load_n(&instrument->batch_slots, __ATOMIC_RELAXED);
+    gboolean first = TRUE;
+
+    if (interval <= 0.0) interval = 1e-9;
+    g_string_append_printf(out, "{\"time\":%.3f,\"interval\":%.3f,\"fps\":{",
+                           g_get_real_time() / 1e6, interval);
+    for (guint i = 0; i < instrument->max_sources; i++) {
+        guint64 frames = __atomic_load_n(&instrument->frames[i], __ATOMIC_RELAXED);
+        guint64 delta = frames - instrument->last_frames[i];
+        instrument->last_frames[i] = frames;
+        if (delta == 0) continue;
+        g_string_append_printf(out, "%s\"%u\":%.2f", first ? "" : ",", i,
+                               delta / interval);
+        first = FALSE;
+    }
+
+    g_string_append_printf(
+        out, "},\"batches\":%" G_GUINT64_FORMAT ",\"batch_fill\":%.3f,\"latency\":[",
+        batches - instrument->last_batches,
+        batch_slots > instrument->last_batch_slots
+            ? (gdouble)(batch_frames - instrument->last_batch_frames) /
+                  (batch_slots - instrument->last_batch_slots)
+            : 0.0);
+    instrument->last_batches = batches;
+    instrument->last_batch_frames = batch_frames;
+    instrument->last_batch_slots = batch_slots;
+
+    first = TRUE;
+    for (guint t = 0; t < instrument->timers->len; t++) {
+        ElementTimer *timer = g_ptr_array_index(instrument->timers, t);
+        for (guint i = 0; i < instrument->max_sources; i++) {
+            latency_histogram_reset(&instrument->snapshot);
+            latency_histogram_drain(&timer->latency[i], &instrument->snapshot);
+            append_latency(instrument, out, timer->name, i, &first);
+        }
+    }
+
+    /* Batches waiting in each queue */
+    g_string_append(out, "],\"queues\":[");
+    first = TRUE;
+    for (guint t = 0; t < instrument->timers->len; t++) {
+        ElementTimer *timer = g_ptr_array_index(instrument->timers, t);
+        if (!timer->queue) continue;
+        g_string_append_printf(
+            out,
+            "%s{\"element\":\"%s\",\"capacity\":%u,\"level\":%d,"
+            "\"max_level\":%d,\"full\":%d}",
+            first ? "" : ",", timer->name, timer->capacity,
+            queue_level(timer),
+            g_atomic_int_get(&timer->max_level), g_atomic_int_get(&timer->full));
+        g_atomic_int_set(&timer->max_level, 0);
+        g_atomic_int_set(&timer->full, 0);
+        first = FALSE;
+    }
+    g_string_append_c(out, ']');
+
+    for (guint i = 0; i < instrument->sections->len; i++) {
+        Section *section = &g_array_index(instrument->sections, Section, i);
+        g_string_append_printf(out, ",\"%s\":", section->key);
+        section->func(out, section->data);
+    }
+    g_string_append(out, "}\n");
+    instrument->last_dump_ns = now;
+}
+
+/* Clients that cannot keep up, or went away, are dropped */
+static void send_to_clients(Instrument *instrument, const GString *line) {
+    for (guint i = instrument->clients->len; i > 0; i--) {
+        GIOStream *stream = G_IO_STREAM(g_ptr_array_index(instrument->clients, i - 1));
+        GOutputStream *output = g_io_stream_get_output_stream(stream);
+        gssize written = g_pollable_output_stream_write_nonblocking(
+            G_POLLABLE_OUTPUT_STREAM(output), line->str, line->len, NULL, NULL);
+        if (written != (gssize)line->len) {
+            g_ptr_array_remove_index_fast(instrument->clients, i - 1);
+        }
+    }
+}
+
+static gboolean dump_timeout(gpointer data) {
+    Instrument *instrument = (Instrument *)data;
+
+    g_string_truncate(instrument->line, 0);
+    instrument_dump(instrument, instrument->line);
+    if (instrument->file) {
+        fwrite(instrument->line->str, 1, instrument->line->len, instrument->file);
+        fflush(instrument->file);
+    }
+    if (instrument->service) send_to_clients(instrument, instrument->line);
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean on_incoming(GSocketService *service, GSocketConnection *connection,
+                            GObject *source_object, gpointer data) {
+    Instrument *instrument = (Instrument *)data;
+    g_ptr_array_add(instrument->clients, g_object_ref(connection));
+    return TRUE;
+}
+
+gboolean instrument_start(Instrument *instrument, const gchar *dest,
+                          guint interval_sec, GError **error) {
+    if (g_str_has_prefix(dest, "unix:")) {
+        GSocketAddress *address;
+        gboolean ok;
+
+        address = unix_socket_address_new(dest + 5, error);
+        if (!address) return FALSE;
+        instrument->socket_path = g_strdup(dest + 5);
+        instrument->service = g_socket_service_new();
+        ok = g_socket_listener_add_address(
+            G_SOCKET_LISTENER(instrument->service), address, G_SOCKET_TYPE_STREAM,
+            G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, error);
+        g_object_unref(address);
+        if (!ok) {
+            g_clear_object(&instrument->service);
+            return FALSE;
+        }
+        g_signal_connect(instrument->service, "incoming", G_CALLBACK(on_incoming),
+                         instrument);
+        g_socket_service_start(instrument->service);
+    } else {
+        instrument->file = g_fopen(dest, "a");
+        if (!instrument->file) {
+            g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                        "Cannot open %s: %s", dest, g_strerror(errno));
+            return FALSE;
+        }
+    }
+    instrument->last_dump_ns = now_ns();
+    instrument->timeout_id =
+        g_timeout_add_seconds(MAX(interval_sec, 1), dump_timeout, instrument);
+    return TRUE;
+}
@@ -0,0 +1,41 @@
+#ifndef __INSTRUMENT_H__
+#define __INSTRUMENT_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+/* Per-element latency and per-stream throughput of the running pipeline.
+ *
+ * Every top-level element with a static sink and src pad gets a probe on
+ * each, and the time a batch spends between them is recorded for every
+ * source in the batch into LatencyHistograms. Frames reaching the sink are
+ * counted per source, and the muxer output gives the batch fill ratio. For
+ * queues the number of batches waiting is reported too, with the highest
+ * fill since the previous dump and how often the queue was full. Every
+ * interval the figures since the previous dump are written as one JSON
+ * line, either appended to a file or pushed to the clients of a Unix socket.
+ * Source bins are not instrumented, the muxer's time is left out. */
+
+typedef struct _Instrument Instrument;
+
+/* Appends the JSON value of an extra top-level key to a dump. */
+typedef void (*InstrumentSectionFunc)(GString *out, gpointer data);
+
+/* Attaches the probes. streammux and sink may be NULL. */
+Instrument *instrument_new(GstElement *pipeline, GstElement *streammux,
+                           GstElement *sink, guint max_sources);
+void instrument_free(Instrument *instrument);
+
+/* dest is a file path, or unix:PATH to listen on a Unix socket. Dumps run
+ * from the default main context. */
+gboolean instrument_start(Instrument *instrument, const gchar *dest,
+                          guint interval_sec, GError **error);
+
+/* Adds key to every dump, with the value written by func. */
+void instrument_add_section(Instrument *instrument, const gchar *key,
+                            InstrumentSectionFunc func, gpointer data);
+
+/* Appends one JSON line with the figures since the previous call. */
+void instrument_dump(Instrument *instrument, GString *out);
+
+#endif
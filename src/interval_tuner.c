@@ -0,0 +1,212 @@
+#include "interval_tuner.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+
+#include "core/logger.h"
+#include "gstnvdsmeta.h"
+
+struct _IntervalTuner {
+    GstElement *pgie;
+    IntervalController *controller;
+    GPtrArray *queues;
+
+    /* Written by the streaming threads, read by the period timeout */
+    guint64 batches_in;
+    guint64 frames_in;
+    guint64 frames_out;
+    guint64 objects_out;
+
+    gint64 start_ns;
+    gint64 last_period_ns;
+    guint64 last_batches_in;
+    guint64 last_frames_in;
+    guint64 last_frames_out;
+    /* Frames per batch over the last period that had any */
+    gdouble batch_fill;
+    guint64 last_objects_out;
+
+    guint timeout_id;
+    FILE *trace;
+};
+
+static inline gint64 now_ns(void) { return g_get_monotonic_time() * 1000; }
+
+static GstPadProbeReturn mux_src_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
+                                                  gpointer u_data) {
+    IntervalTuner *tuner = (IntervalTuner *)u_data;
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta((GstBuffer *)info->data);
+
+    if (!batch_meta) return GST_PAD_PROBE_OK;
+    __atomic_fetch_add(&tuner->batches_in, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&tuner->frames_in, batch_meta->num_frames_in_batch,
+                       __ATOMIC_RELAXED);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn sink_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
+                                               gpointer u_data) {
+    IntervalTuner *tuner = (IntervalTuner *)u_data;
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta((GstBuffer *)info->data);
+    guint frames = 0, objects = 0;
+
+    if (!batch_meta) return GST_PAD_PROBE_OK;
+    for (NvDsMetaList *l = batch_meta->frame_meta_list; l; l = l->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)l->data;
+        frames++;
+        objects += frame_meta->num_obj_meta;
+    }
+    __atomic_fetch_add(&tuner->objects_out, objects, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&tuner->frames_out, frames, __ATOMIC_RELAXED);
+    return GST_PAD_PROBE_OK;
+}
+
+static void add_probe(GstElement *element, const gchar *pad_name,
+                      GstPadProbeCallback callback, IntervalTuner *tuner) {
+    GstPad *pad = gst_element_get_static_pad(element, pad_name);
+    if (!pad) return;
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, callback, tuner, NULL);
+    gst_object_unref(pad);
+}
+
+static gboolean is_queue(GstElement *element) {
+    GstElementFactory *factory = gst_element_get_factory(element);
+    return factory && !g_strcmp0(gst_plugin_feature_get_name(factory), "queue");
+}
+
+static void find_queues(IntervalTuner *tuner, GstElement *pipeline) {
+    GstIterator *it = gst_bin_iterate_elements(GST_BIN(pipeline));
+    GValue item = G_VALUE_INIT;
+    gboolean done = FALSE;
+
+    while (!done) {
+        switch (gst_iterator_next(it, &item)) {
+            case GST_ITERATOR_OK: {
+                GstElement *element = GST_ELEMENT(g_value_get_object(&item));
+                if (is_queue(element)) {
+                    g_ptr_array_add(tuner->queues, gst_object_ref(element));
+                }
+                g_value_reset(&item);
+                break;
+            }
+            case GST_ITERATOR_RESYNC:
+                g_ptr_array_set_size(tuner->queues, 0);
+                gst_iterator_resync(it);
+                break;
+            default:
+                done = TRUE;
+                break;
+        }
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+}
+
+IntervalTuner *interval_tuner_new(GstElement *pipeline, GstElement *pgie,
+                                  GstElement *streammux, GstElement *sink,
+                                  const IntervalControlConfig *config) {
+    IntervalTuner *tuner = g_new0(IntervalTuner, 1);
+
+    tuner->pgie = gst_object_ref(pgie);
+    tuner->controller = interval_controller_new(config);
+    tuner->queues = g_ptr_array_new_with_free_func(gst_object_unref);
+    tuner->batch_fill = 1.0;
+    find_queues(tuner, pipeline);
+    add_probe(streammux, "src", mux_src_pad_buffer_probe, tuner);
+    add_probe(sink, "sink", sink_pad_buffer_probe, tuner);
+    g_object_set(G_OBJECT(pgie), "interval",
+                 interval_controller_interval(tuner->controller), NULL);
+    return tuner;
+}
+
+void interval_tuner_free(IntervalTuner *tuner) {
+    if (!tuner) return;
+    if (tuner->timeout_id) g_source_remove(tuner->timeout_id);
+    if (tuner->trace) fclose(tuner->trace);
+    interval_controller_free(tuner->controller);
+    g_ptr_array_free(tuner->queues, TRUE);
+    gst_object_unref(tuner->pgie);
+    g_free(tuner);
+}
+
+/* Frames waiting in the fullest queue. A slow stage fills the queue in front
+ * of it, whether that queue blocks or leaks. */
+static guint queued_frames(IntervalTuner *tuner) {
+    guint max_level = 0;
+
+    for (guint i = 0; i < tuner->queues->len; i++) {
+        guint level = 0;
+        g_object_get(g_ptr_array_index(tuner->queues, i), "current-level-buffers",
+                     &level, NULL);
+        max_level = MAX(max_level, level);
+    }
+    return (guint)(max_level * tuner->batch_fill + 0.5);
+}
+
+static gboolean period_timeout(gpointer data) {
+    IntervalTuner *tuner = (IntervalTuner *)data;
+    guint64 batches_in = __atomic_load_n(&tuner->batches_in, __ATOMIC_RELAXED);
+    guint64 frames_in = __atomic_load_n(&tuner->frames_in, __ATOMIC_RELAXED);
+    guint64 objects_out = __atomic_load_n(&tuner->objects_out, __ATOMIC_RELAXED);
+    guint64 frames_out = __atomic_load_n(&tuner->frames_out, __ATOMIC_RELAXED);
+    gint64 now = now_ns();
+    gdouble elapsed = (now - tuner->last_period_ns) / 1e9;
+    guint previous = interval_controller_interval(tuner->controller);
+    guint64 period_frames_out = frames_out - tuner->last_frames_out;
+    LoadSample sample;
+    guint interval;
+
+    if (elapsed <= 0) return G_SOURCE_CONTINUE;
+    sample.input_fps = (frames_in - tuner->last_frames_in) / elapsed;
+    sample.output_fps = period_frames_out / elapsed;
+    if (batches_in > tuner->last_batches_in) {
+        tuner->batch_fill = (gdouble)(frames_in - tuner->last_frames_in) /
+                            (batches_in - tuner->last_batches_in);
+    }
+    sample.backlog = queued_frames(tuner);
+    sample.objects_per_frame =
+        period_frames_out
+            ? (gdouble)(objects_out - tuner->last_objects_out) / period_frames_out
+            : 0.0;
+
+    interval = interval_controller_update(tuner->controller, &sample);
+    if (interval != previous) {
+        g_object_set(G_OBJECT(tuner->pgie), "interval", interval, NULL);
+        LOG_INFO(LOG_CAT_INTERVAL,
+                 "pgie interval %u -> %u (%.1f fps in, %.1f fps out, %u queued, "
+                 "%.1f objects/frame)",
+                 previous, interval, sample.input_fps, sample.output_fps,
+                 sample.backlog, sample.objects_per_frame);
+    }
+    if (tuner->trace) {
+        fprintf(tuner->trace, "%.3f,%.2f,%.2f,%u,%.3f,%u\n",
+                (now - tuner->start_ns) / 1e9, sample.input_fps, sample.output_fps,
+                sample.backlog, sample.objects_per_frame, interval);
+        fflush(tuner->trace);
+    }
+
+    tuner->last_period_ns = now;
+    tuner->last_batches_in = batches_in;
+    tuner->last_frames_in = frames_in;
+    tuner->last_frames_out = frames_out;
+    tuner->last_objects_out = objects_out;
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean interval_tuner_start(IntervalTuner *tuner, guint period_sec,
+                              const gchar *trace_file, GError **error) {
+    if (trace_file) {
+        tuner->trace = g_fopen(trace_file, "w");
+        if (!tuner->trace) {
+            g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                        "Cannot open %s: %s", trace_file, g_strerror(errno));
+            return FALSE;
+        }
+        fprintf(tuner->trace, "%s\n", INTERVAL_TRACE_HEADER);
+    }
+    tuner->start_ns = tuner->last_period_ns = now_ns();
+    tuner->timeout_id =
+        g_timeout_add_seconds(MAX(period_sec, 1), period_timeout, tuner);
+    return TRUE;
+}
@@ -0,0 +1,32 @@
+#ifndef __INTERVAL_TUNER_H__
+#define __INTERVAL_TUNER_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "core/interval_control.h"
+
+/* Adjusts the primary nvinfer's interval property while the pipeline runs.
+ *
+ * Probes count the frames leaving the muxer and reaching the sink, and the
+ * objects on the latter. Every period the rates, the frames waiting in the
+ * fullest queue of the pipeline and the mean object count are handed to an
+ * IntervalController, and its answer is set on pgie. The backlog comes from
+ * the queues' current levels rather than the frames counted in and out, as
+ * leaky queues and detached sources drop frames that never reach the sink.
+ * Each period can also be appended to a CSV trace with the chosen interval,
+ * which nvds_interval_trace replays offline. */
+
+typedef struct _IntervalTuner IntervalTuner;
+
+/* The queues are looked up among the pipeline's elements. */
+IntervalTuner *interval_tuner_new(GstElement *pipeline, GstElement *pgie,
+                                  GstElement *streammux, GstElement *sink,
+                                  const IntervalControlConfig *config);
+void interval_tuner_free(IntervalTuner *tuner);
+
+/* trace_file may be NULL. Periods run from the default main context. */
+gboolean interval_tuner_start(IntervalTuner *tuner, guint period_sec,
+                              const gchar *trace_file, GError **error);
+
+#endif
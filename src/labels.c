@@ -0,0 +1,31 @@
+#include "labels.h"
+
+gchar sgie1_classes_str[SGIE1_NUM_CLASSES][32] = {
+    "black", "blue", "brown", "gold",   "green", "grey",
+    "maroon", "orange", "red", "silver", "white", "yellow"};
+
+gchar sgie2_classes_str[SGIE2_NUM_CLASSES][32] = {
+    "Acura", "Audi",     "BMW",     "Chevrolet", "Chrysler", "Dodge",     "Ford",
+    "GMC",   "Honda",    "Hyundai", "Infiniti",  "Jeep",     "Kia",       "Lexus",
+    "Mazda", "Mercedes", "Nissan",  "Subaru",    "Toyota",   "Volkswagen"};
+
+gchar sgie3_classes_str[SGIE3_NUM_CLASSES][32] = {"coupe", "largevehicle", "sedan",
+                                                  "suv",   "truck",        "van"};
+
+gchar pgie_classes_str[PGIE_NUM_CLASSES][32] = {"Vehicle", "TwoWheeler", "Person",
+                                                "RoadSign"};
+
+static const LabelTable tables[] = {
+    {"pgie", pgie_classes_str, PGIE_NUM_CLASSES},
+    {"sgie1", sgie1_classes_str, SGIE1_NUM_CLASSES},
+    {"sgie2", sgie2_classes_str, SGIE2_NUM_CLASSES},
+    {"sgie3", sgie3_classes_str, SGIE3_NUM_CLASSES},
+};
+
+const LabelTable *labels_for_stage(const gchar *stage_name, gboolean is_primary) {
+    if (is_primary) return &tables[0];
+    for (guint i = 1; i < G_N_ELEMENTS(tables); i++) {
+        if (!g_strcmp0(stage_name, tables[i].name)) return &tables[i];
+    }
+    return NULL;
+}
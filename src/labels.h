@@ -0,0 +1,30 @@
+#ifndef __LABELS_H__
+#define __LABELS_H__
+
+#include <glib.h>
+
+#define PGIE_CLASS_ID_VEHICLE 0
+#define PGIE_CLASS_ID_PERSON 2
+
+#define PGIE_NUM_CLASSES 4
+#define SGIE1_NUM_CLASSES 12
+#define SGIE2_NUM_CLASSES 20
+#define SGIE3_NUM_CLASSES 6
+
+/* These are the strings of the labels for the respective models */
+extern gchar pgie_classes_str[PGIE_NUM_CLASSES][32];
+extern gchar sgie1_classes_str[SGIE1_NUM_CLASSES][32];
+extern gchar sgie2_classes_str[SGIE2_NUM_CLASSES][32];
+extern gchar sgie3_classes_str[SGIE3_NUM_CLASSES][32];
+
+typedef struct {
+    const gchar *name;
+    gchar (*labels)[32];
+    guint num_labels;
+} LabelTable;
+
+/* The labels of the model a pipeline.txt stage runs: the pgie table for the
+ * primary detector, else the table named like the stage. NULL for none. */
+const LabelTable *labels_for_stage(const gchar *stage_name, gboolean is_primary);
+
+#endif
@@ -21,27 +21,41 @@
  */
 
 #include <cuda_runtime_api.h>
+#include <glib-unix.h>
 #include <glib.h>
 #include <gst/gst.h>
 #include <math.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "benchmark.h"
+#include "clips.h"
+#include "core/analytics_pool.h"
+#include "core/class_counters.h"
+#include "core/crowd.h"
+#include "core/export_ring.h"
+#include "core/logger.h"
+#include "core/meta_record.h"
+#include "core/stream_clock.h"
+#include "core/trajectory_archive.h"
+#include "core/zones.h"
+#include "gather.h"
 #include "gstnvdsmeta.h"
-
-#define PGIE_CONFIG_FILE "../pgie_config.txt"
-#define SGIE1_CONFIG_FILE "../sgie1_config.txt"
-#define SGIE2_CONFIG_FILE "../sgie2_config.txt"
-#define SGIE3_CONFIG_FILE "../sgie3_config.txt"
-#define MAX_DISPLAY_LEN 64
-
-#define TRACKER_CONFIG_FILE "../tracker_config.txt"
+#include "instrument.h"
+#include "interval_tuner.h"
+#include "labels.h"
+#include "metrics_server.h"
+#include "offline.h"
+#include "overlay.h"
+#include "pipeline_config.h"
+#include "sgie_cache.h"
+#include "sources.h"
+
+#define PIPELINE_CONFIG_FILE "../pipeline.txt"
 #define MAX_TRACKING_ID_LEN 16
 
-#define PGIE_CLASS_ID_VEHICLE 0
-#define PGIE_CLASS_ID_PERSON 2
-
 /* The muxer output resolution must be set if the input streams will be of
  * different resolution. The muxer will scale all the input frames to this
  * resolution. */
@@ -52,30 +66,10 @@
  * based on the fastest source's framerate. */
 #define MUXER_BATCH_TIMEOUT_USEC 40000
 
-gint frame_number = 0;
-/* These are the strings of the labels for the respective models */
-gchar sgie1_classes_str[12][32] = {"black", "blue",   "brown",  "gold",
-                                   "green", "grey",   "maroon", "orange",
-                                   "red",   "silver", "white",  "yellow"};
-
-gchar sgie2_classes_str[20][32] = {
-    "Acura", "Audi",     "BMW",     "Chevrolet", "Chrysler", "Dodge",     "Ford",
-    "GMC",   "Honda",    "Hyundai", "Infiniti",  "Jeep",     "Kia",       "Lexus",
-    "Mazda", "Mercedes", "Nissan",  "Subaru",    "Toyota",   "Volkswagen"};
-
-gchar sgie3_classes_str[6][32] = {"coupe", "largevehicle", "sedan",
-                                  "suv",   "truck",        "van"};
-
-gchar pgie_classes_str[4][32] = {"Vehicle", "TwoWheeler", "Person", "RoadSign"};
-
-/* gie_unique_id is one of the properties in the above dstest2_sgiex_config.txt
- * files. These should be unique and known when we want to parse the Metadata
- * respective to the sgie labels. Ideally these should be read from the config
- * files but for brevity we ensure they are same. */
+/* Seconds between decisions of the adaptive pgie interval */
+#define INTERVAL_PERIOD_SEC 1
 
-guint sgie1_unique_id = 2;
-guint sgie2_unique_id = 3;
-guint sgie3_unique_id = 4;
+gint frame_number = 0;
 
 /* Wrapper function for handling CUDA runtime calls */
 void cudaCheckError(cudaError_t err) {
@@ -84,34 +78,67 @@ void cudaCheckError(cudaError_t err) {
     }
 }
 
-#define SIZE 64
-static double x_history[SIZE];
-static double avg_x_movement = 0.0;
-double threshold = 5.0;
-static bool is_loitering = FALSE;
-
-double process_history(double buf[SIZE]) {
-    // get pixel deltas
-    for (int i = SIZE - 1; i > 0; i--) {
-        buf[i] = fabs(buf[i] - buf[i - 1]);
-        g_printf("%.1lf\t", buf[i]);
-    }
-    g_printf("\r");
-    // get avg
-    double sum = 0.0;
-    for (int i = 1; i < SIZE; i++) {
-        sum += buf[i];
-    }
-    return sum / ((double)SIZE - 1);
+static AnalyticsPool *analytics = NULL;
+static MetaRecorder *recorder = NULL;
+static ExportWriter *exporter = NULL;
+static Overlay *overlay = NULL;
+static SourceManager *sources = NULL;
+static CrowdAnalyzer *crowd = NULL;
+static ClipRecorder *clips = NULL;
+static TrajectoryArchive *trajectories = NULL;
+static ClassCounters *class_counters = NULL;
+static OfflineScheduler *offline_queue = NULL;
+static StreamClock *stream_clock = NULL;
+
+/* Latest crowd figures per source, written by the probe and read by --stats */
+typedef struct {
+    gint people;
+    gint close_pairs;
+    gint crowded;
+    gint peak_density;
+    gint max_close_pairs;
+} CrowdSourceStats;
+
+static CrowdSourceStats *crowd_stats = NULL;
+static guint crowd_num_sources = 0;
+
+/* Per-frame scratch space, the probe only ever runs on one streaming thread */
+static ObjectRecord frame_objects[MAX_FRAME_OBJECTS];
+static NvDsObjectMeta *frame_obj_metas[MAX_FRAME_OBJECTS];
+static gboolean frame_crowded[MAX_FRAME_OBJECTS];
+
+static void update_crowd(const FrameRecord *frame) {
+    CrowdSourceStats *out;
+    CrowdStats stats;
+
+    crowd_analyzer_process(crowd, frame, &stats, frame_crowded);
+    if (frame->source_id >= crowd_num_sources) return;
+    out = &crowd_stats[frame->source_id];
+    g_atomic_int_set(&out->people, stats.objects);
+    g_atomic_int_set(&out->close_pairs, stats.close_pairs);
+    g_atomic_int_set(&out->crowded, stats.crowded);
+    g_atomic_int_set(&out->peak_density, stats.peak_density);
+    if ((gint)stats.close_pairs > g_atomic_int_get(&out->max_close_pairs)) {
+        g_atomic_int_set(&out->max_close_pairs, stats.close_pairs);
+    }
 }
 
-double avg(double buf[SIZE]) {
-    double sum = 0.0;
-    for (int i = 0; i < SIZE; i++) {
-        sum += buf[i];
+/* Puts every frame on one timeline as it leaves the muxer, before the sgie
+ * caches and the analytics read its pts */
+static GstPadProbeReturn mux_src_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
+                                                  gpointer u_data) {
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta((GstBuffer *)info->data);
+
+    if (!batch_meta) return GST_PAD_PROBE_OK;
+    for (NvDsMetaList *l = batch_meta->frame_meta_list; l; l = l->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)l->data;
+
+        frame_meta->buf_pts =
+            stream_clock_map(stream_clock, frame_meta->source_id, frame_meta->buf_pts);
     }
-    return sum / ((double)SIZE);
+    return GST_PAD_PROBE_OK;
 }
+
 /* This is the buffer probe function that we have registered on the sink pad
  * of the OSD element. All the infer elements in the pipeline shall attach
  * their metadata to the GstBuffer, here we will iterate & process the metadata
@@ -119,91 +146,153 @@ double avg(double buf[SIZE]) {
 static GstPadProbeReturn osd_sink_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
                                                    gpointer u_data) {
     GstBuffer *buf = (GstBuffer *)info->data;
-    guint num_rects = 0;
-    NvDsObjectMeta *obj_meta = NULL;
+    guint num_persons = 0;
+    guint num_loitering = 0;
     NvDsMetaList *l_frame = NULL;
-    NvDsMetaList *l_obj = NULL;
-    NvDsDisplayMeta *display_meta = NULL;
-    double temp;
+    FrameRecord frame = {0};
+    gint64 now_us = class_counters ? g_get_real_time() : 0;
 
     NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(buf);
 
+    frame.objects = frame_objects;
     for (l_frame = batch_meta->frame_meta_list; l_frame != NULL;
          l_frame = l_frame->next) {
         NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)(l_frame->data);
-        int offset = 0;
-        for (l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next) {
-            obj_meta = (NvDsObjectMeta *)(l_obj->data);
-            if (obj_meta->class_id == PGIE_CLASS_ID_VEHICLE) {
-                num_rects++;
-            }
-            if (obj_meta->class_id == PGIE_CLASS_ID_PERSON) {
-                num_rects++;
-                x_history[frame_meta->frame_num % SIZE] = obj_meta->rect_params.left;
-                temp = obj_meta->rect_params.left;
-
-                if (frame_meta->frame_num % SIZE == 0 &&
-                    frame_meta->frame_num > (SIZE - 1)) {
-                    avg_x_movement = process_history(x_history);
-                    is_loitering = fabs(avg_x_movement) < threshold;
-                }
-                if (is_loitering) {
-                    obj_meta->rect_params.border_color.red = 0.0;
-                    obj_meta->rect_params.border_color.blue = 1.0;
-                }
+
+        /* Analytics run on worker threads from a compact copy of the
+         * metadata, which is also what --record writes out for replay. Their
+         * results come back per track and are applied on later frames. */
+        gather_frame(frame_meta, &frame, frame_obj_metas);
+        if (recorder) meta_recorder_write(recorder, &frame);
+        if (exporter) export_writer_write(exporter, &frame);
+        analytics_pool_submit(analytics, &frame);
+        if (crowd) update_crowd(&frame);
+        if (class_counters) class_counters_add_frame(class_counters, &frame, now_us);
+        if (offline_queue) offline_scheduler_add_frame(offline_queue, &frame);
+
+        num_persons = 0;
+        num_loitering = 0;
+        for (guint i = 0; i < frame.num_objects; i++) {
+            NvDsObjectMeta *obj_meta = frame_obj_metas[i];
+            guint32 flags;
+
+            if (obj_meta->class_id != PGIE_CLASS_ID_PERSON) continue;
+            num_persons++;
+            flags = analytics_pool_lookup(analytics, frame.source_id,
+                                          frame.objects[i].object_id);
+            if (flags & TRACK_RESULT_LOITERING) {
+                obj_meta->rect_params.border_color.red = 0.0;
+                obj_meta->rect_params.border_color.blue = 1.0;
+                num_loitering++;
+            } else if (crowd && frame_crowded[i]) {
+                /* Yellow */
+                obj_meta->rect_params.border_color.red = 1.0;
+                obj_meta->rect_params.border_color.green = 1.0;
+                obj_meta->rect_params.border_color.blue = 0.0;
             }
         }
-        display_meta = nvds_acquire_display_meta_from_pool(batch_meta);
-        NvOSD_TextParams *txt_params = &display_meta->text_params[0];
-        display_meta->num_labels = 1;
-        txt_params->display_text = g_malloc0(MAX_DISPLAY_LEN);
-        offset = snprintf(txt_params->display_text, MAX_DISPLAY_LEN, "left = %lf ",
-                          avg_x_movement);
-        offset = snprintf(txt_params->display_text + offset, MAX_DISPLAY_LEN,
-                          "top = %lf ", temp);
-
-        /* Now set the offsets where the string should appear */
-        txt_params->x_offset = 10;
-        txt_params->y_offset = 12;
-
-        /* Font , font-color and font-size */
-        txt_params->font_params.font_name = "Serif";
-        txt_params->font_params.font_size = 10;
-        txt_params->font_params.font_color.red = 1.0;
-        txt_params->font_params.font_color.green = 1.0;
-        txt_params->font_params.font_color.blue = 1.0;
-        txt_params->font_params.font_color.alpha = 1.0;
-
-        /* Text background color */
-        txt_params->set_bg_clr = 1;
-        txt_params->text_bg_clr.red = 0.0;
-        txt_params->text_bg_clr.green = 0.0;
-        txt_params->text_bg_clr.blue = 0.0;
-        txt_params->text_bg_clr.alpha = 1.0;
-
-        nvds_add_display_meta_to_frame(frame_meta, display_meta);
+        overlay_update(overlay, batch_meta, frame_meta, num_persons, num_loitering);
     }
 
     return GST_PAD_PROBE_OK;
 }
 
+static void start_clip(guint source_id, guint64 object_id, gpointer data) {
+    clip_recorder_trigger((ClipRecorder *)data, source_id, object_id);
+}
+
+static gboolean send_eos_on_signal(gpointer data) {
+    GstElement *pipeline = (GstElement *)data;
+    LOG_INFO(LOG_CAT_APP, "Interrupted, sending EOS");
+    if (offline_queue) offline_scheduler_stop(offline_queue);
+    source_manager_shutdown(sources);
+    gst_element_send_event(pipeline, gst_event_new_eos());
+    /* A second Ctrl-C falls through to the default handler */
+    return G_SOURCE_REMOVE;
+}
+
+static void dump_source_health(GString *out, gpointer data) {
+    source_manager_dump_health((SourceManager *)data, out);
+}
+
+static void dump_zones(GString *out, gpointer data) {
+    analytics_pool_dump_zones((AnalyticsPool *)data, out);
+}
+
+static void dump_crowd(GString *out, gpointer data) {
+    g_string_append_c(out, '[');
+    for (guint i = 0; i < crowd_num_sources; i++) {
+        CrowdSourceStats *stats = &crowd_stats[i];
+        g_string_append_printf(
+            out,
+            "%s{\"source\":%u,\"people\":%d,\"close_pairs\":%d,\"crowded\":%d,"
+            "\"peak_density\":%d,\"max_close_pairs\":%d}",
+            i ? "," : "", i, g_atomic_int_get(&stats->people),
+            g_atomic_int_get(&stats->close_pairs), g_atomic_int_get(&stats->crowded),
+            g_atomic_int_get(&stats->peak_density),
+            g_atomic_int_get(&stats->max_close_pairs));
+    }
+    g_string_append_c(out, ']');
+}
+
+/* One model per nvinfer stage with a label table, or just the primary
+ * classes without a pipeline description */
+static ClassCounters *new_class_counters(const PipelineConfig *config,
+                                         guint max_sources) {
+    CounterModel models[CLASS_COUNTERS_MAX_MODELS];
+    GPtrArray *labels = g_ptr_array_new_with_free_func(g_free);
+    guint num_stages = config ? config->num_stages : 1;
+    guint num_models = 0;
+    ClassCounters *counters;
+
+    for (guint i = 0; i < num_stages && num_models < G_N_ELEMENTS(models); i++) {
+        const PipelineStage *stage = config ? &config->stages[i] : NULL;
+        const LabelTable *table;
+        CounterModel *model = &models[num_models];
+        const gchar **names;
+
+        if (stage && stage->type != STAGE_NVINFER) continue;
+        table = stage ? labels_for_stage(stage->name, stage->is_primary)
+                      : labels_for_stage(NULL, TRUE);
+        if (!table) continue;
+        names = g_new(const gchar *, table->num_labels);
+        for (guint l = 0; l < table->num_labels; l++) names[l] = table->labels[l];
+        g_ptr_array_add(labels, names);
+        model->name = stage ? stage->name : table->name;
+        model->primary = stage ? stage->is_primary : TRUE;
+        model->component_id = stage ? stage->gie_unique_id : 0;
+        model->labels = names;
+        model->num_labels = table->num_labels;
+        num_models++;
+    }
+    counters = class_counters_new(models, num_models, max_sources,
+                                  CLASS_COUNTERS_DEFAULT_TRACK_TTL_NS);
+    g_ptr_array_free(labels, TRUE);
+    return counters;
+}
+
+static void quit_loop(gpointer data) { g_main_loop_quit((GMainLoop *)data); }
+
 static gboolean bus_call(GstBus *bus, GstMessage *msg, gpointer data) {
     GMainLoop *loop = (GMainLoop *)data;
     switch (GST_MESSAGE_TYPE(msg)) {
         case GST_MESSAGE_EOS:
-            g_print("End of stream\n");
+            LOG_INFO(LOG_CAT_APP, "End of stream");
             g_main_loop_quit(loop);
             break;
         case GST_MESSAGE_ERROR: {
             gchar *debug;
             GError *error;
             gst_message_parse_error(msg, &error, &debug);
-            g_printerr("ERROR from element %s: %s\n", GST_OBJECT_NAME(msg->src),
-                       error->message);
-            if (debug) g_printerr("Error details: %s\n", debug);
+            LOG_ERROR(LOG_CAT_APP, "ERROR from element %s: %s",
+                      GST_OBJECT_NAME(msg->src), error->message);
+            if (debug) LOG_DEBUG(LOG_CAT_APP, "Error details: %s", debug);
             g_free(debug);
             g_error_free(error);
-            g_main_loop_quit(loop);
+            /* A failing camera only takes its own branch down */
+            if (!sources || !source_manager_handle_error(sources, msg)) {
+                g_main_loop_quit(loop);
+            }
             break;
         }
         default:
@@ -228,58 +317,15 @@ static gboolean bus_call(GstBus *bus, GstMessage *msg, gpointer data) {
 #define CONFIG_GROUP_TRACKER_ENABLE_BATCH_PROCESS "enable-batch-process"
 #define CONFIG_GPU_ID "gpu-id"
 
-// Certain components dynamically generate their sources, so they can't be linked
-// immediately
-static void link_source_pad_to_pipe(GstElement *src, GstPad *new_src_pad,
-                                    GstElement *sink_elem) {
-    GstPad *sink_pad = gst_element_get_static_pad(sink_elem, "sink");
-    g_print("Source Pad was created with name %s\n", gst_pad_get_name(new_src_pad));
-    GstPadLinkReturn status = gst_pad_link(new_src_pad, sink_pad);
-    if (GST_PAD_LINK_FAILED(status)) {
-        g_printerr("Type is %s but link failed",
-                   gst_structure_get_name(gst_caps_get_structure(
-                       gst_pad_get_current_caps(new_src_pad), 0)));
-    }
-}
-
-static gchar *get_absolute_file_path(gchar *cfg_file_path, gchar *file_path) {
-    gchar abs_cfg_path[PATH_MAX + 1];
-    gchar *abs_file_path;
-    gchar *delim;
-
-    if (file_path && file_path[0] == '/') {
-        return file_path;
-    }
-
-    if (!realpath(cfg_file_path, abs_cfg_path)) {
-        g_free(file_path);
-        return NULL;
-    }
-
-    // Return absolute path of config file if file_path is NULL.
-    if (!file_path) {
-        abs_file_path = g_strdup(abs_cfg_path);
-        return abs_file_path;
-    }
-
-    delim = g_strrstr(abs_cfg_path, "/");
-    *(delim + 1) = '\0';
-
-    abs_file_path = g_strconcat(abs_cfg_path, file_path, NULL);
-    g_free(file_path);
-
-    return abs_file_path;
-}
-
-static gboolean set_tracker_properties(GstElement *nvtracker) {
+static gboolean set_tracker_properties(GstElement *nvtracker,
+                                       const gchar *config_file) {
     gboolean ret = FALSE;
     GError *error = NULL;
     gchar **keys = NULL;
     gchar **key = NULL;
     GKeyFile *key_file = g_key_file_new();
 
-    if (!g_key_file_load_from_file(key_file, TRACKER_CONFIG_FILE, G_KEY_FILE_NONE,
-                                   &error)) {
+    if (!g_key_file_load_from_file(key_file, config_file, G_KEY_FILE_NONE, &error)) {
         g_printerr("Failed to load config file: %s\n", error->message);
         return FALSE;
     }
@@ -305,14 +351,14 @@ static gboolean set_tracker_properties(GstElement *nvtracker) {
             g_object_set(G_OBJECT(nvtracker), "gpu_id", gpu_id, NULL);
         } else if (!g_strcmp0(*key, CONFIG_GROUP_TRACKER_LL_CONFIG_FILE)) {
             char *ll_config_file = get_absolute_file_path(
-                TRACKER_CONFIG_FILE,
+                config_file,
                 g_key_file_get_string(key_file, CONFIG_GROUP_TRACKER,
                                       CONFIG_GROUP_TRACKER_LL_CONFIG_FILE, &error));
             CHECK_ERROR(error);
             g_object_set(G_OBJECT(nvtracker), "ll-config-file", ll_config_file, NULL);
         } else if (!g_strcmp0(*key, CONFIG_GROUP_TRACKER_LL_LIB_FILE)) {
             char *ll_lib_file = get_absolute_file_path(
-                TRACKER_CONFIG_FILE,
+                config_file,
                 g_key_file_get_string(key_file, CONFIG_GROUP_TRACKER,
                                       CONFIG_GROUP_TRACKER_LL_LIB_FILE, &error));
             CHECK_ERROR(error);
@@ -343,205 +389,771 @@ done:
     return ret;
 }
 
-int main(int argc, char *argv[]) {
-    GMainLoop *loop = NULL;
-    GstElement *pipeline = NULL, *source = NULL, *depay = NULL, *h264parser = NULL,
-               *decoder = NULL, *streammux = NULL, *sink = NULL, *pgie = NULL,
-               *nvvidconv = NULL, *nvosd = NULL, *sgie1 = NULL, *sgie2 = NULL,
-               *sgie3 = NULL, *nvtracker = NULL;
-    g_print("With tracker\n");
-    GstElement *transform = NULL;
-    GstBus *bus = NULL;
-    guint bus_watch_id = 0;
-    GstPad *osd_sink_pad = NULL;
-
-    int current_device = -1;
-    cudaCheckError(cudaGetDevice(&current_device));
-    struct cudaDeviceProp prop;
-    cudaCheckError(cudaGetDeviceProperties(&prop, current_device));
-
-    /* Check input arguments */
-    if (argc != 2) {
-        g_printerr("Usage: %s <elementary H265 filename>\n", argv[0]);
-        return -1;
-    }
-
-    /* Standard GStreamer initialization */
-    gst_init(&argc, &argv);
-    loop = g_main_loop_new(NULL, FALSE);
-
-    /* Create gstreamer elements */
-
-    /* Create Pipeline element that will be a container of other elements */
-    pipeline = gst_pipeline_new("dstest2-pipeline");
-
-    /* Source element for reading from the RTSP Stream*/
-    source = gst_element_factory_make("rtspsrc", "source");
-
-    depay = gst_element_factory_make("rtph264depay", "depay");
+static gchar *source_list_file = NULL;
+static gchar *pipeline_file = NULL;
+static gint max_sources = 0;
+static gboolean benchmark = FALSE;
+static gboolean cpu_only = FALSE;
+static gint warmup_sec = 5;
+static gint stub_objects = 32;
+static gchar *record_file = NULL;
+static gchar *export_file = NULL;
+static gint export_capacity = EXPORT_RING_DEFAULT_CAPACITY;
+static gchar *stats_dest = NULL;
+static gint stats_interval = 10;
+static gchar *interval_trace_file = NULL;
+static gchar *zones_file = NULL;
+static gint rtsp_latency = SOURCE_DEFAULT_LATENCY_MS;
+static gboolean rtsp_tcp = FALSE;
+static gboolean rtsp_drop_on_latency = FALSE;
+static gint rtsp_stall_timeout = SOURCE_DEFAULT_STALL_TIMEOUT_MS / 1000;
+static gint rtsp_retry_max = SOURCE_DEFAULT_RETRY_MAX_MS / 1000;
+static gint analytics_workers = ANALYTICS_DEFAULT_WORKERS;
+static gint analytics_queue = ANALYTICS_DEFAULT_QUEUE_LEN;
+static gdouble crowd_distance = 0;
+static gchar *clips_dir = NULL;
+static gint clip_preroll = CLIP_DEFAULT_PREROLL_MS / 1000;
+static gint clip_postroll = CLIP_DEFAULT_POSTROLL_MS / 1000;
+static gchar *trajectories_dir = NULL;
+static gchar *metrics_dest = NULL;
+static gboolean offline = FALSE;
+static gchar *offline_report = NULL;
+static OverlayPolicy overlay_policy = {OVERLAY_ON_CHANGE, 1};
+static gchar *log_file = NULL;
+/* Filled in by the --log-* callbacks, set to the defaults before parsing */
+static LogConfig log_config;
+
+static gboolean parse_overlay_policy(const gchar *option_name, const gchar *value,
+                                     gpointer data, GError **error) {
+    return overlay_policy_parse(value, &overlay_policy, error);
+}
 
-    h264parser = gst_element_factory_make("h264parse", "parser");
+static gboolean parse_log_level(const gchar *option_name, const gchar *value,
+                                gpointer data, GError **error) {
+    return logger_config_parse_levels(&log_config, value, error);
+}
 
-    /* Use nvdec_h264 for hardware accelerated decode on GPU */
-    decoder = gst_element_factory_make("nvv4l2decoder", "nvv4l2-decoder");
+static gboolean parse_log_rate(const gchar *option_name, const gchar *value,
+                               gpointer data, GError **error) {
+    return logger_config_parse_rates(&log_config, value, error);
+}
 
-    /* Create nvstreammux instance to form batches from one or more sources. */
-    streammux = gst_element_factory_make("nvstreammux", "stream-muxer");
+static gboolean parse_log_format(const gchar *option_name, const gchar *value,
+                                 gpointer data, GError **error) {
+    if (!g_strcmp0(value, "text")) {
+        log_config.format = LOG_FORMAT_TEXT;
+    } else if (!g_strcmp0(value, "json")) {
+        log_config.format = LOG_FORMAT_JSON;
+    } else {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                    "Unknown log format '%s', expected text or json", value);
+        return FALSE;
+    }
+    return TRUE;
+}
 
-    if (!pipeline || !streammux) {
-        g_printerr("One element could not be created. Exiting.\n");
-        return -1;
+static GOptionEntry entries[] = {
+    {"source-list", 'l', 0, G_OPTION_ARG_FILENAME, &source_list_file,
+     "File with one RTSP URI or video file per line", "FILE"},
+    {"pipeline", 'p', 0, G_OPTION_ARG_FILENAME, &pipeline_file,
+     "Pipeline description listing the inference stages (default: "
+     PIPELINE_CONFIG_FILE ")",
+     "FILE"},
+    {"max-sources", 'm', 0, G_OPTION_ARG_INT, &max_sources,
+     "Muxer slots to reserve for sources added at runtime (default: number of "
+     "sources)",
+     "N"},
+    {"rtsp-latency", 0, 0, G_OPTION_ARG_INT, &rtsp_latency,
+     "RTSP jitterbuffer latency in milliseconds (default: 200)", "MS"},
+    {"rtsp-tcp", 0, 0, G_OPTION_ARG_NONE, &rtsp_tcp,
+     "Receive RTSP streams interleaved over TCP instead of UDP", NULL},
+    {"rtsp-drop-on-latency", 0, 0, G_OPTION_ARG_NONE, &rtsp_drop_on_latency,
+     "Drop RTSP packets arriving later than the latency instead of waiting", NULL},
+    {"rtsp-stall-timeout", 0, 0, G_OPTION_ARG_INT, &rtsp_stall_timeout,
+     "Rebuild an RTSP source that sent nothing for SEC seconds, 0 to rely on "
+     "rtspsrc errors only (default: 5)",
+     "SEC"},
+    {"rtsp-retry-max", 0, 0, G_OPTION_ARG_INT, &rtsp_retry_max,
+     "Longest wait between reconnection attempts (default: 30)", "SEC"},
+    {"offline", 0, 0, G_OPTION_ARG_NONE, &offline,
+     "Process the given files, and the video files in the given directories, "
+     "as fast as possible, --max-sources at a time (default: 4)",
+     NULL},
+    {"offline-report", 0, 0, G_OPTION_ARG_FILENAME, &offline_report,
+     "Write the frames, detections and time taken for each --offline file to "
+     "FILE as CSV",
+     "FILE"},
+    {"benchmark", 'b', 0, G_OPTION_ARG_NONE, &benchmark,
+     "Render to a non-syncing fakesink and report FPS, latency and CPU at exit",
+     NULL},
+    {"cpu-only", 0, 0, G_OPTION_ARG_NONE, &cpu_only,
+     "Benchmark without a GPU: software decode and a stub in place of the "
+     "inference stages",
+     NULL},
+    {"warmup", 0, 0, G_OPTION_ARG_INT, &warmup_sec,
+     "Seconds excluded from the benchmark figures (default: 5)", "SEC"},
+    {"stub-objects", 0, 0, G_OPTION_ARG_INT, &stub_objects,
+     "Synthetic objects per frame with --cpu-only (default: 32)", "N"},
+    {"record", 'r', 0, G_OPTION_ARG_FILENAME, &record_file,
+     "Record the object metadata seen by the analytics probe, for nvds_replay",
+     "FILE"},
+    {"export", 'x', 0, G_OPTION_ARG_FILENAME, &export_file,
+     "Export every detection to a memory-mapped ring file, see nvds_export_cat",
+     "FILE"},
+    {"export-capacity", 0, 0, G_OPTION_ARG_INT, &export_capacity,
+     "Records kept in the export ring (default: 1048576)", "N"},
+    {"analytics-workers", 'w', 0, G_OPTION_ARG_INT, &analytics_workers,
+     "Threads running the per-track analytics (default: 1)", "N"},
+    {"zones", 'z', 0, G_OPTION_ARG_FILENAME, &zones_file,
+     "Count zone dwell time and line crossings, see zones.txt", "FILE"},
+    {"crowd-distance", 0, 0, G_OPTION_ARG_DOUBLE, &crowd_distance,
+     "Count people closer than RATIO times their height, and the densest "
+     "256x256 area of each frame, 0 to disable (default: 0)",
+     "RATIO"},
+    {"clips", 0, 0, G_OPTION_ARG_FILENAME, &clips_dir,
+     "Save an MP4 clip to DIR around each track that starts loitering, from "
+     "the compressed stream",
+     "DIR"},
+    {"clip-preroll", 0, 0, G_OPTION_ARG_INT, &clip_preroll,
+     "Seconds of video kept from before the event (default: 5)", "SEC"},
+    {"clip-postroll", 0, 0, G_OPTION_ARG_INT, &clip_postroll,
+     "Seconds of video recorded after the event (default: 5)", "SEC"},
+    {"trajectories", 0, 0, G_OPTION_ARG_FILENAME, &trajectories_dir,
+     "Archive the simplified path of every track to DIR, see nvds_traj_query",
+     "DIR"},
+    {"analytics-queue", 0, 0, G_OPTION_ARG_INT, &analytics_queue,
+     "Frames queued per analytics thread before they are dropped (default: 64)",
+     "N"},
+    {"metrics", 0, 0, G_OPTION_ARG_STRING, &metrics_dest,
+     "Serve object counts per source and class to Prometheus over HTTP on PORT, "
+     "HOST:PORT or unix:PATH",
+     "DEST"},
+    {"stats", 's', 0, G_OPTION_ARG_STRING, &stats_dest,
+     "Append per-element latency, FPS and batch fill as JSON lines to FILE, or "
+     "stream them to clients of unix:PATH",
+     "DEST"},
+    {"stats-interval", 0, 0, G_OPTION_ARG_INT, &stats_interval,
+     "Seconds between --stats dumps (default: 10)", "SEC"},
+    {"interval-trace", 0, 0, G_OPTION_ARG_FILENAME, &interval_trace_file,
+     "Write the load seen by the adaptive pgie interval each second as CSV, for "
+     "nvds_interval_trace",
+     "FILE"},
+    {"overlay", 0, 0, G_OPTION_ARG_CALLBACK, parse_overlay_policy,
+     "Text overlay policy: off, on-change or every-N frames (default: on-change)",
+     "POLICY"},
+    {"log", 0, 0, G_OPTION_ARG_FILENAME, &log_file,
+     "Append log lines to FILE instead of stdout and stderr", "FILE"},
+    {"log-format", 0, 0, G_OPTION_ARG_CALLBACK, parse_log_format,
+     "Log lines as text or json (default: text)", "FORMAT"},
+    {"log-level", 0, 0, G_OPTION_ARG_CALLBACK, parse_log_level,
+     "Log level for every category, CATEGORY=LEVEL, or a comma-separated list, "
+     "e.g. warning,sources=debug (default: info)",
+     "SPEC"},
+    {"log-rate", 0, 0, G_OPTION_ARG_CALLBACK, parse_log_rate,
+     "Log lines per second over which a category's lines are dropped, as N, "
+     "CATEGORY=N or a list (default: 100, 0 for no limit)",
+     "SPEC"},
+    {NULL}};
+
+typedef struct {
+    GstElement *pipeline;
+    /* nvstreammux, or a funnel in --cpu-only mode */
+    GstElement *streammux;
+    /* The analytics probe goes on this element's sink pad: nvdsosd, or the
+     * converter when the pipeline has no OSD */
+    GstElement *nvosd;
+    GstElement *sink;
+} AppPipeline;
+
+/* Creates the element for one inference or tracking stage */
+static GstElement *create_stage(const PipelineStage *stage) {
+    GstElement *element;
+
+    if (stage->type == STAGE_NVTRACKER) {
+        element = gst_element_factory_make("nvtracker", stage->name);
+        if (element && !set_tracker_properties(element, stage->config_file)) {
+            g_printerr("Failed to set tracker properties. Exiting.\n");
+            gst_object_unref(element);
+            return NULL;
+        }
+        return element;
     }
-    g_print("Got this far\n");
 
     /* Use nvinfer to run inferencing on decoder's output,
      * behaviour of inferencing is set through config file */
-    pgie = gst_element_factory_make("nvinfer", "primary-nvinference-engine");
+    element = gst_element_factory_make("nvinfer", stage->name);
+    if (!element) return NULL;
+    g_object_set(G_OBJECT(element), "config-file-path", stage->config_file, NULL);
+    /* One batch slot per source, so inference is amortized across cameras */
+    if (stage->is_primary) {
+        g_object_set(G_OBJECT(element), "batch-size", max_sources, NULL);
+    }
+    return element;
+}
 
-    /* We need to have a tracker to track the identified objects */
-    nvtracker = gst_element_factory_make("nvtracker", "tracker");
+/* Adds element to the pipeline and links it after *last, through a queue named
+ * after it when queue asks for one */
+static gboolean append_element(GstElement *pipeline, GstElement **last,
+                               GstElement *element, const QueueConfig *queue) {
+    gst_bin_add(GST_BIN(pipeline), element);
+    if (queue && queue->enabled) {
+        gchar *name = g_strdup_printf("queue-%s", GST_ELEMENT_NAME(element));
+        GstElement *q = gst_element_factory_make("queue", name);
+
+        g_free(name);
+        if (!q) return FALSE;
+        /* Bounded by batches only, so a slow stage pushes back on the muxer */
+        g_object_set(G_OBJECT(q), "max-size-buffers", queue->max_buffers,
+                     "max-size-bytes", 0, "max-size-time", (guint64)0, "leaky",
+                     queue->leaky, NULL);
+        gst_bin_add(GST_BIN(pipeline), q);
+        if (!gst_element_link(*last, q)) return FALSE;
+        *last = q;
+    }
+    if (!gst_element_link(*last, element)) return FALSE;
+    *last = element;
+    return TRUE;
+}
 
-    /* We need three secondary gies so lets create 3 more instances of
-       nvinfer */
-    sgie1 = gst_element_factory_make("nvinfer", "secondary1-nvinference-engine");
+/* streammux | <stages from the pipeline file> | nvvidconv | [nvosd] | [tiler] |
+ * [transform] | sink, with queues in front of the elements the pipeline file
+ * names */
+static gboolean build_inference_pipeline(AppPipeline *app,
+                                         const PipelineConfig *config) {
+    GstElement *nvvidconv = NULL, *tiler = NULL, *transform = NULL, *last;
+    guint tiler_rows, tiler_columns;
+    gboolean fake_sink = benchmark || offline || config->sink == SINK_FAKE;
 
-    sgie2 = gst_element_factory_make("nvinfer", "secondary2-nvinference-engine");
+    int current_device = -1;
+    cudaCheckError(cudaGetDevice(&current_device));
+    struct cudaDeviceProp prop;
+    cudaCheckError(cudaGetDeviceProperties(&prop, current_device));
 
-    sgie3 = gst_element_factory_make("nvinfer", "secondary3-nvinference-engine");
+    /* Create nvstreammux instance to form batches from one or more sources. */
+    app->streammux = gst_element_factory_make("nvstreammux", "stream-muxer");
+    if (!app->streammux) {
+        g_printerr("One element could not be created. Exiting.\n");
+        return FALSE;
+    }
+    g_object_set(G_OBJECT(app->streammux), "batch-size", max_sources, NULL);
+    g_object_set(G_OBJECT(app->streammux), "width", MUXER_OUTPUT_WIDTH, "height",
+                 MUXER_OUTPUT_HEIGHT, "batched-push-timeout", MUXER_BATCH_TIMEOUT_USEC,
+                 NULL);
+    gst_bin_add(GST_BIN(app->pipeline), app->streammux);
+    last = app->streammux;
+
+    for (guint i = 0; i < config->num_stages; i++) {
+        GstElement *stage = create_stage(&config->stages[i]);
+        if (!stage) {
+            g_printerr("Stage %s could not be created. Exiting.\n",
+                       config->stages[i].name);
+            return FALSE;
+        }
+        if (!append_element(app->pipeline, &last, stage, &config->stages[i].queue)) {
+            g_printerr("Stage %s could not be linked. Exiting.\n",
+                       config->stages[i].name);
+            return FALSE;
+        }
+    }
 
     /* Use convertor to convert from NV12 to RGBA as required by nvosd */
     nvvidconv = gst_element_factory_make("nvvideoconvert", "nvvideo-converter");
 
-    /* Create OSD to draw on the converted RGBA buffer */
-    nvosd = gst_element_factory_make("nvdsosd", "nv-onscreendisplay");
+    /* Create OSD to draw on the converted RGBA buffer. Without it the analytics
+     * probe goes on the converter instead. */
+    app->nvosd = nvvidconv;
+    if (config->osd) {
+        app->nvosd = gst_element_factory_make("nvdsosd", "nv-onscreendisplay");
+    }
+
+    /* Composite the batch into a 2D grid after the OSD, so the probe still sees
+     * boxes in per-source coordinates */
+    if (config->tiler) {
+        tiler = gst_element_factory_make("nvmultistreamtiler", "nvtiler");
+    }
 
-    /* Finally render the osd output */
-    if (prop.integrated) {
-        transform = gst_element_factory_make("nvegltransform", "nvegl-transform");
+    /* Finally render the osd output. Benchmarks and offline runs must not be
+     * clocked to real time or need a display, so they end in a fakesink instead */
+    if (fake_sink) {
+        app->sink = gst_element_factory_make("fakesink", "benchmark-sink");
+    } else {
+        if (prop.integrated) {
+            transform = gst_element_factory_make("nvegltransform", "nvegl-transform");
+        }
+        app->sink = gst_element_factory_make("nveglglessink", "nvvideo-renderer");
     }
-    sink = gst_element_factory_make("nveglglessink", "nvvideo-renderer");
 
-    if (!source || !depay || !h264parser || !decoder || !pgie || !nvtracker || !sgie1 ||
-        !sgie2 || !sgie3 || !nvvidconv || !nvosd || !sink) {
+    if (!nvvidconv || !app->nvosd || (config->tiler && !tiler) || !app->sink) {
         g_printerr("One element could not be created. Exiting.\n");
-        return -1;
+        return FALSE;
     }
 
-    if (!transform && prop.integrated) {
+    if (!transform && prop.integrated && !fake_sink) {
         g_printerr("One tegra element could not be created. Exiting.\n");
-        return -1;
+        return FALSE;
+    }
+
+    if (tiler) {
+        tiler_rows = (guint)sqrt(max_sources);
+        tiler_columns = (guint)ceil(1.0 * max_sources / tiler_rows);
+        g_object_set(G_OBJECT(tiler), "rows", tiler_rows, "columns", tiler_columns,
+                     "width", MUXER_OUTPUT_WIDTH, "height", MUXER_OUTPUT_HEIGHT, NULL);
     }
 
-    /* Set the input filename to the source element */
-    g_object_set(G_OBJECT(source), "location", argv[1], NULL);
+    if (fake_sink) g_object_set(G_OBJECT(app->sink), "sync", FALSE, NULL);
+
+    /* Set up the rest of the pipeline, skipping the optional elements. The
+     * sink queue goes in front of the transform on Jetson. */
+    if (!append_element(app->pipeline, &last, nvvidconv, &config->convert_queue) ||
+        (app->nvosd != nvvidconv &&
+         !append_element(app->pipeline, &last, app->nvosd, &config->osd_queue)) ||
+        (tiler && !append_element(app->pipeline, &last, tiler, NULL)) ||
+        (transform &&
+         !append_element(app->pipeline, &last, transform, &config->sink_queue)) ||
+        !append_element(app->pipeline, &last, app->sink,
+                        transform ? NULL : &config->sink_queue)) {
+        g_printerr("Elements could not be linked. Exiting.\n");
+        return FALSE;
+    }
+    return TRUE;
+}
 
-    g_object_set(G_OBJECT(streammux), "batch-size", 1, NULL);
+/* funnel | fakesink, with software decode and the inference stub inside each
+ * source bin. The analytics probe runs on the fakesink's sink pad. */
+static gboolean build_cpu_pipeline(AppPipeline *app) {
+    app->streammux = gst_element_factory_make("funnel", "stream-funnel");
+    app->sink = gst_element_factory_make("fakesink", "benchmark-sink");
+    if (!app->streammux || !app->sink) {
+        g_printerr("One element could not be created. Exiting.\n");
+        return FALSE;
+    }
+    app->nvosd = app->sink;
+    g_object_set(G_OBJECT(app->sink), "sync", FALSE, NULL);
 
-    g_object_set(G_OBJECT(streammux), "width", MUXER_OUTPUT_WIDTH, "height",
-                 MUXER_OUTPUT_HEIGHT, "batched-push-timeout", MUXER_BATCH_TIMEOUT_USEC,
-                 NULL);
+    gst_bin_add_many(GST_BIN(app->pipeline), app->streammux, app->sink, NULL);
+    if (!gst_element_link(app->streammux, app->sink)) {
+        g_printerr("Elements could not be linked. Exiting.\n");
+        return FALSE;
+    }
+    return TRUE;
+}
 
-    g_signal_connect(source, "pad-added", G_CALLBACK(link_source_pad_to_pipe), depay);
+int main(int argc, char *argv[]) {
+    GMainLoop *loop = NULL;
+    AppPipeline app = {0};
+    g_print("With tracker\n");
+    GstBus *bus = NULL;
+    guint bus_watch_id = 0;
+    GstPad *osd_sink_pad = NULL;
+    GstPad *mux_src_pad = NULL;
+    GOptionContext *context = NULL;
+    GError *error = NULL;
+    gchar **uris = NULL;
+    guint num_uris = 0;
+    SourceOptions source_options;
+    Benchmark *bench = NULL;
+    Instrument *instrument = NULL;
+    PipelineConfig *pipeline_config = NULL;
+    SgieCache *sgie_cache = NULL;
+    IntervalTuner *tuner = NULL;
+    ZoneLayout *zones = NULL;
+    MetricsServer *metrics = NULL;
+    gint status = 0;
 
-    /* Set all the necessary properties of the nvinfer element,
-     * the necessary ones are : */
-    g_object_set(G_OBJECT(pgie), "config-file-path", PGIE_CONFIG_FILE, NULL);
-    g_object_set(G_OBJECT(sgie1), "config-file-path", SGIE1_CONFIG_FILE, NULL);
-    g_object_set(G_OBJECT(sgie2), "config-file-path", SGIE2_CONFIG_FILE, NULL);
-    g_object_set(G_OBJECT(sgie3), "config-file-path", SGIE3_CONFIG_FILE, NULL);
+    /* Check input arguments */
+    logger_config_init(&log_config);
+    context = g_option_context_new("[RTSP URI or video file...]");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return -1;
+    }
+    g_option_context_free(context);
 
-    /* Set necessary properties of the tracker element. */
-    if (!set_tracker_properties(nvtracker)) {
-        g_printerr("Failed to set tracker properties. Exiting.\n");
+    /* Streaming threads log from here on, a background thread writes it out */
+    log_config.path = log_file;
+    if (!logger_start(&log_config, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
         return -1;
     }
 
-    /* we add a message handler */
-    bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
-    bus_watch_id = gst_bus_add_watch(bus, bus_call, loop);
-    gst_object_unref(bus);
+    if (source_list_file) {
+        uris = source_list_load(source_list_file, &error);
+        if (!uris) {
+            g_printerr("Failed to read source list: %s\n", error->message);
+            g_error_free(error);
+            return -1;
+        }
+    } else {
+        uris = g_strdupv(argv + 1);
+    }
+    if (offline) {
+        gchar **files = offline_list_files(uris, &error);
 
-    /* Set up the pipeline */
-    /* we add all elements into the pipeline */
-    /* decoder | pgie1 | nvtracker | sgie1 | sgie2 | sgie3 | etc.. */
-    if (prop.integrated) {
-        gst_bin_add_many(GST_BIN(pipeline), source, depay, h264parser, decoder,
-                         streammux, pgie, nvtracker, sgie1, sgie2, sgie3, nvvidconv,
-                         nvosd, transform, sink, NULL);
+        if (!files) {
+            g_printerr("Failed to list the offline files: %s\n", error->message);
+            g_error_free(error);
+            return -1;
+        }
+        g_strfreev(uris);
+        uris = files;
+        for (guint i = 0; uris[i]; i++) {
+            if (g_str_has_prefix(uris[i], "rtsp://") ||
+                g_str_has_prefix(uris[i], "rtsps://")) {
+                g_printerr("--offline only takes files, not %s\n", uris[i]);
+                return -1;
+            }
+        }
+    }
+    num_uris = g_strv_length(uris);
+    if (num_uris == 0) {
+        g_printerr("Usage: %s [--source-list FILE] [--max-sources N] "
+                   "[--benchmark [--cpu-only]] [--offline] "
+                   "<RTSP URI, file or --offline directory>...\n",
+                   argv[0]);
+        return -1;
+    }
+    /* Offline, the muxer slots are shared out among the files in turn */
+    if (offline) {
+        if (max_sources <= 0) max_sources = MIN(num_uris, OFFLINE_DEFAULT_SLOTS);
     } else {
-        gst_bin_add_many(GST_BIN(pipeline), source, depay, h264parser, decoder,
-                         streammux, pgie, nvtracker, sgie1, sgie2, sgie3, nvvidconv,
-                         nvosd, sink, NULL);
+        max_sources = MAX(max_sources, (gint)num_uris);
     }
+    if (cpu_only) benchmark = TRUE;
+
+    /* Standard GStreamer initialization */
+    gst_init(&argc, &argv);
+    loop = g_main_loop_new(NULL, FALSE);
 
-    gchar pad_name_sink[16] = "sink_0";
-    gchar pad_name_src[16] = "src";
+    /* Create gstreamer elements */
 
-    GstPad *sinkpad = gst_element_get_request_pad(streammux, pad_name_sink);
-    if (!sinkpad) {
-        g_printerr("Streammux request sink pad failed. Exiting.\n");
+    /* Create Pipeline element that will be a container of other elements */
+    app.pipeline = gst_pipeline_new("dstest2-pipeline");
+    if (!app.pipeline) {
+        g_printerr("One element could not be created. Exiting.\n");
         return -1;
     }
+    g_print("Got this far\n");
 
-    GstPad *srcpad = gst_element_get_static_pad(decoder, pad_name_src);
-    if (!srcpad) {
-        g_printerr("Decoder request src pad failed. Exiting.\n");
-        return -1;
+    if (!cpu_only) {
+        pipeline_config =
+            pipeline_config_load(pipeline_file ? pipeline_file : PIPELINE_CONFIG_FILE,
+                                 &error);
+        if (!pipeline_config) {
+            g_printerr("Failed to load pipeline description: %s\n", error->message);
+            g_error_free(error);
+            return -1;
+        }
+        pipeline_config_print(pipeline_config);
+        /* Nothing would draw the text */
+        if (!pipeline_config->osd) overlay_policy.mode = OVERLAY_OFF;
     }
 
-    if (gst_pad_link(srcpad, sinkpad) != GST_PAD_LINK_OK) {
-        g_printerr("Failed to link decoder to stream muxer. Exiting.\n");
+    if (!(cpu_only ? build_cpu_pipeline(&app)
+                   : build_inference_pipeline(&app, pipeline_config))) {
         return -1;
     }
 
-    gst_object_unref(sinkpad);
-    gst_object_unref(srcpad);
+    /* we add a message handler */
+    bus = gst_pipeline_get_bus(GST_PIPELINE(app.pipeline));
+    bus_watch_id = gst_bus_add_watch(bus, bus_call, loop);
+    gst_object_unref(bus);
+
+    /* Taps every source branch, so it must exist before the first one */
+    if (clips_dir) {
+        ClipConfig clip_config;
 
-    /* Link the elements together */
-    if (!gst_element_link_many(depay, h264parser, decoder, NULL)) {
-        g_printerr("Elements could not be linked: 1. Exiting.\n");
-        return -1;
+        if (g_mkdir_with_parents(clips_dir, 0755) < 0) {
+            g_printerr("Cannot create %s. Exiting.\n", clips_dir);
+            return -1;
+        }
+        clip_config_init(&clip_config, clips_dir);
+        clip_config.preroll_ms = MAX(clip_preroll, 0) * 1000;
+        clip_config.postroll_ms = MAX(clip_postroll, 0) * 1000;
+        clips = clip_recorder_new(&clip_config, max_sources);
     }
 
-    if (prop.integrated) {
-        if (!gst_element_link_many(streammux, pgie, nvtracker, sgie1, sgie2, sgie3,
-                                   nvvidconv, nvosd, transform, sink, NULL)) {
-            g_printerr("Elements could not be linked. Exiting.\n");
+    /* Each source is its own rtspsrc | depay | parse | decoder bin on a mux pad */
+    source_options_init(&source_options);
+    source_options.cpu_only = cpu_only;
+    source_options.stub_objects = stub_objects;
+    source_options.width = MUXER_OUTPUT_WIDTH;
+    source_options.height = MUXER_OUTPUT_HEIGHT;
+    source_options.latency_ms = MAX(rtsp_latency, 0);
+    source_options.tcp = rtsp_tcp;
+    source_options.drop_on_latency = rtsp_drop_on_latency;
+    source_options.stall_timeout_ms = MAX(rtsp_stall_timeout, 0) * 1000;
+    source_options.retry_max_ms =
+        MAX(rtsp_retry_max * 1000, (gint)source_options.retry_initial_ms);
+    if (clips) {
+        source_options.tap = clip_recorder_tap;
+        source_options.tap_data = clips;
+    }
+    if (offline) {
+        offline_queue = offline_scheduler_new(uris, max_sources, quit_loop, loop);
+        source_options.on_end = offline_scheduler_source_ended;
+        source_options.on_end_data = offline_queue;
+    }
+    sources = source_manager_new(app.pipeline, app.streammux, max_sources,
+                                 &source_options);
+    if (offline_queue) {
+        if (!offline_scheduler_start(offline_queue, sources)) {
+            g_printerr("None of the %u file(s) could be added. Exiting.\n", num_uris);
             return -1;
         }
     } else {
-        if (!gst_element_link_many(streammux, pgie, nvtracker, sgie1, sgie2, sgie3,
-                                   nvvidconv, nvosd, sink, NULL)) {
-            g_printerr("Elements could not be linked. Exiting.\n");
+        for (guint i = 0; i < num_uris; i++) {
+            if (source_manager_add(sources, uris[i]) < 0) {
+                g_printerr("Failed to add source %s. Exiting.\n", uris[i]);
+                return -1;
+            }
+        }
+    }
+
+    AnalyticsConfig analytics_config;
+    analytics_config_init(&analytics_config, MAX_FRAME_OBJECTS, PGIE_CLASS_ID_PERSON);
+    analytics_config.num_workers = MAX(analytics_workers, 1);
+    analytics_config.queue_len = MAX(analytics_queue, 1);
+    if (zones_file) {
+        /* Boxes are in muxer output coordinates */
+        zones = zone_layout_load(zones_file, MUXER_OUTPUT_WIDTH, MUXER_OUTPUT_HEIGHT,
+                                 max_sources, &error);
+        if (!zones) {
+            g_printerr("Failed to load zones: %s\n", error->message);
+            g_error_free(error);
+            return -1;
+        }
+        analytics_config.zones = zones;
+    }
+    if (trajectories_dir) {
+        TrajectoryArchiveConfig archive_config;
+
+        /* Frame pts count from about when the pipeline starts playing */
+        trajectory_archive_config_init(&archive_config);
+        archive_config.time_base_ms = g_get_real_time() / 1000;
+        trajectories =
+            trajectory_archive_open(trajectories_dir, &archive_config, &error);
+        if (!trajectories) {
+            g_printerr("Failed to open the trajectory archive: %s\n", error->message);
+            g_error_free(error);
             return -1;
         }
+        analytics_config.trajectory_sink = trajectory_archive_add;
+        analytics_config.trajectory_data = trajectories;
+    }
+    if (clips) {
+        analytics_config.loiter_start = start_clip;
+        analytics_config.loiter_start_data = clips;
+    }
+    analytics = analytics_pool_new(&analytics_config);
+
+    if (crowd_distance > 0) {
+        CrowdConfig crowd_config;
+
+        crowd_config_init(&crowd_config, PGIE_CLASS_ID_PERSON);
+        crowd_config.distance_ratio = crowd_distance;
+        crowd = crowd_analyzer_new(&crowd_config, MAX_FRAME_OBJECTS);
+        crowd_num_sources = max_sources;
+        crowd_stats = g_new0(CrowdSourceStats, crowd_num_sources);
+        g_print("Crowd analysis with the %s kernel\n",
+                crowd_analyzer_kernel_name(crowd));
+    }
+
+    if (metrics_dest) {
+        class_counters = new_class_counters(pipeline_config, max_sources);
+        metrics = metrics_server_new(metrics_dest, class_counters, &error);
+        if (!metrics) {
+            g_printerr("Cannot serve metrics on %s: %s. Exiting.\n", metrics_dest,
+                       error->message);
+            g_error_free(error);
+            return -1;
+        }
+        g_print("Serving %u counter series on %s\n",
+                class_counters_num_series(class_counters), metrics_dest);
     }
 
+    if (record_file) {
+        recorder = meta_recorder_open(record_file, &error);
+        if (!recorder) {
+            g_printerr("%s. Exiting.\n", error->message);
+            g_error_free(error);
+            return -1;
+        }
+    }
+
+    if (export_file) {
+        exporter = export_writer_open(export_file, MAX(export_capacity, 1), &error);
+        if (!exporter) {
+            g_printerr("%s. Exiting.\n", error->message);
+            g_error_free(error);
+            return -1;
+        }
+    }
+
+    /* Queued files and rebuilt branches start their pts over */
+    stream_clock = stream_clock_new();
+    mux_src_pad = gst_element_get_static_pad(app.streammux, "src");
+    gst_pad_add_probe(mux_src_pad, GST_PAD_PROBE_TYPE_BUFFER, mux_src_pad_buffer_probe,
+                      NULL, NULL);
+    gst_object_unref(mux_src_pad);
+
     /* Lets add probe to get informed of the meta data generated, we add probe to
      * the sink pad of the osd element, since by that time, the buffer would have
      * had got all the metadata. */
-    osd_sink_pad = gst_element_get_static_pad(nvosd, "sink");
+    osd_sink_pad = gst_element_get_static_pad(app.nvosd, "sink");
     if (!osd_sink_pad)
         g_print("Unable to get sink pad\n");
     else
         gst_pad_add_probe(osd_sink_pad, GST_PAD_PROBE_TYPE_BUFFER,
                           osd_sink_pad_buffer_probe, NULL, NULL);
-    gst_object_unref(osd_sink_pad);
+
+    /* Measured from the muxer output to the sink input, after the analytics
+     * probe has run */
+    if (benchmark && osd_sink_pad) {
+        GstPad *sink_pad = gst_element_get_static_pad(app.sink, "sink");
+
+        mux_src_pad = gst_element_get_static_pad(app.streammux, "src");
+        bench = benchmark_new(max_sources, warmup_sec);
+        benchmark_attach(bench, mux_src_pad, sink_pad);
+        gst_object_unref(mux_src_pad);
+        gst_object_unref(sink_pad);
+    }
+    if (osd_sink_pad) gst_object_unref(osd_sink_pad);
+
+    overlay = overlay_new(max_sources, &overlay_policy);
+    overlay_attach(overlay, app.nvosd);
+
+    if (pipeline_config) sgie_cache = sgie_cache_new(app.pipeline, pipeline_config);
+
+    /* Measured over the whole pipeline, so a backlog anywhere slows the pgie */
+    const PipelineStage *adaptive =
+        pipeline_config ? pipeline_config_find_adaptive(pipeline_config) : NULL;
+    if (adaptive) {
+        GstElement *pgie = gst_bin_get_by_name(GST_BIN(app.pipeline), adaptive->name);
+        IntervalControlConfig interval_config;
+
+        interval_control_config_init(&interval_config, adaptive->interval,
+                                     adaptive->max_interval);
+        /* Overloaded once a queue is full, i.e. a stage cannot keep up. At
+         * least one batch, or queues of a single buffer would count as
+         * overloaded whenever they hold anything */
+        if (pipeline_config_num_queues(pipeline_config)) {
+            guint batches = pipeline_config_min_queue_buffers(pipeline_config) - 1;
+            interval_config.max_backlog = MAX(batches, 1) * max_sources;
+        }
+        tuner = interval_tuner_new(app.pipeline, pgie, app.streammux, app.sink,
+                                   &interval_config);
+        gst_object_unref(pgie);
+        if (!interval_tuner_start(tuner, INTERVAL_PERIOD_SEC, interval_trace_file,
+                                  &error)) {
+            g_printerr("%s. Exiting.\n", error->message);
+            g_error_free(error);
+            return -1;
+        }
+    }
+
+    /* Only elements present now are timed, the source bins never are */
+    if (stats_dest) {
+        instrument = instrument_new(app.pipeline, cpu_only ? NULL : app.streammux,
+                                    app.sink, max_sources);
+        if (!instrument_start(instrument, stats_dest, MAX(stats_interval, 1),
+                              &error)) {
+            g_printerr("Cannot write stats to %s: %s. Exiting.\n", stats_dest,
+                       error->message);
+            g_error_free(error);
+            return -1;
+        }
+        instrument_add_section(instrument, "sources", dump_source_health, sources);
+        if (zones) instrument_add_section(instrument, "zones", dump_zones, analytics);
+        if (crowd) instrument_add_section(instrument, "crowd", dump_crowd, NULL);
+    }
+
+    /* Sources can be attached and detached from stdin while running, unless
+     * the offline queue owns them, and Ctrl-C ends a benchmark cleanly with EOS
+     * so the report is printed */
+    if (!offline_queue) source_manager_watch_stdin(sources);
+    g_unix_signal_add(SIGINT, send_eos_on_signal, app.pipeline);
 
     /* Set the pipeline to "playing" state */
-    g_print("Now playing: %s\n", argv[1]);
-    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    if (offline_queue) {
+        g_print("Processing %u file(s), %d at a time\n", num_uris, max_sources);
+    } else {
+        g_print("Now playing %u source(s)\n", num_uris);
+    }
+    gst_element_set_state(app.pipeline, GST_STATE_PLAYING);
 
     /* Iterate */
     g_print("Running...\n");
     g_main_loop_run(loop);
+    /* Writes out what is queued before the reports, later lines go out at once */
+    logger_stop();
+
+    if (bench) benchmark_report(bench);
+    if (offline_queue) {
+        OfflineSummary summary;
+
+        offline_scheduler_print_report(offline_queue);
+        if (offline_report &&
+            !offline_scheduler_write_report(offline_queue, offline_report, &error)) {
+            g_printerr("%s\n", error->message);
+            g_clear_error(&error);
+        }
+        /* Scripts reprocessing footage can tell a partial run apart */
+        offline_scheduler_get_summary(offline_queue, &summary);
+        if (summary.done < summary.files) status = 1;
+    }
+    analytics_pool_print_stats(analytics);
+    sgie_cache_print_stats(sgie_cache);
+    clip_recorder_print_stats(clips);
+    for (guint i = 0; i < crowd_num_sources; i++) {
+        if (!crowd_stats[i].max_close_pairs) continue;
+        g_print("Source %u: at most %d pairs of people too close\n", i,
+                crowd_stats[i].max_close_pairs);
+    }
 
     /* Out of the main loop, clean up nicely */
     g_print("Returned, stopping playback\n");
-    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_element_set_state(app.pipeline, GST_STATE_NULL);
     g_print("Deleting pipeline\n");
-    gst_object_unref(GST_OBJECT(pipeline));
+    gst_object_unref(GST_OBJECT(app.pipeline));
     g_source_remove(bus_watch_id);
     g_main_loop_unref(loop);
-    return 0;
+    offline_scheduler_free(offline_queue);
+    source_manager_free(sources);
+    metrics_server_free(metrics);
+    class_counters_free(class_counters);
+    stream_clock_free(stream_clock);
+    benchmark_free(bench);
+    instrument_free(instrument);
+    sgie_cache_free(sgie_cache);
+    interval_tuner_free(tuner);
+    pipeline_config_free(pipeline_config);
+    g_strfreev(uris);
+    /* Hands the tracks still open to the archive, and may still start clips */
+    analytics_pool_free(analytics);
+    clip_recorder_free(clips);
+    if (trajectories) {
+        TrajectoryArchiveStats archive_stats;
+
+        if (!trajectory_archive_close(trajectories, &archive_stats)) {
+            g_printerr("Trajectory archive %s is incomplete\n", trajectories_dir);
+        }
+        g_print("Archived %" G_GUINT64_FORMAT " trajectories, %" G_GUINT64_FORMAT
+                " of %" G_GUINT64_FORMAT " points kept, %" G_GUINT64_FORMAT
+                " bytes in %" G_GUINT64_FORMAT " segments\n",
+                archive_stats.tracks, archive_stats.points, archive_stats.raw_points,
+                archive_stats.bytes, archive_stats.segments);
+    }
+    zone_layout_free(zones);
+    crowd_analyzer_free(crowd);
+    g_free(crowd_stats);
+    overlay_free(overlay);
+    export_writer_close(exporter);
+    if (!meta_recorder_close(recorder)) {
+        g_printerr("Recording to %s is incomplete\n", record_file);
+    }
+    return status;
 }
@@ -0,0 +1,177 @@
+#include "metrics_server.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "unix_socket.h"
+
+#define METRICS_DEFAULT_HOST "127.0.0.1"
+#define REQUEST_MAX 4096
+
+struct _MetricsServer {
+    ClassCounters *counters;
+    GSocketService *service;
+    GCancellable *cancellable;
+    gchar *socket_path;
+};
+
+typedef struct {
+    MetricsServer *server;
+    GSocketConnection *connection;
+    GCancellable *cancellable;
+    gchar request[REQUEST_MAX];
+    gsize len;
+    GString *response;
+} Client;
+
+static void client_free(Client *client) {
+    g_io_stream_close(G_IO_STREAM(client->connection), NULL, NULL);
+    g_object_unref(client->connection);
+    g_object_unref(client->cancellable);
+    if (client->response) g_string_free(client->response, TRUE);
+    g_free(client);
+}
+
+static void on_written(GObject *source, GAsyncResult *result, gpointer data) {
+    g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, NULL, NULL);
+    client_free((Client *)data);
+}
+
+static void respond(Client *client) {
+    GString *body = g_string_sized_new(64 * 1024);
+    GOutputStream *output;
+    const gchar *status = "200 OK";
+
+    if (g_str_has_prefix(client->request, "GET /metrics ") ||
+        g_str_has_prefix(client->request, "GET / ")) {
+        class_counters_dump_prometheus(client->server->counters, body,
+                                       g_get_real_time());
+    } else if (!g_str_has_prefix(client->request, "GET ")) {
+        status = "405 Method Not Allowed";
+    } else {
+        status = "404 Not Found";
+    }
+    client->response = g_string_sized_new(body->len + 256);
+    g_string_append_printf(client->response,
+                           "HTTP/1.0 %s\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+                           "Connection: close\r\n\r\n",
+                           status, body->len);
+    g_string_append_len(client->response, body->str, body->len);
+    g_string_free(body, TRUE);
+
+    output = g_io_stream_get_output_stream(G_IO_STREAM(client->connection));
+    g_output_stream_write_all_async(output, client->response->str,
+                                    client->response->len, G_PRIORITY_DEFAULT,
+                                    client->cancellable, on_written, client);
+}
+
+static void on_read(GObject *source, GAsyncResult *result, gpointer data) {
+    Client *client = (Client *)data;
+    gssize n = g_input_stream_read_finish(G_INPUT_STREAM(source), result, NULL);
+
+    /* Gone, cancelled, or a request too large to be a scrape */
+    if (n <= 0 || g_cancellable_is_cancelled(client->cancellable)) {
+        client_free(client);
+        return;
+    }
+    client->len += n;
+    client->request[client->len] = '\0';
+    if (strstr(client->request, "\r\n\r\n") || strstr(client->request, "\n\n")) {
+        respond(client);
+        return;
+    }
+    g_input_stream_read_async(G_INPUT_STREAM(source), client->request + client->len,
+                              REQUEST_MAX - 1 - client->len, G_PRIORITY_DEFAULT,
+                              client->cancellable, on_read, client);
+}
+
+static gboolean on_incoming(GSocketService *service, GSocketConnection *connection,
+                            GObject *source_object, gpointer data) {
+    Client *client = g_new0(Client, 1);
+    GInputStream *input = g_io_stream_get_input_stream(G_IO_STREAM(connection));
+
+    client->server = (MetricsServer *)data;
+    client->connection = g_object_ref(connection);
+    client->cancellable = g_object_ref(client->server->cancellable);
+    g_input_stream_read_async(input, client->request, REQUEST_MAX - 1,
+                              G_PRIORITY_DEFAULT, client->cancellable, on_read, client);
+    return TRUE;
+}
+
+static GSocketAddress *parse_dest(MetricsServer *server, const gchar *dest,
+                                  GError **error) {
+    const gchar *colon;
+    gchar *host, *end;
+    guint64 port;
+    GSocketAddress *address;
+
+    if (g_str_has_prefix(dest, "unix:")) {
+        address = unix_socket_address_new(dest + 5, error);
+        if (address) server->socket_path = g_strdup(dest + 5);
+        return address;
+    }
+    colon = strrchr(dest, ':');
+    host = colon ? g_strndup(dest, colon - dest) : g_strdup(METRICS_DEFAULT_HOST);
+    port = g_ascii_strtoull(colon ? colon + 1 : dest, &end, 10);
+    address = NULL;
+    if (*end || end == (colon ? colon + 1 : dest) || port == 0 || port > 65535) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "Bad metrics address %s, expected PORT, HOST:PORT or unix:PATH",
+                    dest);
+    } else {
+        address = g_inet_socket_address_new_from_string(host, (guint)port);
+        if (!address) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                        "Bad metrics host %s, expected an IP address", host);
+        }
+    }
+    g_free(host);
+    return address;
+}
+
+MetricsServer *metrics_server_new(const gchar *dest, ClassCounters *counters,
+                                  GError **error) {
+    MetricsServer *server = g_new0(MetricsServer, 1);
+    GSocketAddress *address;
+    gboolean ok;
+
+    server->counters = counters;
+    address = parse_dest(server, dest, error);
+    if (!address) {
+        metrics_server_free(server);
+        return NULL;
+    }
+    server->service = g_socket_service_new();
+    server->cancellable = g_cancellable_new();
+    ok = g_socket_listener_add_address(G_SOCKET_LISTENER(server->service), address,
+                                       G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT,
+                                       NULL, NULL, error);
+    g_object_unref(address);
+    if (!ok) {
+        metrics_server_free(server);
+        return NULL;
+    }
+    g_signal_connect(server->service, "incoming", G_CALLBACK(on_incoming), server);
+    g_socket_service_start(server->service);
+    return server;
+}
+
+void metrics_server_free(MetricsServer *server) {
+    if (!server) return;
+    if (server->service) {
+        g_socket_service_stop(server->service);
+        g_socket_listener_close(G_SOCKET_LISTENER(server->service));
+        g_object_unref(server->service);
+    }
+    /* Requests still in flight end without touching the server */
+    if (server->cancellable) {
+        g_cancellable_cancel(server->cancellable);
+        g_object_unref(server->cancellable);
+    }
+    if (server->socket_path) g_unlink(server->socket_path);
+    g_free(server->socket_path);
+    g_free(server);
+}
@@ -0,0 +1,23 @@
+#ifndef __METRICS_SERVER_H__
+#define __METRICS_SERVER_H__
+
+#include <glib.h>
+
+#include "core/class_counters.h"
+
+/* Serves ClassCounters over HTTP in the Prometheus text format.
+ *
+ * GET /metrics, or /, answers with the counters as they are when the request
+ * comes in. Connections are handled asynchronously on the default main
+ * context, so a slow client never holds up the loop, and the streaming
+ * threads are never involved: the counters are read with atomic loads. */
+
+typedef struct _MetricsServer MetricsServer;
+
+/* dest is PORT or HOST:PORT, HOST being 127.0.0.1 by default, or unix:PATH
+ * for a Unix socket, e.g. for curl --unix-socket. */
+MetricsServer *metrics_server_new(const gchar *dest, ClassCounters *counters,
+                                  GError **error);
+void metrics_server_free(MetricsServer *server);
+
+#endif
@@ -0,0 +1,408 @@
+#include "offline.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "core/logger.h"
+
+/* How often files that have ended are checked for frames still on the way */
+#define OFFLINE_DRAIN_CHECK_MS 100
+/* A file is finished anyway once its frames stop arriving for this long, e.g.
+ * when a leaky queue dropped some */
+#define OFFLINE_DRAIN_TIMEOUT_MS 2000
+
+/* Recordings, and the raw H.264 that parsebin also takes */
+static const gchar *const video_extensions[] = {".mp4", ".mkv", ".mov",
+                                                ".ts",  ".h264", ".264"};
+
+typedef enum {
+    FILE_PENDING,
+    FILE_RUNNING,
+    FILE_DONE,
+    FILE_FAILED,
+    FILE_INTERRUPTED,
+} FileStatus;
+
+static const gchar *const status_names[] = {"pending", "running", "done", "failed",
+                                            "interrupted"};
+
+typedef struct {
+    gchar *path;
+    FileStatus status;
+    gchar *error;
+    guint64 frames;
+    guint64 detections;
+    gdouble video_sec;
+    gdouble wall_sec;
+} OfflineFile;
+
+typedef struct {
+    /* Written by the analytics probe */
+    guint64 frames;
+    guint64 detections;
+    guint64 first_pts;
+    guint64 last_pts;
+
+    /* Main loop only. file is -1 while the slot is free. */
+    gint file;
+    gint64 started_us;
+    gboolean ended;
+    guint64 buffers;
+    gchar *error;
+    /* Frames seen at the last check, and when that count last moved */
+    guint64 drained;
+    gint64 progress_us;
+} Slot;
+
+struct _OfflineScheduler {
+    OfflineFile *files;
+    guint num_files;
+    guint next_file;
+    Slot *slots;
+    guint num_slots;
+    SourceManager *sources;
+    OfflineDoneFunc done;
+    gpointer done_data;
+    guint check_id;
+    gboolean stopping;
+    gint64 start_us;
+    gint64 end_us;
+};
+
+static gboolean is_video_file(const gchar *name) {
+    gsize len = strlen(name);
+
+    for (guint i = 0; i < G_N_ELEMENTS(video_extensions); i++) {
+        gsize ext_len = strlen(video_extensions[i]);
+        if (len > ext_len &&
+            !g_ascii_strcasecmp(name + len - ext_len, video_extensions[i])) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static gint compare_paths(gconstpointer a, gconstpointer b) {
+    return strcmp(*(const gchar *const *)a, *(const gchar *const *)b);
+}
+
+gchar **offline_list_files(gchar **paths, GError **error) {
+    GPtrArray *files = g_ptr_array_new_with_free_func(g_free);
+
+    for (gchar **path = paths; *path; path++) {
+        GPtrArray *entries;
+        const gchar *name;
+        GDir *dir;
+
+        if (!g_file_test(*path, G_FILE_TEST_IS_DIR)) {
+            g_ptr_array_add(files, g_strdup(*path));
+            continue;
+        }
+        dir = g_dir_open(*path, 0, error);
+        if (!dir) {
+            g_ptr_array_free(files, TRUE);
+            return NULL;
+        }
+        entries = g_ptr_array_new();
+        while ((name = g_dir_read_name(dir))) {
+            gchar *file;
+
+            if (name[0] == '.' || !is_video_file(name)) continue;
+            file = g_build_filename(*path, name, NULL);
+            if (g_file_test(file, G_FILE_TEST_IS_REGULAR)) {
+                g_ptr_array_add(entries, file);
+            } else {
+                g_free(file);
+            }
+        }
+        g_dir_close(dir);
+        g_ptr_array_sort(entries, compare_paths);
+        for (guint i = 0; i < entries->len; i++) {
+            g_ptr_array_add(files, g_ptr_array_index(entries, i));
+        }
+        g_ptr_array_free(entries, TRUE);
+    }
+    g_ptr_array_add(files, NULL);
+    return (gchar **)g_ptr_array_free(files, FALSE);
+}
+
+OfflineScheduler *offline_scheduler_new(gchar **files, guint slots,
+                                        OfflineDoneFunc done, gpointer done_data) {
+    OfflineScheduler *scheduler = g_new0(OfflineScheduler, 1);
+
+    scheduler->num_files = g_strv_length(files);
+    scheduler->files = g_new0(OfflineFile, scheduler->num_files);
+    for (guint i = 0; i < scheduler->num_files; i++) {
+        scheduler->files[i].path = g_strdup(files[i]);
+    }
+    scheduler->num_slots = MAX(slots, 1);
+    scheduler->slots = g_new0(Slot, scheduler->num_slots);
+    for (guint i = 0; i < scheduler->num_slots; i++) scheduler->slots[i].file = -1;
+    scheduler->done = done;
+    scheduler->done_data = done_data;
+    return scheduler;
+}
+
+void offline_scheduler_free(OfflineScheduler *scheduler) {
+    if (!scheduler) return;
+    if (scheduler->check_id) g_source_remove(scheduler->check_id);
+    for (guint i = 0; i < scheduler->num_files; i++) {
+        g_free(scheduler->files[i].path);
+        g_free(scheduler->files[i].error);
+    }
+    for (guint i = 0; i < scheduler->num_slots; i++) g_free(scheduler->slots[i].error);
+    g_free(scheduler->files);
+    g_free(scheduler->slots);
+    g_free(scheduler);
+}
+
+/* Figures so far of the file a slot is running */
+static void read_slot(const Slot *slot, OfflineFile *file, gint64 now_us) {
+    guint64 first = __atomic_load_n(&slot->first_pts, __ATOMIC_RELAXED);
+    guint64 last = __atomic_load_n(&slot->last_pts, __ATOMIC_RELAXED);
+
+    file->frames = __atomic_load_n(&slot->frames, __ATOMIC_RELAXED);
+    file->detections = __atomic_load_n(&slot->detections, __ATOMIC_RELAXED);
+    /* The span between the first and last frame, plus one frame's worth */
+    file->video_sec = 0;
+    if (file->frames > 1 && last > first) {
+        file->video_sec =
+            (gdouble)(last - first) / GST_SECOND * file->frames / (file->frames - 1);
+    }
+    file->wall_sec = (now_us - slot->started_us) / 1e6;
+}
+
+static void print_file(const OfflineScheduler *scheduler, guint index) {
+    const OfflineFile *file = &scheduler->files[index];
+
+    if (file->status == FILE_FAILED) {
+        LOG_WARNING(LOG_CAT_OFFLINE,
+                    "File %u/%u %s failed after %" G_GUINT64_FORMAT " frames: %s",
+                    index + 1, scheduler->num_files, file->path, file->frames,
+                    file->error);
+        return;
+    }
+    LOG_INFO(LOG_CAT_OFFLINE,
+             "File %u/%u %s: %" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT
+             " detections, %.1f s of video in %.1f s (%.1fx)",
+             index + 1, scheduler->num_files, file->path, file->frames,
+             file->detections, file->video_sec, file->wall_sec,
+             file->wall_sec > 0 ? file->video_sec / file->wall_sec : 0);
+}
+
+/* Gives free slots the next files, skipping those that cannot be added */
+static void fill_slots(OfflineScheduler *scheduler) {
+    while (!scheduler->stopping && scheduler->next_file < scheduler->num_files &&
+           source_manager_count(scheduler->sources) < scheduler->num_slots) {
+        guint index = scheduler->next_file++;
+        OfflineFile *file = &scheduler->files[index];
+        gint id = source_manager_add(scheduler->sources, file->path);
+        Slot *slot;
+
+        if (id < 0) {
+            file->status = FILE_FAILED;
+            file->error = g_strdup("its branch could not be built");
+            print_file(scheduler, index);
+            continue;
+        }
+        slot = &scheduler->slots[id];
+        slot->file = (gint)index;
+        slot->started_us = g_get_monotonic_time();
+        slot->ended = FALSE;
+        slot->drained = 0;
+        file->status = FILE_RUNNING;
+    }
+}
+
+static void finish_slot(OfflineScheduler *scheduler, guint id, gint64 now_us) {
+    Slot *slot = &scheduler->slots[id];
+    OfflineFile *file = &scheduler->files[slot->file];
+
+    read_slot(slot, file, now_us);
+    file->status = slot->error ? FILE_FAILED : FILE_DONE;
+    file->error = slot->error;
+    slot->error = NULL;
+    print_file(scheduler, slot->file);
+    /* Every frame of the file has been counted, the next starts from zero */
+    __atomic_store_n(&slot->frames, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->detections, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->first_pts, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->last_pts, 0, __ATOMIC_RELAXED);
+    slot->file = -1;
+    if (!source_manager_remove(scheduler->sources, id)) {
+        LOG_ERROR(LOG_CAT_OFFLINE,
+                  "Muxer slot %u could not be freed, running one file less", id);
+    }
+}
+
+static gboolean drain_check(gpointer data) {
+    OfflineScheduler *scheduler = (OfflineScheduler *)data;
+    gint64 now = g_get_monotonic_time();
+    gboolean busy = FALSE;
+
+    for (guint i = 0; i < scheduler->num_slots; i++) {
+        Slot *slot = &scheduler->slots[i];
+        guint64 frames;
+
+        if (slot->file < 0) continue;
+        busy = TRUE;
+        if (!slot->ended || scheduler->stopping) continue;
+        /* Frames still between the branch and the probe belong to this file */
+        frames = __atomic_load_n(&slot->frames, __ATOMIC_RELAXED);
+        if (frames < slot->buffers) {
+            if (frames != slot->drained) {
+                slot->drained = frames;
+                slot->progress_us = now;
+                continue;
+            }
+            if (now - slot->progress_us < OFFLINE_DRAIN_TIMEOUT_MS * 1000) continue;
+        }
+        finish_slot(scheduler, i, now);
+    }
+    if (scheduler->stopping) return G_SOURCE_CONTINUE;
+
+    fill_slots(scheduler);
+    if (busy || source_manager_count(scheduler->sources) > 0) {
+        return G_SOURCE_CONTINUE;
+    }
+    scheduler->end_us = now;
+    scheduler->check_id = 0;
+    if (scheduler->done) scheduler->done(scheduler->done_data);
+    return G_SOURCE_REMOVE;
+}
+
+void offline_scheduler_source_ended(guint source_id, guint64 buffers,
+                                    const GError *error, gpointer data) {
+    OfflineScheduler *scheduler = (OfflineScheduler *)data;
+    Slot *slot;
+
+    if (source_id >= scheduler->num_slots) return;
+    slot = &scheduler->slots[source_id];
+    if (slot->file < 0 || slot->ended) return;
+    slot->ended = TRUE;
+    slot->buffers = buffers;
+    slot->error = error ? g_strdup(error->message) : NULL;
+    slot->drained = __atomic_load_n(&slot->frames, __ATOMIC_RELAXED);
+    slot->progress_us = g_get_monotonic_time();
+}
+
+gboolean offline_scheduler_start(OfflineScheduler *scheduler, SourceManager *sources) {
+    scheduler->sources = sources;
+    scheduler->start_us = g_get_monotonic_time();
+    fill_slots(scheduler);
+    if (!source_manager_count(sources)) return FALSE;
+    scheduler->check_id =
+        g_timeout_add(OFFLINE_DRAIN_CHECK_MS, drain_check, scheduler);
+    return TRUE;
+}
+
+void offline_scheduler_stop(OfflineScheduler *scheduler) { scheduler->stopping = TRUE; }
+
+void offline_scheduler_add_frame(OfflineScheduler *scheduler,
+                                 const FrameRecord *frame) {
+    Slot *slot;
+
+    if (frame->source_id >= scheduler->num_slots) return;
+    slot = &scheduler->slots[frame->source_id];
+    /* The probe is the only writer */
+    if (!__atomic_load_n(&slot->frames, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&slot->first_pts, frame->pts, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&slot->last_pts, frame->pts, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->detections, frame->num_objects, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->frames, 1, __ATOMIC_RELAXED);
+}
+
+/* Files still running are reported as interrupted, with what they got through */
+static void get_file(const OfflineScheduler *scheduler, guint index,
+                     OfflineFile *file, gint64 now_us) {
+    *file = scheduler->files[index];
+    if (file->status != FILE_RUNNING) return;
+    for (guint i = 0; i < scheduler->num_slots; i++) {
+        if (scheduler->slots[i].file != (gint)index) continue;
+        read_slot(&scheduler->slots[i], file, now_us);
+        file->status = FILE_INTERRUPTED;
+    }
+}
+
+void offline_scheduler_get_summary(const OfflineScheduler *scheduler,
+                                   OfflineSummary *summary) {
+    gint64 now = g_get_monotonic_time();
+
+    memset(summary, 0, sizeof(*summary));
+    summary->files = scheduler->num_files;
+    for (guint i = 0; i < scheduler->num_files; i++) {
+        OfflineFile file;
+
+        get_file(scheduler, i, &file, now);
+        if (file.status == FILE_DONE) summary->done++;
+        if (file.status == FILE_FAILED) summary->failed++;
+        if (file.status == FILE_INTERRUPTED) summary->interrupted++;
+        summary->frames += file.frames;
+        summary->detections += file.detections;
+        summary->video_sec += file.video_sec;
+    }
+    if (scheduler->start_us) {
+        summary->wall_sec =
+            ((scheduler->end_us ? scheduler->end_us : now) - scheduler->start_us) /
+            1e6;
+    }
+}
+
+void offline_scheduler_print_report(const OfflineScheduler *scheduler) {
+    OfflineSummary summary;
+
+    offline_scheduler_get_summary(scheduler, &summary);
+    g_print("Offline: %u file(s), %u done, %u failed, %u interrupted, %u not "
+            "started\n",
+            summary.files, summary.done, summary.failed, summary.interrupted,
+            summary.files - summary.done - summary.failed - summary.interrupted);
+    if (summary.wall_sec <= 0) return;
+    g_print("  %.2f h of video in %.2f h: %.1f video-hours per hour, %.0f frames/s, "
+            "%" G_GUINT64_FORMAT " detections\n",
+            summary.video_sec / 3600, summary.wall_sec / 3600,
+            summary.video_sec / summary.wall_sec, summary.frames / summary.wall_sec,
+            summary.detections);
+}
+
+static void write_csv_field(FILE *out, const gchar *value) {
+    fputc('"', out);
+    for (const gchar *c = value; *c; c++) {
+        if (*c == '"') fputc('"', out);
+        fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+gboolean offline_scheduler_write_report(const OfflineScheduler *scheduler,
+                                        const gchar *path, GError **error) {
+    gint64 now = g_get_monotonic_time();
+    FILE *out = g_fopen(path, "w");
+
+    if (!out) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                    "Cannot open %s: %s", path, g_strerror(errno));
+        return FALSE;
+    }
+    fprintf(out, "file,status,frames,detections,video_sec,wall_sec,error\n");
+    for (guint i = 0; i < scheduler->num_files; i++) {
+        OfflineFile file;
+
+        get_file(scheduler, i, &file, now);
+        write_csv_field(out, file.path);
+        fprintf(out,
+                ",%s,%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%.3f,%.3f,",
+                status_names[file.status], file.frames, file.detections,
+                file.video_sec, file.wall_sec);
+        if (file.error) write_csv_field(out, file.error);
+        fputc('\n', out);
+    }
+    if (fclose(out) != 0) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                    "Cannot write %s: %s", path, g_strerror(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
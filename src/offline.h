@@ -0,0 +1,75 @@
+#ifndef __OFFLINE_H__
+#define __OFFLINE_H__
+
+#include <glib.h>
+
+#include "core/frame_record.h"
+#include "sources.h"
+
+/* Runs a queue of recorded files through the pipeline, a few at a time.
+ *
+ * Each muxer slot of the SourceManager takes the next file from the queue.
+ * When a file's branch has pushed its last buffer, and every one of those
+ * frames has reached the analytics probe, its results are recorded, its
+ * branch is removed and the slot is given to the next file. The pipeline,
+ * and the inference engines in it, are built once for the whole queue. All
+ * calls but offline_scheduler_add_frame() are made from the main loop. */
+
+/* Offline runs default to this many files at once */
+#define OFFLINE_DEFAULT_SLOTS 4
+
+typedef struct {
+    guint files;
+    guint done;
+    guint failed;
+    /* Still running when the scheduler was stopped */
+    guint interrupted;
+    guint64 frames;
+    guint64 detections;
+    /* Spanned by the frames' timestamps */
+    gdouble video_sec;
+    /* From the start to the last file finishing */
+    gdouble wall_sec;
+} OfflineSummary;
+
+typedef void (*OfflineDoneFunc)(gpointer data);
+
+typedef struct _OfflineScheduler OfflineScheduler;
+
+/* Expands each directory among paths to the video files directly in it, in
+ * name order, and keeps the other paths as they are. Returns a
+ * NULL-terminated array to free with g_strfreev(). */
+gchar **offline_list_files(gchar **paths, GError **error);
+
+OfflineScheduler *offline_scheduler_new(gchar **files, guint slots,
+                                        OfflineDoneFunc done, gpointer done_data);
+void offline_scheduler_free(OfflineScheduler *scheduler);
+
+/* The SourceEndFunc of the manager's SourceOptions, with the scheduler as its
+ * data. */
+void offline_scheduler_source_ended(guint source_id, guint64 buffers,
+                                    const GError *error, gpointer data);
+
+/* Adds the first files to sources, which must have been created with as many
+ * muxer slots as the scheduler, one per slot. done is called from the
+ * main loop once every file has finished. Returns FALSE if none could be
+ * added. */
+gboolean offline_scheduler_start(OfflineScheduler *scheduler, SourceManager *sources);
+/* Starts no more files, e.g. before EOS is sent on Ctrl-C. */
+void offline_scheduler_stop(OfflineScheduler *scheduler);
+
+/* From the analytics probe, for every frame. */
+void offline_scheduler_add_frame(OfflineScheduler *scheduler,
+                                 const FrameRecord *frame);
+
+void offline_scheduler_get_summary(const OfflineScheduler *scheduler,
+                                   OfflineSummary *summary);
+
+/* Prints the summary, with throughput in hours of video per hour. */
+void offline_scheduler_print_report(const OfflineScheduler *scheduler);
+/* Writes one CSV line per file: its status, frames, detections, seconds of
+ * video and seconds spent. */
+gboolean offline_scheduler_write_report(const OfflineScheduler *scheduler,
+                                        const gchar *path, GError **error);
+
+#endif
@@ -0,0 +1,173 @@
+#include "overlay.h"
+
+#include <string.h>
+
+#include "core/logger.h"
+
+typedef struct {
+    gchar *text;
+    gboolean valid;
+    guint num_persons;
+    guint num_loitering;
+    guint64 frames;
+} OverlaySlot;
+
+struct _Overlay {
+    OverlayPolicy policy;
+    guint max_sources;
+    OverlaySlot *slots;
+    /* One block of max_sources * OVERLAY_TEXT_LEN, so ownership of a
+     * display_text pointer is a range check */
+    gchar *texts;
+    NvOSD_TextParams text_template;
+};
+
+gboolean overlay_policy_parse(const gchar *str, OverlayPolicy *policy,
+                              GError **error) {
+    gchar *end = NULL;
+
+    policy->interval = 1;
+    if (!g_strcmp0(str, "off")) {
+        policy->mode = OVERLAY_OFF;
+        return TRUE;
+    }
+    if (!g_strcmp0(str, "on-change")) {
+        policy->mode = OVERLAY_ON_CHANGE;
+        return TRUE;
+    }
+    if (g_str_has_prefix(str, "every-")) {
+        guint64 n = g_ascii_strtoull(str + 6, &end, 10);
+        if (end != str + 6 && *end == '\0' && n > 0 && n <= G_MAXUINT) {
+            policy->mode = OVERLAY_EVERY_N;
+            policy->interval = (guint)n;
+            return TRUE;
+        }
+    }
+    g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                "Invalid overlay policy '%s', expected off, on-change or every-N",
+                str);
+    return FALSE;
+}
+
+static void init_template(NvOSD_TextParams *txt_params) {
+    memset(txt_params, 0, sizeof(*txt_params));
+
+    /* Now set the offsets where the string should appear */
+    txt_params->x_offset = 10;
+    txt_params->y_offset = 12;
+
+    /* Font , font-color and font-size */
+    txt_params->font_params.font_name = "Serif";
+    txt_params->font_params.font_size = 10;
+    txt_params->font_params.font_color.red = 1.0;
+    txt_params->font_params.font_color.green = 1.0;
+    txt_params->font_params.font_color.blue = 1.0;
+    txt_params->font_params.font_color.alpha = 1.0;
+
+    /* Text background color */
+    txt_params->set_bg_clr = 1;
+    txt_params->text_bg_clr.red = 0.0;
+    txt_params->text_bg_clr.green = 0.0;
+    txt_params->text_bg_clr.blue = 0.0;
+    txt_params->text_bg_clr.alpha = 1.0;
+}
+
+Overlay *overlay_new(guint max_sources, const OverlayPolicy *policy) {
+    Overlay *overlay = g_new0(Overlay, 1);
+    overlay->policy = *policy;
+    overlay->max_sources = max_sources;
+    overlay->slots = g_new0(OverlaySlot, max_sources);
+    overlay->texts = g_malloc0((gsize)max_sources * OVERLAY_TEXT_LEN);
+    for (guint i = 0; i < max_sources; i++) {
+        overlay->slots[i].text = overlay->texts + (gsize)i * OVERLAY_TEXT_LEN;
+    }
+    init_template(&overlay->text_template);
+    return overlay;
+}
+
+void overlay_free(Overlay *overlay) {
+    if (!overlay) return;
+    g_free(overlay->texts);
+    g_free(overlay->slots);
+    g_free(overlay);
+}
+
+static gboolean owns_text(const Overlay *overlay, const gchar *text) {
+    return text >= overlay->texts &&
+           text < overlay->texts + (gsize)overlay->max_sources * OVERLAY_TEXT_LEN;
+}
+
+static GstPadProbeReturn reclaim_probe(GstPad *pad, GstPadProbeInfo *info,
+                                       gpointer u_data) {
+    Overlay *overlay = (Overlay *)u_data;
+    NvDsBatchMeta *batch_meta =
+        gst_buffer_get_nvds_batch_meta(GST_PAD_PROBE_INFO_BUFFER(info));
+
+    if (!batch_meta) return GST_PAD_PROBE_OK;
+    for (NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame;
+         l_frame = l_frame->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)l_frame->data;
+        for (NvDsMetaList *l = frame_meta->display_meta_list; l; l = l->next) {
+            NvDsDisplayMeta *display_meta = (NvDsDisplayMeta *)l->data;
+            for (guint i = 0; i < display_meta->num_labels; i++) {
+                NvOSD_TextParams *txt_params = &display_meta->text_params[i];
+                if (owns_text(overlay, txt_params->display_text)) {
+                    txt_params->display_text = NULL;
+                }
+            }
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+void overlay_attach(Overlay *overlay, GstElement *osd) {
+    GstPad *pad;
+
+    if (overlay->policy.mode == OVERLAY_OFF) return;
+    pad = gst_element_get_static_pad(osd, "src");
+    if (!pad) pad = gst_element_get_static_pad(osd, "sink");
+    if (!pad) {
+        LOG_WARNING(LOG_CAT_APP, "Unable to get a pad on %s for the overlay",
+                    GST_ELEMENT_NAME(osd));
+        return;
+    }
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, reclaim_probe, overlay, NULL);
+    gst_object_unref(pad);
+}
+
+static gboolean needs_refresh(const Overlay *overlay, const OverlaySlot *slot,
+                              guint num_persons, guint num_loitering) {
+    if (!slot->valid) return TRUE;
+    if (overlay->policy.mode == OVERLAY_EVERY_N) {
+        return slot->frames % overlay->policy.interval == 0;
+    }
+    return slot->num_persons != num_persons || slot->num_loitering != num_loitering;
+}
+
+void overlay_update(Overlay *overlay, NvDsBatchMeta *batch_meta,
+                    NvDsFrameMeta *frame_meta, guint num_persons,
+                    guint num_loitering) {
+    OverlaySlot *slot;
+    NvDsDisplayMeta *display_meta;
+    NvOSD_TextParams *txt_params;
+
+    if (overlay->policy.mode == OVERLAY_OFF) return;
+    if (frame_meta->source_id >= overlay->max_sources) return;
+    slot = &overlay->slots[frame_meta->source_id];
+
+    if (needs_refresh(overlay, slot, num_persons, num_loitering)) {
+        g_snprintf(slot->text, OVERLAY_TEXT_LEN, "persons = %u loitering = %u",
+                   num_persons, num_loitering);
+        slot->num_persons = num_persons;
+        slot->num_loitering = num_loitering;
+        slot->valid = TRUE;
+    }
+    slot->frames++;
+
+    display_meta = nvds_acquire_display_meta_from_pool(batch_meta);
+    txt_params = &display_meta->text_params[0];
+    *txt_params = overlay->text_template;
+    txt_params->display_text = slot->text;
+    display_meta->num_labels = 1;
+    nvds_add_display_meta_to_frame(frame_meta, display_meta);
+}
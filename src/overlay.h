@@ -0,0 +1,54 @@
+#ifndef __OVERLAY_H__
+#define __OVERLAY_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "gstnvdsmeta.h"
+
+/* Per-source text overlay drawn by nvdsosd.
+ *
+ * Each source owns one fixed text buffer, allocated up front, that the
+ * display meta points at instead of a g_malloc'd string. The text is only
+ * reformatted when the policy asks for it, and the display meta is filled
+ * from a prebuilt NvOSD_TextParams template. Since DeepStream frees
+ * display_text when the batch meta is released, overlay_attach() installs a
+ * probe downstream of the OSD that hands the buffers back first. */
+
+#define OVERLAY_TEXT_LEN 64
+
+typedef enum {
+    /* No display meta is attached at all */
+    OVERLAY_OFF,
+    /* The text is reformatted only when the counts change */
+    OVERLAY_ON_CHANGE,
+    /* The text is reformatted every interval frames of a source */
+    OVERLAY_EVERY_N,
+} OverlayMode;
+
+typedef struct {
+    OverlayMode mode;
+    guint interval;
+} OverlayPolicy;
+
+/* Parses "off", "on-change" or "every-N", e.g. "every-30". */
+gboolean overlay_policy_parse(const gchar *str, OverlayPolicy *policy,
+                              GError **error);
+
+typedef struct _Overlay Overlay;
+
+Overlay *overlay_new(guint max_sources, const OverlayPolicy *policy);
+void overlay_free(Overlay *overlay);
+
+/* Reclaims the text buffers on osd's src pad, or on its sink pad when osd is
+ * the sink itself; in that case it must be called after the probe that calls
+ * overlay_update() was added. */
+void overlay_attach(Overlay *overlay, GstElement *osd);
+
+/* Adds the overlay for one frame. Must be called from the streaming thread
+ * feeding the OSD. */
+void overlay_update(Overlay *overlay, NvDsBatchMeta *batch_meta,
+                    NvDsFrameMeta *frame_meta, guint num_persons,
+                    guint num_loitering);
+
+#endif
@@ -0,0 +1,455 @@
+#include "pipeline_config.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include "core/attribute_cache.h"
+
+#define PIPELINE_CONFIG_ERROR g_quark_from_static_string("pipeline-config-error")
+
+#define CONFIG_GROUP_PIPELINE "pipeline"
+#define CONFIG_GROUP_PROPERTY "property"
+
+#define QUEUE_DEFAULT_MAX_BUFFERS 4
+
+gchar *get_absolute_file_path(const gchar *cfg_file_path, gchar *file_path) {
+    gchar abs_cfg_path[PATH_MAX + 1];
+    gchar *abs_file_path;
+    gchar *delim;
+
+    if (file_path && file_path[0] == '/') {
+        return file_path;
+    }
+
+    if (!realpath(cfg_file_path, abs_cfg_path)) {
+        g_free(file_path);
+        return NULL;
+    }
+
+    // Return absolute path of config file if file_path is NULL.
+    if (!file_path) {
+        abs_file_path = g_strdup(abs_cfg_path);
+        return abs_file_path;
+    }
+
+    delim = g_strrstr(abs_cfg_path, "/");
+    *(delim + 1) = '\0';
+
+    abs_file_path = g_strconcat(abs_cfg_path, file_path, NULL);
+    g_free(file_path);
+
+    return abs_file_path;
+}
+
+static gint get_integer(GKeyFile *key_file, const gchar *group, const gchar *key,
+                        gint default_value) {
+    GError *error = NULL;
+    gint value = g_key_file_get_integer(key_file, group, key, &error);
+    if (error) {
+        g_error_free(error);
+        return default_value;
+    }
+    return value;
+}
+
+/* Leaves value alone when the key is missing */
+static gboolean get_boolean(GKeyFile *key_file, const gchar *group, const gchar *key,
+                            gboolean *value, GError **error) {
+    GError *local_error = NULL;
+    gboolean result;
+
+    if (!g_key_file_has_key(key_file, group, key, NULL)) return TRUE;
+    result = g_key_file_get_boolean(key_file, group, key, &local_error);
+    if (local_error) {
+        g_propagate_error(error, local_error);
+        return FALSE;
+    }
+    *value = result;
+    return TRUE;
+}
+
+/* The ids nvinfer attaches to its metadata, with nvinfer's own defaults */
+static gboolean read_nvinfer_config(PipelineStage *stage, GError **error) {
+    GKeyFile *key_file = g_key_file_new();
+    gboolean ok = g_key_file_load_from_file(key_file, stage->config_file,
+                                            G_KEY_FILE_NONE, error);
+
+    if (ok && !g_key_file_has_group(key_file, CONFIG_GROUP_PROPERTY)) {
+        g_set_error(error, PIPELINE_CONFIG_ERROR, 0, "%s has no [%s] group",
+                    stage->config_file, CONFIG_GROUP_PROPERTY);
+        ok = FALSE;
+    }
+    if (ok) {
+        stage->gie_unique_id =
+            (guint)get_integer(key_file, CONFIG_GROUP_PROPERTY, "gie-unique-id", 0);
+        stage->is_primary =
+            get_integer(key_file, CONFIG_GROUP_PROPERTY, "process-mode", 1) == 1;
+        stage->operate_on_gie_id =
+            get_integer(key_file, CONFIG_GROUP_PROPERTY, "operate-on-gie-id", -1);
+        stage->interval =
+            (guint)MAX(get_integer(key_file, CONFIG_GROUP_PROPERTY, "interval", 0), 0);
+        /* Missing means every class */
+        stage->operate_on_class_ids = g_key_file_get_integer_list(
+            key_file, CONFIG_GROUP_PROPERTY, "operate-on-class-ids",
+            &stage->num_operate_on_class_ids, NULL);
+    }
+    g_key_file_free(key_file);
+    return ok;
+}
+
+static gboolean load_stage(GKeyFile *key_file, const gchar *path, const gchar *name,
+                           PipelineStage *stage, GError **error) {
+    gchar *type, *config_file;
+
+    stage->name = g_strdup(name);
+    if (!g_key_file_has_group(key_file, name)) {
+        g_set_error(error, PIPELINE_CONFIG_ERROR, 0, "Stage %s has no [%s] group",
+                    name, name);
+        return FALSE;
+    }
+
+    type = g_key_file_get_string(key_file, name, "type", error);
+    if (!type) return FALSE;
+    if (!g_strcmp0(type, "nvinfer")) {
+        stage->type = STAGE_NVINFER;
+    } else if (!g_strcmp0(type, "nvtracker")) {
+        stage->type = STAGE_NVTRACKER;
+    } else {
+        g_set_error(error, PIPELINE_CONFIG_ERROR, 0,
+                    "Stage %s has unknown type '%s', expected nvinfer or nvtracker",
+                    name, type);
+        g_free(type);
+        return FALSE;
+    }
+    g_free(type);
+
+    config_file = g_key_file_get_string(key_file, name, "config-file", error);
+    if (!config_file) return FALSE;
+    stage->config_file = get_absolute_file_path(path, config_file);
+    if (!stage->config_file) {
+        g_set_error(error, PIPELINE_CONFIG_ERROR, 0, "Cannot resolve %s", path);
+        return FALSE;
+    }
+
+    stage->max_interval = (guint)MAX(get_integer(key_file, name, "max-interval", 0), 0);
+    if (!get_boolean(key_file, name, "cache", &stage->cache, error)) return FALSE;
+    stage->cache_stable_frames = (guint)MAX(
+        get_integer(key_file, name, "cache-stable-frames",
+                    ATTRIBUTE_CACHE_DEFAULT_STABLE_FRAMES),
+        1);
+    stage->cache_refresh_frames = (guint)MAX(
+        get_integer(key_file, name, "cache-refresh-frames",
+                    ATTRIBUTE_CACHE_DEFAULT_REFRESH_FRAMES),
+        0);
+
+    if (stage->type == STAGE_NVINFER) return read_nvinfer_config(stage, error);
+    return TRUE;
+}
+
+static gboolean parse_leaky(const gchar *group, const gchar *value,
+                            QueueLeaky *leaky, GError **error) {
+    if (!g_strcmp0(value, "no")) {
+        *leaky = QUEUE_LEAKY_NONE;
+    } else if (!g_strcmp0(value, "upstream")) {
+        *leaky = QUEUE_LEAKY_UPSTREAM;
+    } else if (!g_strcmp0(value, "downstream")) {
+        *leaky = QUEUE_LEAKY_DOWNSTREAM;
+    } else {
+        g_set_error(error, PIPELINE_CONFIG_ERROR, 0,
+                    "[%s] has unknown queue-leaky '%s', expected no, upstream or "
+                    "downstream",
+                    group, value);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Overrides the settings in queue with those given in group */
+static gboolean load_queue_settings(GKeyFile *key_file, const gchar *group,
+                                    QueueConfig *queue, GError **error) {
+    gchar *leaky = g_key_file_get_string(key_file, group, "queue-leaky", NULL);
+    gboolean ok = !leaky || parse_leaky(group, leaky, &queue->leaky, error);
+
+    queue->max_buffers = (guint)MAX(
+        get_integer(key_file, group, "queue-max-buffers", (gint)queue->max_buffers),
+        1);
+    g_free(leaky);
+    return ok;
+}
+
+static QueueConfig *find_queue(PipelineConfig *config, const gchar *name) {
+    if (!g_strcmp0(name, "convert")) return &config->convert_queue;
+    if (!g_strcmp0(name, "osd")) return &config->osd_queue;
+    if (!g_strcmp0(name, "sink")) return &config->sink_queue;
+    for (guint i = 0; i < config->num_stages; i++) {
+        if (!g_strcmp0(name, config->stages[i].name)) return &config->stages[i].queue;
+    }
+    return NULL;
+}
+
+/* threading=pipelined queues every element, queues= picks them by name */
+static gboolean load_queues(GKeyFile *key_file, PipelineConfig *config,
+                            GError **error) {
+    QueueConfig defaults = {FALSE, QUEUE_DEFAULT_MAX_BUFFERS, QUEUE_LEAKY_NONE};
+    gchar *threading;
+    gchar **names;
+    gsize num_names = 0;
+    gboolean ok = TRUE;
+
+    if (!load_queue_settings(key_file, CONFIG_GROUP_PIPELINE, &defaults, error))
+        return FALSE;
+    threading =
+        g_key_file_get_string(key_file, CONFIG_GROUP_PIPELINE, "threading", NULL);
+    if (threading && !g_strcmp0(threading, "pipelined")) {
+        defaults.enabled = TRUE;
+    } else if (threading && g_strcmp0(threading, "serial")) {
+        g_set_error(error, PIPELINE_CONFIG_ERROR, 0,
+                    "Unknown threading '%s', expected serial or pipelined", threading);
+        ok = FALSE;
+    }
+    g_free(threading);
+    if (!ok) return FALSE;
+
+    config->convert_queue = config->osd_queue = config->sink_queue = defaults;
+    for (guint i = 0; i < config->num_stages && ok; i++) {
+        PipelineStage *stage = &config->stages[i];
+        stage->queue = defaults;
+        ok = load_queue_settings(key_file, stage->name, &stage->queue, error);
+    }
+    if (!ok) return FALSE;
+
+    names = g_key_file_get_string_list(key_file, CONFIG_GROUP_PIPELINE, "queues",
+                                       &num_names, NULL);
+    if (names) {
+        config->convert_queue.enabled = FALSE;
+        config->osd_queue.enabled = FALSE;
+        config->sink_queue.enabled = FALSE;
+        for (guint i = 0; i < config->num_stages; i++) {
+            config->stages[i].queue.enabled = FALSE;
+        }
+    }
+    for (gsize i = 0; i < num_names && ok; i++) {
+        gchar *name = g_strstrip(names[i]);
+        QueueConfig *queue;
+
+        if (*name == '\0') continue;
+        queue = find_queue(config, name);
+        if (!queue) {
+            g_set_error(error, PIPELINE_CONFIG_ERROR, 0,
+                        "Cannot queue '%s', expected a stage, convert, osd or sink",
+                        name);
+            ok = FALSE;
+        } else {
+            queue->enabled = TRUE;
+        }
+    }
+    g_strfreev(names);
+
+    if (!config->osd) config->osd_queue.enabled = FALSE;
+    return ok;
+}
+
+static gboolean cache_error(const PipelineStage *stage, GError **error) {
+    g_set_error(error, PIPELINE_CONFIG_ERROR, 0,
+                "Stage %s cannot be cached, only secondary nvinfer stages with an "
+                "operate-on-gie-id that come after the tracker can",
+                stage->name);
+    return FALSE;
+}
+
+static gboolean has_tracker_after(const PipelineConfig *config, guint index) {
+    for (guint i = index + 1; i < config->num_stages; i++) {
+        if (config->stages[i].type == STAGE_NVTRACKER) return TRUE;
+    }
+    return FALSE;
+}
+
+/* Secondary stages must come after the detector they operate on, and ids
+ * must be unique for the metadata to be told apart */
+static gboolean validate(const PipelineConfig *config, GError **error) {
+    guint num_trackers = 0;
+
+    for (guint i = 0; i < config->num_stages; i++) {
+        const PipelineStage *stage = &config->stages[i];
+        gboolean found = stage->operate_on_gie_id < 0;
+
+        if (stage->type == STAGE_NVTRACKER) {
+            num_trackers++;
+            if (stage->cache) return cache_error(stage, error);
+            continue;
+        }
+        /* The cache is keyed by track and hides objects from the stage by their
+         * detector id */
+        if (stage->cache &&
+            (stage->is_primary || stage->operate_on_gie_id < 0 || !num_trackers))
+            return cache_error(stage, error);
+        if (stage->max_interval > stage->interval && !stage->is_primary) {
+            g_set_error(error, PIPELINE_CONFIG_ERROR, 0,
+                        "Stage %s sets max-interval, only primary stages can",
+                        stage->name);
+            return FALSE;
+        }
+        /* Skipped frames only keep their boxes through the tracker */
+        if (stage->max_interval > stage->interval && !has_tracker_after(config, i)) {
+            g_set_error(error, PIPELINE_CONFIG_ERROR, 0,
+                        "Stage %s sets max-interval without a tracker after it",
+                        stage->name);
+            return FALSE;
+        }
+        for (guint j = 0; j < i; j++) {
+            const PipelineStage *prev = &config->stages[j];
+            if (prev->type != STAGE_NVINFER) continue;
+            if (prev->gie_unique_id == stage->gie_unique_id) {
+                g_set_error(error, PIPELINE_CONFIG_ERROR, 0,
+                            "Stages %s and %s share gie-unique-id %u", prev->name,
+                            stage->name, stage->gie_unique_id);
+                return FALSE;
+            }
+            if ((gint)prev->gie_unique_id == stage->operate_on_gie_id) found = TRUE;
+        }
+        if (!stage->is_primary && !found) {
+            g_set_error(error, PIPELINE_CONFIG_ERROR, 0,
+                        "Stage %s operates on gie %d, which no earlier stage is",
+                        stage->name, stage->operate_on_gie_id);
+            return FALSE;
+        }
+    }
+    if (num_trackers > 1) {
+        g_set_error(error, PIPELINE_CONFIG_ERROR, 0, "At most one tracker stage");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+PipelineConfig *pipeline_config_load(const gchar *path, GError **error) {
+    GKeyFile *key_file = g_key_file_new();
+    PipelineConfig *config = NULL;
+    gchar **names = NULL;
+    gchar *sink = NULL;
+    gsize num_names = 0;
+
+    if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, error)) goto done;
+
+    names = g_key_file_get_string_list(key_file, CONFIG_GROUP_PIPELINE, "stages",
+                                       &num_names, error);
+    if (!names) goto done;
+
+    config = g_new0(PipelineConfig, 1);
+    config->stages = g_new0(PipelineStage, num_names);
+    config->osd = TRUE;
+    config->tiler = TRUE;
+    config->sink = SINK_DISPLAY;
+
+    for (gsize i = 0; i < num_names; i++) {
+        gchar *name = g_strstrip(names[i]);
+        if (*name == '\0') continue;
+        if (!load_stage(key_file, path, name, &config->stages[config->num_stages++],
+                        error))
+            goto fail;
+    }
+
+    if (!get_boolean(key_file, CONFIG_GROUP_PIPELINE, "osd", &config->osd, error) ||
+        !get_boolean(key_file, CONFIG_GROUP_PIPELINE, "tiler", &config->tiler, error) ||
+        !load_queues(key_file, config, error))
+        goto fail;
+    sink = g_key_file_get_string(key_file, CONFIG_GROUP_PIPELINE, "sink", NULL);
+    if (sink && !g_strcmp0(sink, "fake")) {
+        config->sink = SINK_FAKE;
+    } else if (sink && g_strcmp0(sink, "display")) {
+        g_set_error(error, PIPELINE_CONFIG_ERROR, 0,
+                    "Unknown sink '%s', expected display or fake", sink);
+        goto fail;
+    }
+
+    if (validate(config, error)) goto done;
+
+fail:
+    pipeline_config_free(config);
+    config = NULL;
+done:
+    g_free(sink);
+    g_strfreev(names);
+    g_key_file_free(key_file);
+    return config;
+}
+
+void pipeline_config_free(PipelineConfig *config) {
+    if (!config) return;
+    for (guint i = 0; i < config->num_stages; i++) {
+        g_free(config->stages[i].name);
+        g_free(config->stages[i].config_file);
+        g_free(config->stages[i].operate_on_class_ids);
+    }
+    g_free(config->stages);
+    g_free(config);
+}
+
+const PipelineStage *pipeline_config_find_adaptive(const PipelineConfig *config) {
+    for (guint i = 0; i < config->num_stages; i++) {
+        const PipelineStage *stage = &config->stages[i];
+        if (stage->type == STAGE_NVINFER && stage->max_interval > stage->interval)
+            return stage;
+    }
+    return NULL;
+}
+
+const PipelineStage *pipeline_config_find_gie(const PipelineConfig *config,
+                                              guint unique_id) {
+    for (guint i = 0; i < config->num_stages; i++) {
+        const PipelineStage *stage = &config->stages[i];
+        if (stage->type == STAGE_NVINFER && stage->gie_unique_id == unique_id)
+            return stage;
+    }
+    return NULL;
+}
+
+guint pipeline_config_num_queues(const PipelineConfig *config) {
+    guint n = config->convert_queue.enabled + config->osd_queue.enabled +
+              config->sink_queue.enabled;
+    for (guint i = 0; i < config->num_stages; i++) {
+        n += config->stages[i].queue.enabled;
+    }
+    return n;
+}
+
+static guint min_buffers(guint current, const QueueConfig *queue) {
+    if (!queue->enabled) return current;
+    return current ? MIN(current, queue->max_buffers) : queue->max_buffers;
+}
+
+guint pipeline_config_min_queue_buffers(const PipelineConfig *config) {
+    guint n = min_buffers(0, &config->convert_queue);
+
+    n = min_buffers(n, &config->osd_queue);
+    n = min_buffers(n, &config->sink_queue);
+    for (guint i = 0; i < config->num_stages; i++) {
+        n = min_buffers(n, &config->stages[i].queue);
+    }
+    return n;
+}
+
+void pipeline_config_print(const PipelineConfig *config) {
+    g_print("Pipeline: streammux");
+    for (guint i = 0; i < config->num_stages; i++) {
+        const PipelineStage *stage = &config->stages[i];
+        if (stage->queue.enabled) g_print(" | queue");
+        if (stage->type == STAGE_NVINFER) {
+            g_print(" | %s (gie %u%s%s", stage->name, stage->gie_unique_id,
+                    stage->is_primary ? "" : ", secondary",
+                    stage->cache ? ", cached" : "");
+            if (stage->max_interval > stage->interval) {
+                g_print(", interval %u-%u", stage->interval, stage->max_interval);
+            }
+            g_print(")");
+        } else {
+            g_print(" | %s", stage->name);
+        }
+    }
+    if (config->convert_queue.enabled) g_print(" | queue");
+    g_print(" | nvvidconv");
+    if (config->osd_queue.enabled) g_print(" | queue");
+    if (config->osd) g_print(" | nvosd");
+    if (config->tiler) g_print(" | tiler");
+    if (config->sink_queue.enabled) g_print(" | queue");
+    g_print(" | %s\n", config->sink == SINK_FAKE ? "fakesink" : "display");
+}
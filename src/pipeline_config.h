@@ -0,0 +1,100 @@
+#ifndef __PIPELINE_CONFIG_H__
+#define __PIPELINE_CONFIG_H__
+
+#include <glib.h>
+
+/* Pipeline description file, see pipeline.txt.
+ *
+ * Lists the inference and tracking stages to run between the muxer and the
+ * OSD, with their config files, and whether to add the OSD and tiler. The
+ * ids each nvinfer stage is known by in the metadata are read from its own
+ * config file rather than repeated here. It also says where queues go, so
+ * that the stages on either side run on their own streaming threads. */
+
+/* Same values as GstQueueLeaky */
+typedef enum {
+    QUEUE_LEAKY_NONE,
+    QUEUE_LEAKY_UPSTREAM,
+    QUEUE_LEAKY_DOWNSTREAM,
+} QueueLeaky;
+
+typedef struct {
+    /* Put a queue, and so a new streaming thread, in front of the element */
+    gboolean enabled;
+    /* Batches, not frames */
+    guint max_buffers;
+    QueueLeaky leaky;
+} QueueConfig;
+
+typedef enum {
+    STAGE_NVINFER,
+    STAGE_NVTRACKER,
+} StageType;
+
+typedef struct {
+    /* Group name in the description, also used as the element name */
+    gchar *name;
+    StageType type;
+    /* Absolute path of the element's config file */
+    gchar *config_file;
+
+    /* nvinfer only, from the [property] group of config_file */
+    guint gie_unique_id;
+    gboolean is_primary;
+    /* -1 when the stage operates on every detector */
+    gint operate_on_gie_id;
+    guint interval;
+    /* Primary only, adapt the interval up to this at runtime, see
+     * interval_tuner.h. Not above interval means fixed. */
+    guint max_interval;
+    /* NULL when the stage operates on every class */
+    gint *operate_on_class_ids;
+    gsize num_operate_on_class_ids;
+
+    /* Secondary nvinfer only, reuse stable results per track, see sgie_cache.h */
+    gboolean cache;
+    guint cache_stable_frames;
+    guint cache_refresh_frames;
+
+    QueueConfig queue;
+} PipelineStage;
+
+typedef enum {
+    SINK_DISPLAY,
+    SINK_FAKE,
+} SinkType;
+
+typedef struct {
+    PipelineStage *stages;
+    guint num_stages;
+    gboolean osd;
+    gboolean tiler;
+    SinkType sink;
+    /* Queues in front of nvvidconv, nvosd and the sink */
+    QueueConfig convert_queue;
+    QueueConfig osd_queue;
+    QueueConfig sink_queue;
+} PipelineConfig;
+
+PipelineConfig *pipeline_config_load(const gchar *path, GError **error);
+void pipeline_config_free(PipelineConfig *config);
+
+/* The nvinfer stage with this gie-unique-id, or NULL. */
+const PipelineStage *pipeline_config_find_gie(const PipelineConfig *config,
+                                              guint unique_id);
+
+/* The first stage with an adaptive interval, or NULL. */
+const PipelineStage *pipeline_config_find_adaptive(const PipelineConfig *config);
+
+guint pipeline_config_num_queues(const PipelineConfig *config);
+/* max_buffers of the smallest queue, 0 without queues */
+guint pipeline_config_min_queue_buffers(const PipelineConfig *config);
+
+void pipeline_config_print(const PipelineConfig *config);
+
+/* Resolves file_path relative to the directory of cfg_file_path, or returns
+ * the absolute path of cfg_file_path itself when file_path is NULL. Takes
+ * ownership of file_path. Returns NULL if cfg_file_path does not exist. */
+gchar *get_absolute_file_path(const gchar *cfg_file_path, gchar *file_path);
+
+#endif
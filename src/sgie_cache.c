@@ -0,0 +1,219 @@
+#include "sgie_cache.h"
+
+#include "core/attribute_cache.h"
+#include "core/frame_record.h"
+#include "core/logger.h"
+#include "gstnvdsmeta.h"
+
+/* Detector ids at or below this mark an object hidden from the stage. Real
+ * gie-unique-ids are never negative, so the original id is recovered as
+ * HIDDEN_GIE_ID - id. */
+#define HIDDEN_GIE_ID (-1000)
+
+typedef struct {
+    const PipelineStage *stage;
+    AttributeCache *cache;
+} CachedStage;
+
+struct _SgieCache {
+    CachedStage *stages;
+    guint num_stages;
+};
+
+static gboolean operates_on(const PipelineStage *stage, NvDsObjectMeta *obj_meta) {
+    if (obj_meta->unique_component_id != stage->operate_on_gie_id) return FALSE;
+    if (obj_meta->object_id == RECORD_UNTRACKED_ID) return FALSE;
+    if (!stage->operate_on_class_ids) return TRUE;
+    for (gsize i = 0; i < stage->num_operate_on_class_ids; i++) {
+        if (stage->operate_on_class_ids[i] == obj_meta->class_id) return TRUE;
+    }
+    return FALSE;
+}
+
+/* Attaches the result the way nvinfer does, label appended to the box text */
+static void stamp_result(const PipelineStage *stage, NvDsBatchMeta *batch_meta,
+                         NvDsObjectMeta *obj_meta, const AttributeResult *result) {
+    NvDsClassifierMeta *classifier_meta =
+        nvds_acquire_classifier_meta_from_pool(batch_meta);
+    NvDsLabelInfo *label_info = nvds_acquire_label_info_meta_from_pool(batch_meta);
+
+    classifier_meta->unique_component_id = stage->gie_unique_id;
+    label_info->num_classes = result->num_classes;
+    label_info->result_class_id = result->class_id;
+    label_info->label_id = result->label_id;
+    label_info->result_prob = result->prob;
+    g_strlcpy(label_info->result_label, result->label, MAX_LABEL_SIZE);
+    nvds_add_label_info_meta_to_classifier(classifier_meta, label_info);
+    nvds_add_classifier_meta_to_object(obj_meta, classifier_meta);
+
+    if (obj_meta->text_params.display_text && result->label[0]) {
+        gchar *text =
+            g_strconcat(obj_meta->text_params.display_text, " ", result->label, NULL);
+        g_free(obj_meta->text_params.display_text);
+        obj_meta->text_params.display_text = text;
+    }
+}
+
+static GstPadProbeReturn sink_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
+                                               gpointer u_data) {
+    CachedStage *cached = (CachedStage *)u_data;
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta((GstBuffer *)info->data);
+
+    if (!batch_meta) return GST_PAD_PROBE_OK;
+    for (NvDsMetaList *l = batch_meta->frame_meta_list; l; l = l->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)l->data;
+
+        for (NvDsMetaList *l_obj = frame_meta->obj_meta_list; l_obj;
+             l_obj = l_obj->next) {
+            NvDsObjectMeta *obj_meta = (NvDsObjectMeta *)l_obj->data;
+            AttributeResult result;
+            guint64 key;
+
+            if (!operates_on(cached->stage, obj_meta)) continue;
+            key = record_track_key(frame_meta->source_id, obj_meta->object_id);
+            if (!attribute_cache_lookup(cached->cache, key, frame_meta->buf_pts,
+                                        &result))
+                continue;
+            stamp_result(cached->stage, batch_meta, obj_meta, &result);
+            obj_meta->unique_component_id =
+                HIDDEN_GIE_ID - obj_meta->unique_component_id;
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static const NvDsLabelInfo *find_result(const PipelineStage *stage,
+                                        NvDsObjectMeta *obj_meta) {
+    for (NvDsMetaList *l = obj_meta->classifier_meta_list; l; l = l->next) {
+        NvDsClassifierMeta *classifier_meta = (NvDsClassifierMeta *)l->data;
+        if (classifier_meta->unique_component_id != (gint)stage->gie_unique_id)
+            continue;
+        if (classifier_meta->label_info_list)
+            return (NvDsLabelInfo *)classifier_meta->label_info_list->data;
+    }
+    return NULL;
+}
+
+static GstPadProbeReturn src_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
+                                              gpointer u_data) {
+    CachedStage *cached = (CachedStage *)u_data;
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta((GstBuffer *)info->data);
+    guint64 now = 0;
+
+    if (!batch_meta) return GST_PAD_PROBE_OK;
+    for (NvDsMetaList *l = batch_meta->frame_meta_list; l; l = l->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)l->data;
+
+        now = MAX(now, frame_meta->buf_pts);
+        for (NvDsMetaList *l_obj = frame_meta->obj_meta_list; l_obj;
+             l_obj = l_obj->next) {
+            NvDsObjectMeta *obj_meta = (NvDsObjectMeta *)l_obj->data;
+            const NvDsLabelInfo *label_info;
+            AttributeResult result;
+
+            if (obj_meta->unique_component_id <= HIDDEN_GIE_ID) {
+                obj_meta->unique_component_id =
+                    HIDDEN_GIE_ID - obj_meta->unique_component_id;
+                continue;
+            }
+            if (!operates_on(cached->stage, obj_meta)) continue;
+            /* Below classifier-threshold, or still pending in async mode */
+            label_info = find_result(cached->stage, obj_meta);
+            if (!label_info) continue;
+
+            result.class_id = (gint)label_info->result_class_id;
+            result.label_id = label_info->label_id;
+            result.num_classes = label_info->num_classes;
+            result.prob = label_info->result_prob;
+            g_strlcpy(result.label,
+                      label_info->pResult_label ? label_info->pResult_label
+                                                : label_info->result_label,
+                      sizeof(result.label));
+            attribute_cache_update(
+                cached->cache,
+                record_track_key(frame_meta->source_id, obj_meta->object_id),
+                frame_meta->buf_pts, &result);
+        }
+    }
+    attribute_cache_expire(cached->cache, now);
+    return GST_PAD_PROBE_OK;
+}
+
+static gboolean attach(GstElement *pipeline, CachedStage *cached) {
+    GstElement *element = gst_bin_get_by_name(GST_BIN(pipeline), cached->stage->name);
+    GstPad *sink_pad, *src_pad;
+
+    if (!element) return FALSE;
+    sink_pad = gst_element_get_static_pad(element, "sink");
+    src_pad = gst_element_get_static_pad(element, "src");
+    if (sink_pad && src_pad) {
+        gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, sink_pad_buffer_probe,
+                          cached, NULL);
+        gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, src_pad_buffer_probe,
+                          cached, NULL);
+    }
+    if (sink_pad) gst_object_unref(sink_pad);
+    if (src_pad) gst_object_unref(src_pad);
+    gst_object_unref(element);
+    return sink_pad && src_pad;
+}
+
+SgieCache *sgie_cache_new(GstElement *pipeline, const PipelineConfig *config) {
+    SgieCache *cache = g_new0(SgieCache, 1);
+
+    cache->stages = g_new0(CachedStage, config->num_stages);
+    for (guint i = 0; i < config->num_stages; i++) {
+        const PipelineStage *stage = &config->stages[i];
+        CachedStage *cached = &cache->stages[cache->num_stages];
+        AttributeCacheConfig cache_config;
+
+        if (!stage->cache) continue;
+        attribute_cache_config_init(&cache_config);
+        cache_config.stable_frames = stage->cache_stable_frames;
+        cache_config.refresh_frames = stage->cache_refresh_frames;
+        cached->stage = stage;
+        cached->cache = attribute_cache_new(&cache_config);
+        if (!attach(pipeline, cached)) {
+            LOG_WARNING(LOG_CAT_APP, "Cannot cache stage %s, running it uncached",
+                        stage->name);
+            attribute_cache_free(cached->cache);
+            continue;
+        }
+        cache->num_stages++;
+    }
+
+    if (!cache->num_stages) {
+        sgie_cache_free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void sgie_cache_free(SgieCache *cache) {
+    if (!cache) return;
+    for (guint i = 0; i < cache->num_stages; i++) {
+        attribute_cache_free(cache->stages[i].cache);
+    }
+    g_free(cache->stages);
+    g_free(cache);
+}
+
+void sgie_cache_print_stats(SgieCache *cache) {
+    if (!cache) return;
+    for (guint i = 0; i < cache->num_stages; i++) {
+        AttributeCacheStats stats;
+        guint64 lookups;
+
+        attribute_cache_get_stats(cache->stages[i].cache, &stats);
+        lookups = stats.hits + stats.misses;
+        g_print("%s cache: %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT
+                " objects reused (%.1f%% hit rate), %u tracks",
+                cache->stages[i].stage->name, stats.hits, lookups,
+                lookups ? 100.0 * stats.hits / lookups : 0.0, stats.tracks);
+        if (stats.rejected) {
+            g_print(", %" G_GUINT64_FORMAT " tracks not cached (table full)",
+                    stats.rejected);
+        }
+        g_print("\n");
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef __SGIE_CACHE_H__
+#define __SGIE_CACHE_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "pipeline_config.h"
+
+/* Per-track result cache in front of secondary classifiers.
+ *
+ * For every stage with cache=true in the pipeline description, a probe on the
+ * stage's sink pad looks each object up by track. When the stage has given
+ * the track the same label often enough, the probe attaches that label as
+ * the stage's classifier meta itself and hides the object from nvinfer by
+ * moving it to a detector id the stage does not operate on. A probe on the
+ * src pad moves hidden objects back and feeds new results into the cache.
+ * Tracks are forgotten once they have not been seen for the cache ttl. */
+
+typedef struct _SgieCache SgieCache;
+
+/* Returns NULL when no stage in config is cached. The stage elements must
+ * already be in pipeline, named after their stage. */
+SgieCache *sgie_cache_new(GstElement *pipeline, const PipelineConfig *config);
+void sgie_cache_free(SgieCache *cache);
+
+/* Prints the hit rate of each cached stage, i.e. the share of objects that
+ * were not sent to the classifier. */
+void sgie_cache_print_stats(SgieCache *cache);
+
+#endif
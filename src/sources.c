@@ -0,0 +1,625 @@
+#include "sources.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "core/logger.h"
+#include "infer_stub.h"
+
+/* How often the supervisor looks for stalled and recovered branches */
+#define SOURCE_WATCHDOG_MS 250
+
+typedef struct {
+    SourceManager *manager;
+    guint id;
+    gboolean active;
+    gboolean is_rtsp;
+    gchar *uri;
+    /* NULL while a source that is down waits for its next rebuild */
+    GstElement *bin;
+    GstPad *mux_pad;
+
+    /* Written by the branch's streaming thread, g_get_monotonic_time() */
+    gint64 first_buffer_us;
+    gint64 last_buffer_us;
+    gint64 eos_us;
+    guint64 buffers;
+
+    /* Main loop only */
+    gint64 built_us;
+    gint64 down_since_us;
+    guint attempts;
+    guint retry_delay_ms;
+    guint retry_id;
+    /* The end callback has been called for this branch */
+    gboolean ended;
+    SourceHealth health;
+} Source;
+
+struct _SourceManager {
+    GstElement *pipeline;
+    GstElement *streammux;
+    Source *sources;
+    SourceOptions options;
+    guint max_sources;
+    guint count;
+    guint stdin_watch;
+    guint watchdog_id;
+    /* Since when the pipeline has been PLAYING, 0 when it is not */
+    gint64 playing_since_us;
+    /* Set by source_manager_shutdown(), read by the EOS probes */
+    gint stopping;
+};
+
+// rtspsrc and parsebin create their source pads once the stream is known, so
+// they can only be linked from pad-added
+static void link_source_pad_to_pipe(GstElement *src, GstPad *new_src_pad,
+                                    GstElement *sink_elem) {
+    GstPad *sink_pad = gst_element_get_static_pad(sink_elem, "sink");
+    GstCaps *caps = gst_pad_get_current_caps(new_src_pad);
+    const gchar *type;
+    gchar *name = gst_pad_get_name(new_src_pad);
+
+    if (!caps) caps = gst_pad_query_caps(new_src_pad, NULL);
+    type = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+    LOG_DEBUG(LOG_CAT_SOURCES, "Source pad %s created", name);
+    g_free(name);
+
+    /* Only the first RTP or H.264 stream is used, audio and the rest are left
+     * unlinked */
+    if (!gst_pad_is_linked(sink_pad) && (!g_strcmp0(type, "application/x-rtp") ||
+                                         g_str_has_prefix(type, "video/x-h264"))) {
+        if (GST_PAD_LINK_FAILED(gst_pad_link(new_src_pad, sink_pad))) {
+            LOG_WARNING(LOG_CAT_SOURCES, "Type is %s but link failed", type);
+        }
+    }
+    gst_caps_unref(caps);
+    gst_object_unref(sink_pad);
+}
+
+static gboolean is_rtsp_uri(const gchar *uri) {
+    return g_str_has_prefix(uri, "rtsp://") || g_str_has_prefix(uri, "rtsps://");
+}
+
+/* rtspsrc ! rtph264depay ! h264parse, or filesrc ! parsebin ! h264parse for
+ * local files, followed by the decoder and, without a GPU, the inference stub */
+static GstElement *create_source_bin(guint source_id, const gchar *uri,
+                                     const SourceOptions *options) {
+    gchar name[32];
+    GstElement *bin, *source, *depay, *h264parser, *decoder, *stub = NULL, *last;
+    GstPad *last_src, *ghost;
+    gboolean linked;
+
+    g_snprintf(name, sizeof(name), "source-bin-%02u", source_id);
+    bin = gst_bin_new(name);
+
+    if (is_rtsp_uri(uri)) {
+        source = gst_element_factory_make("rtspsrc", "source");
+        depay = gst_element_factory_make("rtph264depay", "depay");
+    } else {
+        source = gst_element_factory_make("filesrc", "source");
+        depay = gst_element_factory_make("parsebin", "demux");
+    }
+    h264parser = gst_element_factory_make("h264parse", "parser");
+    if (options->cpu_only) {
+        decoder = gst_element_factory_make("avdec_h264", "sw-decoder");
+        stub = infer_stub_new(source_id, options->stub_objects, options->width,
+                              options->height);
+    } else {
+        /* Use nvdec_h264 for hardware accelerated decode on GPU */
+        decoder = gst_element_factory_make("nvv4l2decoder", "nvv4l2-decoder");
+    }
+
+    if (!bin || !source || !depay || !h264parser || !decoder ||
+        (options->cpu_only && !stub)) {
+        LOG_ERROR(LOG_CAT_SOURCES, "One source element could not be created");
+        if (bin) gst_object_unref(bin);
+        return NULL;
+    }
+
+    gst_bin_add_many(GST_BIN(bin), source, depay, h264parser, decoder, NULL);
+    if (stub) gst_bin_add(GST_BIN(bin), stub);
+
+    if (is_rtsp_uri(uri)) {
+        g_object_set(G_OBJECT(source), "location", uri, "latency", options->latency_ms,
+                     "drop-on-latency", options->drop_on_latency, NULL);
+        if (options->tcp) gst_util_set_object_arg(G_OBJECT(source), "protocols", "tcp");
+        g_signal_connect(source, "pad-added", G_CALLBACK(link_source_pad_to_pipe),
+                         depay);
+        linked = gst_element_link_many(depay, h264parser, decoder, NULL);
+    } else {
+        g_object_set(G_OBJECT(source), "location",
+                     g_str_has_prefix(uri, "file://") ? uri + 7 : uri, NULL);
+        g_signal_connect(depay, "pad-added", G_CALLBACK(link_source_pad_to_pipe),
+                         h264parser);
+        linked = gst_element_link(source, depay) &&
+                 gst_element_link(h264parser, decoder);
+    }
+    if (linked && stub) linked = gst_element_link(decoder, stub);
+    if (!linked) {
+        LOG_ERROR(LOG_CAT_SOURCES, "Source elements could not be linked");
+        gst_object_unref(bin);
+        return NULL;
+    }
+
+    last = stub ? stub : decoder;
+    last_src = gst_element_get_static_pad(last, "src");
+    ghost = gst_ghost_pad_new("src", last_src);
+    gst_object_unref(last_src);
+    if (!ghost || !gst_element_add_pad(bin, ghost)) {
+        LOG_ERROR(LOG_CAT_SOURCES, "Failed to add ghost pad to %s", name);
+        gst_object_unref(bin);
+        return NULL;
+    }
+    if (options->tap) options->tap(source_id, h264parser, options->tap_data);
+    return bin;
+}
+
+void source_options_init(SourceOptions *options) {
+    memset(options, 0, sizeof(*options));
+    options->latency_ms = SOURCE_DEFAULT_LATENCY_MS;
+    options->stall_timeout_ms = SOURCE_DEFAULT_STALL_TIMEOUT_MS;
+    options->retry_initial_ms = SOURCE_DEFAULT_RETRY_INITIAL_MS;
+    options->retry_max_ms = SOURCE_DEFAULT_RETRY_MAX_MS;
+}
+
+static GstPadProbeReturn branch_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
+                                             gpointer u_data) {
+    Source *source = (Source *)u_data;
+    gint64 now = g_get_monotonic_time();
+
+    if (!__atomic_load_n(&source->first_buffer_us, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&source->first_buffer_us, now, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&source->last_buffer_us, now, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&source->buffers, 1, __ATOMIC_RELAXED);
+    return GST_PAD_PROBE_OK;
+}
+
+/* A camera that goes away usually ends with EOS. Letting it reach the muxer
+ * would end that stream for good, so it is dropped and the branch rebuilt,
+ * unless the application is shutting down. Files with an end callback keep
+ * their pad open the same way, for the next file. */
+static GstPadProbeReturn branch_event_probe(GstPad *pad, GstPadProbeInfo *info,
+                                            gpointer u_data) {
+    Source *source = (Source *)u_data;
+
+    if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) != GST_EVENT_EOS ||
+        g_atomic_int_get(&source->manager->stopping)) {
+        return GST_PAD_PROBE_OK;
+    }
+    __atomic_store_n(&source->eos_us, g_get_monotonic_time(), __ATOMIC_RELAXED);
+    return GST_PAD_PROBE_DROP;
+}
+
+/* Builds the source's branch and links it to its muxer pad */
+static gboolean attach_branch(SourceManager *manager, Source *source) {
+    GstPad *src_pad;
+
+    source->bin = create_source_bin(source->id, source->uri, &manager->options);
+    if (!source->bin) return FALSE;
+    gst_bin_add(GST_BIN(manager->pipeline), source->bin);
+
+    src_pad = gst_element_get_static_pad(source->bin, "src");
+    if (gst_pad_link(src_pad, source->mux_pad) != GST_PAD_LINK_OK) {
+        LOG_ERROR(LOG_CAT_SOURCES, "Failed to link source %u to stream muxer",
+                  source->id);
+        gst_object_unref(src_pad);
+        gst_bin_remove(GST_BIN(manager->pipeline), source->bin);
+        source->bin = NULL;
+        return FALSE;
+    }
+    gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, branch_buffer_probe, source,
+                      NULL);
+    if (source->is_rtsp || manager->options.on_end) {
+        gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                          branch_event_probe, source, NULL);
+    }
+    gst_object_unref(src_pad);
+
+    source->first_buffer_us = 0;
+    source->last_buffer_us = 0;
+    source->eos_us = 0;
+    source->buffers = 0;
+    source->ended = FALSE;
+    source->built_us = g_get_monotonic_time();
+
+    /* No-op before the pipeline starts, brings late sources up to PLAYING */
+    gst_element_sync_state_with_parent(source->bin);
+    return TRUE;
+}
+
+/* Stops and removes the branch, leaving the muxer pad requested */
+static gboolean detach_branch(SourceManager *manager, Source *source) {
+    GstPad *src_pad;
+
+    if (!source->bin) return TRUE;
+    if (gst_element_set_state(source->bin, GST_STATE_NULL) ==
+        GST_STATE_CHANGE_FAILURE) {
+        return FALSE;
+    }
+    src_pad = gst_element_get_static_pad(source->bin, "src");
+    gst_pad_unlink(src_pad, source->mux_pad);
+    gst_object_unref(src_pad);
+    gst_bin_remove(GST_BIN(manager->pipeline), source->bin);
+    source->bin = NULL;
+
+    /* Let the muxer drop anything queued for this pad */
+    gst_pad_send_event(source->mux_pad, gst_event_new_flush_stop(FALSE));
+    return TRUE;
+}
+
+static void source_failed(SourceManager *manager, Source *source,
+                          const gchar *reason);
+
+static gboolean retry_timeout(gpointer data) {
+    Source *source = (Source *)data;
+    SourceManager *manager = source->manager;
+
+    source->retry_id = 0;
+    source->attempts++;
+    source->health.rebuilds++;
+    LOG_INFO(LOG_CAT_SOURCES, "Reconnecting source %u, attempt %u", source->id,
+             source->attempts);
+    if (!attach_branch(manager, source)) {
+        source_failed(manager, source, "branch could not be rebuilt");
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/* Tears the branch down at once and schedules a rebuild, backing off further
+ * each time the rebuilt branch fails before delivering a frame */
+static void source_failed(SourceManager *manager, Source *source,
+                          const gchar *reason) {
+    if (source->retry_id || g_atomic_int_get(&manager->stopping)) return;
+
+    if (!source->health.down) {
+        source->health.down = TRUE;
+        source->health.outages++;
+        source->down_since_us = g_get_monotonic_time();
+        source->attempts = 0;
+        source->retry_delay_ms = manager->options.retry_initial_ms;
+    }
+    LOG_WARNING(LOG_CAT_SOURCES, "Source %u is down (%s), retrying in %.1f s",
+                source->id, reason, source->retry_delay_ms / 1e3);
+
+    if (!detach_branch(manager, source)) {
+        LOG_ERROR(LOG_CAT_SOURCES, "Failed to stop source %u", source->id);
+    }
+    source->retry_id = g_timeout_add(source->retry_delay_ms, retry_timeout, source);
+    source->retry_delay_ms =
+        MIN(source->retry_delay_ms * 2, MAX(manager->options.retry_max_ms, 1));
+}
+
+static void source_recovered(Source *source, gint64 first_buffer_us) {
+    SourceHealth *health = &source->health;
+    gdouble seconds = (first_buffer_us - source->down_since_us) / 1e6;
+
+    health->down = FALSE;
+    health->recoveries++;
+    health->last_recovery_sec = seconds;
+    health->max_recovery_sec = MAX(health->max_recovery_sec, seconds);
+    health->down_sec += seconds;
+    LOG_INFO(LOG_CAT_SOURCES, "Source %u recovered after %.2f s (%u attempt%s)",
+             source->id, seconds, source->attempts, source->attempts == 1 ? "" : "s");
+}
+
+static gboolean watchdog_timeout(gpointer data) {
+    SourceManager *manager = (SourceManager *)data;
+    gint64 now = g_get_monotonic_time();
+    gint64 stall_us = manager->options.stall_timeout_ms * (gint64)1000;
+    GstState state = GST_STATE_NULL;
+
+    gst_element_get_state(manager->pipeline, &state, NULL, 0);
+    if (state != GST_STATE_PLAYING) {
+        manager->playing_since_us = 0;
+    } else if (!manager->playing_since_us) {
+        manager->playing_since_us = now;
+    }
+
+    for (guint i = 0; i < manager->max_sources; i++) {
+        Source *source = &manager->sources[i];
+        gint64 first, last;
+
+        if (!source->active || !source->bin) continue;
+        if (!source->is_rtsp) {
+            if (!source->ended && __atomic_load_n(&source->eos_us, __ATOMIC_RELAXED)) {
+                source->ended = TRUE;
+                manager->options.on_end(
+                    source->id, __atomic_load_n(&source->buffers, __ATOMIC_RELAXED),
+                    NULL, manager->options.on_end_data);
+            }
+            continue;
+        }
+        first = __atomic_load_n(&source->first_buffer_us, __ATOMIC_RELAXED);
+        last = __atomic_load_n(&source->last_buffer_us, __ATOMIC_RELAXED);
+
+        if (__atomic_load_n(&source->eos_us, __ATOMIC_RELAXED)) {
+            source_failed(manager, source, "end of stream");
+            continue;
+        }
+        if (source->health.down && first) source_recovered(source, first);
+
+        /* Engine loading and preroll do not count as a stall */
+        if (!stall_us || !manager->playing_since_us) continue;
+        if (now - MAX(MAX(last, source->built_us), manager->playing_since_us) >
+            stall_us) {
+            source_failed(manager, source, "no data");
+        }
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+SourceManager *source_manager_new(GstElement *pipeline, GstElement *streammux,
+                                  guint max_sources, const SourceOptions *options) {
+    SourceManager *manager = g_new0(SourceManager, 1);
+    if (options) {
+        manager->options = *options;
+    } else {
+        source_options_init(&manager->options);
+    }
+    manager->pipeline = pipeline;
+    manager->streammux = streammux;
+    manager->sources = g_new0(Source, max_sources);
+    manager->max_sources = max_sources;
+    for (guint i = 0; i < max_sources; i++) {
+        manager->sources[i].manager = manager;
+        manager->sources[i].id = i;
+    }
+    manager->watchdog_id = g_timeout_add(SOURCE_WATCHDOG_MS, watchdog_timeout, manager);
+    return manager;
+}
+
+void source_manager_free(SourceManager *manager) {
+    if (!manager) return;
+    if (manager->stdin_watch) g_source_remove(manager->stdin_watch);
+    if (manager->watchdog_id) g_source_remove(manager->watchdog_id);
+    /* The pipeline owns the bins, only our references are dropped here */
+    for (guint i = 0; i < manager->max_sources; i++) {
+        if (manager->sources[i].retry_id) g_source_remove(manager->sources[i].retry_id);
+        if (manager->sources[i].mux_pad) gst_object_unref(manager->sources[i].mux_pad);
+        g_free(manager->sources[i].uri);
+    }
+    g_free(manager->sources);
+    g_free(manager);
+}
+
+gint source_manager_add(SourceManager *manager, const gchar *uri) {
+    gchar pad_name[16];
+    Source *source = NULL;
+    guint id;
+
+    for (id = 0; id < manager->max_sources; id++) {
+        if (!manager->sources[id].active) {
+            source = &manager->sources[id];
+            break;
+        }
+    }
+    if (!source) {
+        LOG_ERROR(LOG_CAT_SOURCES, "All %u muxer slots are in use, not adding %s",
+                  manager->max_sources, uri);
+        return -1;
+    }
+
+    /* The pad outlives rebuilds of the branch, which keeps the source id */
+    g_snprintf(pad_name, sizeof(pad_name), "sink_%u", id);
+    source->mux_pad = gst_element_get_request_pad(manager->streammux, pad_name);
+    if (!source->mux_pad) {
+        LOG_ERROR(LOG_CAT_SOURCES, "Streammux request sink pad failed");
+        return -1;
+    }
+
+    source->uri = g_strdup(uri);
+    source->is_rtsp = is_rtsp_uri(uri);
+    if (!attach_branch(manager, source)) {
+        gst_element_release_request_pad(manager->streammux, source->mux_pad);
+        gst_object_unref(source->mux_pad);
+        source->mux_pad = NULL;
+        g_clear_pointer(&source->uri, g_free);
+        return -1;
+    }
+
+    memset(&source->health, 0, sizeof(source->health));
+    source->active = TRUE;
+    manager->count++;
+    LOG_INFO(LOG_CAT_SOURCES, "Added source %u: %s", id, uri);
+    return (gint)id;
+}
+
+gboolean source_manager_remove(SourceManager *manager, guint source_id) {
+    Source *source;
+
+    if (source_id >= manager->max_sources || !manager->sources[source_id].active) {
+        LOG_WARNING(LOG_CAT_SOURCES, "No source with id %u", source_id);
+        return FALSE;
+    }
+    source = &manager->sources[source_id];
+
+    if (!detach_branch(manager, source)) {
+        LOG_ERROR(LOG_CAT_SOURCES, "Failed to stop source %u", source_id);
+        return FALSE;
+    }
+    if (source->retry_id) {
+        g_source_remove(source->retry_id);
+        source->retry_id = 0;
+    }
+
+    gst_element_release_request_pad(manager->streammux, source->mux_pad);
+    gst_object_unref(source->mux_pad);
+    source->mux_pad = NULL;
+
+    LOG_INFO(LOG_CAT_SOURCES, "Removed source %u: %s", source_id, source->uri);
+    g_clear_pointer(&source->uri, g_free);
+    source->active = FALSE;
+    manager->count--;
+    return TRUE;
+}
+
+guint source_manager_count(const SourceManager *manager) { return manager->count; }
+
+gboolean source_manager_get_health(const SourceManager *manager, guint source_id,
+                                   SourceHealth *health) {
+    const Source *source;
+
+    if (source_id >= manager->max_sources) return FALSE;
+    source = &manager->sources[source_id];
+    if (!source->active) return FALSE;
+    *health = source->health;
+    if (health->down) {
+        health->down_sec += (g_get_monotonic_time() - source->down_since_us) / 1e6;
+    }
+    return TRUE;
+}
+
+void source_manager_print(const SourceManager *manager) {
+    g_print("%u/%u sources attached\n", manager->count, manager->max_sources);
+    for (guint i = 0; i < manager->max_sources; i++) {
+        SourceHealth health;
+
+        if (!source_manager_get_health(manager, i, &health)) continue;
+        g_print("  %u: %s%s\n", i, manager->sources[i].uri,
+                health.down ? " (down)" : "");
+        if (!health.outages) continue;
+        g_print("     %u outage(s), %u recovered, last in %.2f s, slowest %.2f s, "
+                "%.1f s down in total\n",
+                health.outages, health.recoveries, health.last_recovery_sec,
+                health.max_recovery_sec, health.down_sec);
+    }
+}
+
+void source_manager_dump_health(const SourceManager *manager, GString *out) {
+    gboolean first = TRUE;
+
+    g_string_append_c(out, '[');
+    for (guint i = 0; i < manager->max_sources; i++) {
+        SourceHealth health;
+        gchar *uri;
+
+        if (!source_manager_get_health(manager, i, &health)) continue;
+        uri = g_strescape(manager->sources[i].uri, NULL);
+        g_string_append_printf(
+            out,
+            "%s{\"source\":%u,\"uri\":\"%s\",\"down\":%s,\"outages\":%u,"
+            "\"recoveries\":%u,\"rebuilds\":%u,\"last_recovery_sec\":%.3f,"
+            "\"max_recovery_sec\":%.3f,\"down_sec\":%.3f}",
+            first ? "" : ",", i, uri, health.down ? "true" : "false", health.outages,
+            health.recoveries, health.rebuilds, health.last_recovery_sec,
+            health.max_recovery_sec, health.down_sec);
+        g_free(uri);
+        first = FALSE;
+    }
+    g_string_append_c(out, ']');
+}
+
+/* Only the first error of a branch is reported, later ones are its fallout */
+static gboolean file_failed(SourceManager *manager, Source *source,
+                            GstMessage *message) {
+    GError *error = NULL;
+
+    if (!manager->options.on_end) return FALSE;
+    if (source->ended) return TRUE;
+    source->ended = TRUE;
+    gst_message_parse_error(message, &error, NULL);
+    manager->options.on_end(source->id,
+                            __atomic_load_n(&source->buffers, __ATOMIC_RELAXED), error,
+                            manager->options.on_end_data);
+    g_error_free(error);
+    return TRUE;
+}
+
+gboolean source_manager_handle_error(SourceManager *manager, GstMessage *message) {
+    GstObject *origin = GST_MESSAGE_SRC(message);
+
+    /* Late errors from a branch that was already torn down */
+    if (origin != GST_OBJECT(manager->pipeline) &&
+        !gst_object_has_as_ancestor(origin, GST_OBJECT(manager->pipeline))) {
+        return TRUE;
+    }
+    for (guint i = 0; i < manager->max_sources; i++) {
+        Source *source = &manager->sources[i];
+
+        if (!source->active || !source->bin ||
+            !gst_object_has_as_ancestor(origin, GST_OBJECT(source->bin))) {
+            continue;
+        }
+        if (g_atomic_int_get(&manager->stopping)) return FALSE;
+        if (!source->is_rtsp) return file_failed(manager, source, message);
+        source_failed(manager, source, "error");
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void source_manager_shutdown(SourceManager *manager) {
+    g_atomic_int_set(&manager->stopping, TRUE);
+    for (guint i = 0; i < manager->max_sources; i++) {
+        Source *source = &manager->sources[i];
+
+        if (source->retry_id) {
+            g_source_remove(source->retry_id);
+            source->retry_id = 0;
+        }
+        if (source->active && !source->bin) {
+            gst_pad_send_event(source->mux_pad, gst_event_new_eos());
+        }
+    }
+}
+
+gchar **source_list_load(const gchar *path, GError **error) {
+    gchar *contents = NULL;
+    gchar **lines;
+    GPtrArray *uris;
+
+    if (!g_file_get_contents(path, &contents, NULL, error)) return NULL;
+
+    uris = g_ptr_array_new();
+    lines = g_strsplit(contents, "\n", -1);
+    for (gchar **line = lines; *line; line++) {
+        gchar *uri = g_strstrip(*line);
+        if (*uri == '\0' || *uri == '#') continue;
+        g_ptr_array_add(uris, g_strdup(uri));
+    }
+    g_ptr_array_add(uris, NULL);
+
+    g_strfreev(lines);
+    g_free(contents);
+    return (gchar **)g_ptr_array_free(uris, FALSE);
+}
+
+static gboolean stdin_command(GIOChannel *channel, GIOCondition condition,
+                              gpointer data) {
+    SourceManager *manager = (SourceManager *)data;
+    gchar *line = NULL;
+    gchar *cmd;
+
+    if (g_io_channel_read_line(channel, &line, NULL, NULL, NULL) !=
+        G_IO_STATUS_NORMAL) {
+        g_free(line);
+        if (!(condition & G_IO_HUP)) return G_SOURCE_CONTINUE;
+        /* stdin closed, stop watching it */
+        manager->stdin_watch = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    cmd = g_strstrip(line);
+    if (g_str_has_prefix(cmd, "add ")) {
+        source_manager_add(manager, g_strstrip(cmd + 4));
+    } else if (g_str_has_prefix(cmd, "remove ")) {
+        source_manager_remove(manager, (guint)g_ascii_strtoull(cmd + 7, NULL, 10));
+    } else if (!g_strcmp0(cmd, "list")) {
+        source_manager_print(manager);
+    } else if (*cmd) {
+        LOG_WARNING(LOG_CAT_SOURCES,
+                    "Unknown command '%s', expected add <uri>, remove <id> or list",
+                    cmd);
+    }
+    g_free(line);
+    return G_SOURCE_CONTINUE;
+}
+
+void source_manager_watch_stdin(SourceManager *manager) {
+    GIOChannel *channel = g_io_channel_unix_new(fileno(stdin));
+    manager->stdin_watch =
+        g_io_add_watch(channel, G_IO_IN | G_IO_HUP, stdin_command, manager);
+    g_io_channel_unref(channel);
+}
@@ -0,0 +1,124 @@
+#ifndef __SOURCES_H__
+#define __SOURCES_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+/* Owns the per-camera source branches feeding nvstreammux.
+ *
+ * Each source is a bin holding rtspsrc ! rtph264depay ! h264parse !
+ * nvv4l2decoder, or filesrc ! parsebin ! h264parse ! nvv4l2decoder when the
+ * URI is a local file, linked to the muxer's sink_%u request pad whose index
+ * is also the source id reported in NvDsFrameMeta::source_id. Sources can be
+ * attached and detached while the pipeline is playing; both calls must be
+ * made from the thread running the main loop.
+ *
+ * RTSP branches are supervised. One that posts an error, reaches end of
+ * stream or stops producing buffers is torn down on its own and rebuilt on
+ * the same muxer pad, so the rest of the pipeline and the other cameras keep
+ * running. Rebuilds are retried with exponential backoff until frames flow
+ * again, and the time from the outage to the first new buffer is recorded.
+ *
+ * File branches normally end the muxer's stream at end of file. With an end
+ * callback they are held open instead, and reported, so that the muxer pad
+ * can be given to the next file. */
+
+#define SOURCE_DEFAULT_LATENCY_MS 200
+#define SOURCE_DEFAULT_STALL_TIMEOUT_MS 5000
+#define SOURCE_DEFAULT_RETRY_INITIAL_MS 500
+#define SOURCE_DEFAULT_RETRY_MAX_MS 30000
+
+/* Given each new branch's h264parse before the branch starts, e.g. to tap
+ * the compressed stream */
+typedef void (*SourceTapFunc)(guint source_id, GstElement *parser, gpointer data);
+
+/* Given a file source whose branch has pushed its last buffer, with the number
+ * of buffers it pushed, or has failed, with the error. Called once per branch
+ * from the main loop. The source stays attached until it is removed. */
+typedef void (*SourceEndFunc)(guint source_id, guint64 buffers, const GError *error,
+                              gpointer data);
+
+typedef struct {
+    /* Decode in software and attach synthetic detections with
+     * infer_stub_new(), for pipelines without nvstreammux and nvinfer. The
+     * muxer is then any element with sink_%u request pads, e.g. funnel. */
+    gboolean cpu_only;
+    guint stub_objects;
+    guint width;
+    guint height;
+    /* RTSP only: jitterbuffer latency, interleaved TCP instead of UDP, and
+     * dropping packets that arrive later than the latency */
+    guint latency_ms;
+    gboolean tcp;
+    gboolean drop_on_latency;
+    /* A branch without a buffer for this long while the pipeline is playing
+     * is rebuilt, 0 leaves stall detection to rtspsrc's own timeouts */
+    guint stall_timeout_ms;
+    /* Delay before the first rebuild, doubled after each failed one */
+    guint retry_initial_ms;
+    guint retry_max_ms;
+    /* Called for every branch built, rebuilds included */
+    SourceTapFunc tap;
+    gpointer tap_data;
+    /* Files only, NULL to let end of file through to the muxer */
+    SourceEndFunc on_end;
+    gpointer on_end_data;
+} SourceOptions;
+
+/* Outages of one source since it was added */
+typedef struct {
+    gboolean down;
+    guint outages;
+    guint recoveries;
+    /* Branches built after the first, successful or not */
+    guint rebuilds;
+    /* From the outage being noticed to the first buffer of the new branch */
+    gdouble last_recovery_sec;
+    gdouble max_recovery_sec;
+    /* Including the current outage */
+    gdouble down_sec;
+} SourceHealth;
+
+typedef struct _SourceManager SourceManager;
+
+/* GPU decode and the defaults above. */
+void source_options_init(SourceOptions *options);
+
+/* options may be NULL for source_options_init() defaults. */
+SourceManager *source_manager_new(GstElement *pipeline, GstElement *streammux,
+                                  guint max_sources, const SourceOptions *options);
+void source_manager_free(SourceManager *manager);
+
+/* Returns the id of the new source, or -1 if every mux slot is in use or the
+ * branch could not be built. */
+gint source_manager_add(SourceManager *manager, const gchar *uri);
+gboolean source_manager_remove(SourceManager *manager, guint source_id);
+
+guint source_manager_count(const SourceManager *manager);
+void source_manager_print(const SourceManager *manager);
+
+gboolean source_manager_get_health(const SourceManager *manager, guint source_id,
+                                   SourceHealth *health);
+/* Appends the health of every attached source as a JSON array. */
+void source_manager_dump_health(const SourceManager *manager, GString *out);
+
+/* Called from the bus watch with an ERROR message. Returns TRUE when the
+ * error came from a source branch that is being rebuilt, from a file branch
+ * handed to the end callback, or from one that is no longer in the pipeline,
+ * and should not stop the application. */
+gboolean source_manager_handle_error(SourceManager *manager, GstMessage *message);
+
+/* Lets end of stream through and stops rebuilding, before EOS is sent to the
+ * pipeline to shut it down. Sources that are down get EOS on their muxer
+ * pad, as they have no branch to send it. */
+void source_manager_shutdown(SourceManager *manager);
+
+/* Reads one URI per line, skipping blank lines and lines starting with '#'.
+ * Returns a NULL-terminated array to free with g_strfreev(). */
+gchar **source_list_load(const gchar *path, GError **error);
+
+/* Watches stdin for "add <uri>", "remove <id>" and "list" commands until
+ * stdin is closed or the manager is freed. */
+void source_manager_watch_stdin(SourceManager *manager);
+
+#endif
@@ -0,0 +1,19 @@
+#include "unix_socket.h"
+
+#include <gio/gunixsocketaddress.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+
+GSocketAddress *unix_socket_address_new(const gchar *path, GError **error) {
+    GStatBuf st;
+
+    if (g_lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_EXISTS,
+                        "Cannot listen on %s, it exists and is not a socket", path);
+            return NULL;
+        }
+        g_unlink(path);
+    }
+    return g_unix_socket_address_new(path);
+}
@@ -0,0 +1,13 @@
+#ifndef __UNIX_SOCKET_H__
+#define __UNIX_SOCKET_H__
+
+#include <gio/gio.h>
+
+/* Address to listen on for a unix:PATH destination.
+ *
+ * A socket left behind at path by a previous run would make the bind fail,
+ * so it is removed first. Anything else at path is not ours to remove and
+ * fails with G_IO_ERROR_EXISTS. */
+GSocketAddress *unix_socket_address_new(const gchar *path, GError **error);
+
+#endif
@@ -0,0 +1,100 @@
+/* Prints the detections exported by the app with --export, or just counts
+ * them with --rate.
+ *
+ * Usage: nvds_export_cat [OPTION...] RING */
+
+#include <glib.h>
+#include <stdio.h>
+
+#include "core/export_reader.h"
+
+#define READ_BATCH 1024
+#define POLL_US 1000
+
+static gboolean from_oldest = FALSE;
+static gboolean follow = FALSE;
+static gboolean rate = FALSE;
+
+static GOptionEntry entries[] = {
+    {"oldest", 'o', 0, G_OPTION_ARG_NONE, &from_oldest,
+     "Start at the oldest record still in the ring instead of the newest", NULL},
+    {"follow", 'f', 0, G_OPTION_ARG_NONE, &follow,
+     "Keep waiting for new records instead of exiting once caught up", NULL},
+    {"rate", 'r', 0, G_OPTION_ARG_NONE, &rate,
+     "Print records/sec and lost records once a second instead of the records",
+     NULL},
+    {NULL}};
+
+static void print_record(const ExportRecord *record) {
+    const ObjectRecord *obj = &record->object;
+
+    printf("%" G_GUINT64_FORMAT " src=%u frame=%d pts=%" G_GUINT64_FORMAT
+           " id=%" G_GUINT64_FORMAT " class=%d conf=%.2f bbox=%.0f,%.0f,%.0fx%.0f",
+           record->seq, record->source_id, record->frame_num, record->pts,
+           obj->object_id, obj->class_id, obj->confidence, obj->left, obj->top,
+           obj->width, obj->height);
+    for (guint i = 0; i < obj->num_labels && i < RECORD_MAX_LABELS; i++) {
+        printf(" sgie%u=%u", obj->labels[i].component_id, obj->labels[i].class_id);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    GOptionContext *context;
+    GError *error = NULL;
+    ExportReader *reader;
+    ExportRecord *batch;
+    gint64 last_report;
+    guint64 since_report = 0, lost_reported = 0;
+
+    context = g_option_context_new("RING - read an export ring file");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error) || argc != 2) {
+        g_printerr("%s\n", error ? error->message : "Expected one ring file");
+        return 2;
+    }
+    g_option_context_free(context);
+
+    reader = export_reader_open(argv[1], from_oldest, &error);
+    if (!reader) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 2;
+    }
+    if (rate) follow = TRUE;
+
+    batch = g_new(ExportRecord, READ_BATCH);
+    last_report = g_get_monotonic_time();
+    for (;;) {
+        guint n = export_reader_read(reader, batch, READ_BATCH);
+
+        if (rate) {
+            gint64 now = g_get_monotonic_time();
+            since_report += n;
+            if (now - last_report >= G_USEC_PER_SEC) {
+                guint64 lost = export_reader_lost(reader);
+                printf("%.0f records/s, %" G_GUINT64_FORMAT " lost\n",
+                       since_report * 1e6 / (now - last_report), lost - lost_reported);
+                fflush(stdout);
+                lost_reported = lost;
+                since_report = 0;
+                last_report = now;
+            }
+        } else {
+            for (guint i = 0; i < n; i++) print_record(&batch[i]);
+        }
+
+        if (n == 0) {
+            if (!follow) break;
+            g_usleep(POLL_US);
+        }
+    }
+
+    if (export_reader_lost(reader)) {
+        g_printerr("%" G_GUINT64_FORMAT " records were overwritten before being read\n",
+                   export_reader_lost(reader));
+    }
+    g_free(batch);
+    export_reader_close(reader);
+    return 0;
+}
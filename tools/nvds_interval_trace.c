@@ -0,0 +1,192 @@
+/* Replays a load trace through the adaptive pgie interval controller.
+ *
+ * Usage: nvds_interval_trace [OPTION...] TRACE
+ *
+ * TRACE is a CSV file written by the app with --interval-trace. Each period's
+ * sample is fed to an IntervalController built from the options, and every
+ * change of interval is printed, followed by how long each interval was in
+ * use. With --check the exit status is non-zero unless every decision matches
+ * the interval recorded in the trace, which makes the tool usable as a
+ * regression check after changing the controller.
+ *
+ * A recorded trace only shows the load under the intervals that were chosen
+ * at the time. With --capacity the output rate and backlog are instead
+ * simulated from the input rate, for a detector that infers that many frames
+ * per second, so different settings can be compared in closed loop. */
+
+#include <glib.h>
+#include <stdio.h>
+
+#include "core/interval_control.h"
+
+static gint min_interval = 0;
+static gint max_interval = 4;
+static gint max_backlog = INTERVAL_CONTROL_DEFAULT_MAX_BACKLOG;
+static gdouble min_throughput = INTERVAL_CONTROL_DEFAULT_MIN_THROUGHPUT;
+static gdouble quiet_objects = INTERVAL_CONTROL_DEFAULT_QUIET_OBJECTS;
+static gint hold_periods = INTERVAL_CONTROL_DEFAULT_HOLD_PERIODS;
+static gdouble capacity = 0;
+static gboolean check = FALSE;
+
+static GOptionEntry entries[] = {
+    {"min", 0, 0, G_OPTION_ARG_INT, &min_interval,
+     "Lowest interval, the pgie config's interval (default: 0)", "N"},
+    {"max", 0, 0, G_OPTION_ARG_INT, &max_interval,
+     "Highest interval, the stage's max-interval (default: 4)", "N"},
+    {"max-backlog", 0, 0, G_OPTION_ARG_INT, &max_backlog,
+     "Frames queued that count as overloaded (default: 16)", "N"},
+    {"min-throughput", 0, 0, G_OPTION_ARG_DOUBLE, &min_throughput,
+     "Share of the input rate the output must keep up with (default: 0.95)",
+     "RATIO"},
+    {"quiet-objects", 0, 0, G_OPTION_ARG_DOUBLE, &quiet_objects,
+     "Objects per frame at or under which a scene is quiet (default: 0.5)", "N"},
+    {"hold", 0, 0, G_OPTION_ARG_INT, &hold_periods,
+     "Periods a condition must last before the interval comes down, or goes up "
+     "for a quiet scene (default: 5)",
+     "N"},
+    {"capacity", 'c', 0, G_OPTION_ARG_DOUBLE, &capacity,
+     "Simulate the output for a detector inferring FPS frames per second", "FPS"},
+    {"check", 0, 0, G_OPTION_ARG_NONE, &check,
+     "Fail unless every decision matches the interval in the trace", NULL},
+    {NULL}};
+
+typedef struct {
+    gdouble seconds;
+    LoadSample sample;
+    /* -1 when the trace has no interval column */
+    gint interval;
+} TraceLine;
+
+static GArray *load_trace(const gchar *path, GError **error) {
+    GArray *lines;
+    gchar *contents;
+    gchar **rows;
+
+    if (!g_file_get_contents(path, &contents, NULL, error)) return NULL;
+    lines = g_array_new(FALSE, FALSE, sizeof(TraceLine));
+    rows = g_strsplit(contents, "\n", -1);
+    for (gchar **row = rows; *row; row++) {
+        TraceLine line = {.interval = -1};
+        gint fields;
+
+        if (**row == '\0' || **row == '#' || g_str_has_prefix(*row, "seconds"))
+            continue;
+        fields = sscanf(*row, "%lf,%lf,%lf,%u,%lf,%d", &line.seconds,
+                        &line.sample.input_fps, &line.sample.output_fps,
+                        &line.sample.backlog, &line.sample.objects_per_frame,
+                        &line.interval);
+        if (fields < 5) {
+            g_printerr("Skipping malformed line: %s\n", *row);
+            continue;
+        }
+        g_array_append_val(lines, line);
+    }
+    g_strfreev(rows);
+    g_free(contents);
+    return lines;
+}
+
+/* One period of a detector that infers capacity frames per second and
+ * skips interval frames after each, with a queue in front of it */
+static void simulate(LoadSample *sample, gdouble *queued, gdouble period,
+                     guint interval) {
+    gdouble max_out = capacity * (interval + 1) * period;
+    gdouble arrived = sample->input_fps * period;
+    gdouble out = MIN(*queued + arrived, max_out);
+
+    *queued += arrived - out;
+    sample->output_fps = out / period;
+    sample->backlog = (guint)*queued;
+}
+
+int main(int argc, char *argv[]) {
+    GOptionContext *context;
+    GError *error = NULL;
+    IntervalControlConfig config;
+    IntervalController *controller;
+    GArray *trace;
+    guint64 *periods_at;
+    guint changes = 0, mismatches = 0, overloaded = 0, max_seen_backlog = 0;
+    gdouble queued = 0, inferred = 0, frames = 0, previous_seconds = 0;
+
+    context = g_option_context_new("TRACE - replay a load trace");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error) || argc != 2) {
+        g_printerr("%s\n", error ? error->message : "Expected one trace file");
+        return 2;
+    }
+    g_option_context_free(context);
+
+    trace = load_trace(argv[1], &error);
+    if (!trace) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 2;
+    }
+
+    interval_control_config_init(&config, MAX(min_interval, 0), MAX(max_interval, 0));
+    config.max_backlog = MAX(max_backlog, 0);
+    config.min_throughput = min_throughput;
+    config.quiet_objects = quiet_objects;
+    config.hold_periods = MAX(hold_periods, 1);
+    controller = interval_controller_new(&config);
+    periods_at = g_new0(guint64, config.max_interval + 1);
+
+    for (guint i = 0; i < trace->len; i++) {
+        TraceLine *line = &g_array_index(trace, TraceLine, i);
+        LoadSample sample = line->sample;
+        guint before = interval_controller_interval(controller);
+        gdouble period = i ? line->seconds - previous_seconds : line->seconds;
+        guint after;
+
+        if (period <= 0) period = 1;
+        previous_seconds = line->seconds;
+        if (capacity > 0) simulate(&sample, &queued, period, before);
+
+        after = interval_controller_update(controller, &sample);
+        periods_at[before]++;
+        frames += sample.output_fps * period;
+        inferred += sample.output_fps * period / (before + 1);
+        if (interval_controller_overloaded(controller)) overloaded++;
+        max_seen_backlog = MAX(max_seen_backlog, sample.backlog);
+
+        if (after != before) {
+            changes++;
+            printf("%9.1f s  interval %u -> %u  (%.1f fps in, %.1f fps out, "
+                   "%u in flight, %.2f objects/frame)\n",
+                   line->seconds, before, after, sample.input_fps, sample.output_fps,
+                   sample.backlog, sample.objects_per_frame);
+        }
+        if (check && capacity <= 0 && line->interval >= 0 &&
+            (guint)line->interval != after) {
+            if (!mismatches) {
+                g_printerr("%.1f s: trace has interval %d, controller chose %u\n",
+                           line->seconds, line->interval, after);
+            }
+            mismatches++;
+        }
+    }
+
+    printf("periods:       %u, %u overloaded, %u interval changes\n", trace->len,
+           overloaded, changes);
+    for (guint i = 0; i <= config.max_interval; i++) {
+        if (!periods_at[i]) continue;
+        printf("interval %-4u %5.1f%% of periods\n", i,
+               100.0 * periods_at[i] / MAX(trace->len, 1));
+    }
+    if (frames > 0) {
+        printf("inferred:      %.1f%% of %.0f frames\n", 100.0 * inferred / frames,
+               frames);
+    }
+    printf("max backlog:   %u frames\n", max_seen_backlog);
+
+    if (mismatches) {
+        g_printerr("%u of %u decisions differ from the trace\n", mismatches,
+                   trace->len);
+    }
+
+    g_free(periods_at);
+    interval_controller_free(controller);
+    g_array_free(trace, TRUE);
+    return mismatches ? 1 : 0;
+}
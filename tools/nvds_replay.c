@@ -0,0 +1,199 @@
+/* Replays recorded or synthetic object metadata through the loitering
+ * analytics at full speed, without GStreamer or a GPU.
+ *
+ * Usage: nvds_replay [OPTION...] [RECORDING]
+ *
+ * RECORDING is a file written by the app with --record. Without it, frames
+ * come from the synthetic scene. With --expect-loitering the exit status is
+ * non-zero unless the last frame of every source adds up to that many
+ * loitering objects, which makes the tool usable as a regression check.
+ * Frame pts go through the same StreamClock as in the app, so a source whose
+ * pts start over, as with queued files, replays the way it runs live.
+ * --save writes the frames out as a recording, e.g. to make a fixture from
+ * the synthetic scene. */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_util.h"
+#include "core/loiter.h"
+#include "core/meta_record.h"
+#include "core/stream_clock.h"
+#include "core/synthetic.h"
+
+/* Same ids as the app's labels.h, which needs the DeepStream headers */
+#define PERSON_CLASS_ID 2
+#define VEHICLE_CLASS_ID 0
+
+static gint synthetic_objects = 64;
+static gint num_frames = 900;
+static gint num_sources = 4;
+static gint num_loops = 5;
+static gdouble speed_threshold = LOITER_DEFAULT_SPEED_THRESHOLD;
+static gint expect_loitering = -1;
+static gchar *save_file = NULL;
+
+static GOptionEntry entries[] = {
+    {"synthetic", 's', 0, G_OPTION_ARG_INT, &synthetic_objects,
+     "Objects per synthetic frame, when no recording is given (default: 64)", "N"},
+    {"frames", 'f', 0, G_OPTION_ARG_INT, &num_frames,
+     "Synthetic frames per source (default: 900)", "N"},
+    {"sources", 'n', 0, G_OPTION_ARG_INT, &num_sources,
+     "Synthetic sources (default: 4)", "N"},
+    {"loops", 'l', 0, G_OPTION_ARG_INT, &num_loops,
+     "Times to replay the frames, each with fresh analytics state (default: 5)",
+     "N"},
+    {"speed-threshold", 't', 0, G_OPTION_ARG_DOUBLE, &speed_threshold,
+     "Loitering speed threshold in px/s (default: 150)", "PX"},
+    {"expect-loitering", 'e', 0, G_OPTION_ARG_INT, &expect_loitering,
+     "Fail unless the final frames hold N loitering objects in total", "N"},
+    {"save", 0, 0, G_OPTION_ARG_FILENAME, &save_file,
+     "Write the frames to FILE as a recording", "FILE"},
+    {NULL}};
+
+/* Interleaves the sources frame by frame, the way nvstreammux batches them */
+static MetaRecording *synthetic_recording(void) {
+    SyntheticScene scene = {
+        .num_objects = synthetic_objects,
+        .width = 1920,
+        .height = 1080,
+        .person_class_id = PERSON_CLASS_ID,
+        .vehicle_class_id = VEHICLE_CLASS_ID,
+        .frame_duration = NSEC_PER_SEC / 30,
+    };
+    MetaRecording *recording = g_new0(MetaRecording, 1);
+    ObjectRecord *objects;
+    guint f = 0;
+
+    recording->num_frames = num_frames * num_sources;
+    recording->num_objects = (guint64)recording->num_frames * synthetic_objects;
+    recording->frames = g_new0(FrameRecord, recording->num_frames);
+    objects = g_new(ObjectRecord, recording->num_objects);
+    recording->data = (gchar *)objects;
+
+    for (gint frame_num = 0; frame_num < num_frames; frame_num++) {
+        for (gint source_id = 0; source_id < num_sources; source_id++, f++) {
+            recording->frames[f].objects = objects + (gsize)f * synthetic_objects;
+            synthetic_scene_frame(&scene, source_id, frame_num, &recording->frames[f]);
+        }
+    }
+
+    g_print("Synthetic: %d sources x %d frames x %d objects, %u loitering expected\n",
+            num_sources, num_frames, synthetic_objects,
+            num_sources * synthetic_scene_num_stationary_persons(&scene));
+    return recording;
+}
+
+int main(int argc, char *argv[]) {
+    GOptionContext *context;
+    GError *error = NULL;
+    MetaRecording *recording;
+    LoiterConfig config;
+    GHashTable *last_count;
+    gboolean *loitering;
+    guint max_objects = 0;
+    guint64 elapsed = 0;
+    guint total_loitering = 0;
+
+    context = g_option_context_new("[RECORDING] - replay object metadata");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    if (argc > 1) {
+        recording = meta_recording_load(argv[1], &error);
+        if (!recording) {
+            g_printerr("%s\n", error->message);
+            g_error_free(error);
+            return 2;
+        }
+        g_print("%s: %u frames, %" G_GUINT64_FORMAT " objects\n", argv[1],
+                recording->num_frames, recording->num_objects);
+    } else {
+        recording = synthetic_recording();
+    }
+    if (save_file) {
+        MetaRecorder *recorder = meta_recorder_open(save_file, &error);
+        gboolean ok = recorder != NULL;
+
+        for (guint f = 0; ok && f < recording->num_frames; f++) {
+            ok = meta_recorder_write(recorder, &recording->frames[f]);
+        }
+        if (recorder && !meta_recorder_close(recorder)) ok = FALSE;
+        if (!ok) {
+            if (error) {
+                g_printerr("%s\n", error->message);
+            } else {
+                g_printerr("Cannot write %s\n", save_file);
+            }
+            return 2;
+        }
+    }
+
+    for (guint f = 0; f < recording->num_frames; f++) {
+        max_objects = MAX(max_objects, recording->frames[f].num_objects);
+    }
+    loitering = g_new0(gboolean, MAX(max_objects, 1));
+    /* source_id -> loitering objects in its latest frame */
+    last_count = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    loiter_config_init(&config, PERSON_CLASS_ID);
+    config.speed_threshold = speed_threshold;
+
+    for (gint loop = 0; loop < num_loops; loop++) {
+        LoiterAnalytics *loiter = loiter_analytics_new(&config);
+        StreamClock *clock = stream_clock_new();
+        guint64 t0 = now_ns();
+
+        for (guint f = 0; f < recording->num_frames; f++) {
+            FrameRecord frame = recording->frames[f];
+            guint n;
+
+            frame.pts = stream_clock_map(clock, frame.source_id, frame.pts);
+            n = loiter_analytics_process(loiter, &frame, loitering);
+            if (loop == num_loops - 1) {
+                g_hash_table_insert(last_count, GUINT_TO_POINTER(frame.source_id),
+                                    GUINT_TO_POINTER(n));
+            }
+        }
+        elapsed += now_ns() - t0;
+        stream_clock_free(clock);
+        loiter_analytics_free(loiter);
+    }
+
+    {
+        GHashTableIter iter;
+        gpointer value;
+        gdouble objects = (gdouble)recording->num_objects * num_loops;
+        gdouble frames = (gdouble)recording->num_frames * num_loops;
+
+        g_hash_table_iter_init(&iter, last_count);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            total_loitering += GPOINTER_TO_UINT(value);
+        }
+
+        printf("frames:        %.0f\n", frames);
+        printf("objects:       %.0f\n", objects);
+        if (elapsed > 0 && objects > 0) {
+            printf("ns/object:     %.1f\n", (gdouble)elapsed / objects);
+            printf("objects/sec:   %.0f\n", objects * 1e9 / elapsed);
+            printf("frames/sec:    %.0f\n", frames * 1e9 / elapsed);
+        }
+        printf("loitering:     %u\n", total_loitering);
+    }
+
+    g_hash_table_destroy(last_count);
+    g_free(loitering);
+    meta_recording_free(recording);
+
+    if (expect_loitering >= 0 && total_loitering != (guint)expect_loitering) {
+        g_printerr("Expected %d loitering objects, got %u\n", expect_loitering,
+                   total_loitering);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+/* Finds the tracks in a trajectory archive written by the app with
+ * --trajectories, by source, time range and region.
+ *
+ * Usage: nvds_traj_query [OPTION...] DIR */
+
+#include <glib.h>
+#include <stdio.h>
+
+#include "core/trajectory_archive.h"
+
+static gint source_id = -1;
+static gboolean print_points = FALSE;
+static gboolean count_only = FALSE;
+static TrajectoryQuery query;
+
+/* ms since the epoch, or an ISO 8601 date and time */
+static gboolean parse_time(const gchar *value, gint64 *time_ms, GError **error) {
+    GDateTime *date;
+    gchar *end;
+
+    *time_ms = g_ascii_strtoll(value, &end, 10);
+    if (end != value && !*end) return TRUE;
+    date = g_date_time_new_from_iso8601(value, NULL);
+    if (!date) {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                    "Bad time %s, expected ms since the epoch or ISO 8601", value);
+        return FALSE;
+    }
+    *time_ms =
+        g_date_time_to_unix(date) * 1000 + g_date_time_get_microsecond(date) / 1000;
+    g_date_time_unref(date);
+    return TRUE;
+}
+
+static gboolean parse_from(const gchar *option_name, const gchar *value, gpointer data,
+                           GError **error) {
+    return parse_time(value, &query.start_ms, error);
+}
+
+static gboolean parse_to(const gchar *option_name, const gchar *value, gpointer data,
+                         GError **error) {
+    return parse_time(value, &query.end_ms, error);
+}
+
+static gboolean parse_region(const gchar *option_name, const gchar *value,
+                             gpointer data, GError **error) {
+    gchar **parts = g_strsplit(value, ",", -1);
+    gdouble v[4];
+    gboolean ok = g_strv_length(parts) == 4;
+
+    for (guint i = 0; ok && i < 4; i++) {
+        gchar *end;
+        v[i] = g_ascii_strtod(parts[i], &end);
+        ok = end != parts[i] && !*end;
+    }
+    g_strfreev(parts);
+    if (!ok) {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                    "Bad region %s, expected X0,Y0,X1,Y1", value);
+        return FALSE;
+    }
+    query.has_region = TRUE;
+    query.min_x = MIN(v[0], v[2]);
+    query.min_y = MIN(v[1], v[3]);
+    query.max_x = MAX(v[0], v[2]);
+    query.max_y = MAX(v[1], v[3]);
+    return TRUE;
+}
+
+static GOptionEntry entries[] = {
+    {"source", 's', 0, G_OPTION_ARG_INT, &source_id,
+     "Only tracks of this source (default: all)", "ID"},
+    {"from", 'f', 0, G_OPTION_ARG_CALLBACK, parse_from,
+     "Only tracks seen at or after TIME, ms since the epoch or ISO 8601", "TIME"},
+    {"to", 't', 0, G_OPTION_ARG_CALLBACK, parse_to,
+     "Only tracks seen at or before TIME", "TIME"},
+    {"region", 'r', 0, G_OPTION_ARG_CALLBACK, parse_region,
+     "Only tracks passing through this box, in muxer pixels, within the time range",
+     "X0,Y0,X1,Y1"},
+    {"points", 'p', 0, G_OPTION_ARG_NONE, &print_points,
+     "Print every point of the matching tracks", NULL},
+    {"count", 'c', 0, G_OPTION_ARG_NONE, &count_only,
+     "Only count the matching tracks", NULL},
+    {NULL}};
+
+static void print_match(const TrajectoryMatch *match, gpointer data) {
+    if (count_only) return;
+    printf("src=%u id=%" G_GUINT64_FORMAT " class=%d start=%" G_GINT64_FORMAT
+           " end=%" G_GINT64_FORMAT " points=%u\n",
+           match->source_id, match->object_id, match->class_id, match->start_ms,
+           match->end_ms, match->num_samples);
+    if (!print_points) return;
+    for (guint i = 0; i < match->num_samples; i++) {
+        printf("  %" G_GINT64_FORMAT " %.1f %.1f\n", match->samples[i].time_ms,
+               match->samples[i].x, match->samples[i].y);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    GOptionContext *context;
+    GError *error = NULL;
+    TrajectoryQueryStats stats;
+    gint64 start;
+
+    trajectory_query_init(&query);
+    context = g_option_context_new("DIR - query a trajectory archive");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error) || argc != 2) {
+        g_printerr("%s\n", error ? error->message : "Expected one archive directory");
+        return 2;
+    }
+    g_option_context_free(context);
+    query.source_id = source_id;
+
+    start = g_get_monotonic_time();
+    if (!trajectory_archive_query(argv[1], &query, print_match, NULL, &stats, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+    g_printerr("%" G_GUINT64_FORMAT " tracks match, %u of %u segments read, %"
+               G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " tracks decoded in %.2f ms\n",
+               stats.matches, stats.segments_read, stats.segments, stats.tracks_decoded,
+               stats.tracks_scanned, (g_get_monotonic_time() - start) / 1000.0);
+    return 0;
+}
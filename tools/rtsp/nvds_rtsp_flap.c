@@ -0,0 +1,169 @@
+/* Local RTSP camera that keeps failing, for testing source recovery.
+ *
+ * Usage: nvds_rtsp_flap [OPTION...]
+ *
+ * Serves a live H.264 test pattern at rtsp://127.0.0.1:PORT/test. After
+ * every --up seconds the camera goes away for --down seconds, either by
+ * closing every client connection and unmounting the stream, like a camera
+ * rebooting, or with --stall by keeping the connections open and sending
+ * nothing, like a camera that hangs. The start of each outage is printed, so
+ * the recovery times reported by the app can be checked against it. */
+
+#include <glib.h>
+#include <gst/gst.h>
+#include <gst/rtsp-server/rtsp-server.h>
+#include <stdio.h>
+
+static gint port = 8554;
+static gchar *mount = "/test";
+static gint up_sec = 10;
+static gint down_sec = 3;
+static gboolean stall = FALSE;
+static gint fps = 30;
+
+static GOptionEntry entries[] = {
+    {"port", 'p', 0, G_OPTION_ARG_INT, &port, "Port to listen on (default: 8554)",
+     "PORT"},
+    {"mount", 0, 0, G_OPTION_ARG_STRING, &mount,
+     "Path of the stream (default: /test)", "PATH"},
+    {"up", 'u', 0, G_OPTION_ARG_INT, &up_sec,
+     "Seconds the stream runs between outages (default: 10)", "SEC"},
+    {"down", 'd', 0, G_OPTION_ARG_INT, &down_sec,
+     "Seconds each outage lasts (default: 3)", "SEC"},
+    {"stall", 's', 0, G_OPTION_ARG_NONE, &stall,
+     "Stop sending data instead of dropping the connections", NULL},
+    {"fps", 0, 0, G_OPTION_ARG_INT, &fps, "Frame rate (default: 30)", "N"},
+    {NULL}};
+
+typedef struct {
+    GstRTSPServer *server;
+    GstRTSPMountPoints *mounts;
+    /* The shared media while a client is connected, for --stall */
+    GstRTSPMedia *media;
+    gboolean down;
+    guint outages;
+    gint64 start_us;
+} Flapper;
+
+static gdouble elapsed(const Flapper *flapper) {
+    return (g_get_monotonic_time() - flapper->start_us) / 1e6;
+}
+
+static void media_unprepared(GstRTSPMedia *media, gpointer data) {
+    Flapper *flapper = (Flapper *)data;
+    if (flapper->media == media) g_clear_object(&flapper->media);
+}
+
+static void media_configure(GstRTSPMediaFactory *factory, GstRTSPMedia *media,
+                            gpointer data) {
+    Flapper *flapper = (Flapper *)data;
+
+    g_clear_object(&flapper->media);
+    flapper->media = g_object_ref(media);
+    g_signal_connect(media, "unprepared", G_CALLBACK(media_unprepared), flapper);
+}
+
+static void mount_stream(Flapper *flapper) {
+    GstRTSPMediaFactory *factory = gst_rtsp_media_factory_new();
+    gchar *launch = g_strdup_printf(
+        "( videotestsrc is-live=true pattern=ball ! video/x-raw,width=1280,"
+        "height=720,framerate=%d/1 ! valve name=gate ! x264enc tune=zerolatency "
+        "speed-preset=ultrafast key-int-max=%d ! rtph264pay name=pay0 pt=96 "
+        "config-interval=1 )",
+        MAX(fps, 1), MAX(fps, 1));
+
+    gst_rtsp_media_factory_set_launch(factory, launch);
+    gst_rtsp_media_factory_set_shared(factory, TRUE);
+    g_signal_connect(factory, "media-configure", G_CALLBACK(media_configure), flapper);
+    gst_rtsp_mount_points_add_factory(flapper->mounts, mount, factory);
+    g_free(launch);
+}
+
+static GstRTSPFilterResult drop_client(GstRTSPServer *server, GstRTSPClient *client,
+                                       gpointer data) {
+    return GST_RTSP_FILTER_REMOVE;
+}
+
+static void set_gate(Flapper *flapper, gboolean drop) {
+    GstElement *bin, *gate;
+
+    if (!flapper->media) return;
+    bin = gst_rtsp_media_get_element(flapper->media);
+    gate = gst_bin_get_by_name(GST_BIN(bin), "gate");
+    if (gate) {
+        g_object_set(G_OBJECT(gate), "drop", drop, NULL);
+        gst_object_unref(gate);
+    }
+    gst_object_unref(bin);
+}
+
+static gboolean flap(gpointer data) {
+    Flapper *flapper = (Flapper *)data;
+
+    flapper->down = !flapper->down;
+    if (flapper->down) {
+        flapper->outages++;
+        printf("%9.3f s  outage %u starts (%s for %d s)\n", elapsed(flapper),
+               flapper->outages, stall ? "stalled" : "disconnected", down_sec);
+        if (stall) {
+            set_gate(flapper, TRUE);
+        } else {
+            gst_rtsp_mount_points_remove_factory(flapper->mounts, mount);
+            gst_rtsp_server_client_filter(flapper->server, drop_client, NULL);
+        }
+    } else {
+        printf("%9.3f s  outage %u ends\n", elapsed(flapper), flapper->outages);
+        if (stall) {
+            set_gate(flapper, FALSE);
+        } else {
+            mount_stream(flapper);
+        }
+    }
+    fflush(stdout);
+    g_timeout_add_seconds(MAX(flapper->down ? down_sec : up_sec, 1), flap, flapper);
+    return G_SOURCE_REMOVE;
+}
+
+int main(int argc, char *argv[]) {
+    GOptionContext *context;
+    GError *error = NULL;
+    GMainLoop *loop;
+    Flapper flapper = {0};
+    gchar *service;
+
+    context = g_option_context_new("- flapping RTSP test camera");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    gst_init(&argc, &argv);
+    loop = g_main_loop_new(NULL, FALSE);
+
+    flapper.server = gst_rtsp_server_new();
+    service = g_strdup_printf("%d", port);
+    g_object_set(G_OBJECT(flapper.server), "service", service, NULL);
+    g_free(service);
+    flapper.mounts = gst_rtsp_server_get_mount_points(flapper.server);
+    mount_stream(&flapper);
+    if (!gst_rtsp_server_attach(flapper.server, NULL)) {
+        g_printerr("Cannot listen on port %d\n", port);
+        return 1;
+    }
+
+    flapper.start_us = g_get_monotonic_time();
+    printf("Serving rtsp://127.0.0.1:%d%s, %d s up, %d s down\n", port, mount,
+           up_sec, down_sec);
+    fflush(stdout);
+    g_timeout_add_seconds(MAX(up_sec, 1), flap, &flapper);
+    g_main_loop_run(loop);
+
+    g_clear_object(&flapper.media);
+    g_object_unref(flapper.mounts);
+    g_object_unref(flapper.server);
+    g_main_loop_unref(loop);
+    return 0;
+}